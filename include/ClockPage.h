@@ -0,0 +1,75 @@
+/*
+Layout of the clock page mapped read-only into every task.
+Copyright 2020 Salvatore ISAJA. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED THE COPYRIGHT HOLDER ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef CLOCKPAGE_H_INCLUDED
+#define CLOCKPAGE_H_INCLUDED
+
+#include <stdint.h>
+
+/** Fixed user virtual address of the clock page, just below the kernel. */
+#define CLOCKPAGE_ADDRESS 0xBFFFF000
+
+/**
+ * Parameters to compute monotonic nanoseconds from the TSC in user mode,
+ * without a system call. The kernel updates them as a sequence lock:
+ * the sequence number is odd while an update is in progress.
+ */
+typedef struct ClockPage {
+    uint32_t sequence;
+    uint32_t nsPerTick; // <<20 on 32-bit
+    uint64_t tscBase; // TSC value at nsBase
+    uint64_t nsBase; // monotonic nanoseconds at tscBase
+    uint32_t tscUsable; // nonzero if the TSC can be read in user mode as a monotonic clock on any CPU
+} ClockPage;
+
+/** Returns the clock page mapped into the current task. */
+static inline const volatile ClockPage *ClockPage_get() {
+    return (const volatile ClockPage *) CLOCKPAGE_ADDRESS;
+}
+
+/**
+ * Reads the TSC and converts it to monotonic nanoseconds using the clock page,
+ * retrying if the kernel updated the page meanwhile.
+ * Valid only if the tscUsable field of the clock page is nonzero.
+ */
+static inline uint64_t ClockPage_readNanoseconds(const volatile ClockPage *page) {
+    uint32_t sequence;
+    uint64_t ns;
+    do {
+        sequence = page->sequence;
+        asm volatile("" : : : "memory");
+        uint32_t a, d;
+        asm volatile("rdtsc" : "=a" (a), "=d" (d));
+        uint64_t delta = ((uint64_t) a | ((uint64_t) d << 32)) - page->tscBase;
+        uint32_t nsPerTick = page->nsPerTick;
+        ns = page->nsBase
+                + (((uint64_t) (uint32_t) (delta >> 32) * nsPerTick) << 12)
+                + (((uint64_t) (uint32_t) delta * nsPerTick) >> 20);
+        asm volatile("" : : : "memory");
+    } while ((sequence & 1) != 0 || sequence != page->sequence);
+    return ns;
+}
+
+#endif
@@ -0,0 +1,42 @@
+/*
+Layout of the thread statistics returned by the kernel.
+Copyright 2020 Salvatore ISAJA. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED THE COPYRIGHT HOLDER ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef THREADSTATISTICS_H_INCLUDED
+#define THREADSTATISTICS_H_INCLUDED
+
+#include <stdint.h>
+
+/**
+ * CPU time and scheduling statistics of a thread, as written to a user buffer
+ * by the syscallGetThreadStatistics system call.
+ */
+typedef struct ThreadStatistics {
+    uint64_t userNanoseconds; // time spent running the thread in user mode
+    uint64_t kernelNanoseconds; // time spent in the kernel on behalf of the thread
+    uint32_t runCount; // number of times the thread has been switched to
+    uint32_t migrationCount; // number of times the thread has been switched to on a different CPU
+} ThreadStatistics;
+
+#endif
@@ -1,9 +1,11 @@
 #ifndef ERRNO_H_INCLUDED
 #define ERRNO_H_INCLUDED
 
+#define EPERM   1 // Operation not permitted
 #define	EAGAIN 11 // Operation would block, try again
 #define ENOMEM 12 // Not enough core
 #define EFAULT 14 // Bad address
+#define EEXIST 17 // Already exists
 #define EINVAL 22 // Invalid argument
 #define ENOSYS 38 // Invalid system call
 
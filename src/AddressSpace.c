@@ -32,28 +32,71 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  * 64-bit 3 levels (2 MiB page): 0xFF8000000000 shift 39, 0x7FC0000000 shift 30, 0x3FE00000 shift 21
  * 64-bit 2 levels (1 GiB page): 0xFF8000000000 shift 39, 0x7FC0000000 shift 30
  */
+#ifdef PAE
+#define ADDRESSSPACE_HEIGHT 2
+/** Number of page directories for user space, one for each GiB below HIGH_HALF_BEGIN. */
+#define USER_PAGE_DIRECTORY_COUNT 3
+#else
 #define ADDRESSSPACE_HEIGHT 1
-#define PAGE_TABLE_SHIFT 10
-#define PAGE_TABLE_LENGTH (1 << PAGE_TABLE_SHIFT)
+#endif
+
+/** ptNoExecute if supported and enabled on all CPUs, 0 otherwise. */
+PageTableEntry AddressSpace_noExecute;
+
+/**
+ * The TLB shootdown in progress, if any. Shootdowns of all address spaces are serialized,
+ * so that each target CPU finds what to invalidate here when it receives the IPI.
+ */
+static struct {
+    Spinlock lock;
+    AtomicWord pendingCount; // target CPUs that have not acknowledged yet
+    CpuMask targets; // each target CPU clears its own bit when it handles the IPI
+    size_t pageCount;
+    VirtualAddress pages[TASK_MAX_TLB_SHOOTDOWN_PAGES];
+} AddressSpace_shootdown;
 
 static PageTable *resolvePageTableEntry(PageTableEntry pte) {
-    return phys2virt(physicalAddress(pte & ~(PAGE_SIZE - 1)));
+    return frame2virt(AddressSpace_getEntryFrameNumber(pte));
 }
 
 /**
  * Creates an address space made only of the empty top page table.
+ * With PAE, page directory pointers are loaded only when CR3 is written,
+ * thus all page directories for user space are allocated beforehand,
+ * and the page directory for the higher half is shared with the kernel.
  * @param task Task to attach the new address space to.
  * @return 0 on success, or a negative error code.
  */
 int AddressSpace_initialize(Task *task) {
     FrameNumber rootFrame = PhysicalMemory_allocate(task, permamapMemoryRegion);
     if (rootFrame.v == 0) return -ENOMEM;
+#ifdef PAE
+    PageTable *pdpt = frame2virt(rootFrame);
+    memzero(pdpt, PAGE_SIZE);
+    for (size_t i = 0; i < USER_PAGE_DIRECTORY_COUNT; i++) {
+        FrameNumber pdFrame = PhysicalMemory_allocate(task, permamapMemoryRegion);
+        if (pdFrame.v == 0) {
+            while (i-- > 0)
+                PhysicalMemory_deallocate(AddressSpace_getEntryFrameNumber(pdpt->entries[i]));
+            PhysicalMemory_deallocate(rootFrame);
+            return -ENOMEM;
+        }
+        memzero(frame2virt(pdFrame), PAGE_SIZE);
+        pdpt->entries[i] = AddressSpace_makeEntry(pdFrame, ptPresent);
+    }
+    pdpt->entries[USER_PAGE_DIRECTORY_COUNT] = AddressSpace_makeEntry(virt2frame(&Boot_kernelPageDirectory), ptPresent);
+#else
     PageTable *pd = frame2virt(rootFrame);
     memzero(pd, PAGE_SIZE - 1024);
     memcpy(&pd->entries[768], &Boot_kernelPageDirectory.entries[768], 1024);
-    task->addressSpace.root = rootFrame.v << PAGE_SHIFT;
+#endif
+    task->addressSpace.root = frame2phys(rootFrame).v;
     task->addressSpace.tlbShootdownPageCount = 0;
     LinkedList_initialize(&task->addressSpace.shootdownFrameListHead);
+    task->addressSpace.batchDepth = 0;
+    memzero(&task->addressSpace.activeCpus, sizeof(CpuMask));
+    AtomicWord_init(&task->addressSpace.generation, 0);
+    Spinlock_init(&task->addressSpace.lock);
     return 0;
 }
 
@@ -72,12 +115,28 @@ static void AddressSpace_enqueueShootdownFrame(Task *task, VirtualAddress virtua
     LinkedList_insertBefore(&f->node, &task->addressSpace.shootdownFrameListHead);
 }
 
+/** Returns the page directory entry for the specified address. */
+static PageTableEntry *AddressSpace_getPageDirectoryEntry(Task *task, VirtualAddress virtualAddress) {
+    PageTable *pd = resolvePageTableEntry(task->addressSpace.root);
+#ifdef PAE
+    pd = resolvePageTableEntry(pd->entries[virtualAddress.v >> (LARGE_PAGE_SHIFT + PAGE_TABLE_SHIFT)]);
+#endif
+    return &pd->entries[virtualAddress.v >> LARGE_PAGE_SHIFT & (PAGE_TABLE_LENGTH - 1)];
+}
+
+/** Returns the page directory entry mapping the specified address with a large page, or 0 if not mapped with a large page. */
+static PageTableEntry AddressSpace_findLargePage(Task *task, VirtualAddress virtualAddress) {
+    PageTableEntry pde = *AddressSpace_getPageDirectoryEntry(task, virtualAddress);
+    return ((pde & (ptPresent | ptLargePage)) == (ptPresent | ptLargePage)) ? pde : 0;
+}
+
+/** Returns the page table mapping the specified address, or NULL if missing or if the address is in a large page. */
 static PageTable* AddressSpace_findLeaf(Task *task, VirtualAddress virtualAddress) {
     PageTable *table = resolvePageTableEntry(task->addressSpace.root);
     int height = ADDRESSSPACE_HEIGHT;
     while (height > 0) {
-        size_t subindex = virtualAddress.v >> ((height - 1) * PAGE_TABLE_SHIFT + PAGE_SHIFT) & (PAGE_TABLE_LENGTH - 1);
-        if ((table->entries[subindex] & ptPresent) == 0) return NULL;
+        size_t subindex = virtualAddress.v >> (height * PAGE_TABLE_SHIFT + PAGE_SHIFT) & (PAGE_TABLE_LENGTH - 1);
+        if ((table->entries[subindex] & ptPresent) == 0 || (table->entries[subindex] & ptLargePage)) return NULL;
         table = resolvePageTableEntry(table->entries[subindex]);
         height--;
     }
@@ -89,12 +148,13 @@ static PageTable *AddressSpace_findLeafAllocating(Task *task, VirtualAddress vir
     int height = ADDRESSSPACE_HEIGHT;
     while (height > 0) {
         size_t subindex = virtualAddress.v >> (height * PAGE_TABLE_SHIFT + PAGE_SHIFT) & (PAGE_TABLE_LENGTH - 1);
+        if (table->entries[subindex] & ptLargePage) return NULL;
         if ((table->entries[subindex] & ptPresent) == 0) {
             FrameNumber frameNumber = PhysicalMemory_allocate(task, permamapMemoryRegion);
             if (frameNumber.v == 0) return NULL;
             PageTable *subtable = frame2virt(frameNumber);
             memzero(subtable, sizeof(PageTable));
-            table->entries[subindex] = frameNumber.v << PAGE_SHIFT | ptPresent | ptWriteable | ptUser;
+            table->entries[subindex] = AddressSpace_makeEntry(frameNumber, ptPresent | ptWriteable | ptUser);
         }
         table = resolvePageTableEntry(table->entries[subindex]);
         height--;
@@ -102,45 +162,150 @@ static PageTable *AddressSpace_findLeafAllocating(Task *task, VirtualAddress vir
     return table;
 }
 
-static void AddressSpace_initiateTlbShootdown(Task *task) {
-    if (task->addressSpace.tlbShootdownPageCount < TASK_MAX_TLB_SHOOTDOWN_PAGES) {
-        for (size_t i = 0; i < task->addressSpace.tlbShootdownPageCount; i++) {
-            AddressSpace_invalidateTlbAddress(task->addressSpace.tlbShootdownPages[i]);
+/** Invalidates the TLB entries of the specified pages on the current CPU, or the whole TLB if too many. */
+static void AddressSpace_invalidatePages(const VirtualAddress *pages, size_t pageCount) {
+    if (pageCount < TASK_MAX_TLB_SHOOTDOWN_PAGES) {
+        for (size_t i = 0; i < pageCount; i++) {
+            AddressSpace_invalidateTlbAddress(pages[i]);
         }
     } else {
         AddressSpace_invalidateTlb();
     }
-    if (task->threadCount > 1) {
-        for (size_t j = 0; j < Cpu_cpuCount; j++) {
-            if (Cpu_cpus[j]->currentThread->task == task) {
-                Cpu_sendTlbShootdownIpi(Cpu_cpus[j]);
-            }
+}
+
+/**
+ * Handles a TLB shootdown IPI on the current CPU, invalidating the pages of the shootdown
+ * in progress and acknowledging it, unless this CPU has already handled it while waiting for its own turn.
+ */
+void AddressSpace_handleTlbShootdownIpi(Cpu *cpu) {
+    if (!CpuMask_testAndClear(&AddressSpace_shootdown.targets, cpu->index)) return;
+    AddressSpace_invalidatePages(AddressSpace_shootdown.pages, AddressSpace_shootdown.pageCount);
+    AtomicWord_decrement(&AddressSpace_shootdown.pendingCount);
+}
+
+/**
+ * Counts the CPUs other than the specified one that have the specified address space loaded,
+ * optionally copying them to the specified mask.
+ */
+static size_t AddressSpace_countOtherActiveCpus(AddressSpace *as, const Cpu *cpu, CpuMask *targets) {
+    size_t count = 0;
+    for (size_t i = 0; i < MAX_CPU_COUNT / 32; i++) {
+        Word w = AtomicWord_get(&as->activeCpus.words[i]);
+        if (cpu != NULL && i == cpu->index >> 5) w &= ~(1u << (cpu->index & 31));
+        if (targets != NULL) AtomicWord_set(&targets->words[i], w);
+        for (; w != 0; w &= w - 1) count++;
+    }
+    return count;
+}
+
+/**
+ * Invalidates the pages unmapped or remapped since the last shootdown on all CPUs that have the
+ * address space loaded. Each other CPU gets an IPI and the initiator waits for their acknowledgements,
+ * handling shootdowns targeting itself while waiting for its turn, as interrupts are disabled.
+ * The target mask is published only once the pages and the pending count are set, as a target
+ * waiting for its own turn may handle the shootdown before receiving the IPI.
+ * Only CPUs running threads of the task are interrupted. CPUs that switched away, possibly leaving
+ * the address space loaded for a kernel thread, see the new generation when switching back and flush
+ * the whole TLB then, as they either increment the mask before reading the generation or are in the mask.
+ */
+static void AddressSpace_initiateTlbShootdown(Task *task) {
+    AddressSpace *as = &task->addressSpace;
+    AddressSpace_invalidatePages(as->tlbShootdownPages, as->tlbShootdownPageCount);
+    Word generation = AtomicWord_addAndGet(&as->generation, 1); // before reading the mask, see Cpu_switchToThread
+    Cpu *cpu = Cpu_getCurrent();
+    if (cpu != NULL && cpu->addressSpace == as && cpu->addressSpaceGeneration == generation - 1) {
+        cpu->addressSpaceGeneration = generation; // the current CPU has just invalidated the pages itself
+    }
+    if (AddressSpace_countOtherActiveCpus(as, cpu, NULL) > 0) {
+        while (!Spinlock_tryLock(&AddressSpace_shootdown.lock)) {
+            AddressSpace_handleTlbShootdownIpi(cpu);
+            Cpu_relax();
+        }
+        CpuMask targets;
+        size_t targetCount = AddressSpace_countOtherActiveCpus(as, cpu, &targets);
+        if (targetCount > 0) {
+            AddressSpace_shootdown.pageCount = as->tlbShootdownPageCount;
+            for (size_t i = 0; i < as->tlbShootdownPageCount && i < TASK_MAX_TLB_SHOOTDOWN_PAGES; i++)
+                AddressSpace_shootdown.pages[i] = as->tlbShootdownPages[i];
+            AtomicWord_set(&AddressSpace_shootdown.pendingCount, targetCount);
+            writeBarrier(); // before publishing the targets
+            for (size_t i = 0; i < MAX_CPU_COUNT / 32; i++)
+                AtomicWord_set(&AddressSpace_shootdown.targets.words[i], AtomicWord_get(&targets.words[i]));
+            Cpu_sendTlbShootdownIpi(&targets);
+            while (AtomicWord_get(&AddressSpace_shootdown.pendingCount) != 0) Cpu_relax();
         }
+        Spinlock_unlock(&AddressSpace_shootdown.lock);
     }
+    as->tlbShootdownPageCount = 0;
 }
 
 /**
- * Map a frame number to a user virtual address.
- * @param task Task to map the page into.
- * @param virtualAddress Virtual address to map into.
- * @param frame Frame number to map.
- * @return 0 on success, or a negative error code.
+ * Defers TLB shootdowns of the specified address space, so that many map and unmap operations
+ * are flushed at once by the matching AddressSpace_endBatch. Batches can be nested.
+ * Unmapped frames must not be reused before the batch ends.
  */
-int AddressSpace_map(Task *task, VirtualAddress virtualAddress, FrameNumber fn) {
+void AddressSpace_beginBatch(Task *task) {
+    task->addressSpace.batchDepth++;
+}
+
+/** Ends a batch of map and unmap operations, initiating a single TLB shootdown for all of them if needed. */
+void AddressSpace_endBatch(Task *task) {
+    assert(task->addressSpace.batchDepth > 0);
+    if (--task->addressSpace.batchDepth == 0 && task->addressSpace.tlbShootdownPageCount > 0) {
+        AddressSpace_initiateTlbShootdown(task);
+    }
+}
+
+/** Maps a frame number to a user virtual address with the specified page table entry flags. */
+static int AddressSpace_doMap(Task *task, VirtualAddress virtualAddress, FrameNumber fn, PageTableEntry flags) {
     ADDRESSSPACE_LOG_PRINTF("Mapping virtual address %p to frame %p for task %p (address space root=%p).\n", virtualAddress, fn.v, task, task->addressSpace.root);
+    if (AddressSpace_findLargePage(task, virtualAddress) != 0) return -EEXIST;
     PageTable *pt = AddressSpace_findLeafAllocating(task, virtualAddress);
     if (pt == NULL) return -ENOMEM;
-    size_t index = virtualAddress.v >> PAGE_SHIFT & (PAGE_TABLE_LENGTH - 1);
+    size_t index = AddressSpace_getPageTableIndex(virtualAddress);
     if (pt->entries[index] & ptPresent) {
-        AddressSpace_enqueueShootdownFrame(task, virtualAddress, frameNumber(pt->entries[index] >> PAGE_SHIFT));
+        AddressSpace_enqueueShootdownFrame(task, virtualAddress, AddressSpace_getEntryFrameNumber(pt->entries[index]));
     }
-    pt->entries[index] = fn.v << PAGE_SHIFT | ptPresent | ptWriteable | ptUser;
-    if (task->addressSpace.tlbShootdownPageCount > 0) {
+    pt->entries[index] = AddressSpace_makeEntry(fn, flags);
+    if (task->addressSpace.tlbShootdownPageCount > 0 && task->addressSpace.batchDepth == 0) {
         AddressSpace_initiateTlbShootdown(task);
     }
     return 0;
 }
 
+/**
+ * Map a frame number to a user virtual address.
+ * @param task Task to map the page into.
+ * @param virtualAddress Virtual address to map into.
+ * @param frame Frame number to map.
+ * @return 0 on success, or a negative error code.
+ */
+int AddressSpace_map(Task *task, VirtualAddress virtualAddress, FrameNumber fn) {
+    return AddressSpace_doMap(task, virtualAddress, fn, ptPresent | ptWriteable | ptUser);
+}
+
+/**
+ * Map a frame number to a user virtual address, preventing writes from user mode.
+ * @param task Task to map the page into.
+ * @param virtualAddress Virtual address to map into.
+ * @param frame Frame number to map.
+ * @return 0 on success, or a negative error code.
+ */
+int AddressSpace_mapReadOnly(Task *task, VirtualAddress virtualAddress, FrameNumber fn) {
+    return AddressSpace_doMap(task, virtualAddress, fn, ptPresent | ptUser);
+}
+
+/**
+ * Map a frame number to a user virtual address, preventing instruction fetches if supported.
+ * @param task Task to map the page into.
+ * @param virtualAddress Virtual address to map into.
+ * @param frame Frame number to map.
+ * @return 0 on success, or a negative error code.
+ */
+int AddressSpace_mapNoExecute(Task *task, VirtualAddress virtualAddress, FrameNumber fn) {
+    return AddressSpace_doMap(task, virtualAddress, fn, ptPresent | ptWriteable | ptUser | AddressSpace_noExecute);
+}
+
 /**
  * Map pages from pages of a possibly different address space.
  * @param destTask Task to map pages into.
@@ -153,15 +318,15 @@ int AddressSpace_map(Task *task, VirtualAddress virtualAddress, FrameNumber fn)
 int AddressSpace_mapCopy(Task *destTask, VirtualAddress destVirt, Task *srcTask, VirtualAddress srcVirt) {
     PageTable *srcPt = AddressSpace_findLeaf(srcTask, srcVirt);
     if (srcPt == NULL) return -EFAULT;
-    size_t srcIndex = srcVirt.v >> PAGE_SHIFT & (PAGE_TABLE_LENGTH - 1);
+    size_t srcIndex = AddressSpace_getPageTableIndex(srcVirt);
     PageTable *destPt = AddressSpace_findLeafAllocating(destTask, destVirt);
     if (destPt == NULL) return -ENOMEM;
-    size_t destIndex = destVirt.v >> PAGE_SHIFT & (PAGE_TABLE_LENGTH - 1);
+    size_t destIndex = AddressSpace_getPageTableIndex(destVirt);
     if (destPt->entries[destIndex] & ptPresent) {
-        AddressSpace_enqueueShootdownFrame(destTask, destVirt, frameNumber(destPt->entries[destIndex] >> PAGE_SHIFT));
+        AddressSpace_enqueueShootdownFrame(destTask, destVirt, AddressSpace_getEntryFrameNumber(destPt->entries[destIndex]));
     }
     destPt->entries[destIndex] = srcPt->entries[srcIndex];
-    if (destTask->addressSpace.tlbShootdownPageCount > 0) {
+    if (destTask->addressSpace.tlbShootdownPageCount > 0 && destTask->addressSpace.batchDepth == 0) {
         AddressSpace_initiateTlbShootdown(destTask);
     }
     return 0;
@@ -170,20 +335,204 @@ int AddressSpace_mapCopy(Task *destTask, VirtualAddress destVirt, Task *srcTask,
 // TODO: Map pages from frame capabilities
 
 /**
- * Map a page from a newly allocated frame.
+ * Map a page from a newly allocated frame filled with zeros, not executable.
  * @param task Task to map the page into.
  * @param virtualAddress Virtual address to mapping into.
  * @return 0 on success, or a negative error code.
  */
 int AddressSpace_mapFromNewFrame(Task *task, VirtualAddress virtualAddress, PhysicalMemoryRegionType preferredRegion) {
-    FrameNumber frameNumber = PhysicalMemory_allocate(task, preferredRegion);
+    FrameNumber frameNumber = PhysicalMemory_allocateZeroed(task, preferredRegion);
     if (frameNumber.v == 0) return -ENOMEM;
-//    memzero(frame2virt(frame), PAGE_SIZE);
-    int res = AddressSpace_map(task, virtualAddress, frameNumber);
+    int res = AddressSpace_mapNoExecute(task, virtualAddress, frameNumber);
     if (res < 0) PhysicalMemory_deallocate(frameNumber);
     return res;
 }
 
+/**
+ * Maps a range of user pages walking the page tables once for each leaf page table,
+ * allocating missing ones as the walk reaches them, and initiating at most one TLB shootdown
+ * at the end. On failure, the pages mapped so far are left mapped.
+ * @param firstFrameNumber Frame number to map the first page to, subsequent pages are mapped
+ *        to subsequent frames. If zero, each page is mapped to a newly allocated zeroed frame.
+ * @param preferredRegion The highest region to allocate new frames from, if firstFrameNumber is zero.
+ */
+static int AddressSpace_doMapRange(Task *task, VirtualAddress virtualAddress, size_t pageCount,
+        FrameNumber firstFrameNumber, PageTableEntry flags, PhysicalMemoryRegionType preferredRegion) {
+    if (virtualAddress.v >= HIGH_HALF_BEGIN || pageCount > (HIGH_HALF_BEGIN - virtualAddress.v) >> PAGE_SHIFT) return -EINVAL;
+    int res = 0;
+    AddressSpace_beginBatch(task);
+    uintptr_t va = virtualAddress.v;
+    size_t i = 0;
+    while (res == 0 && i < pageCount) {
+        if (AddressSpace_findLargePage(task, makeVirtualAddress(va)) != 0) {
+            res = -EEXIST;
+            break;
+        }
+        PageTable *pt = AddressSpace_findLeafAllocating(task, makeVirtualAddress(va));
+        if (pt == NULL) {
+            res = -ENOMEM;
+            break;
+        }
+        for (size_t index = AddressSpace_getPageTableIndex(makeVirtualAddress(va)); index < PAGE_TABLE_LENGTH && i < pageCount; index++) {
+            FrameNumber fn = addToFrameNumber(firstFrameNumber, i);
+            if (firstFrameNumber.v == 0) {
+                fn = PhysicalMemory_allocateZeroed(task, preferredRegion);
+                if (fn.v == 0) {
+                    res = -ENOMEM;
+                    break;
+                }
+            }
+            if (pt->entries[index] & ptPresent) {
+                AddressSpace_enqueueShootdownFrame(task, makeVirtualAddress(va), AddressSpace_getEntryFrameNumber(pt->entries[index]));
+            }
+            pt->entries[index] = AddressSpace_makeEntry(fn, flags);
+            va += PAGE_SIZE;
+            i++;
+        }
+    }
+    AddressSpace_endBatch(task);
+    return res;
+}
+
+/**
+ * Maps contiguous frames to a range of user virtual addresses, much cheaper than mapping each page
+ * on its own, as page tables are walked once for each leaf page table and the TLB flushed once.
+ * @param task Task to map the pages into.
+ * @param virtualAddress Virtual address of the first page to map.
+ * @param firstFrameNumber Frame number of the first of pageCount contiguous frames to map.
+ * @param pageCount Number of pages to map.
+ * @param flags Page table entry flags besides ptPresent and ptUser, such as ptWriteable and AddressSpace_noExecute.
+ * @return 0 on success, -EINVAL if the range is not in user space, -EEXIST if it overlaps a large page,
+ *         or -ENOMEM if page tables cannot be allocated, leaving the pages mapped so far mapped.
+ */
+int AddressSpace_mapRange(Task *task, VirtualAddress virtualAddress, FrameNumber firstFrameNumber, size_t pageCount, PageTableEntry flags) {
+    assert(firstFrameNumber.v != 0);
+    return AddressSpace_doMapRange(task, virtualAddress, pageCount, firstFrameNumber, ptPresent | ptUser | flags, permamapMemoryRegion);
+}
+
+/**
+ * Maps a range of pages from newly allocated frames filled with zeros, not executable,
+ * like AddressSpace_mapFromNewFrame for each page but with a single page table walk
+ * for each leaf page table and a single TLB flush.
+ * @param task Task to map the pages into.
+ * @param virtualAddress Virtual address of the first page to map.
+ * @param pageCount Number of pages to map.
+ * @param preferredRegion The highest region to allocate from.
+ * @return 0 on success, or a negative error code as AddressSpace_mapRange.
+ */
+int AddressSpace_mapRangeFromNewFrames(Task *task, VirtualAddress virtualAddress, size_t pageCount, PhysicalMemoryRegionType preferredRegion) {
+    return AddressSpace_doMapRange(task, virtualAddress, pageCount, frameNumber(0),
+            ptPresent | ptWriteable | ptUser | AddressSpace_noExecute, preferredRegion);
+}
+
+/**
+ * Reserves a range of user pages to be mapped to newly allocated zeroed frames, not executable,
+ * only when first accessed, see AddressSpace_handlePageFault. Leaf page tables are allocated
+ * upfront, pages already mapped are left untouched.
+ * @param task Task to reserve the pages into.
+ * @param virtualAddress Virtual address of the first page to reserve.
+ * @param pageCount Number of pages to reserve.
+ * @return 0 on success, -EINVAL if the range is not in user space, -EEXIST if it overlaps a large page,
+ *         or -ENOMEM if page tables cannot be allocated, leaving the pages reserved so far reserved.
+ */
+int AddressSpace_reserveRange(Task *task, VirtualAddress virtualAddress, size_t pageCount) {
+    if (virtualAddress.v >= HIGH_HALF_BEGIN || pageCount > (HIGH_HALF_BEGIN - virtualAddress.v) >> PAGE_SHIFT) return -EINVAL;
+    uintptr_t va = virtualAddress.v;
+    while (pageCount > 0) {
+        if (AddressSpace_findLargePage(task, makeVirtualAddress(va)) != 0) return -EEXIST;
+        PageTable *pt = AddressSpace_findLeafAllocating(task, makeVirtualAddress(va));
+        if (pt == NULL) return -ENOMEM;
+        size_t index = AddressSpace_getPageTableIndex(makeVirtualAddress(va));
+        size_t count = PAGE_TABLE_LENGTH - index;
+        if (count > pageCount) count = pageCount;
+        for (size_t i = index; i < index + count; i++) {
+            if ((pt->entries[i] & ptPresent) == 0) pt->entries[i] = ptDemandZero;
+        }
+        va += count * PAGE_SIZE;
+        pageCount -= count;
+    }
+    return 0;
+}
+
+/**
+ * Maps a new zeroed frame to the page of the specified page table entry, if reserved.
+ * The frame is allocated and zeroed without holding the lock of the address space,
+ * then discarded if another CPU mapped the page meanwhile.
+ * @return 0 if the page is mapped, -EFAULT if not reserved, or -ENOMEM.
+ */
+static int AddressSpace_mapReserved(Task *task, PageTableEntry *pte) {
+    if (*pte != ptDemandZero) return (*pte & ptPresent) ? 0 : -EFAULT;
+    FrameNumber fn = PhysicalMemory_allocateZeroed(task, highMemoryRegion);
+    if (fn.v == 0) return -ENOMEM;
+    int res = 0;
+    Spinlock_lock(&task->addressSpace.lock);
+    if (*pte == ptDemandZero) {
+        *pte = AddressSpace_makeEntry(fn, ptPresent | ptWriteable | ptUser | AddressSpace_noExecute);
+        fn = frameNumber(0);
+    } else if ((*pte & ptPresent) == 0) {
+        res = -EFAULT;
+    }
+    Spinlock_unlock(&task->addressSpace.lock);
+    if (fn.v != 0) PhysicalMemory_deallocate(fn);
+    return res;
+}
+
+/**
+ * Handles a page fault on a user address, mapping a new zeroed frame if the page was reserved
+ * with AddressSpace_reserveRange. No TLB invalidation is needed, as non-present entries are not cached.
+ * @param task Task whose address space is loaded.
+ * @param virtualAddress Faulting address, as read from CR2.
+ * @param errorCode Error code pushed by the processor, see PageFaultErrorFlags.
+ * @return 0 if the faulting instruction can be restarted, -EFAULT if the page was not reserved,
+ *         or -ENOMEM if a frame cannot be allocated.
+ */
+int AddressSpace_handlePageFault(Task *task, VirtualAddress virtualAddress, uint32_t errorCode) {
+    if ((errorCode & pfProtectionViolation) || virtualAddress.v >= HIGH_HALF_BEGIN) return -EFAULT;
+    PageTable *pt = AddressSpace_findLeaf(task, virtualAddress);
+    if (pt == NULL) return -EFAULT;
+    return AddressSpace_mapReserved(task, &pt->entries[AddressSpace_getPageTableIndex(virtualAddress)]);
+}
+
+/**
+ * Maps contiguous frames to a user virtual address with a single large page, not executable,
+ * saving a page table and reducing TLB misses for large working sets.
+ * @param task Task to map the large page into.
+ * @param virtualAddress Virtual address to map into, aligned to LARGE_PAGE_SIZE.
+ * @param firstFrameNumber Frame number of the first of LARGE_PAGE_FRAMES contiguous frames, aligned to LARGE_PAGE_FRAMES.
+ * @return 0 on success, -EINVAL if not properly aligned or not in user space,
+ *         or -EEXIST if anything is already mapped in the range.
+ */
+int AddressSpace_mapLarge(Task *task, VirtualAddress virtualAddress, FrameNumber firstFrameNumber) {
+    if ((virtualAddress.v & (LARGE_PAGE_SIZE - 1)) != 0 || (firstFrameNumber.v & (LARGE_PAGE_FRAMES - 1)) != 0) return -EINVAL;
+    if (virtualAddress.v >= HIGH_HALF_BEGIN) return -EINVAL;
+    PageTableEntry *pde = AddressSpace_getPageDirectoryEntry(task, virtualAddress);
+    if (*pde & ptPresent) return -EEXIST;
+    *pde = AddressSpace_makeEntry(firstFrameNumber, ptLargePage | ptPresent | ptWriteable | ptUser | AddressSpace_noExecute);
+    return 0;
+}
+
+/**
+ * Maps a large page from newly allocated contiguous frames filled with zeros.
+ * Like PhysicalMemory_allocateZeroed, frames are taken from permanently mapped memory
+ * at most until temporary mappings are available.
+ * @param task Task to map the large page into.
+ * @param virtualAddress Virtual address to map into, aligned to LARGE_PAGE_SIZE.
+ * @param preferredRegion The highest region to allocate from.
+ * @return 0 on success, -ENOMEM if not enough contiguous memory, or an error from AddressSpace_mapLarge.
+ */
+int AddressSpace_mapLargeFromNewFrames(Task *task, VirtualAddress virtualAddress, PhysicalMemoryRegionType preferredRegion) {
+    if (!PhysicalMemory_frameCachesEnabled && preferredRegion > permamapMemoryRegion) preferredRegion = permamapMemoryRegion;
+    FrameNumber frameNumber = PhysicalMemory_allocateContiguous(task, preferredRegion, LARGE_PAGE_FRAMES, LARGE_PAGE_FRAMES);
+    if (frameNumber.v == 0) return -ENOMEM;
+    int res = AddressSpace_mapLarge(task, virtualAddress, frameNumber);
+    if (res < 0) {
+        PhysicalMemory_deallocateContiguous(frameNumber, LARGE_PAGE_FRAMES);
+        return res;
+    }
+    PhysicalMemory_zeroFrames(frameNumber, LARGE_PAGE_FRAMES);
+    return 0;
+}
+
 //Allocate frames and return frame capabilities
 
 
@@ -195,18 +544,78 @@ int AddressSpace_mapFromNewFrame(Task *task, VirtualAddress virtualAddress, Phys
  */
 void AddressSpace_unmap(Task *task, VirtualAddress virtualAddress, uintptr_t payload) {
     assert((payload & ptPresent) == 0);
-    size_t index = virtualAddress.v >> PAGE_SHIFT & (PAGE_TABLE_LENGTH - 1);
+    size_t index = AddressSpace_getPageTableIndex(virtualAddress);
     PageTable *pt = AddressSpace_findLeaf(task, virtualAddress);
     if (pt == NULL) return;
     if (pt->entries[index] & ptPresent) {
-        AddressSpace_enqueueShootdownFrame(task, virtualAddress, frameNumber(pt->entries[index] >> PAGE_SHIFT));
+        AddressSpace_enqueueShootdownFrame(task, virtualAddress, AddressSpace_getEntryFrameNumber(pt->entries[index]));
     }
     pt->entries[index] = payload;
-    if (task->addressSpace.tlbShootdownPageCount > 0) {
+    if (task->addressSpace.tlbShootdownPageCount > 0 && task->addressSpace.batchDepth == 0) {
         AddressSpace_initiateTlbShootdown(task);
     }
 }
 
+/**
+ * Unmaps a range of pages, walking the page tables once for each leaf page table and initiating
+ * at most one TLB shootdown at the end. Parts of the range not mapped or mapped with large pages are skipped.
+ * @param task Task to unmap the pages from.
+ * @param virtualAddress Virtual address of the first page to unmap.
+ * @param pageCount Number of pages to unmap.
+ * @param payload Word to insert into each non-present page. Bit 0 must be clear.
+ */
+void AddressSpace_unmapRange(Task *task, VirtualAddress virtualAddress, size_t pageCount, uintptr_t payload) {
+    assert((payload & ptPresent) == 0);
+    AddressSpace_beginBatch(task);
+    uintptr_t va = virtualAddress.v;
+    while (pageCount > 0) {
+        size_t index = AddressSpace_getPageTableIndex(makeVirtualAddress(va));
+        size_t count = PAGE_TABLE_LENGTH - index;
+        if (count > pageCount) count = pageCount;
+        PageTable *pt = AddressSpace_findLeaf(task, makeVirtualAddress(va));
+        for (size_t i = 0; pt != NULL && i < count; i++) {
+            if (pt->entries[index + i] & ptPresent) {
+                AddressSpace_enqueueShootdownFrame(task, makeVirtualAddress(va + i * PAGE_SIZE), AddressSpace_getEntryFrameNumber(pt->entries[index + i]));
+            }
+            pt->entries[index + i] = payload;
+        }
+        va += count * PAGE_SIZE;
+        pageCount -= count;
+    }
+    AddressSpace_endBatch(task);
+}
+
+/**
+ * Checks that a range of user virtual addresses is entirely mapped with user access,
+ * before the kernel accesses it on behalf of the task. Reserved pages are mapped.
+ * @param task Task owning the address space.
+ * @param virtualAddress Virtual address of the first byte of the range.
+ * @param size Size of the range in bytes.
+ * @param writeable Whether the range must be writeable from user mode too.
+ * @return 0 on success, or -EFAULT if any byte of the range is not accessible.
+ */
+int AddressSpace_checkUserRange(Task *task, VirtualAddress virtualAddress, size_t size, bool writeable) {
+    if (size == 0) return 0;
+    uintptr_t last = virtualAddress.v + size - 1;
+    if (last < virtualAddress.v || last >= HIGH_HALF_BEGIN) return -EFAULT;
+    PageTableEntry required = ptPresent | ptUser | (writeable ? ptWriteable : 0);
+    uintptr_t page = virtualAddress.v & ~(PAGE_SIZE - 1);
+    while (page <= last) {
+        PageTableEntry largePage = AddressSpace_findLargePage(task, makeVirtualAddress(page));
+        if (largePage != 0) {
+            if ((largePage & required) != required) return -EFAULT;
+            page = (page & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE;
+            continue;
+        }
+        PageTable *pt = AddressSpace_findLeaf(task, makeVirtualAddress(page));
+        if (pt == NULL) return -EFAULT;
+        PageTableEntry *pte = &pt->entries[AddressSpace_getPageTableIndex(makeVirtualAddress(page))];
+        if (AddressSpace_mapReserved(task, pte) < 0 || (*pte & required) != required) return -EFAULT;
+        page += PAGE_SIZE;
+    }
+    return 0;
+}
+
 //TODO: Deallocate frame capabilities
 //TODO: Unmap pages and deallocate frame capabilities
 //TODO: Copy memory block possibly across address spaces
@@ -24,19 +24,53 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 /*
  * On 32-bit higher half mode, the virtual address space is mapped as following in the kernel:
  * [0xC0000000, 0xF8000000) maps all physical memory from [0x00000000, 0x3800000) 896 MiB
- * [0xF8000000, 0xF8800000) temporary mapping area #1, 8 MiB
- * [0xF8800000, 0xF9000000) temporary mapping area #2, 8 MiB
- * ...
- * [0xFE000000, 0xFE800000) temporary mapping area #13, 8 MiB
+ * [0xF8000000, 0xF8800000) boot temporary mapping area #0, 8 MiB
+ * [0xF8800000, 0xF9000000) boot temporary mapping area #1, 8 MiB
+ * [0xF9000000, 0xFD000000) per-CPU temporary mapping slots, 64 MiB
  * [0xFEC00000, 0xFEC01000) I/O APIC
+ * [0xFED00000, 0xFED01000) HPET
  * [0xFEE00000, 0xFEE01000) Local APIC
+ *
+ * With PAE, the higher half is a single page directory shared by all address spaces.
  */
 
+#ifdef PAE
+/** log2 of the number of entries of a page table (any level). */
+#define PAGE_TABLE_SHIFT 9
+/** log2 of the size in bytes of a large page, mapped by a single page directory entry. */
+#define LARGE_PAGE_SHIFT 21
+/** Page table entry flag preventing instruction fetches, usable only if AddressSpace_noExecute is set. */
+#define ptNoExecute ((PageTableEntry) 1 << 63)
+#else
+/** log2 of the number of entries of a page table (any level). */
+#define PAGE_TABLE_SHIFT 10
+/** log2 of the size in bytes of a large page, mapped by a single page directory entry. */
+#define LARGE_PAGE_SHIFT 22
+#endif
+/**
+ * Payload of a non-present page table entry for a page reserved with AddressSpace_reserveRange,
+ * to be mapped to a new zeroed frame on first access. Uses bits ignored by the processor.
+ */
+#define ptDemandZero ((PageTableEntry) 1 << 9)
+/** Number of entries of a page table (any level). */
+#define PAGE_TABLE_LENGTH (1 << PAGE_TABLE_SHIFT)
+/** Size in bytes of a large page, mapped by a single page directory entry. */
+#define LARGE_PAGE_SIZE (1UL << LARGE_PAGE_SHIFT)
+/** Number of contiguous frames backing a large page. */
+#define LARGE_PAGE_FRAMES (LARGE_PAGE_SIZE / PAGE_SIZE)
+/** Size in bytes of each boot temporary mapping area. */
+#define TEMPORARY_MAPPING_AREA_SIZE 0x800000u
+/** Virtual address of the per-CPU temporary mapping slots. */
+#define TEMPORARY_MAPPING_SLOTS_BEGIN 0xF9000000u
+/** Size in bytes of the virtual memory for per-CPU temporary mapping slots, split among all CPUs. */
+#define TEMPORARY_MAPPING_SLOTS_SIZE (64UL << 20)
+
 typedef struct PageTable {
     PageTableEntry entries[PAGE_SIZE / sizeof(PageTableEntry)];
 } PageTable;
 
 extern PageTable Boot_kernelPageDirectory;
+extern PageTableEntry AddressSpace_noExecute;
 
 /** Flags of a page table entry (any level). */
 enum PageTableFlags {
@@ -53,14 +87,82 @@ enum PageTableFlags {
     ptIgnored = 7 << 9
 };
 
+/** Flags of the error code pushed by the processor on page faults. */
+enum PageFaultErrorFlags {
+    pfProtectionViolation = 1 << 0, // the page was present, otherwise the page was not present
+    pfWrite = 1 << 1,
+    pfUser = 1 << 2
+};
+
 static inline VirtualAddress AddressSpace_getTemporaryMappingArea(int index) {
-    return makeVirtualAddress(0xF8000000 + 0x800000 * index);
+    return makeVirtualAddress(0xF8000000 + TEMPORARY_MAPPING_AREA_SIZE * index);
+}
+
+/** Returns a page table entry mapping the specified frame with the specified flags. */
+static inline PageTableEntry AddressSpace_makeEntry(FrameNumber frameNumber, PageTableEntry flags) {
+    return (PageTableEntry) frameNumber.v << PAGE_SHIFT | flags;
+}
+
+/** Returns the frame number a page table entry points to. With PAE, the cast discards ptNoExecute. */
+static inline FrameNumber AddressSpace_getEntryFrameNumber(PageTableEntry pte) {
+    return frameNumber((uintptr_t) (pte >> PAGE_SHIFT));
+}
+
+/** Returns the index of the entry mapping the specified address within its last level page table. */
+static inline size_t AddressSpace_getPageTableIndex(VirtualAddress virtualAddress) {
+    return virtualAddress.v >> PAGE_SHIFT & (PAGE_TABLE_LENGTH - 1);
+}
+
+/** Returns the entry of the kernel page directory mapping the specified higher half address. */
+static inline PageTableEntry *AddressSpace_getKernelPageDirectoryEntry(VirtualAddress virtualAddress) {
+#ifdef PAE
+    return &Boot_kernelPageDirectory.entries[(virtualAddress.v - HIGH_HALF_BEGIN) >> LARGE_PAGE_SHIFT];
+#else
+    return &Boot_kernelPageDirectory.entries[virtualAddress.v >> LARGE_PAGE_SHIFT];
+#endif
+}
+
+/**
+ * Returns a kernel pointer to the specified frame. Frames not permanently mapped
+ * are mapped to the next temporary mapping slot of the specified CPU, unless already
+ * mapped by the last used slot. When all slots are used, they are cleared and the TLB
+ * is invalidated, thus the pointer is valid only until the CPU maps as many frames as
+ * its slots, and must not be used after enabling interrupts.
+ */
+static inline void *AddressSpace_mapTemporary(Cpu *cpu, FrameNumber frameNumber) {
+    if (PhysicalMemory_isPermamapped(frameNumber)) return frame2virt(frameNumber);
+    TemporaryMappings *tm = &cpu->temporaryMappings;
+    assert(tm->count > 0);
+    PageTableEntry pte = AddressSpace_makeEntry(frameNumber, ptPresent | ptWriteable);
+    if (tm->next > 0 && tm->slots[tm->next - 1] == pte)
+        return (void *) (tm->begin + (tm->next - 1) * PAGE_SIZE);
+    if (tm->next == tm->count) {
+        memzero(tm->slots, tm->count * sizeof(PageTableEntry));
+        AddressSpace_invalidateTlb();
+        tm->next = 0;
+    }
+    size_t slot = tm->next++;
+    tm->slots[slot] = pte;
+    return (void *) (tm->begin + slot * PAGE_SIZE);
 }
 
 int  AddressSpace_initialize(Task *task);
 int  AddressSpace_map(Task *task, VirtualAddress virtualAddress, FrameNumber frameNumber);
+int  AddressSpace_mapReadOnly(Task *task, VirtualAddress virtualAddress, FrameNumber frameNumber);
+int  AddressSpace_mapNoExecute(Task *task, VirtualAddress virtualAddress, FrameNumber frameNumber);
 int  AddressSpace_mapCopy(Task *destTask, VirtualAddress destVirt, Task *srcTask, VirtualAddress srcVirt);
 int  AddressSpace_mapFromNewFrame(Task *task, VirtualAddress virtualAddress, PhysicalMemoryRegionType preferredRegion);
+int  AddressSpace_mapRange(Task *task, VirtualAddress virtualAddress, FrameNumber firstFrameNumber, size_t pageCount, PageTableEntry flags);
+int  AddressSpace_mapRangeFromNewFrames(Task *task, VirtualAddress virtualAddress, size_t pageCount, PhysicalMemoryRegionType preferredRegion);
+int  AddressSpace_reserveRange(Task *task, VirtualAddress virtualAddress, size_t pageCount);
+int  AddressSpace_handlePageFault(Task *task, VirtualAddress virtualAddress, uint32_t errorCode);
+int  AddressSpace_mapLarge(Task *task, VirtualAddress virtualAddress, FrameNumber firstFrameNumber);
+int  AddressSpace_mapLargeFromNewFrames(Task *task, VirtualAddress virtualAddress, PhysicalMemoryRegionType preferredRegion);
 void AddressSpace_unmap(Task *task, VirtualAddress virtualAddress, uintptr_t payload);
+void AddressSpace_unmapRange(Task *task, VirtualAddress virtualAddress, size_t pageCount, uintptr_t payload);
+void AddressSpace_beginBatch(Task *task);
+void AddressSpace_endBatch(Task *task);
+void AddressSpace_handleTlbShootdownIpi(Cpu *cpu);
+int  AddressSpace_checkUserRange(Task *task, VirtualAddress virtualAddress, size_t size, bool writeable);
 
 #endif
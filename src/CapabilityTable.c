@@ -0,0 +1,90 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "kernel.h"
+
+/*
+ * Dense capability space, as an alternative to the sparse one made by a slab
+ * allocator. Capabilities are entries of a two-level radix table: a directory
+ * page pointing to leaf pages of entries, allocated on demand. A capability
+ * address is the index of the entry, with the generation of the entry in the
+ * upper bits to detect stale addresses after the entry is freed and reused.
+ * Capability addresses are thus small integers, and the lookup does not need
+ * the frame descriptors of the capability space.
+ */
+
+/** Number of leaf pointers in the directory page. */
+#define CAPABILITYTABLE_MAX_LEAVES (PAGE_SIZE / sizeof(CapabilityTableEntry *))
+
+/** Generation of the reserved entry at index 0, that no capability address can match. */
+#define CAPABILITYTABLE_RESERVED_GENERATION (1 << CAPABILITYTABLE_GENERATION_BITS)
+
+/**
+ * Initializes a dense capability table with no leaves, allocating its directory page.
+ * @return 0 on success, or -ENOMEM if out of memory.
+ */
+int CapabilityTable_initialize(CapabilityTable *ct, Task *task) {
+    FrameNumber fn = PhysicalMemory_allocate(task, permamapMemoryRegion);
+    if (fn.v == 0) return -ENOMEM;
+    ct->leaves = frame2virt(fn);
+    memzero(ct->leaves, PAGE_SIZE);
+    ct->freeEntries = NULL;
+    ct->leafCount = 0;
+    ct->padding = 0;
+    return 0;
+}
+
+/** Adds a leaf page to the table, pushing its entries to the free list so that lower indices are used first. */
+static bool CapabilityTable_grow(CapabilityTable *ct, Task *task) {
+    if (ct->leafCount == CAPABILITYTABLE_MAX_LEAVES) return false;
+    FrameNumber fn = PhysicalMemory_allocate(task, permamapMemoryRegion);
+    if (fn.v == 0) return false;
+    CapabilityTableEntry *leaf = frame2virt(fn);
+    memzero(leaf, PAGE_SIZE);
+    size_t base = ct->leafCount << CAPABILITYTABLE_LEAF_SHIFT;
+    for (size_t i = CAPABILITYTABLE_LEAF_ENTRIES; i-- > 0; ) {
+        leaf[i].index = base + i;
+        if (base + i == 0) {
+            leaf[i].generation = CAPABILITYTABLE_RESERVED_GENERATION; // capability address 0 is never valid
+            continue;
+        }
+        leaf[i].cap.next = (Capability *) ct->freeEntries;
+        ct->freeEntries = &leaf[i];
+    }
+    ct->leaves[ct->leafCount++] = leaf;
+    return true;
+}
+
+/**
+ * Allocates an entry of a dense capability table, growing the table if needed.
+ * @return The capability of the new entry, or NULL if out of memory or the table is full.
+ */
+Capability *CapabilityTable_allocate(CapabilityTable *ct, Task *task) {
+    if (UNLIKELY(ct->freeEntries == NULL) && !CapabilityTable_grow(ct, task)) return NULL;
+    CapabilityTableEntry *entry = ct->freeEntries;
+    ct->freeEntries = (CapabilityTableEntry *) entry->cap.next;
+    return &entry->cap;
+}
+
+/** Frees an entry of a dense capability table, invalidating all capability addresses referring to it. */
+void CapabilityTable_deallocate(CapabilityTable *ct, Capability *cap) {
+    CapabilityTableEntry *entry = (CapabilityTableEntry *) cap;
+    entry->generation = (entry->generation + 1) & (CAPABILITYTABLE_RESERVED_GENERATION - 1);
+    cap->obj = 0;
+    cap->next = (Capability *) ct->freeEntries;
+    ct->freeEntries = entry;
+}
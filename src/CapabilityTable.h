@@ -0,0 +1,50 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef CAPABILITYTABLE_H_INCLUDED
+#define CAPABILITYTABLE_H_INCLUDED
+
+#include "Types.h"
+
+int         CapabilityTable_initialize(CapabilityTable *ct, Task *task);
+Capability *CapabilityTable_allocate(CapabilityTable *ct, Task *task);
+void        CapabilityTable_deallocate(CapabilityTable *ct, Capability *cap);
+
+/**
+ * Looks up a capability in a dense capability table.
+ * The capability address packs the index of the entry and its generation,
+ * thus the lookup is a bounds check, two loads and a generation comparison.
+ * @return Pointer to the capability, or NULL if the address is out of range or stale.
+ */
+static inline Capability *CapabilityTable_lookup(const CapabilityTable *ct, CapabilityAddress address) {
+    uintptr_t v = address.v >> 4;
+    if (UNLIKELY(v >> (CAPABILITYTABLE_INDEX_BITS + CAPABILITYTABLE_GENERATION_BITS))) return NULL; // would alias the reserved generation
+    uintptr_t index = v & ((1 << CAPABILITYTABLE_INDEX_BITS) - 1);
+    uintptr_t leaf = index >> CAPABILITYTABLE_LEAF_SHIFT;
+    if (UNLIKELY(leaf >= ct->leafCount)) return NULL;
+    CapabilityTableEntry *entry = &ct->leaves[leaf][index & (CAPABILITYTABLE_LEAF_ENTRIES - 1)];
+    if (UNLIKELY(entry->generation != v >> CAPABILITYTABLE_INDEX_BITS)) return NULL;
+    return &entry->cap;
+}
+
+/** Returns the capability address of a capability allocated from a dense capability table. */
+static inline uintptr_t CapabilityTable_getAddress(const Capability *cap) {
+    const CapabilityTableEntry *entry = (const CapabilityTableEntry *) cap;
+    return ((entry->generation << CAPABILITYTABLE_INDEX_BITS) | entry->index) << 4;
+}
+
+#endif
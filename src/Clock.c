@@ -0,0 +1,85 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "kernel.h"
+
+/** The clock page, shared read-only with all tasks. */
+ClockPage *Clock_page;
+/** The frame holding the clock page, or 0 if not allocated yet. */
+FrameNumber Clock_pageFrameNumber;
+/** Whether the raw TSC differs across CPUs, thus user mode cannot read it as a monotonic clock. */
+bool Clock_tscUnsynchronized;
+
+/**
+ * Allocates the clock page and publishes the calibration of the specified TSC,
+ * that is the one of the bootstrap processor, consistently with Tsc_readNanoseconds.
+ * Called on the bootstrap processor once its TSC has been calibrated.
+ */
+__attribute__((section(".boot")))
+void Clock_initialize(const Tsc *tsc) {
+    FrameNumber frameNumber = PhysicalMemory_allocate(NULL, permamapMemoryRegion);
+    if (frameNumber.v == 0)
+        panic("Unable to allocate the clock page.\n");
+    Clock_page = frame2virt(frameNumber);
+    memzero(Clock_page, PAGE_SIZE);
+    Clock_pageFrameNumber = frameNumber;
+    uint64_t tscBase = Tsc_read();
+    Clock_publish(tsc, tscBase, Tsc_convertLongTicksToNanoseconds(tsc, tscBase));
+}
+
+/**
+ * Updates the clock page so that user mode computes the TSC value tscBase
+ * as nsBase nanoseconds, using the calibration of the specified TSC.
+ * The update is a sequence lock write, thus calls must be serialized by the caller.
+ */
+void Clock_publish(const Tsc *tsc, uint64_t tscBase, uint64_t nsBase) {
+    ClockPage *page = Clock_page;
+    page->sequence++;
+    writeBarrier();
+    page->nsPerTick = tsc->nsPerTick;
+    page->tscBase = tscBase;
+    page->nsBase = nsBase;
+    page->tscUsable = tsc->invariant && !Clock_tscUnsynchronized;
+    writeBarrier();
+    page->sequence++;
+}
+
+/**
+ * Marks the TSC as not usable in user mode because an application processor
+ * has a non-invariant TSC or one that needs offset compensation.
+ * Called on the bootstrap processor while synchronizing TSCs.
+ */
+__attribute__((section(".boot")))
+void Clock_reportUnsynchronizedTsc() {
+    Clock_tscUnsynchronized = true;
+    ClockPage *page = Clock_page;
+    if (page == NULL) return;
+    page->sequence++;
+    writeBarrier();
+    page->tscUsable = 0;
+    writeBarrier();
+    page->sequence++;
+}
+
+/**
+ * Maps the clock page read-only into the specified task at CLOCKPAGE_ADDRESS.
+ * @return 0 on success, or a negative error code.
+ */
+int Clock_mapPage(Task *task) {
+    if (Clock_pageFrameNumber.v == 0) return 0;
+    return AddressSpace_mapReadOnly(task, makeVirtualAddress(CLOCKPAGE_ADDRESS), Clock_pageFrameNumber);
+}
@@ -0,0 +1,33 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef CLOCK_H_INCLUDED
+#define CLOCK_H_INCLUDED
+
+#include "Types.h"
+#include "ClockPage.h"
+
+extern ClockPage *Clock_page;
+extern FrameNumber Clock_pageFrameNumber;
+extern bool Clock_tscUnsynchronized;
+
+__attribute__((section(".boot"))) void Clock_initialize(const Tsc *tsc);
+__attribute__((section(".boot"))) void Clock_reportUnsynchronizedTsc();
+void Clock_publish(const Tsc *tsc, uint64_t tscBase, uint64_t nsBase);
+int  Clock_mapPage(Task *task);
+
+#endif
@@ -133,6 +133,7 @@ __attribute__((fastcall)) static void Cpu_doNothingInterrupt(Cpu *cpu, void *par
  */
 void Cpu_switchToThread(Cpu *cpu, Thread *next) {
     Thread *curr = cpu->currentThread;
+    Cpu_accountThreadTime(cpu, false);
 //    Log_printf("Cpu %d switching from thread %p (prio=%d) to thread %p (prio=%d).\n", cpu->lapicId,
 //            curr, curr->queueNode.key,
 //            next, next->queueNode.key);
@@ -159,21 +160,49 @@ void Cpu_switchToThread(Cpu *cpu, Thread *next) {
     }
     // TODO: optionally save FPU/SSE context
     if (next->task != curr->task) {
-        AddressSpace_activate(&next->task->addressSpace);
+        if (curr->task != NULL) CpuMask_testAndClear(&curr->task->addressSpace.activeCpus, cpu->index);
+        if (next->task != NULL) {
+            // Kernel threads leave the previous address space loaded, that is reused if no shootdown happened meanwhile
+            AddressSpace *as = &next->task->addressSpace;
+            CpuMask_set(&as->activeCpus, cpu->index); // before reading the generation, see AddressSpace_initiateTlbShootdown
+            Word generation = AtomicWord_get(&as->generation);
+            if (as != cpu->addressSpace || generation != cpu->addressSpaceGeneration) {
+                AddressSpace_activate(as);
+                cpu->addressSpace = as;
+                cpu->addressSpaceGeneration = generation;
+            }
+        }
     }
     next->state = threadStateRunning;
+    next->runCount++;
+    if (next->cpu != NULL && next->cpu != cpu) next->migrationCount++;
     next->cpu = cpu;
     cpu->currentThread = next;
     cpu->nextThread = next;
     cpu->tss.esp0 = (uint32_t) nr + sizeof(ThreadRegisters); // unused for kernel-mode threads
 }
 
+/**
+ * Charges the TSC ticks elapsed since the last accounting point to the current thread.
+ * @param cpu The current CPU.
+ * @param userMode Whether the elapsed time was spent running the thread in user mode.
+ */
+void Cpu_accountThreadTime(Cpu *cpu, bool userMode) {
+    uint64_t t = Tsc_read();
+    uint64_t dt = t - cpu->lastAccountingTime;
+    cpu->lastAccountingTime = t;
+    if (userMode) {
+        cpu->currentThread->userTime += dt;
+    } else {
+        cpu->currentThread->kernelTime += dt;
+    }
+}
+
 bool Cpu_accountTimesliceAndCheckExpiration(Cpu *cpu) {
     uint64_t t = Tsc_read();
     uint64_t dt = t - cpu->lastScheduleTime; // may overflow if we run for 10s of years :)
     cpu->lastScheduleTime = t;
-    if (dt > UINT32_MAX) dt = UINT32_MAX;
-    uint64_t dtNanoseconds = Tsc_convertTicksToNanoseconds(&cpu->tsc, dt);
+    uint64_t dtNanoseconds = Tsc_convertLongTicksToNanoseconds(&cpu->tsc, dt);
     if (cpu->currentThread->timesliceRemaining <= TIMESLICE_TOLERANCE + dtNanoseconds) {
         cpu->currentThread->timesliceRemaining = Cpu_timesliceLengths[cpu->currentThread->nice];
         return true;
@@ -207,16 +236,95 @@ Thread *Cpu_findNextThreadAndUpdateReadyQueue(Cpu *cpu, bool timesliced) {
     return curr;
 }
 
+/**
+ * Returns the monotonic time in nanoseconds used for timers of the specified CPU,
+ * that is assumed to be the current CPU. This is the TSC if invariant, otherwise
+ * the HPET if it has a 64-bit counter, falling back to the TSC as a last resort.
+ */
+uint64_t Cpu_readNanoseconds(const Cpu *cpu) {
+    if (cpu->tsc.invariant || !Hpet_isMonotonicClock())
+        return Tsc_readNanoseconds(&cpu->tsc);
+    return Hpet_readNanoseconds();
+}
+
+/**
+ * Programs the one-shot LAPIC timer of the specified CPU, that is assumed to be
+ * the current CPU, to fire at the specified absolute time in nanoseconds.
+ * In TSC-deadline mode the absolute TSC value is written, with no drift due to
+ * the conversion to LAPIC timer ticks and no LAPIC timer calibration needed.
+ */
+static void Cpu_programLapicTimer(Cpu *cpu, uint64_t now, uint64_t deadline) {
+    LapicTimer *lt = &cpu->lapicTimer;
+    uint32_t dt = 0;
+    if (deadline > now) dt = (deadline - now < LAPICTIMER_MAX_NANOSECONDS) ? deadline - now : LAPICTIMER_MAX_NANOSECONDS;
+    lt->nextExpirationNanoseconds = deadline;
+    if (lt->tscDeadlineMode) {
+        Cpu_writeMsr(msrTscDeadline, Tsc_read() + Tsc_convertNanosecondsToTicks(&cpu->tsc, dt) + 1); // zero would disarm
+    } else {
+        uint32_t ticks = (dt < LAPICTIMER_MAX_NANOSECONDS) ? LapicTimer_convertNanosecondsToTicks(lt, dt) : lt->maxTicks;
+        Cpu_writeLocalApic(lapicTimerInitialCount, (ticks != 0) ? ticks : 1);
+    }
+}
+
+/**
+ * Programs the LAPIC timer for the earliest between the end of the time slice
+ * of the current thread, if any, and the next non-empty slot of the timer wheel.
+ */
 void Cpu_setTimesliceTimer(Cpu *cpu) {
     cpu->timesliceTimerEnabled = cpu->currentThread != &cpu->idleThread
             && !PriorityQueue_isEmpty(&cpu->cpuNode->readyQueue)
             && PriorityQueue_peek(&cpu->cpuNode->readyQueue)->key == cpu->currentThread->queueNode.key;
+    uint64_t deadline = LAPICTIMER_DISARMED;
+    uint64_t now = Cpu_readNanoseconds(cpu);
     if (cpu->timesliceTimerEnabled) {
         assert(cpu->currentThread->timesliceRemaining > TIMESLICE_TOLERANCE);
-        uint32_t ticks = LapicTimer_convertNanosecondsToTicks(&cpu->lapicTimer, cpu->currentThread->timesliceRemaining);
-//        Log_printf("Cpu %d enabling timeslice in %d LAPIC timer ticks.\n", cpu->lapicId, ticks);
-        Cpu_writeLocalApic(lapicTimerInitialCount, ticks);
+        deadline = now + cpu->currentThread->timesliceRemaining;
     }
+    if (cpu->timerWheel != NULL && !TimerWheel_isEmpty(cpu->timerWheel)) {
+        uint64_t timerDeadline = TimerWheel_getNextExpiration(cpu->timerWheel);
+        if (timerDeadline < deadline) deadline = timerDeadline;
+    }
+    if (deadline != LAPICTIMER_DISARMED) {
+//        Log_printf("Cpu %d programming the LAPIC timer in %d ns.\n", cpu->lapicId, (int) (deadline - now));
+        Cpu_programLapicTimer(cpu, now, deadline);
+    } else {
+        cpu->lapicTimer.nextExpirationNanoseconds = LAPICTIMER_DISARMED;
+    }
+}
+
+/**
+ * Arms a timer of the specified CPU, that is assumed to be the current CPU,
+ * reprogramming the LAPIC timer if the timer expires before it.
+ * @param cpu The current CPU.
+ * @param timer Timer to arm, possibly already armed.
+ * @param expiration Absolute expiration time in nanoseconds.
+ */
+void Cpu_armTimer(Cpu *cpu, Timer *timer, uint64_t expiration) {
+    uint64_t now = Cpu_readNanoseconds(cpu);
+    TimerWheel_arm(cpu->timerWheel, timer, expiration, now);
+    uint64_t next = TimerWheel_getNextExpiration(cpu->timerWheel);
+    if (next < cpu->lapicTimer.nextExpirationNanoseconds)
+        Cpu_programLapicTimer(cpu, now, next);
+}
+
+/**
+ * Cancels a timer of the specified CPU, that is assumed to be the current CPU.
+ * The LAPIC timer is left as is, at worst it will fire with nothing to do.
+ */
+void Cpu_cancelTimer(Cpu *cpu, Timer *timer) {
+    TimerWheel_cancel(cpu->timerWheel, timer);
+}
+
+/**
+ * Handles the LAPIC timer interrupt of the specified CPU, that is assumed to be
+ * the current CPU, firing all expired timers in a single batch.
+ * The LAPIC timer is reprogrammed by the scheduler.
+ */
+static void Cpu_handleLapicTimer(Cpu *cpu) {
+    cpu->lapicTimer.nextExpirationNanoseconds = LAPICTIMER_DISARMED;
+    if (cpu->timerWheel != NULL && !TimerWheel_isEmpty(cpu->timerWheel))
+        TimerWheel_expire(cpu->timerWheel, cpu, Cpu_readNanoseconds(cpu));
+    cpu->rescheduleNeeded = true;
 }
 
 /**
@@ -282,7 +390,7 @@ void Cpu_schedule(Cpu *currentCpu) {
     if (next != currentCpu->currentThread) {
         Cpu_switchToThread(currentCpu, next); // ~200 TSC ticks
         Cpu_setTimesliceTimer(currentCpu); // ~15 TSC ticks
-    } else if (timesliced) {
+    } else if (timesliced || currentCpu->lapicTimer.nextExpirationNanoseconds == LAPICTIMER_DISARMED) {
         Cpu_setTimesliceTimer(currentCpu);
     }
     Spinlock_unlock(&currentCpu->cpuNode->lock);
@@ -295,9 +403,6 @@ static void Cpu_handleSysenter(Cpu *currentCpu) {
         case 1:
             regs->eax = Syscall_createChannel(currentCpu->currentThread->task);
             break;
-        case 2:
-            regs->eax = Syscall_deleteCapability(currentCpu->currentThread->task, regs->ebx);
-            break;
         case 3:
             regs->eax = Syscall_sendMessage(currentCpu, regs->eax >> 8, regs->ebx);
             break;
@@ -308,6 +413,18 @@ static void Cpu_handleSysenter(Cpu *currentCpu) {
             regs->eax = Syscall_readMessage(currentCpu->currentThread, regs->ebx, regs->ebp, (uint8_t *) regs->esi, regs->edi);
             break;
 #endif
+        case syscallGetThreadStatistics:
+            regs->eax = Syscall_getThreadStatistics(currentCpu, regs->esi, regs->edi);
+            break;
+        case syscallDeleteCapability:
+            regs->eax = Syscall_deleteCapability(currentCpu->currentThread->task, makeCapabilityAddress(regs->ebx));
+            break;
+        case syscallCreateProxy:
+            regs->eax = Syscall_createProxy(currentCpu->currentThread->task, makeCapabilityAddress(regs->ebx));
+            break;
+        case syscallRevokeProxy:
+            regs->eax = Syscall_revokeProxy(currentCpu->currentThread->task, makeCapabilityAddress(regs->ebx));
+            break;
         case 127:
             Log_printf("System call on Cpu 0x%02X\n"
                     "  regs=%p\n"
@@ -335,14 +452,33 @@ static void Cpu_handleSysenter(Cpu *currentCpu) {
     Cpu_schedule(currentCpu);
 }
 
+/**
+ * Handles a page fault by mapping a reserved page of the task of the current thread,
+ * treating any other page fault as an unhandled exception.
+ */
+static void Cpu_handlePageFault(Cpu *currentCpu) {
+    Thread *thread = currentCpu->currentThread;
+    VirtualAddress faultingAddress = makeVirtualAddress((uintptr_t) Cpu_getFaultingAddress());
+    if (thread->task == NULL || AddressSpace_handlePageFault(thread->task, faultingAddress, thread->regs->error) < 0) {
+        Cpu_unhandledException(currentCpu, NULL);
+    }
+}
+
 static void Cpu_handleInterrupt(Cpu *currentCpu) {
     const int logMaxInterruptCount = 12;
     const int maxInterruptCount = 1 << logMaxInterruptCount;
     uint64_t beginTsc = Tsc_read();
     currentCpu->interruptCount++;
     switch (currentCpu->currentThread->regs->vector & THREADREGISTERS_VECTOR_MASK) {
+        case pageFaultVector:
+            Cpu_handlePageFault(currentCpu);
+            break;
         case lapicTimerVector:
-            currentCpu->rescheduleNeeded = true;
+            Cpu_handleLapicTimer(currentCpu);
+            Cpu_writeLocalApic(lapicEoi, 0);
+            break;
+        case tlbShootdownIpiVector:
+            AddressSpace_handleTlbShootdownIpi(currentCpu);
             Cpu_writeLocalApic(lapicEoi, 0);
             break;
         case rescheduleIpiVector:
@@ -373,6 +509,8 @@ static void Cpu_handleInterrupt(Cpu *currentCpu) {
  * @return Pointer to the ThreadRegister structure of the thread to resume.
  */
 __attribute__((fastcall)) ThreadRegisters *Cpu_handleSyscallOrInterrupt(Cpu *currentCpu) {
+    // If we are not nested, we have interrupted the current thread while running its own code
+    Cpu_accountThreadTime(currentCpu, currentCpu->kernelEntryCount == 1 && !currentCpu->currentThread->kernelThread);
     while (true) {
         currentCpu->currentThread->kernelRestartNeeded = false;
         if (currentCpu->currentThread->regs->vector & THREADREGISTERS_VECTOR_SYSENTER) {
@@ -384,6 +522,7 @@ __attribute__((fastcall)) ThreadRegisters *Cpu_handleSyscallOrInterrupt(Cpu *cur
         Cpu_enableInterrupts();
         Cpu_disableInterrupts();
     }
+    Cpu_accountThreadTime(currentCpu, false);
     return currentCpu->currentThread->regs;
 }
 
@@ -404,10 +543,19 @@ void Cpu_sendRescheduleInterrupt(Cpu *cpu) {
     Cpu_writeLocalApic(lapicInterruptCommandLow, 0x4000 | rescheduleIpiVector); // IPI to physical destination (no shorthand), assert, fixed vector
 }
 
-/** Sends a TLB shootdown interprocessor interrupt to the specified CPU. */
-void Cpu_sendTlbShootdownIpi(Cpu *cpu) {
-    Cpu_writeLocalApic(lapicInterruptCommandHigh, cpu->lapicId << 24); // Destination processor
-    Cpu_writeLocalApic(lapicInterruptCommandLow, 0x4000 | tlbShootdownIpiVector); // IPI to physical destination (no shorthand), assert, fixed vector
+/**
+ * Sends a TLB shootdown interprocessor interrupt to the specified CPUs, not including the current one.
+ * Each target gets a directed IPI, as physical destination mode cannot multicast, so that
+ * CPUs not in the target set are never interrupted.
+ */
+void Cpu_sendTlbShootdownIpi(const CpuMask *targets) {
+    for (size_t i = 0; i < (Cpu_cpuCount + 31) / 32; i++) {
+        for (Word w = AtomicWord_get(&targets->words[i]); w != 0; w &= w - 1) {
+            while (Cpu_readLocalApic(lapicInterruptCommandLow) & 0x1000) Cpu_relax(); // wait for the previous IPI to be sent
+            Cpu_writeLocalApic(lapicInterruptCommandHigh, Cpu_cpus[i * 32 + __builtin_ctz(w)]->lapicId << 24); // Destination processor
+            Cpu_writeLocalApic(lapicInterruptCommandLow, 0x4000 | tlbShootdownIpiVector); // IPI to physical destination (no shorthand), assert, fixed vector
+        }
+    }
 }
 
 void Cpu_requestReschedule(Cpu *cpu) {
@@ -416,3 +564,12 @@ void Cpu_requestReschedule(Cpu *cpu) {
     else
         cpu->rescheduleNeeded = true;
 }
+
+/**
+ * Does one item of background work on behalf of the idle thread of the current CPU,
+ * such as filling a frame with zeros. Called with interrupts disabled.
+ * @return true if more work is pending, false if the idle thread can halt.
+ */
+bool Cpu_doIdleWork() {
+    return FrameCache_fillZeroedPool(Cpu_getCurrent()->frameCache);
+}
@@ -20,8 +20,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "Types.h"
 
-/** The absolute maximum number of CPUs supported. */
-#define MAX_CPU_COUNT 1024
 /** Number of nice levels (to weight threads with same priority). */
 #define NICE_LEVELS 40
 
@@ -32,11 +30,18 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 enum Msr {
     msrSysenterCs = 0x174,
     msrSysenterEsp = 0x175,
-    msrSysenterEip = 0x176
+    msrSysenterEip = 0x176,
+    msrTscDeadline = 0x6E0
 };
 
+/** Extended Feature Enable Register, whose index does not fit enum Msr. */
+#define CPU_MSR_EFER 0xC0000080
+/** No-execute enable bit of the EFER. */
+#define CPU_EFER_NXE (1 << 11)
+
 /** Hardwired interrupt vectors. */
 enum IrqVector {
+    pageFaultVector = 0x0E,
     lapicTimerVector = 0xFC,
     tlbShootdownIpiVector = 0xFD,
     rescheduleIpiVector = 0xFE,
@@ -63,6 +68,16 @@ enum CpuFlag {
     CpuFlag_interruptEnable = 1 << 9
 };
 
+/** Feature flags reported by CPUID leaf 1 in ECX. */
+enum CpuFeature1Ecx {
+    CpuFeature1Ecx_tscDeadline = 1 << 24
+};
+
+/** Feature flags reported by CPUID leaf 0x80000007 (advanced power management) in EDX. */
+enum CpuPowerManagementEdx {
+    CpuPowerManagementEdx_invariantTsc = 1 << 8
+};
+
 /**
  * Dummy union to check that offsets and size of the Cpu struct are consistent with constants used in assembly.
  * Courtesy of http://www.embedded.com/design/prototyping-and-development/4024941/Learn-a-new-trick-with-the-offsetof--macro
@@ -78,6 +93,25 @@ union CpuChecker {
     char cpuNotFittingInPage[sizeof(Cpu) <= PAGE_SIZE];
 }; 
 
+/** Atomically adds the CPU with the specified index to a CpuMask. */
+static inline void CpuMask_set(CpuMask *mask, size_t index) {
+    AtomicWord *w = &mask->words[index >> 5];
+    Word old;
+    do old = AtomicWord_get(w); while (!AtomicWord_compareAndSet(w, old, old | 1u << (index & 31)));
+}
+
+/** Atomically removes the CPU with the specified index from a CpuMask, returning true if it was there. */
+static inline bool CpuMask_testAndClear(CpuMask *mask, size_t index) {
+    AtomicWord *w = &mask->words[index >> 5];
+    Word bit = 1u << (index & 31);
+    Word old;
+    do {
+        old = AtomicWord_get(w);
+        if ((old & bit) == 0) return false;
+    } while (!AtomicWord_compareAndSet(w, old, old & ~bit));
+    return true;
+}
+
 extern uint32_t Cpu_cpuCount;
 extern Cpu *Cpu_cpus[MAX_CPU_COUNT];
 extern CpuDescriptor Cpu_idt[256];
@@ -89,12 +123,17 @@ __attribute__((fastcall)) void Cpu_unhandledException(Cpu *cpu, void *param);
 void Cpu_returnToUserMode(uintptr_t stackPointer); // from Cpu_asm.S
 void Cpu_setIsr(size_t vector, Isr isr, void *param);
 void Cpu_sendRescheduleInterrupt(Cpu *cpu);
-void Cpu_sendTlbShootdownIpi(Cpu *cpu);
+void Cpu_sendTlbShootdownIpi(const CpuMask *targets);
 void Cpu_switchToThread(Cpu *cpu, Thread *next);
 void Cpu_requestReschedule(Cpu *cpu);
+void Cpu_accountThreadTime(Cpu *cpu, bool userMode);
 bool Cpu_accountTimesliceAndCheckExpiration(Cpu *cpu);
 Thread *Cpu_findNextThreadAndUpdateReadyQueue(Cpu *cpu, bool timesliced);
+uint64_t Cpu_readNanoseconds(const Cpu *cpu);
 void Cpu_setTimesliceTimer(Cpu *cpu);
+void Cpu_armTimer(Cpu *cpu, Timer *timer, uint64_t expiration);
+void Cpu_cancelTimer(Cpu *cpu, Timer *timer);
 void Cpu_schedule(Cpu *currentCpu);
+bool Cpu_doIdleWork();
 
 #endif
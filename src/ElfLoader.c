@@ -17,6 +17,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 #include "kernel.h"
 
+/** Maximum size in bytes of the stack of the initial thread, mapped on demand as it grows. */
+#define ELFLOADER_STACK_SIZE (8UL << 20)
+
 /** ELF header, located at the beginning of the ELF file. */
 typedef struct Elf32_Ehdr {
     unsigned char e_ident[16];
@@ -318,6 +321,39 @@ void ElfLoader_fromMultibootModule(ElfLoader *el, uintptr_t begin, uint32_t end,
     }
 }
 
+/**
+ * Maps newly allocated zeroed frames to the user virtual address range [begin, end).
+ * Large pages are used for the parts aligned to LARGE_PAGE_SIZE where enough
+ * contiguous memory is available, small pages elsewhere.
+ */
+static void ElfLoader_mapNewFrames(Task *task, uintptr_t begin, uintptr_t end) {
+    uintptr_t va = begin;
+    while (va < end) {
+        if ((va & (LARGE_PAGE_SIZE - 1)) == 0 && end - va >= LARGE_PAGE_SIZE
+                && AddressSpace_mapLargeFromNewFrames(task, makeVirtualAddress(va), highMemoryRegion) == 0) {
+            va += LARGE_PAGE_SIZE;
+        } else {
+            uintptr_t next = (va & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE;
+            if (next > end) next = end;
+            AddressSpace_mapRangeFromNewFrames(task, makeVirtualAddress(va), (next - va) >> PAGE_SHIFT, highMemoryRegion);
+            va = next;
+        }
+    }
+}
+
+/**
+ * Maps to the specified user page a new frame with a copy of the first byteCount bytes
+ * of the specified page of the module, the rest being filled with zeros.
+ */
+static int ElfLoader_mapPartialPage(Task *task, uintptr_t va, PhysicalAddress src, size_t byteCount, PageTableEntry flags) {
+    FrameNumber frameNumber = PhysicalMemory_allocateZeroed(task, highMemoryRegion);
+    if (frameNumber.v == 0) return -ENOMEM;
+    memcpy(AddressSpace_mapTemporary(Cpu_getCurrent(), frameNumber), phys2virt(src), byteCount);
+    int res = AddressSpace_mapRange(task, makeVirtualAddress(va), frameNumber, 1, flags);
+    if (res < 0) PhysicalMemory_deallocate(frameNumber);
+    return res;
+}
+
 /**
  * Uses an ELF loader to process a Multiboot module as an executable ELF.
  * A new task is created and its initial thread is made runnable.
@@ -372,24 +408,24 @@ void ElfLoader_fromExeMultibootModule(Task *task, PhysicalAddress begin, Physica
         if (phdr->p_type != 1) continue; // Skip if not PT_LOAD, loadable segment
         Log_printf("  Segment %d is loadable, Offset=0x%08X, VirtAddr=%p, PhysAddr=%p, FileSize=0x%08X, MemSize=0x%08X, Flags=0x%08X, Align=0x%08X\n",
                 i, phdr->p_offset, phdr->p_vaddr, phdr->p_paddr, phdr->p_filesz, phdr->p_memsz, phdr->p_flags, phdr->p_align);
-        for (size_t j = 0; j < phdr->p_memsz; j += PAGE_SIZE) {
-            if (j < phdr->p_filesz) {
-                AddressSpace_map(task, makeVirtualAddress(phdr->p_vaddr + j), floorToFrame(addToPhysicalAddress(begin, + phdr->p_offset + j)));
-                if (j + PAGE_SIZE >= phdr->p_filesz) {
-                    //memzero(phdr->p_vaddr + j);
-                }
-            } else {
-                AddressSpace_mapFromNewFrame(task, makeVirtualAddress(phdr->p_vaddr + j), otherMemoryRegion);
-            }
+        PageTableEntry flags = ptWriteable | ((phdr->p_flags & 1) ? 0 : AddressSpace_noExecute); // PF_X
+        size_t filePages = (phdr->p_filesz + PAGE_SIZE - 1) >> PAGE_SHIFT;
+        size_t tailBytes = phdr->p_filesz & (PAGE_SIZE - 1);
+        size_t copiedPages = (tailBytes != 0 && phdr->p_memsz > phdr->p_filesz) ? 1 : 0; // the zero-filled part begins in the last file page
+        if (filePages > copiedPages) {
+            AddressSpace_mapRange(task, makeVirtualAddress(phdr->p_vaddr), floorToFrame(addToPhysicalAddress(begin, phdr->p_offset)), filePages - copiedPages, flags);
         }
+        if (copiedPages > 0) {
+            size_t offset = (filePages - 1) << PAGE_SHIFT;
+            ElfLoader_mapPartialPage(task, phdr->p_vaddr + offset, addToPhysicalAddress(begin, phdr->p_offset + offset), tailBytes, flags);
+        }
+        size_t memPages = (phdr->p_memsz + PAGE_SIZE - 1) >> PAGE_SHIFT;
+        ElfLoader_mapNewFrames(task, phdr->p_vaddr + (filePages << PAGE_SHIFT), phdr->p_vaddr + (memPages << PAGE_SHIFT));
     }
     uint64_t seed = Tsc_read();
-    uintptr_t stackTop = HIGH_HALF_BEGIN - ((xorshift64star(&seed) & 0x7FF) << PAGE_SHIFT); // 8 MiB randomization
-    // TODO: dynamically grow stack on page fault
-    for (size_t i = 1048576; i > 0; i -= PAGE_SIZE) {
-        AddressSpace_mapFromNewFrame(task, makeVirtualAddress(stackTop - i), otherMemoryRegion);
-    }
-    Log_printf("  Stack allocated and mapped at [%p..%p).\n", stackTop - 1048576, stackTop);
+    uintptr_t stackTop = CLOCKPAGE_ADDRESS - ((xorshift64star(&seed) & 0x7FF) << PAGE_SHIFT); // 8 MiB randomization below the clock page
+    AddressSpace_reserveRange(task, makeVirtualAddress(stackTop - ELFLOADER_STACK_SIZE), ELFLOADER_STACK_SIZE >> PAGE_SHIFT);
+    Log_printf("  Stack reserved at [%p..%p).\n", stackTop - ELFLOADER_STACK_SIZE, stackTop);
     Thread *thread = SlabAllocator_allocate(&threadAllocator);
     if (thread == NULL) {
         Video_printf("  Not enough memory for task %p.", task);
@@ -397,6 +433,6 @@ void ElfLoader_fromExeMultibootModule(Task *task, PhysicalAddress begin, Physica
         return;
     }
     Thread_initialize(task, thread, priority, nice, ehdr->e_entry, stackTop);
-    SlabAllocator_initialize(&task->capabilitySpace, sizeof(Capability), task);
+    SlabAllocator_initialize(&task->capabilitySpace, sizeof(Capability), task, FrameType_capability);
     CpuNode_addRunnableThread(&CpuNode_theInstance, thread);
 }
@@ -0,0 +1,38 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "kernel.h"
+
+/** The global unique instance of the HPET. */
+Hpet Hpet_theInstance;
+
+/**
+ * Runs in a tight loop while reading the HPET main counter until
+ * at least the specified number of ticks have elapsed.
+ * Only the low word of the counter is read, thus this also works with 32-bit counters.
+ * @return The number of HPET ticks actually passed.
+ */
+unsigned Hpet_busyWait(unsigned ticks) {
+    unsigned countedTicks = 0;
+    uint32_t prev = Hpet_readRegister(hpetMainCounterLow);
+    while (countedTicks < ticks) {
+        uint32_t curr = Hpet_readRegister(hpetMainCounterLow);
+        countedTicks += curr - prev;
+        prev = curr;
+    }
+    return countedTicks;
+}
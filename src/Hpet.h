@@ -0,0 +1,85 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef HPET_H_INCLUDED
+#define HPET_H_INCLUDED
+
+#include "Types.h"
+#include "hardware.h"
+
+/** Offsets of the HPET general registers, accessed as 32-bit halves. */
+enum HpetRegister {
+    hpetCapabilities = 0x00, // General Capabilities and ID, low word
+    hpetPeriod = 0x04, // General Capabilities and ID, high word: counter period in femtoseconds
+    hpetConfiguration = 0x10, // General Configuration, low word
+    hpetMainCounterLow = 0xF0,
+    hpetMainCounterHigh = 0xF4
+};
+
+enum HpetFlags {
+    hpetCapabilities64Bit = 1 << 13, // COUNT_SIZE_CAP: the main counter is 64-bit
+    hpetConfigurationEnable = 1 << 0 // ENABLE_CNF: the main counter is running
+};
+
+/** Maximum counter period in femtoseconds allowed by the HPET specification. */
+#define HPET_MAX_PERIOD_FEMTOSECONDS 100000000
+
+/** The High Precision Event Timer, shared by all CPUs. */
+typedef struct Hpet {
+    bool     available; // mapped and running, usable for calibration
+    bool     counter64Bit; // does not wrap, usable as a global monotonic clock
+    uint32_t periodFemtoseconds;
+    uint32_t nsPerTick; // <<20 on 32-bit
+} Hpet;
+
+extern Hpet Hpet_theInstance;
+
+/** Returns true if the HPET can be used as a global monotonic clock. */
+static inline bool Hpet_isMonotonicClock() {
+    return Hpet_theInstance.available && Hpet_theInstance.counter64Bit;
+}
+
+/** Reads the 64-bit main counter of the HPET without tearing between its 32-bit halves. */
+static inline uint64_t Hpet_readCounter() {
+    uint32_t high, low;
+    do {
+        high = Hpet_readRegister(hpetMainCounterHigh);
+        low = Hpet_readRegister(hpetMainCounterLow);
+    } while (high != Hpet_readRegister(hpetMainCounterHigh));
+    return (uint64_t) low | ((uint64_t) high << 32);
+}
+
+/** Converts the specified count of ticks of the HPET to nanoseconds. */
+static inline uint64_t Hpet_convertTicksToNanoseconds(uint32_t ticks) {
+    return mul(ticks, Hpet_theInstance.nsPerTick) >> 20;
+}
+
+/** Converts the specified number of nanoseconds to count of ticks of the HPET, rounding up. */
+static inline uint32_t Hpet_convertNanosecondsToTicks(uint32_t ns) {
+    uint32_t period = Hpet_theInstance.periodFemtoseconds;
+    return div(mul(ns, 1000000) + period - 1, period);
+}
+
+/** Returns the current value of the HPET main counter converted to nanoseconds. */
+static inline uint64_t Hpet_readNanoseconds() {
+    uint64_t ticks = Hpet_readCounter();
+    return (mul(ticks >> 32, Hpet_theInstance.nsPerTick) << 12) + (mul((uint32_t) ticks, Hpet_theInstance.nsPerTick) >> 20);
+}
+
+unsigned Hpet_busyWait(unsigned ticks);
+
+#endif
@@ -0,0 +1,97 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "kernel.h"
+
+/*
+ * General purpose allocator of kernel memory. Small objects are rounded up to
+ * a size class and allocated from the slab allocator of that class, large
+ * objects take contiguous permanently mapped frames. As in Bonwick's design,
+ * the caller passes the size back when freeing, thus objects have no header.
+ * Allocations may be charged to a task, that fails them beyond its quota.
+ */
+
+/** Object sizes of each size class, growing by about 1.5 times to bound internal fragmentation. */
+static const uint16_t KernelMemory_classSizes[KERNELMEMORY_SIZE_CLASS_COUNT] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, KERNELMEMORY_MAX_SMALL_SIZE
+};
+
+SlabAllocator KernelMemory_allocators[KERNELMEMORY_SIZE_CLASS_COUNT];
+
+/** Size class of small objects, indexed by (size - 1) / 16, to find the class in constant time. */
+static uint8_t KernelMemory_sizeClasses[KERNELMEMORY_MAX_SMALL_SIZE / 16];
+
+/** Initializes the slab allocators of all size classes, with per-CPU caches disabled. */
+__attribute__((section(".boot")))
+void KernelMemory_initialize() {
+    size_t c = 0;
+    for (size_t i = 0; i < KERNELMEMORY_MAX_SMALL_SIZE / 16; i++) {
+        if ((i + 1) * 16 > KernelMemory_classSizes[c]) c++;
+        KernelMemory_sizeClasses[i] = c;
+    }
+    for (size_t i = 0; i < KERNELMEMORY_SIZE_CLASS_COUNT; i++)
+        SlabAllocator_initialize(&KernelMemory_allocators[i], KernelMemory_classSizes[i], NULL, FrameType_unmapped);
+}
+
+/** Returns the number of bytes charged for an object of the specified size. */
+static size_t KernelMemory_getChargedSize(size_t size) {
+    if (size <= KERNELMEMORY_MAX_SMALL_SIZE) return KernelMemory_classSizes[KernelMemory_sizeClasses[(size - 1) >> 4]];
+    return (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+/**
+ * Allocates kernel memory.
+ * @param task Task to charge the memory to, or NULL for memory used by the kernel itself.
+ * @param size Size in bytes of the object to allocate, greater than zero.
+ * @return The permanently mapped object, aligned to 16 bytes, or NULL if out of memory or beyond the quota of the task.
+ */
+void *KernelMemory_allocate(Task *task, size_t size) {
+    assert(size > 0);
+    size_t chargedSize = KernelMemory_getChargedSize(size);
+    if (task != NULL) {
+        if (UNLIKELY(chargedSize > task->kernelMemoryQuota - task->kernelMemoryUsage)) return NULL;
+        task->kernelMemoryUsage += chargedSize;
+    }
+    void *p;
+    if (size <= KERNELMEMORY_MAX_SMALL_SIZE) {
+        p = SlabAllocator_allocate(&KernelMemory_allocators[KernelMemory_sizeClasses[(size - 1) >> 4]]);
+    } else {
+        FrameNumber fn = PhysicalMemory_allocateContiguous(NULL, permamapMemoryRegion, chargedSize >> PAGE_SHIFT, 1);
+        p = fn.v != 0 ? frame2virt(fn) : NULL;
+    }
+    if (UNLIKELY(p == NULL) && task != NULL) task->kernelMemoryUsage -= chargedSize;
+    return p;
+}
+
+/**
+ * Frees kernel memory allocated with KernelMemory_allocate.
+ * @param task The task the memory was charged to, or NULL.
+ * @param p The object to free.
+ * @param size The size the object was allocated with.
+ */
+void KernelMemory_deallocate(Task *task, void *p, size_t size) {
+    assert(size > 0);
+    size_t chargedSize = KernelMemory_getChargedSize(size);
+    if (size <= KERNELMEMORY_MAX_SMALL_SIZE)
+        SlabAllocator_deallocate(&KernelMemory_allocators[KernelMemory_sizeClasses[(size - 1) >> 4]], p);
+    else
+        PhysicalMemory_deallocateContiguous(virt2frame(p), chargedSize >> PAGE_SHIFT);
+    if (task != NULL) {
+        assert(task->kernelMemoryUsage >= chargedSize);
+        task->kernelMemoryUsage -= chargedSize;
+    }
+}
@@ -0,0 +1,34 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef KERNELMEMORY_H_INCLUDED
+#define KERNELMEMORY_H_INCLUDED
+
+#include "Types.h"
+
+/** Number of size classes of small kernel objects, each with its own slab allocator. */
+#define KERNELMEMORY_SIZE_CLASS_COUNT 14
+/** Size in bytes of the largest object allocated from slabs, larger ones take contiguous frames. */
+#define KERNELMEMORY_MAX_SMALL_SIZE 2048
+
+extern SlabAllocator KernelMemory_allocators[KERNELMEMORY_SIZE_CLASS_COUNT];
+
+void  KernelMemory_initialize();
+void *KernelMemory_allocate(Task *task, size_t size);
+void  KernelMemory_deallocate(Task *task, void *p, size_t size);
+
+#endif
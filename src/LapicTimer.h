@@ -21,6 +21,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "Types.h"
 #include "Cpu.h"
 
+/** Value of LapicTimer.nextExpirationNanoseconds when the timer is not programmed. */
+#define LAPICTIMER_DISARMED UINT64_MAX
+/** Longest delay the LAPIC timer is programmed for, longer delays are split. */
+#define LAPICTIMER_MAX_NANOSECONDS 4000000000U
+
 /** Converts the specified count of ticks of the Local APIC timer to nanoseconds. */
 static inline uint32_t LapicTimer_convertTicksToNanoseconds(const LapicTimer *lt, uint32_t ticks) {
     return mul(ticks, lt->nsPerTick) >> 20;
@@ -23,58 +23,385 @@ Frame *PhysicalMemory_frameDescriptors;
 FrameNumber PhysicalMemory_firstFrame;
 /** Number of frames of all installed physical memory. */
 size_t PhysicalMemory_totalMemoryFrames;
-/** Descriptors for each region specified by enum PhysicalMemoryRegionType. */
-PhysicalMemoryRegion PhysicalMemory_regions[physicalMemoryRegionCount];
+/**
+ * Descriptors for each region specified by enum PhysicalMemoryRegionType, for each NUMA node.
+ * The regions of a node cover the same frames as those of any other node, but only hold
+ * free blocks of memory local to the node. Node 0 comes first, thus without NUMA
+ * information this is indexed by enum PhysicalMemoryRegionType alone.
+ */
+PhysicalMemoryRegion PhysicalMemory_regions[PHYSICALMEMORY_MAX_NODES * physicalMemoryRegionCount];
+/** Number of NUMA nodes with memory, 1 if the system has no ACPI SRAT. */
+size_t PhysicalMemory_nodeCount = 1;
+/** Ranges of memory assigned to NUMA nodes other than node 0 by the ACPI SRAT, any other memory is in node 0. */
+PhysicalMemoryNodeRange PhysicalMemory_nodeRanges[PHYSICALMEMORY_MAX_NODE_RANGES];
+/** Number of valid entries in PhysicalMemory_nodeRanges. */
+size_t PhysicalMemory_nodeRangeCount;
+/** For each NUMA node, all nodes sorted by increasing distance, starting from the node itself. */
+uint8_t PhysicalMemory_nodeOrder[PHYSICALMEMORY_MAX_NODES][PHYSICALMEMORY_MAX_NODES];
 /** Dummy task to identify free frames. */
 Task PhysicalMemory_freeFramesDummyOwner;
+/** Protects the free lists of all regions once other CPUs are started. */
+Spinlock PhysicalMemory_lock;
+/** Whether single frames are allocated and freed through the frame cache of the current CPU. */
+bool PhysicalMemory_frameCachesEnabled;
 
 
 /********************************************************************
  * PhysicalMemoryRegion
  ********************************************************************/
 
-FrameNumber PhysicalMemoryRegion_allocate(PhysicalMemoryRegion *pmr, Task *task) {
-    if (UNLIKELY(pmr->freeFrameCount == 0))
+/** Returns the index of the free list for blocks of the specified number of frames, that is floor(log2(length)). */
+static inline size_t PhysicalMemoryRegion_freeListIndex(size_t length) {
+    return 31 - __builtin_clz(length);
+}
+
+/** Marks the first and last frame of a free block as free, holding the block length. */
+static inline void PhysicalMemoryRegion_writeBoundaryTags(Frame *first, size_t length) {
+    Frame_setTaskAndType(first, &PhysicalMemory_freeFramesDummyOwner, FrameType_unmapped);
+    Frame_setFreeBlockLength(first, length);
+    Frame_setTaskAndType(&first[length - 1], &PhysicalMemory_freeFramesDummyOwner, FrameType_unmapped);
+    Frame_setFreeBlockLength(&first[length - 1], length);
+}
+
+/** Writes the boundary tags of a free block and links it to the free list for its size. */
+void PhysicalMemoryRegion_insertFreeBlock(PhysicalMemoryRegion *pmr, Frame *first, size_t length) {
+    size_t i = PhysicalMemoryRegion_freeListIndex(length);
+    PhysicalMemoryRegion_writeBoundaryTags(first, length);
+    LinkedList_insertAfter(&first->node, &pmr->freeLists[i]);
+    pmr->nonEmptyFreeLists |= 1u << i;
+}
+
+/** Unlinks a free block from its free list. */
+void PhysicalMemoryRegion_removeFreeBlock(PhysicalMemoryRegion *pmr, Frame *first) {
+    size_t i = PhysicalMemoryRegion_freeListIndex(Frame_getFreeBlockLength(first));
+    LinkedList_remove(&first->node);
+    if (pmr->freeLists[i].next == &pmr->freeLists[i])
+        pmr->nonEmptyFreeLists &= ~(1u << i);
+}
+
+/** Shrinks a free block keeping its first frame, relinking it only if it changes free list. */
+static void PhysicalMemoryRegion_shrinkFreeBlock(PhysicalMemoryRegion *pmr, Frame *first, size_t length) {
+    if (PhysicalMemoryRegion_freeListIndex(length) == PhysicalMemoryRegion_freeListIndex(Frame_getFreeBlockLength(first))) {
+        PhysicalMemoryRegion_writeBoundaryTags(first, length);
+        return;
+    }
+    PhysicalMemoryRegion_removeFreeBlock(pmr, first);
+    PhysicalMemoryRegion_insertFreeBlock(pmr, first, length);
+}
+
+/**
+ * Finds a free block containing count contiguous frames aligned as requested, in constant time.
+ * Blocks in the free lists for sizes of at least count + alignment - 1 frames always fit,
+ * and the smallest of them is picked, approximating best fit. Failing that, the most
+ * recently freed block of the class just below is tried, as it may still fit.
+ */
+static Frame *PhysicalMemoryRegion_findFreeBlock(PhysicalMemoryRegion *pmr, size_t count, size_t alignment) {
+    size_t needed = count + alignment - 1;
+    size_t i = PhysicalMemoryRegion_freeListIndex(needed);
+    bool exact = (needed & (needed - 1)) == 0;
+    uint32_t fitting = (i + 1 < PHYSICALMEMORY_FREE_LIST_COUNT) ? pmr->nonEmptyFreeLists & ~((2u << i) - 1) : 0;
+    if (exact) fitting |= pmr->nonEmptyFreeLists & (1u << i);
+    if (fitting != 0)
+        return Frame_fromNode(pmr->freeLists[__builtin_ctz(fitting)].next);
+    if (exact || i >= PHYSICALMEMORY_FREE_LIST_COUNT || (pmr->nonEmptyFreeLists & (1u << i)) == 0)
+        return NULL;
+    Frame *first = Frame_fromNode(pmr->freeLists[i].next);
+    uintptr_t blockBegin = getFrameNumber(first).v;
+    uintptr_t blockEnd = blockBegin + Frame_getFreeBlockLength(first);
+    return (Frame_getFreeBlockLength(first) >= count && ((blockEnd - count) & ~(alignment - 1)) >= blockBegin) ? first : NULL;
+}
+
+/**
+ * Allocates contiguous frames from the specified region.
+ * The highest suitable frames of the chosen free block are taken, so that its first frame,
+ * linked in a free list, stays in place, and allocating single frames needs no relinking
+ * most of the time.
+ * @param pmr The region to allocate from.
+ * @param task The task to assign the frames to.
+ * @param count Number of frames to allocate, at least 1.
+ * @param alignment Alignment of the first frame number, a power of two number of frames.
+ * @return The frame number of the first allocated frame, or 0 if not enough contiguous memory.
+ */
+FrameNumber PhysicalMemoryRegion_allocateContiguous(PhysicalMemoryRegion *pmr, Task *task, size_t count, size_t alignment) {
+    assert(count > 0);
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    if (UNLIKELY(count > pmr->freeFrameCount))
         return frameNumber(0);
-    Frame *frame = Frame_fromNode(pmr->freeListHead.next);
-    assert(Frame_getTask(frame) == &PhysicalMemory_freeFramesDummyOwner);
-    Frame_setTaskAndType(frame, task, FrameType_unmapped);
-    frame->virtualAddress = makeVirtualAddress(0);
-    LinkedList_remove(pmr->freeListHead.next);
-    pmr->freeFrameCount--;
-    return getFrameNumber(frame);
+    Frame *first = PhysicalMemoryRegion_findFreeBlock(pmr, count, alignment);
+    if (UNLIKELY(first == NULL))
+        return frameNumber(0);
+    assert(Frame_isFree(first));
+    size_t length = Frame_getFreeBlockLength(first);
+    uintptr_t blockBegin = getFrameNumber(first).v;
+    uintptr_t runBegin = (blockBegin + length - count) & ~(alignment - 1);
+    size_t headLength = runBegin - blockBegin;
+    size_t tailLength = length - headLength - count;
+    if (headLength > 0) {
+        PhysicalMemoryRegion_shrinkFreeBlock(pmr, first, headLength);
+    } else {
+        PhysicalMemoryRegion_removeFreeBlock(pmr, first);
+    }
+    Frame *run = first + headLength;
+    if (tailLength > 0)
+        PhysicalMemoryRegion_insertFreeBlock(pmr, run + count, tailLength);
+    for (size_t i = 0; i < count; i++) {
+        Frame_setTaskAndType(&run[i], task, FrameType_unmapped);
+        run[i].virtualAddress = makeVirtualAddress(0);
+    }
+    pmr->freeFrameCount -= count;
+    return frameNumber(runBegin);
+}
+
+FrameNumber PhysicalMemoryRegion_allocate(PhysicalMemoryRegion *pmr, Task *task) {
+    return PhysicalMemoryRegion_allocateContiguous(pmr, task, 1, 1);
+}
+
+/**
+ * Frees contiguous frames of the specified region, coalescing them with the adjacent
+ * free blocks, if any, found in constant time through their boundary tags.
+ */
+void PhysicalMemoryRegion_deallocateContiguous(PhysicalMemoryRegion *pmr, FrameNumber begin, size_t count) {
+    assert(count > 0);
+    assert(begin.v >= pmr->begin.v && begin.v + count <= pmr->end.v);
+    Frame *first = getFrame(begin);
+    for (size_t i = 0; i < count; i++) {
+        assert(!Frame_isFree(&first[i]));
+        first[i].virtualAddress = makeVirtualAddress(0);
+        Frame_setTaskAndType(&first[i], &PhysicalMemory_freeFramesDummyOwner, FrameType_unmapped);
+    }
+    pmr->freeFrameCount += count;
+    size_t length = count;
+    if (begin.v > pmr->begin.v && Frame_isFree(first - 1)) {
+        Frame *previous = first - Frame_getFreeBlockLength(&first[-1]);
+        length += Frame_getFreeBlockLength(previous);
+        PhysicalMemoryRegion_removeFreeBlock(pmr, previous);
+        first = previous;
+    }
+    if (begin.v + count < pmr->end.v && Frame_isFree(first + length)) {
+        Frame *next = first + length;
+        length += Frame_getFreeBlockLength(next);
+        PhysicalMemoryRegion_removeFreeBlock(pmr, next);
+    }
+    PhysicalMemoryRegion_insertFreeBlock(pmr, first, length);
 }
 
 void PhysicalMemoryRegion_deallocate(PhysicalMemoryRegion *pmr, FrameNumber frameNumber) {
-    Frame *frame = getFrame(frameNumber);
-    assert(Frame_getTask(frame) != &PhysicalMemory_freeFramesDummyOwner);
-    frame->virtualAddress = makeVirtualAddress(0);
-    Frame_setTaskAndType(frame, &PhysicalMemory_freeFramesDummyOwner, FrameType_unmapped);
-    LinkedList_insertAfter(&frame->node, &pmr->freeListHead);
-    pmr->freeFrameCount++;
+    PhysicalMemoryRegion_deallocateContiguous(pmr, frameNumber, 1);
 }
 
 
 /******************************************************************************
- * PhysicalMemory
+ * FrameCache
  ******************************************************************************/
 
-FrameNumber PhysicalMemory_allocate(Task *task, PhysicalMemoryRegionType preferredRegion) {
+static PhysicalMemoryRegionType PhysicalMemory_findRegion(FrameNumber frameNumber);
+static FrameNumber PhysicalMemory_allocateNearest(size_t node, size_t firstRank, Task *task, PhysicalMemoryRegionType region, size_t count, size_t alignment);
+
+void FrameCache_initialize(FrameCache *fc) {
+    memzero(fc, sizeof(FrameCache));
+}
+
+/** Moves up to a batch of free frames from the specified region to its magazine, returning the number of frames moved. */
+static size_t FrameCache_refill(FrameCache *fc, PhysicalMemoryRegionType region) {
+    size_t count = fc->count[region];
+    Spinlock_lock(&PhysicalMemory_lock);
+    for (size_t i = 0; i < FRAMECACHE_BATCH; i++) {
+        FrameNumber frameNumber = PhysicalMemoryRegion_allocate(PhysicalMemory_getRegion(fc->node, region), NULL);
+        if (frameNumber.v == 0) break;
+        fc->frames[region][count++] = frameNumber;
+    }
+    Spinlock_unlock(&PhysicalMemory_lock);
+    size_t moved = count - fc->count[region];
+    fc->count[region] = count;
+    return moved;
+}
+
+/** Moves a batch of frames from the magazine of the specified region back to the region. */
+static void FrameCache_drain(FrameCache *fc, PhysicalMemoryRegionType region) {
+    Spinlock_lock(&PhysicalMemory_lock);
+    for (size_t i = 0; i < FRAMECACHE_BATCH; i++)
+        PhysicalMemoryRegion_deallocate(PhysicalMemory_getRegion(fc->node, region), fc->frames[region][--fc->count[region]]);
+    Spinlock_unlock(&PhysicalMemory_lock);
+}
+
+/** Allocates a frame from the magazine of the specified region of the local node only, refilling it if empty. */
+static FrameNumber FrameCache_allocateFromRegion(FrameCache *fc, Task *task, PhysicalMemoryRegionType region) {
+    if (UNLIKELY(fc->count[region] == 0) && FrameCache_refill(fc, region) == 0)
+        return frameNumber(0);
+    FrameNumber frameNumber = fc->frames[region][--fc->count[region]];
+    Frame_setTaskAndType(getFrame(frameNumber), task, FrameType_unmapped);
+    return frameNumber;
+}
+
+/**
+ * Allocates a frame from the magazine of the preferred region, or from lower regions if it is exhausted.
+ * When a region of the local node is exhausted, the same region of the nearest other nodes is tried
+ * under the lock, before falling back to lower regions.
+ * Only the owner CPU shall use the frame cache.
+ */
+FrameNumber FrameCache_allocate(FrameCache *fc, Task *task, PhysicalMemoryRegionType preferredRegion) {
     assert(preferredRegion < physicalMemoryRegionCount);
     for (int i = preferredRegion; i >= 0; i--) {
-        FrameNumber frameNumber = PhysicalMemoryRegion_allocate(&PhysicalMemory_regions[i], task);
+        FrameNumber frameNumber = FrameCache_allocateFromRegion(fc, task, i);
         if (frameNumber.v != 0) return frameNumber;
+        if (PhysicalMemory_nodeCount > 1) {
+            Spinlock_lock(&PhysicalMemory_lock);
+            frameNumber = PhysicalMemory_allocateNearest(fc->node, 1, task, i, 1, 1);
+            Spinlock_unlock(&PhysicalMemory_lock);
+            if (frameNumber.v != 0) return frameNumber;
+        }
     }
     return frameNumber(0);
 }
 
-void PhysicalMemory_deallocate(FrameNumber frameNumber) {
-    for (int i = physicalMemoryRegionCount - 1; i >= 0; i--) {
-        PhysicalMemoryRegion *region = &PhysicalMemory_regions[i];
-        if (frameNumber.v >= region->begin.v) {
-            PhysicalMemoryRegion_deallocate(region, frameNumber);
-            return;
+/**
+ * Adds one more frame, filled with zeros, to the zeroed pool, preferring the highest regions
+ * to spare memory the kernel can access directly, but not below permanently mapped memory.
+ * Called by the idle thread of the owner CPU, with interrupts disabled,
+ * thus the work is bounded to a single frame to keep interrupt latency low.
+ * @return true if the pool is not full yet, false if full or out of memory.
+ */
+bool FrameCache_fillZeroedPool(FrameCache *fc) {
+    if (fc->zeroedCount == FRAMECACHE_ZEROED_CAPACITY) return false;
+    FrameNumber fn = frameNumber(0);
+    for (int i = physicalMemoryRegionCount - 1; i >= permamapMemoryRegion && fn.v == 0; i--)
+        fn = FrameCache_allocateFromRegion(fc, NULL, i);
+    if (fn.v == 0) return false;
+    Cpu_zeroNonTemporal(AddressSpace_mapTemporary(Cpu_getCurrent(), fn), PAGE_SIZE);
+    fc->zeroed[fc->zeroedCount++] = fn;
+    return fc->zeroedCount < FRAMECACHE_ZEROED_CAPACITY;
+}
+
+/**
+ * Frees a single frame to the magazine of its region, or directly to its region
+ * if it belongs to another node. Only the owner CPU shall use the frame cache.
+ */
+void FrameCache_deallocate(FrameCache *fc, FrameNumber frameNumber) {
+    if (UNLIKELY(PhysicalMemory_findNode(frameNumber) != fc->node)) {
+        PhysicalMemory_deallocateContiguous(frameNumber, 1);
+        return;
+    }
+    PhysicalMemoryRegionType region = PhysicalMemory_findRegion(frameNumber);
+    Frame *frame = getFrame(frameNumber);
+    assert(!Frame_isFree(frame));
+    Frame_setTaskAndType(frame, NULL, FrameType_unmapped);
+    frame->virtualAddress = makeVirtualAddress(0);
+    if (UNLIKELY(fc->count[region] == FRAMECACHE_CAPACITY))
+        FrameCache_drain(fc, region);
+    fc->frames[region][fc->count[region]++] = frameNumber;
+}
+
+
+/******************************************************************************
+ * PhysicalMemory
+ ******************************************************************************/
+
+/** Returns the NUMA node the specified frame belongs to. */
+size_t PhysicalMemory_findNode(FrameNumber frameNumber) {
+    for (size_t i = 0; i < PhysicalMemory_nodeRangeCount; i++)
+        if (frameNumber.v >= PhysicalMemory_nodeRanges[i].begin.v && frameNumber.v < PhysicalMemory_nodeRanges[i].end.v)
+            return PhysicalMemory_nodeRanges[i].node;
+    return 0;
+}
+
+/** Returns the type of the region the specified frame belongs to, the same for all nodes. */
+static PhysicalMemoryRegionType PhysicalMemory_findRegion(FrameNumber frameNumber) {
+    for (int i = physicalMemoryRegionCount - 1; i > 0; i--)
+        if (frameNumber.v >= PhysicalMemory_regions[i].begin.v && frameNumber.v < PhysicalMemory_regions[i].end.v) return i;
+    return 0;
+}
+
+/** Returns the NUMA node of the current CPU, or node 0 before frame caches are enabled. */
+static inline size_t PhysicalMemory_getCurrentNode() {
+    return PhysicalMemory_frameCachesEnabled ? Cpu_getCurrent()->frameCache->node : 0;
+}
+
+/**
+ * Allocates contiguous frames from the specified region of the nodes nearest to the specified one,
+ * skipping the first firstRank of them. The lock must be held.
+ */
+static FrameNumber PhysicalMemory_allocateNearest(size_t node, size_t firstRank, Task *task, PhysicalMemoryRegionType region, size_t count, size_t alignment) {
+    FrameNumber result = frameNumber(0);
+    for (size_t i = firstRank; i < PhysicalMemory_nodeCount && result.v == 0; i++)
+        result = PhysicalMemoryRegion_allocateContiguous(PhysicalMemory_getRegion(PhysicalMemory_nodeOrder[node][i], region), task, count, alignment);
+    return result;
+}
+
+/** Allocates a single frame, through the frame cache of the current CPU once enabled. */
+FrameNumber PhysicalMemory_allocate(Task *task, PhysicalMemoryRegionType preferredRegion) {
+    if (PhysicalMemory_frameCachesEnabled)
+        return FrameCache_allocate(Cpu_getCurrent()->frameCache, task, preferredRegion);
+    return PhysicalMemory_allocateContiguous(task, preferredRegion, 1, 1);
+}
+
+/**
+ * Allocates a single frame filled with zeros, such as for user pages.
+ * Frames are taken from the pool zeroed by the idle thread of the current CPU, if not empty
+ * and within the preferred region, otherwise zeroed now. Frames not permanently mapped are
+ * zeroed through temporary mappings, thus they are allocated only once frame caches are enabled,
+ * as both are set up with the per-CPU structures.
+ * @param task The task to assign the frame to.
+ * @param preferredRegion The highest region to allocate from.
+ * @return The frame number of the allocated frame, or 0 if out of memory.
+ */
+FrameNumber PhysicalMemory_allocateZeroed(Task *task, PhysicalMemoryRegionType preferredRegion) {
+    if (!PhysicalMemory_frameCachesEnabled && preferredRegion > permamapMemoryRegion) preferredRegion = permamapMemoryRegion;
+    if (PhysicalMemory_frameCachesEnabled) {
+        FrameCache *fc = Cpu_getCurrent()->frameCache;
+        if (LIKELY(fc->zeroedCount > 0) && fc->zeroed[fc->zeroedCount - 1].v < PhysicalMemory_regions[preferredRegion].end.v) {
+            FrameNumber frameNumber = fc->zeroed[--fc->zeroedCount];
+            Frame_setTaskAndType(getFrame(frameNumber), task, FrameType_unmapped);
+            return frameNumber;
         }
     }
-    assert(false);
+    FrameNumber frameNumber = PhysicalMemory_allocate(task, preferredRegion);
+    if (frameNumber.v != 0)
+        PhysicalMemory_zeroFrames(frameNumber, 1);
+    return frameNumber;
+}
+
+/**
+ * Fills the specified frames with zeros, through temporary mappings of the current CPU
+ * for frames not permanently mapped.
+ */
+void PhysicalMemory_zeroFrames(FrameNumber begin, size_t count) {
+    Cpu *cpu = Cpu_getCurrent();
+    for (size_t i = 0; i < count; i++)
+        memzero(AddressSpace_mapTemporary(cpu, addToFrameNumber(begin, i)), PAGE_SIZE);
+}
+
+/**
+ * Allocates contiguous frames from the preferred region, or from lower regions if it is exhausted.
+ * Each region is tried on the node of the current CPU first, then on the other nodes by distance.
+ * @param task The task to assign the frames to.
+ * @param preferredRegion The highest region to allocate from.
+ * @param count Number of frames to allocate, at least 1.
+ * @param alignment Alignment of the first frame number, a power of two number of frames.
+ * @return The frame number of the first allocated frame, or 0 if not enough contiguous memory.
+ */
+FrameNumber PhysicalMemory_allocateContiguous(Task *task, PhysicalMemoryRegionType preferredRegion, size_t count, size_t alignment) {
+    assert(preferredRegion < physicalMemoryRegionCount);
+    size_t node = PhysicalMemory_getCurrentNode();
+    FrameNumber result = frameNumber(0);
+    Spinlock_lock(&PhysicalMemory_lock);
+    for (int i = preferredRegion; i >= 0 && result.v == 0; i--)
+        result = PhysicalMemory_allocateNearest(node, 0, task, i, count, alignment);
+    Spinlock_unlock(&PhysicalMemory_lock);
+    return result;
+}
+
+/** Frees a single frame, through the frame cache of the current CPU once enabled. */
+void PhysicalMemory_deallocate(FrameNumber frameNumber) {
+    if (PhysicalMemory_frameCachesEnabled)
+        FrameCache_deallocate(Cpu_getCurrent()->frameCache, frameNumber);
+    else
+        PhysicalMemory_deallocateContiguous(frameNumber, 1);
+}
+
+/** Frees contiguous frames allocated with PhysicalMemory_allocateContiguous. */
+void PhysicalMemory_deallocateContiguous(FrameNumber begin, size_t count) {
+    Spinlock_lock(&PhysicalMemory_lock);
+    PhysicalMemoryRegion *pmr = PhysicalMemory_getRegion(PhysicalMemory_findNode(begin), PhysicalMemory_findRegion(begin));
+    PhysicalMemoryRegion_deallocateContiguous(pmr, begin, count);
+    Spinlock_unlock(&PhysicalMemory_lock);
 }
@@ -30,8 +30,32 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define ISADMA_MEMORY_REGION_FRAME_END ((FrameNumber) { 16 << 20 >> PAGE_SHIFT })
 /** Highest possible address of permanently mapped physical memory. */
 #define PERMAMAP_MEMORY_REGION_FRAME_END ((FrameNumber) { 896 << 20 >> PAGE_SHIFT })
-/** The highest possible address for physical memory. */
-#define MAX_PHYSICAL_ADDRESS 0xFFFFF000u // 4 GiB - 4096 bytes
+/** Highest possible address of physical memory addressable with 32 bits. */
+#define OTHER_MEMORY_REGION_FRAME_END ((FrameNumber) { 1 << (32 - PAGE_SHIFT) })
+#ifdef PAE
+/** The highest supported frame number for physical memory, bounding the size of the frame descriptor table. */
+#define MAX_FRAME_NUMBER ((FrameNumber) { 32 << (30 - PAGE_SHIFT) }) // 32 GiB
+#else
+/** The highest supported frame number for physical memory. */
+#define MAX_FRAME_NUMBER ((FrameNumber) { 0xFFFFF }) // 4 GiB - 4096 bytes
+#endif
+/** Maximum number of free frames a per-CPU frame cache holds for each region. */
+#define FRAMECACHE_CAPACITY 64
+/** Number of frames moved at once between a frame cache and a region. */
+#define FRAMECACHE_BATCH (FRAMECACHE_CAPACITY / 2)
+/** Maximum number of frames filled with zeros ahead of time by the idle thread of each CPU. */
+#define FRAMECACHE_ZEROED_CAPACITY 32
+/** Number of free lists of each region, one for each power-of-two class of free block sizes. */
+#ifdef PAE
+#define PHYSICALMEMORY_FREE_LIST_COUNT 23 // blocks of 2^23 frames would exceed 32 GiB
+#else
+#define PHYSICALMEMORY_FREE_LIST_COUNT 20 // blocks of 2^20 frames would exceed 4 GiB
+#endif
+
+/** Maximum number of NUMA nodes, each with its own set of regions. */
+#define PHYSICALMEMORY_MAX_NODES 4
+/** Maximum number of ranges of physical memory assigned to NUMA nodes. */
+#define PHYSICALMEMORY_MAX_NODE_RANGES 16
 
 /** Types of independently managed physical memory regions. */
 typedef enum PhysicalMemoryRegionType {
@@ -40,41 +64,83 @@ typedef enum PhysicalMemoryRegionType {
     /** Memory that is 1:1 permanently mapped in the higher-half virtual address
      * space, with an offset, for data that the kernel needs to access directly. */
     permamapMemoryRegion,
-    /** All other memory, for user mode data. */
+    /** All other memory below 4 GiB, for user mode data. */
     otherMemoryRegion,
+    /** Memory above 4 GiB, only available with PAE, for user mode data. */
+    highMemoryRegion,
     /** Number of supported physical memory regions. */
     physicalMemoryRegionCount
 } PhysicalMemoryRegionType;
 
 typedef struct PhysicalMemoryRegion {
-    LinkedList_Node freeListHead;
+    LinkedList_Node freeLists[PHYSICALMEMORY_FREE_LIST_COUNT]; // free blocks of [2^i, 2^(i+1)) frames
+    uint32_t nonEmptyFreeLists; // bit i set if freeLists[i] is not empty
     FrameNumber begin;
     FrameNumber end;
     size_t freeFrameCount;
 } PhysicalMemoryRegion;
 
+/** Range of physical memory local to a NUMA node, as reported by the ACPI SRAT. */
+typedef struct PhysicalMemoryNodeRange {
+    FrameNumber begin;
+    FrameNumber end;
+    size_t node;
+} PhysicalMemoryNodeRange;
+
 typedef enum FrameType {
     FrameType_unmapped,
     FrameType_user,
     FrameType_capability
 } FrameType;
 
-/** Descriptor of a physical memory frame. */
+/**
+ * Descriptor of a physical memory frame.
+ * Contiguous free frames form free blocks, whose first and last frame descriptors
+ * act as boundary tags, holding the block length, to coalesce blocks in constant time.
+ * The descriptors of the other frames of a free block are only written when allocated.
+ */
 typedef struct Frame {
     uintptr_t taskAndType;
-    VirtualAddress virtualAddress;
-    LinkedList_Node node;
+    VirtualAddress virtualAddress; // length of the free block in the first and last frame of a free block
+    LinkedList_Node node; // links the first frame of a free block in a free list
 } Frame;
 
 static inline Task *Frame_getTask(Frame *frame) { return (Task *) (frame->taskAndType & ~0xF); }
 static inline FrameType Frame_getType(Frame *frame) { return (FrameType) (frame->taskAndType & 0xF); }
 static inline void Frame_setTaskAndType(Frame *frame, Task *task, FrameType frameType) { frame->taskAndType = (uintptr_t) task | frameType; }
+/**
+ * Per-CPU cache of free frames, to allocate and free single frames without
+ * locking the regions. Each region has a magazine of free frames, refilled
+ * from the region when empty and drained to the region when full, a batch
+ * of frames at a time, so that the lock is taken once every batch.
+ */
+struct FrameCache {
+    size_t count[physicalMemoryRegionCount];
+    size_t zeroedCount;
+    size_t node; // NUMA node of the owner CPU, magazines hold frames of this node only
+    FrameNumber frames[physicalMemoryRegionCount][FRAMECACHE_CAPACITY];
+    FrameNumber zeroed[FRAMECACHE_ZEROED_CAPACITY]; // frames already filled with zeros
+};
+
+/** Dummy union to check that a FrameCache fits in the frame allocated for it. */
+union FrameCacheChecker {
+    char frameCacheNotFittingInPage[sizeof(FrameCache) <= PAGE_SIZE];
+};
+
+static inline size_t Frame_getFreeBlockLength(const Frame *frame) { return frame->virtualAddress.v; }
+static inline void Frame_setFreeBlockLength(Frame *frame, size_t length) { frame->virtualAddress.v = length; }
 
 extern Frame *PhysicalMemory_frameDescriptors;
 extern FrameNumber PhysicalMemory_firstFrame;
 extern size_t PhysicalMemory_totalMemoryFrames;
-extern PhysicalMemoryRegion PhysicalMemory_regions[physicalMemoryRegionCount];
+extern PhysicalMemoryRegion PhysicalMemory_regions[PHYSICALMEMORY_MAX_NODES * physicalMemoryRegionCount];
+extern size_t PhysicalMemory_nodeCount;
+extern PhysicalMemoryNodeRange PhysicalMemory_nodeRanges[PHYSICALMEMORY_MAX_NODE_RANGES];
+extern size_t PhysicalMemory_nodeRangeCount;
+extern uint8_t PhysicalMemory_nodeOrder[PHYSICALMEMORY_MAX_NODES][PHYSICALMEMORY_MAX_NODES];
 extern Task PhysicalMemory_freeFramesDummyOwner;
+extern Spinlock PhysicalMemory_lock;
+extern bool PhysicalMemory_frameCachesEnabled;
 
 static inline VirtualAddress makeVirtualAddress(uintptr_t v) { return (VirtualAddress) { v }; }
 static inline VirtualAddress addToVirtualAddress(VirtualAddress va, ptrdiff_t d) { return (VirtualAddress) { va.v + d }; }
@@ -125,15 +191,48 @@ static inline void *frame2virt(FrameNumber frameNumber) {
     return phys2virt(physicalAddress(frameNumber.v << PAGE_SHIFT));
 }
 
+/** Returns the region of the specified type of the specified NUMA node. */
+static inline PhysicalMemoryRegion *PhysicalMemory_getRegion(size_t node, PhysicalMemoryRegionType type) {
+    return &PhysicalMemory_regions[node * physicalMemoryRegionCount + type];
+}
+
+/** Returns true if the specified frame is permanently mapped, thus accessible through frame2virt. */
+static inline bool PhysicalMemory_isPermamapped(FrameNumber frameNumber) {
+    return frameNumber.v < PhysicalMemory_regions[permamapMemoryRegion].end.v;
+}
+
 /** Returns the frame number of the specified permanently mapped virtual address. */
 static inline FrameNumber virt2frame(void *virt) {
     return frameNumber(virt2phys(virt).v >> PAGE_SHIFT);
 }
 
+/**
+ * Returns true if the specified frame is not allocated.
+ * Only reliable for the first and last frame of free blocks, and for allocated frames,
+ * as the descriptors of the other frames of free blocks are not kept up to date.
+ */
+static inline bool Frame_isFree(Frame *frame) {
+    return Frame_getTask(frame) == &PhysicalMemory_freeFramesDummyOwner;
+}
+
 FrameNumber PhysicalMemoryRegion_allocate(PhysicalMemoryRegion *pmr, Task *task);
+FrameNumber PhysicalMemoryRegion_allocateContiguous(PhysicalMemoryRegion *pmr, Task *task, size_t count, size_t alignment);
 void PhysicalMemoryRegion_deallocate(PhysicalMemoryRegion *pmr, FrameNumber frameNumber);
+void PhysicalMemoryRegion_deallocateContiguous(PhysicalMemoryRegion *pmr, FrameNumber begin, size_t count);
+void PhysicalMemoryRegion_insertFreeBlock(PhysicalMemoryRegion *pmr, Frame *first, size_t length);
+void PhysicalMemoryRegion_removeFreeBlock(PhysicalMemoryRegion *pmr, Frame *first);
+
+void FrameCache_initialize(FrameCache *fc);
+FrameNumber FrameCache_allocate(FrameCache *fc, Task *task, PhysicalMemoryRegionType preferredRegion);
+void FrameCache_deallocate(FrameCache *fc, FrameNumber frameNumber);
+bool FrameCache_fillZeroedPool(FrameCache *fc);
 
+size_t PhysicalMemory_findNode(FrameNumber frameNumber);
 FrameNumber PhysicalMemory_allocate(Task *task, PhysicalMemoryRegionType preferredRegion);
+FrameNumber PhysicalMemory_allocateZeroed(Task *task, PhysicalMemoryRegionType preferredRegion);
+FrameNumber PhysicalMemory_allocateContiguous(Task *task, PhysicalMemoryRegionType preferredRegion, size_t count, size_t alignment);
 void PhysicalMemory_deallocate(FrameNumber frameNumber);
+void PhysicalMemory_deallocateContiguous(FrameNumber begin, size_t count);
+void PhysicalMemory_zeroFrames(FrameNumber begin, size_t count);
 
 #endif
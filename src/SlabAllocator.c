@@ -20,53 +20,244 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 SlabAllocator taskAllocator;
 SlabAllocator threadAllocator;
 SlabAllocator channelAllocator;
+SlabAllocator proxyAllocator;
+SlabAllocator magazineAllocator; // magazines for the per-CPU caches of all allocators, protected by its own lock
+
+/*
+ * Each slab is a frame of permanently mapped memory. Its frame descriptor, whose
+ * fields are otherwise unused for kernel memory, links the slab in a list of the
+ * allocator through the node field, and keeps in the virtualAddress field the
+ * number of live items in the low 16 bits, and the offset of the first free item
+ * within the slab in the high 16 bits. Free items of a slab are linked together.
+ */
+
+/** Returns the number of items of the specified slab that are allocated. */
+static inline size_t Slab_getLiveCount(const Frame *slab) {
+    return slab->virtualAddress.v & 0xFFFF;
+}
+
+/** Returns the first free item of the specified slab, only meaningful if the slab is not full. */
+static inline SlabAllocator_FreeItem *Slab_getFreeItems(Frame *slab) {
+    return (SlabAllocator_FreeItem *) ((uint8_t *) frame2virt(getFrameNumber(slab)) + (slab->virtualAddress.v >> 16));
+}
+
+static inline void Slab_set(Frame *slab, size_t liveCount, SlabAllocator_FreeItem *freeItems) {
+    slab->virtualAddress.v = ((uintptr_t) freeItems & (PAGE_SIZE - 1)) << 16 | liveCount;
+}
 
 /**
  * Initializes the specified SlabAllocator for a specified kind of element.
+ * Per-CPU caches are disabled, thus only a CPU at a time shall use the allocator.
  * @param sa Allocator to initialize.
  * @param itemSize Size in bytes of each element managed by the allocator (must be multiple of a proper alignment and 16 bytes).
+ * @param task Task owning the frames of the slabs, or NULL for the kernel.
+ * @param frameType Type the frame descriptors of the slabs are tagged with, to identify the items they contain.
  */
-void SlabAllocator_initialize(SlabAllocator *sa, size_t itemSize, Task *task) {
-    assert((itemSize & 0xF) == 0);
-    sa->freeItems = NULL;
+void SlabAllocator_initialize(SlabAllocator *sa, size_t itemSize, Task *task, FrameType frameType) {
+    assert((itemSize & 0xF) == 0 && itemSize <= PAGE_SIZE);
+    for (size_t i = 0; i < SLAB_PARTIAL_LIST_COUNT; i++)
+        LinkedList_initialize(&sa->partialSlabs[i]);
+    LinkedList_initialize(&sa->emptySlabs);
+    sa->emptySlabCount = 0;
     sa->itemSize = itemSize;
     sa->itemsPerSlab = PAGE_SIZE / itemSize;
-    sa->brk = NULL;
-    sa->limit = NULL;
+    sa->colour = 0;
+    sa->maxColour = (PAGE_SIZE - sa->itemsPerSlab * itemSize) & ~(SLAB_COLOUR_STEP - 1);
+    sa->frameType = frameType;
     sa->task = task;
+    Spinlock_init(&sa->lock);
+    sa->fullMagazines = NULL;
+    sa->emptyMagazines = NULL;
+    sa->cpuCaches = NULL;
+}
+
+/**
+ * Enables per-CPU magazines in front of the specified allocator, so that all CPUs
+ * can use it concurrently, mostly without taking the lock of the allocator.
+ * @param sa Allocator to enable per-CPU caches for.
+ * @param cpuCount Number of CPUs that will use the allocator.
+ * @return 0 on success, or -ENOMEM if out of memory.
+ */
+__attribute__((section(".boot")))
+int SlabAllocator_enableCpuCaches(SlabAllocator *sa, size_t cpuCount) {
+    assert(sa != &magazineAllocator);
+    size_t frameCount = (cpuCount * sizeof(SlabCpuCache) + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    FrameNumber fn = PhysicalMemory_allocateContiguous(NULL, permamapMemoryRegion, frameCount, 1);
+    if (fn.v == 0) return -ENOMEM;
+    SlabCpuCache *cpuCaches = frame2virt(fn);
+    memzero(cpuCaches, frameCount << PAGE_SHIFT);
+    sa->cpuCaches = cpuCaches;
+    return 0;
+}
+
+/** Returns the list a slab with the specified number of live items belongs to, or NULL if the slab is full. */
+static LinkedList_Node *SlabAllocator_getSlabList(SlabAllocator *sa, size_t liveCount) {
+    if (liveCount == 0) return &sa->emptySlabs;
+    if (liveCount == sa->itemsPerSlab) return NULL;
+    return &sa->partialSlabs[liveCount * SLAB_PARTIAL_LIST_COUNT / sa->itemsPerSlab];
+}
+
+/**
+ * Returns a slab with free items, preferring the fullest partially used slab to limit
+ * fragmentation, then an empty slab, and allocating a new one as a last resort.
+ * @return The frame descriptor of the slab, unlinked if it was empty, or NULL if out of memory.
+ */
+static Frame *SlabAllocator_getSlab(SlabAllocator *sa) {
+    for (int i = SLAB_PARTIAL_LIST_COUNT - 1; i >= 0; i--)
+        if (sa->partialSlabs[i].next != &sa->partialSlabs[i])
+            return Frame_fromNode(sa->partialSlabs[i].next);
+    if (sa->emptySlabCount > 0) {
+        Frame *slab = Frame_fromNode(sa->emptySlabs.next);
+        LinkedList_remove(&slab->node);
+        sa->emptySlabCount--;
+        return slab;
+    }
+    FrameNumber fn = PhysicalMemory_allocate(sa->task, permamapMemoryRegion);
+    if (UNLIKELY(fn.v == 0)) return NULL;
+    uint8_t *first = (uint8_t *) frame2virt(fn) + sa->colour; // colours rotate through the bytes left over by the items
+    sa->colour = sa->colour < sa->maxColour ? sa->colour + SLAB_COLOUR_STEP : 0;
+    for (size_t i = 0; i < sa->itemsPerSlab - 1; i++)
+        ((SlabAllocator_FreeItem *) (first + i * sa->itemSize))->next = (SlabAllocator_FreeItem *) (first + (i + 1) * sa->itemSize);
+    ((SlabAllocator_FreeItem *) (first + (sa->itemsPerSlab - 1) * sa->itemSize))->next = NULL;
+    Frame *slab = getFrame(fn);
+    Frame_setTaskAndType(slab, sa->task, sa->frameType);
+    Slab_set(slab, 0, (SlabAllocator_FreeItem *) first);
+    return slab;
+}
+
+/** Allocates an element from the slabs, bypassing per-CPU caches. */
+static void *SlabAllocator_allocateFromSlab(SlabAllocator *sa) {
+    Frame *slab = SlabAllocator_getSlab(sa);
+    if (UNLIKELY(slab == NULL)) return NULL;
+    size_t liveCount = Slab_getLiveCount(slab);
+    SlabAllocator_FreeItem *item = Slab_getFreeItems(slab);
+    Slab_set(slab, liveCount + 1, item->next);
+    LinkedList_Node *oldList = liveCount > 0 ? SlabAllocator_getSlabList(sa, liveCount) : NULL; // empty slabs already unlinked
+    LinkedList_Node *newList = SlabAllocator_getSlabList(sa, liveCount + 1);
+    if (oldList != newList) {
+        if (oldList != NULL) LinkedList_remove(&slab->node);
+        if (newList != NULL) LinkedList_insertAfter(&slab->node, newList);
+    }
+    return item;
+}
+
+/**
+ * Releases an element to its slab, bypassing per-CPU caches.
+ * A slab left without live items is kept as empty slab, or returned to physical memory
+ * if enough empty slabs are kept already.
+ */
+static void SlabAllocator_deallocateToSlab(SlabAllocator *sa, void *item) {
+    Frame *slab = getFrame(virt2frame(item));
+    size_t liveCount = Slab_getLiveCount(slab);
+    assert(liveCount > 0);
+    SlabAllocator_FreeItem *fi = (SlabAllocator_FreeItem *) item;
+    fi->next = Slab_getFreeItems(slab);
+    Slab_set(slab, liveCount - 1, fi);
+    LinkedList_Node *oldList = SlabAllocator_getSlabList(sa, liveCount);
+    LinkedList_Node *newList = SlabAllocator_getSlabList(sa, liveCount - 1);
+    if (oldList == newList) return;
+    if (oldList != NULL) LinkedList_remove(&slab->node);
+    if (newList != &sa->emptySlabs) {
+        LinkedList_insertAfter(&slab->node, newList);
+    } else if (sa->emptySlabCount < SLAB_MAX_EMPTY_SLABS) {
+        LinkedList_insertAfter(&slab->node, newList);
+        sa->emptySlabCount++;
+    } else {
+        Frame_setTaskAndType(slab, sa->task, FrameType_unmapped);
+        PhysicalMemory_deallocate(getFrameNumber(slab));
+    }
+}
+
+/**
+ * Takes an empty magazine from the depot, or allocates a new one.
+ * Called with the lock of the allocator held.
+ * @return The empty magazine, or NULL if out of memory.
+ */
+static SlabMagazine *SlabAllocator_getEmptyMagazine(SlabAllocator *sa) {
+    SlabMagazine *m = sa->emptyMagazines;
+    if (m != NULL) {
+        sa->emptyMagazines = m->next;
+        return m;
+    }
+    Spinlock_lock(&magazineAllocator.lock);
+    m = SlabAllocator_allocateFromSlab(&magazineAllocator);
+    Spinlock_unlock(&magazineAllocator.lock);
+    if (m != NULL) m->rounds = 0;
+    return m;
 }
 
 /**
  * Allocates an element from the slab allocator.
+ * With per-CPU caches enabled, elements are taken from the magazines of the current CPU,
+ * exchanging an empty magazine for a full one from the depot when both are empty.
  * @param sa Allocator to allocate from.
  * @return A pointer to the element, or NULL on failure.
  */
 void *SlabAllocator_allocate(SlabAllocator *sa) {
-    assert(sa->brk <= sa->limit);
-    void *freeItem = (void *) sa->freeItems;
-    if (freeItem != NULL) {
-        sa->freeItems = sa->freeItems->next;
-    } else {
-        if (UNLIKELY(sa->brk == sa->limit)) { // includes the case for brk == limit == NULL for an empty allocator
-            FrameNumber frameNumber = PhysicalMemory_allocate(sa->task, permamapMemoryRegion);
-            if (UNLIKELY(frameNumber.v == 0)) return NULL;
-            void *page = frame2virt(frameNumber);
-            sa->brk = (uint8_t *) page;
-            sa->limit = (uint8_t *) page + sa->itemSize * sa->itemsPerSlab;
+    if (sa->cpuCaches == NULL) return SlabAllocator_allocateFromSlab(sa);
+    SlabCpuCache *cc = &sa->cpuCaches[Cpu_getCurrent()->index];
+    SlabMagazine *m = cc->loaded;
+    if (UNLIKELY(m == NULL || m->rounds == 0)) {
+        if (cc->previous != NULL && cc->previous->rounds > 0) {
+            cc->loaded = cc->previous;
+            cc->previous = m;
+        } else {
+            Spinlock_lock(&sa->lock);
+            SlabMagazine *full = sa->fullMagazines;
+            if (full == NULL) {
+                void *item = SlabAllocator_allocateFromSlab(sa);
+                Spinlock_unlock(&sa->lock);
+                return item;
+            }
+            sa->fullMagazines = full->next;
+            if (cc->previous != NULL) {
+                cc->previous->next = sa->emptyMagazines;
+                sa->emptyMagazines = cc->previous;
+            }
+            Spinlock_unlock(&sa->lock);
+            cc->previous = m;
+            cc->loaded = full;
         }
-        freeItem = sa->brk;
-        sa->brk += sa->itemSize;
+        m = cc->loaded;
     }
-    return freeItem;
+    return m->items[--m->rounds];
 }
 
 /**
  * Releases an element to the appropriate slab allocator.
+ * With per-CPU caches enabled, elements are put in the magazines of the current CPU,
+ * exchanging a full magazine for an empty one from the depot when both are full.
  * @param sa Allocator to release the item to.
  * @param item Item to deallocate (undefined behavior if not allocated from the specified allocator).
  */
 void SlabAllocator_deallocate(SlabAllocator *sa, void *item) {
-    SlabAllocator_FreeItem* fi = (SlabAllocator_FreeItem *) item;
-    fi->next = sa->freeItems;
-    sa->freeItems = fi;
+    if (sa->cpuCaches == NULL) {
+        SlabAllocator_deallocateToSlab(sa, item);
+        return;
+    }
+    SlabCpuCache *cc = &sa->cpuCaches[Cpu_getCurrent()->index];
+    SlabMagazine *m = cc->loaded;
+    if (UNLIKELY(m == NULL || m->rounds == SLAB_MAGAZINE_SIZE)) {
+        if (cc->previous != NULL && cc->previous->rounds == 0) {
+            cc->loaded = cc->previous;
+            cc->previous = m;
+        } else {
+            Spinlock_lock(&sa->lock);
+            SlabMagazine *empty = SlabAllocator_getEmptyMagazine(sa);
+            if (UNLIKELY(empty == NULL)) {
+                SlabAllocator_deallocateToSlab(sa, item);
+                Spinlock_unlock(&sa->lock);
+                return;
+            }
+            if (cc->previous != NULL) {
+                cc->previous->next = sa->fullMagazines;
+                sa->fullMagazines = cc->previous;
+            }
+            Spinlock_unlock(&sa->lock);
+            cc->previous = m;
+            cc->loaded = empty;
+        }
+        m = cc->loaded;
+    }
+    m->items[m->rounds++] = item;
 }
@@ -20,12 +20,32 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "Types.h"
 
-void  SlabAllocator_initialize(SlabAllocator *sa, size_t itemSize, Task *task);
+/** Number of items in a full magazine, so that a magazine takes 64 bytes. */
+#define SLAB_MAGAZINE_SIZE 14
+
+/** A stack of free items, moved as a whole between the per-CPU caches and the depot of an allocator. */
+struct SlabMagazine {
+    SlabMagazine *next; // link in the list of full or empty magazines of the depot
+    size_t rounds; // number of items in the magazine
+    void *items[SLAB_MAGAZINE_SIZE];
+};
+
+/** Magazines of a SlabAllocator owned by a CPU, in a cache line of their own. */
+struct SlabCpuCache {
+    SlabMagazine *loaded; // magazine to allocate from and free to, NULL if none
+    SlabMagazine *previous; // either full, empty or NULL, swapped with the loaded one before going to the depot
+    uint8_t padding[64 - 2 * sizeof(SlabMagazine *)];
+};
+
+void  SlabAllocator_initialize(SlabAllocator *sa, size_t itemSize, Task *task, FrameType frameType);
+int   SlabAllocator_enableCpuCaches(SlabAllocator *sa, size_t cpuCount);
 void *SlabAllocator_allocate  (SlabAllocator *sa);
 void  SlabAllocator_deallocate(SlabAllocator *sa, void *item);
 
 extern SlabAllocator taskAllocator;
 extern SlabAllocator threadAllocator;
 extern SlabAllocator channelAllocator;
+extern SlabAllocator proxyAllocator;
+extern SlabAllocator magazineAllocator;
 
 #endif
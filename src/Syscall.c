@@ -17,7 +17,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 #include "kernel.h"
 
-int Syscall_createChannel(Task *task) {
+/**
+ * Serializes changes to capability spaces and to the rings of capabilities to the same object,
+ * that link capabilities of different tasks, thus a single lock for all of them.
+ */
+static Spinlock Syscall_capabilityLock;
+
+static int Syscall_doCreateChannel(Task *task) {
     Channel *channel = SlabAllocator_allocate(&channelAllocator);
     if (channel == NULL) return -ENOMEM;
     Capability *cap = Task_allocateCapability(task, (uintptr_t) channel | kobjChannel, 0);
@@ -25,20 +31,134 @@ int Syscall_createChannel(Task *task) {
         SlabAllocator_deallocate(&channelAllocator, channel);
         return -ENOMEM;
     }
-    return Task_getCapabilityAddress(cap);
+    return Task_getCapabilityAddress(task, cap);
 }
 
-int Syscall_deleteCapability(Task *task, CapabilityAddress index) {
-    Capability *cap = Task_lookupCapability(task, index);
-    if (cap == NULL) return -EINVAL;
+int Syscall_createChannel(Task *task) {
+    Spinlock_lock(&Syscall_capabilityLock);
+    int res = Syscall_doCreateChannel(task);
+    Spinlock_unlock(&Syscall_capabilityLock);
+    return res;
+}
+
+/**
+ * Copies CPU time statistics of the calling thread to a user buffer.
+ * @param cpu The current CPU.
+ * @param buffer User virtual address of a ThreadStatistics structure, that must be writeable.
+ * @param size Size of the user buffer, at least sizeof(ThreadStatistics).
+ * @return 0 on success, or a negative error code.
+ */
+int Syscall_getThreadStatistics(Cpu *cpu, uintptr_t buffer, size_t size) {
+    if (size < sizeof(ThreadStatistics)) return -EINVAL;
+    Thread *thread = cpu->currentThread;
+    int result = AddressSpace_checkUserRange(thread->task, makeVirtualAddress(buffer), sizeof(ThreadStatistics), true);
+    if (result < 0) return result;
+    Cpu_accountThreadTime(cpu, false);
+    ThreadStatistics statistics;
+    Thread_getStatistics(thread, &cpu->tsc, &statistics);
+    memcpy((void *) buffer, &statistics, sizeof(ThreadStatistics));
+    return 0;
+}
+
+/** Unlinks a capability from the other capabilities to the same object, returning true if it was the last one. */
+static bool Syscall_unlinkCapability(Capability *cap) {
+    bool last = cap->next == cap;
+    cap->prev->next = cap->next;
+    cap->next->prev = cap->prev;
+    cap->prev = cap;
+    cap->next = cap;
+    cap->obj = 0;
+    return last;
+}
+
+/**
+ * Releases the kernel object referenced by a capability, destroying it if that was the last capability to it.
+ * Destroying a proxy releases the forwarded object in turn, iteratively to bound the kernel stack usage.
+ * Objects of other types cannot be destroyed yet, thus they stay alive.
+ */
+static void Syscall_releaseCapability(Capability *cap) {
     KobjType kobjType = Capability_getObjectType(cap);
-    if (kobjType == kobjNone) return -EINVAL;
-    if (cap->next == cap) {
-        switch (kobjType) {
-            default:
-                assert(false);
-        }
+    void *object = Capability_getObject(cap);
+    bool last = kobjType != kobjNone && Syscall_unlinkCapability(cap);
+    while (last && kobjType == kobjProxy) {
+        Proxy *proxy = object;
+        kobjType = Capability_getObjectType(&proxy->cap);
+        object = Capability_getObject(&proxy->cap);
+        last = kobjType != kobjNone && Syscall_unlinkCapability(&proxy->cap);
+        SlabAllocator_deallocate(&proxyAllocator, proxy);
     }
+    if (last && kobjType == kobjChannel) SlabAllocator_deallocate(&channelAllocator, object);
+}
+
+static int Syscall_doDeleteCapability(Task *task, CapabilityAddress index) {
+    Capability *cap = Task_lookupCapability(task, index);
+    if (cap == NULL) return -EINVAL;
+    if (Capability_getObjectType(cap) == kobjNone) return -EINVAL;
+    Syscall_releaseCapability(cap);
     Task_deallocateCapability(task, cap);
     return 0;
 }
+
+int Syscall_deleteCapability(Task *task, CapabilityAddress index) {
+    Spinlock_lock(&Syscall_capabilityLock);
+    int res = Syscall_doDeleteCapability(task, index);
+    Spinlock_unlock(&Syscall_capabilityLock);
+    return res;
+}
+
+static int Syscall_doCreateProxy(Task *task, CapabilityAddress index) {
+    Capability *cap = Task_lookupCapability(task, index);
+    if (cap == NULL || Capability_getObjectType(cap) == kobjNone) return -EINVAL;
+    Proxy *proxy = SlabAllocator_allocate(&proxyAllocator);
+    if (proxy == NULL) return -ENOMEM;
+    Capability *pc = Task_allocateCapability(task, (uintptr_t) proxy | kobjProxy, 0);
+    if (pc == NULL) {
+        SlabAllocator_deallocate(&proxyAllocator, proxy);
+        return -ENOMEM;
+    }
+    proxy->cap.obj = cap->obj;
+    proxy->cap.badge = cap->badge;
+    proxy->cap.prev = cap;
+    proxy->cap.next = cap->next;
+    cap->next->prev = &proxy->cap;
+    cap->next = &proxy->cap;
+    proxy->ownerTask = task;
+    return Task_getCapabilityAddress(task, pc);
+}
+
+/**
+ * Creates a proxy forwarding resolution of the kernel object referenced by a capability, possibly another proxy.
+ * @param task The calling task, that becomes the owner of the proxy.
+ * @param index Capability address of the object to forward.
+ * @return The capability address of the new proxy on success, or a negative error code.
+ */
+int Syscall_createProxy(Task *task, CapabilityAddress index) {
+    Spinlock_lock(&Syscall_capabilityLock);
+    int res = Syscall_doCreateProxy(task, index);
+    Spinlock_unlock(&Syscall_capabilityLock);
+    return res;
+}
+
+static int Syscall_doRevokeProxy(Task *task, CapabilityAddress index) {
+    Capability *cap = Task_lookupCapability(task, index);
+    if (cap == NULL || Capability_getObjectType(cap) != kobjProxy) return -EINVAL;
+    Proxy *proxy = Capability_getObject(cap);
+    if (proxy->ownerTask != task) return -EPERM;
+    Syscall_releaseCapability(&proxy->cap);
+    return 0;
+}
+
+/**
+ * Revokes access to the forwarded object through all capabilities to a proxy, in constant time
+ * regardless of how many capabilities to the proxy have been derived.
+ * The proxy itself is destroyed when the last capability to it is deleted.
+ * @param task The calling task, that must be the owner of the proxy.
+ * @param index Capability address of the proxy.
+ * @return 0 on success, or a negative error code.
+ */
+int Syscall_revokeProxy(Task *task, CapabilityAddress index) {
+    Spinlock_lock(&Syscall_capabilityLock);
+    int res = Syscall_doRevokeProxy(task, index);
+    Spinlock_unlock(&Syscall_capabilityLock);
+    return res;
+}
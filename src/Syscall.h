@@ -28,14 +28,21 @@ enum SyscallNumber {
     syscallReceive,
     syscallReply,
     syscallReplyReceive,
-    syscallYield
+    syscallYield,
+    syscallGetThreadStatistics,
+    syscallDeleteCapability,
+    syscallCreateProxy,
+    syscallRevokeProxy
 };
 
 int Syscall_allocateIpcBuffer(Task *task, uintptr_t virtualAddress);
 int Syscall_createChannel(Task *task);
-int Syscall_deleteCapability(Task *task, PhysicalAddress index);
+int Syscall_deleteCapability(Task *task, CapabilityAddress index);
+int Syscall_createProxy(Task *task, CapabilityAddress index);
+int Syscall_revokeProxy(Task *task, CapabilityAddress index);
 int Syscall_sendMessage(Cpu *cpu, uintptr_t socketCapIndex, uintptr_t endpointCapIndex);
 int Syscall_receiveMessage(Thread *thread, uintptr_t endpointCapIndex, uint8_t *buffer, size_t size);
 int Syscall_readMessage(Thread *thread, uintptr_t messageCapIndex, size_t offset, uint8_t *buffer, size_t size);
+int Syscall_getThreadStatistics(Cpu *cpu, uintptr_t buffer, size_t size);
 
 #endif
@@ -17,16 +17,29 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 #include "kernel.h"
 
-Task *Task_create(Task *ownerTask, uintptr_t *cap) {
+/**
+ * Creates a new task.
+ * @param ownerTask Task to give a capability to the new task, or NULL.
+ * @param cap If ownerTask is not NULL, receives the address of the capability of the owner task.
+ * @param denseCapabilities True to resolve capabilities through a dense CapabilityTable,
+ *        false for a sparse capability space made by a slab allocator.
+ * @return The new task, or NULL if out of memory.
+ */
+Task *Task_create(Task *ownerTask, uintptr_t *cap, bool denseCapabilities) {
     Task *task = SlabAllocator_allocate(&taskAllocator);
     if (task == NULL) return NULL;
     task->ownerTask = ownerTask;
     if (AddressSpace_initialize(task) < 0) return NULL;
-    SlabAllocator_initialize(&task->capabilitySpace, sizeof(Capability), task);
+    if (Clock_mapPage(task) < 0) return NULL;
+    SlabAllocator_initialize(&task->capabilitySpace, sizeof(Capability), task, FrameType_capability);
+    task->capabilityTable.leaves = NULL;
+    if (denseCapabilities && CapabilityTable_initialize(&task->capabilityTable, task) < 0) return NULL;
     task->threadCount = 0;
+    task->kernelMemoryUsage = 0;
+    task->kernelMemoryQuota = (size_t) -1;
     if (ownerTask != NULL) {
         Capability *oc = Task_allocateCapability(ownerTask, (uintptr_t) task | kobjTask, 0);
-        *cap = Task_getCapabilityAddress(oc);
+        *cap = Task_getCapabilityAddress(ownerTask, oc);
     }
     Capability *sc = Task_allocateCapability(task, (uintptr_t) task | kobjTask, 0);
     return task;
@@ -40,9 +53,10 @@ Task *Task_create(Task *ownerTask, uintptr_t *cap) {
  * @return The new capability on success, or NULL on out of memory.
  */
 Capability *Task_allocateCapability(Task *task, uintptr_t obj, uintptr_t badge) {
-    Capability *cap = SlabAllocator_allocate(&task->capabilitySpace);
+    Capability *cap = task->capabilityTable.leaves != NULL
+            ? CapabilityTable_allocate(&task->capabilityTable, task)
+            : SlabAllocator_allocate(&task->capabilitySpace);
     if (UNLIKELY(cap == NULL)) return NULL;
-    // TODO: mark the frame descriptor as slab allocator/capability space.
     cap->obj = obj;
     cap->badge = badge;
     cap->prev = cap;
@@ -50,29 +64,10 @@ Capability *Task_allocateCapability(Task *task, uintptr_t obj, uintptr_t badge)
     return cap;
 }
 
-/**
- * Looks up a capability in the capability space of the specified task.
- * @param task Task to look up the capability into.
- * @param index Index of the capability to look up.
- * @return Pointer to the index-th capability of the task, or NULL index exceeds the size of the capability space.
- */
-Capability *Task_lookupCapability(Task *task, CapabilityAddress address) {
-    FrameNumber frameNumber = floorToFrame(physicalAddress(address.v));
-    if (frameNumber.v >= PhysicalMemory_totalMemoryFrames) return NULL;
-    Frame *frame = getFrame(frameNumber);
-    if (Frame_getTask(frame) != task || Frame_getType(frame) != FrameType_capability) return NULL;
-    return phys2virt(physicalAddress(address.v & ~0xF));
-}
-
-uintptr_t Task_getCapabilityAddress(const Capability *cap) {
-    PhysicalAddress a = virt2phys(cap);
-    assert((a.v & 0xF) == 0);
-    return a.v;
-}
-
 void Task_deallocateCapability(Task *task, Capability *cap) {
     cap->prev->next = cap->next;
     cap->next->prev = cap->prev;
     cap->obj = 0;
-    SlabAllocator_deallocate(&task->capabilitySpace, cap);
+    if (task->capabilityTable.leaves != NULL) CapabilityTable_deallocate(&task->capabilityTable, cap);
+    else SlabAllocator_deallocate(&task->capabilitySpace, cap);
 }
@@ -24,7 +24,11 @@ struct Task {
     Task          *ownerTask;
     AddressSpace   addressSpace;
     SlabAllocator  capabilitySpace;
+    CapabilityTable capabilityTable; // if leaves is not NULL, used instead of capabilitySpace
     size_t         threadCount;
+    size_t         kernelMemoryUsage; // bytes of kernel memory charged to this task
+    size_t         kernelMemoryQuota; // maximum bytes of kernel memory that can be charged to this task
+    uint8_t        padding[4]; // sizeof(Task) must be a multiple of 16 bytes
 };
 
 /**
@@ -73,10 +77,49 @@ static inline unsigned getUntypedByteCount(Word messageHeader) {
     return messageHeader & 0x3F;
 }
 
-Task       *Task_create(Task *ownerTask, uintptr_t *cap);
+/**
+ * Looks up a capability in the capability space of the specified task.
+ * For a sparse capability space, the capability address is the physical address of the capability,
+ * thus the lookup only needs to check the frame descriptor, tagged by the slab allocator of the capability space.
+ * Free slots of the capability space read as capabilities to kobjNone.
+ * @param task Task to look up the capability into.
+ * @param address Capability address to look up.
+ * @return Pointer to the capability, or NULL if the address does not belong to the capability space of the task.
+ */
+static inline Capability *Task_lookupCapability(Task *task, CapabilityAddress address) {
+    if (task->capabilityTable.leaves != NULL) return CapabilityTable_lookup(&task->capabilityTable, address);
+    FrameNumber frameNumber = floorToFrame(physicalAddress(address.v));
+    if (frameNumber.v < PhysicalMemory_firstFrame.v || frameNumber.v >= PhysicalMemory_totalMemoryFrames) return NULL;
+    Frame *frame = getFrame(frameNumber);
+    if (frame->taskAndType != ((uintptr_t) task | FrameType_capability)) return NULL;
+    return phys2virt(physicalAddress(address.v & ~0xF));
+}
+
+/**
+ * Looks up a capability in the capability space of the specified task, following the proxies it
+ * refers to, if any, so that each proxy is an extra indirection to the actual kernel object.
+ * @param task Task to look up the capability into.
+ * @param address Capability address to look up.
+ * @return Pointer to the capability to the actual kernel object, that refers to kobjNone if a proxy
+ *         along the way has been revoked, or NULL if the address does not belong to the capability space of the task.
+ */
+static inline Capability *Task_resolveCapability(Task *task, CapabilityAddress address) {
+    Capability *cap = Task_lookupCapability(task, address);
+    if (cap == NULL) return NULL;
+    while (UNLIKELY(Capability_getObjectType(cap) == kobjProxy)) cap = &((Proxy *) Capability_getObject(cap))->cap;
+    return cap;
+}
+
+/** Returns the capability address of a capability of the specified task, to be passed to user mode. */
+static inline uintptr_t Task_getCapabilityAddress(const Task *task, const Capability *cap) {
+    if (task->capabilityTable.leaves != NULL) return CapabilityTable_getAddress(cap);
+    PhysicalAddress a = virt2phys(cap);
+    assert((a.v & 0xF) == 0);
+    return a.v;
+}
+
+Task       *Task_create(Task *ownerTask, uintptr_t *cap, bool denseCapabilities);
 Capability *Task_allocateCapability(Task *task, uintptr_t obj, uintptr_t badge);
-Capability *Task_lookupCapability(Task *task, CapabilityAddress address);
-uintptr_t   Task_getCapabilityAddress(const Capability *cap);
 void        Task_deallocateCapability(Task *task, Capability *cap);
 
 #endif
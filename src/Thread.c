@@ -35,7 +35,10 @@ int Thread_initialize(Task *task, Thread *thread, unsigned priority, unsigned ni
     thread->timesliceRemaining = Cpu_timesliceLengths[nice];
     thread->threadQueue = NULL;
     thread->cpu = NULL;
-    thread->runningTime = 0;
+    thread->userTime = 0;
+    thread->kernelTime = 0;
+    thread->runCount = 0;
+    thread->migrationCount = 0;
     thread->cpuAffinity = false;
     thread->kernelThread = false;
     thread->stack = NULL;
@@ -52,6 +55,19 @@ int Thread_initialize(Task *task, Thread *thread, unsigned priority, unsigned ni
     return 0;
 }
 
+/**
+ * Fills a statistics structure with the CPU time accounted to the specified thread so far.
+ * @param thread The thread to get statistics of.
+ * @param tsc Calibration of the TSC the accounted time was measured with.
+ * @param statistics Structure to fill.
+ */
+void Thread_getStatistics(const Thread *thread, const Tsc *tsc, ThreadStatistics *statistics) {
+    statistics->userNanoseconds = Tsc_convertLongTicksToNanoseconds(tsc, thread->userTime);
+    statistics->kernelNanoseconds = Tsc_convertLongTicksToNanoseconds(tsc, thread->kernelTime);
+    statistics->runCount = thread->runCount;
+    statistics->migrationCount = thread->migrationCount;
+}
+
 void Thread_destroy(Thread *thread) {
 }
 
@@ -19,6 +19,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define THREAD_H_INCLUDED
 
 #include "Types.h"
+#include "ThreadStatistics.h"
 
 /**
  * Dummy union to check that offsets and size of the ThreadRegisters struct are consistent with constants used in assembly.
@@ -58,5 +59,6 @@ static inline Thread *Thread_fromQueueNode(PriorityQueueNode *n) {
 
 int Thread_initialize(Task *task, Thread *thread, unsigned priority, unsigned nice, uintptr_t entry, uintptr_t stackPointer);
 int Thread_block(Thread *thread, PriorityQueue *queue, bool kernelRestartNeeded);
+void Thread_getStatistics(const Thread *thread, const Tsc *tsc, ThreadStatistics *statistics);
 
 #endif
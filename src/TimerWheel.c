@@ -0,0 +1,204 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "kernel.h"
+
+/*
+ * Hashed hierarchical timer wheel.
+ *
+ * Time is kept in units of 2^TIMERWHEEL_RESOLUTION_SHIFT nanoseconds.
+ * Each level has TIMERWHEEL_SLOTS slots, and a slot of level n spans
+ * 2^(n*TIMERWHEEL_LEVEL_SHIFT) units. A timer is put in the lowest level able
+ * to hold its expiration time, rounded up to the slot granularity, and stays
+ * there until the slot expires: timers never cascade between levels, thus
+ * arming and canceling are O(1). The price is that a timer may expire up to
+ * 1/2^TIMERWHEEL_LEVEL_SHIFT of its delay late, which is fine for timeouts.
+ * Timers farther than the highest level are put in its farthest slot, and
+ * are armed again when that slot expires.
+ *
+ * The clock advances when timers expire and, up to the first non-empty slot,
+ * when timers are armed, as expirations are not processed while the wheel is empty.
+ * Slots of level n only hold times in [clock >> shift, (clock >> shift) + 63],
+ * and a per-level occupancy bitmap allows to find the next non-empty slot
+ * without scanning empty ones. This lets the CPU stay tickless: the LAPIC
+ * timer is programmed to fire only when the next non-empty slot expires.
+ */
+
+static inline unsigned TimerWheel_getLevelShift(unsigned level) {
+    return level * TIMERWHEEL_LEVEL_SHIFT;
+}
+
+/** Returns the index of the least significant bit set of a non-zero value, avoiding libgcc on 32-bit. */
+static inline unsigned TimerWheel_findFirstSet(uint64_t v) {
+    uint32_t low = (uint32_t) v;
+    return (low != 0) ? __builtin_ctz(low) : 32 + __builtin_ctz((uint32_t) (v >> 32));
+}
+
+/** Divides the specified quantity by 2^shift, rounding up. */
+static inline uint64_t TimerWheel_shiftRoundingUp(uint64_t v, unsigned shift) {
+    return (v >> shift) + ((v & ((1ULL << shift) - 1)) != 0);
+}
+
+/** Returns the time in wheel units of the first non-empty slot of the specified level, or UINT64_MAX. */
+static uint64_t TimerWheel_getLevelExpiration(const TimerWheel *tw, unsigned level) {
+    uint64_t occupancy = tw->occupancy[level];
+    if (occupancy == 0) return UINT64_MAX;
+    unsigned shift = TimerWheel_getLevelShift(level);
+    uint64_t levelClock = tw->clock >> shift;
+    unsigned start = levelClock & (TIMERWHEEL_SLOTS - 1);
+    if (start != 0) occupancy = (occupancy >> start) | (occupancy << (TIMERWHEEL_SLOTS - start));
+    return (levelClock + TimerWheel_findFirstSet(occupancy)) << shift;
+}
+
+static void TimerWheel_insert(TimerWheel *tw, Timer *timer) {
+    uint64_t t = TimerWheel_shiftRoundingUp(timer->expiration, TIMERWHEEL_RESOLUTION_SHIFT);
+    if (t < tw->clock) t = tw->clock;
+    unsigned level = 0;
+    uint64_t slotTime = t;
+    while (true) {
+        unsigned shift = TimerWheel_getLevelShift(level);
+        slotTime = TimerWheel_shiftRoundingUp(t, shift);
+        if (slotTime - (tw->clock >> shift) < TIMERWHEEL_SLOTS) break;
+        if (level == TIMERWHEEL_LEVELS - 1) {
+            slotTime = (tw->clock >> shift) + TIMERWHEEL_SLOTS - 1;
+            break;
+        }
+        level++;
+    }
+    unsigned index = slotTime & (TIMERWHEEL_SLOTS - 1);
+    timer->slot = level * TIMERWHEEL_SLOTS + index;
+    LinkedList_insertBefore(&timer->node, &tw->slots[timer->slot]);
+    tw->occupancy[level] |= 1ULL << index;
+    tw->timerCount++;
+}
+
+/**
+ * Advances the clock to the specified time in wheel units, but not past the first non-empty slot,
+ * so that timers armed after an idle period are put in slots as fine as their delay allows.
+ * Non-empty slots are not before the new clock, thus stay within the span of their level.
+ */
+static void TimerWheel_advance(TimerWheel *tw, uint64_t nowUnits) {
+    for (unsigned level = 0; level < TIMERWHEEL_LEVELS; level++) {
+        uint64_t t = TimerWheel_getLevelExpiration(tw, level);
+        if (t < nowUnits) nowUnits = t;
+    }
+    if (nowUnits > tw->clock) tw->clock = nowUnits;
+}
+
+/**
+ * Initializes the specified timer wheel with no timers.
+ * @param tw Timer wheel to initialize.
+ * @param now Current time in nanoseconds.
+ */
+void TimerWheel_initialize(TimerWheel *tw, uint64_t now) {
+    tw->clock = now >> TIMERWHEEL_RESOLUTION_SHIFT;
+    tw->timerCount = 0;
+    for (size_t i = 0; i < TIMERWHEEL_LEVELS; i++)
+        tw->occupancy[i] = 0;
+    for (size_t i = 0; i < TIMERWHEEL_LEVELS * TIMERWHEEL_SLOTS; i++)
+        LinkedList_initialize(&tw->slots[i]);
+}
+
+/**
+ * Arms a timer in O(1), moving it if it is already armed.
+ * @param tw Timer wheel to arm the timer in.
+ * @param timer Timer to arm.
+ * @param expiration Absolute expiration time in nanoseconds, may be in the past.
+ * @param now Current time in nanoseconds, as the clock of the wheel only advances when timers expire.
+ */
+void TimerWheel_arm(TimerWheel *tw, Timer *timer, uint64_t expiration, uint64_t now) {
+    if (Timer_isArmed(timer)) TimerWheel_cancel(tw, timer);
+    TimerWheel_advance(tw, now >> TIMERWHEEL_RESOLUTION_SHIFT);
+    timer->expiration = expiration;
+    TimerWheel_insert(tw, timer);
+}
+
+/** Cancels a timer in O(1). Nothing is done if the timer is not armed. */
+void TimerWheel_cancel(TimerWheel *tw, Timer *timer) {
+    if (!Timer_isArmed(timer)) return;
+    LinkedList_Node *slot = &tw->slots[timer->slot];
+    LinkedList_remove(&timer->node);
+    if (slot->next == slot)
+        tw->occupancy[timer->slot / TIMERWHEEL_SLOTS] &= ~(1ULL << (timer->slot & (TIMERWHEEL_SLOTS - 1)));
+    timer->slot = TIMERWHEEL_NO_SLOT;
+    tw->timerCount--;
+}
+
+/**
+ * Returns the time in nanoseconds the next non-empty slot expires at,
+ * or UINT64_MAX if no timer is armed.
+ */
+uint64_t TimerWheel_getNextExpiration(const TimerWheel *tw) {
+    uint64_t next = UINT64_MAX;
+    for (unsigned level = 0; level < TIMERWHEEL_LEVELS; level++) {
+        uint64_t t = TimerWheel_getLevelExpiration(tw, level);
+        if (t < next) next = t;
+    }
+    return next != UINT64_MAX ? next << TIMERWHEEL_RESOLUTION_SHIFT : UINT64_MAX;
+}
+
+/**
+ * Fires all timers expired at the specified time in a single batch.
+ * Callbacks may arm and cancel timers of the same wheel.
+ * @param tw Timer wheel to process.
+ * @param cpu CPU passed to the timer callbacks.
+ * @param now Current time in nanoseconds.
+ * @return The number of timers fired.
+ */
+size_t TimerWheel_expire(TimerWheel *tw, Cpu *cpu, uint64_t now) {
+    uint64_t nowUnits = now >> TIMERWHEEL_RESOLUTION_SHIFT;
+    size_t firedCount = 0;
+    while (tw->timerCount > 0) {
+        uint64_t next = UINT64_MAX;
+        unsigned nextLevel = 0;
+        for (unsigned level = 0; level < TIMERWHEEL_LEVELS; level++) {
+            uint64_t t = TimerWheel_getLevelExpiration(tw, level);
+            if (t < next) {
+                next = t;
+                nextLevel = level;
+            }
+        }
+        if (next > nowUnits) break;
+        if (next > tw->clock) tw->clock = next;
+        unsigned slotIndex = nextLevel * TIMERWHEEL_SLOTS + ((next >> TimerWheel_getLevelShift(nextLevel)) & (TIMERWHEEL_SLOTS - 1));
+        LinkedList_Node *slot = &tw->slots[slotIndex];
+        LinkedList_Node expired;
+        LinkedList_initialize(&expired);
+        if (slot->next != slot) {
+            expired.next = slot->next;
+            expired.prev = slot->prev;
+            expired.next->prev = &expired;
+            expired.prev->next = &expired;
+            LinkedList_initialize(slot);
+        }
+        tw->occupancy[nextLevel] &= ~(1ULL << (slotIndex & (TIMERWHEEL_SLOTS - 1)));
+        while (expired.next != &expired) {
+            Timer *timer = (Timer *) ((uint8_t *) expired.next - offsetof(Timer, node));
+            LinkedList_remove(&timer->node);
+            timer->slot = TIMERWHEEL_NO_SLOT;
+            tw->timerCount--;
+            if (timer->expiration > now) {
+                TimerWheel_insert(tw, timer); // farther than the highest level
+            } else {
+                timer->callback(cpu, timer);
+                firedCount++;
+            }
+        }
+    }
+    if (nowUnits > tw->clock) tw->clock = nowUnits;
+    return firedCount;
+}
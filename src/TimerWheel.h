@@ -0,0 +1,55 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef TIMERWHEEL_H_INCLUDED
+#define TIMERWHEEL_H_INCLUDED
+
+#include "Types.h"
+#include "PhysicalMemory.h"
+
+/** Dummy union to check the size of a TimerWheel and that it fits in the frame allocated for it. */
+union TimerWheelChecker {
+    char wrongSize[sizeof(TimerWheel) == 3132];
+    char timerWheelNotFittingInPage[sizeof(TimerWheel) <= PAGE_SIZE];
+};
+
+/** Initializes the specified timer as not armed. */
+static inline void Timer_initialize(Timer *timer, TimerCallback callback) {
+    timer->node.prev = NULL;
+    timer->node.next = NULL;
+    timer->expiration = 0;
+    timer->callback = callback;
+    timer->slot = TIMERWHEEL_NO_SLOT;
+}
+
+/** Returns true if the specified timer is waiting for expiration in a timer wheel. */
+static inline bool Timer_isArmed(const Timer *timer) {
+    return timer->slot != TIMERWHEEL_NO_SLOT;
+}
+
+/** Returns true if no timer is armed in the specified timer wheel. */
+static inline bool TimerWheel_isEmpty(const TimerWheel *tw) {
+    return tw->timerCount == 0;
+}
+
+void     TimerWheel_initialize(TimerWheel *tw, uint64_t now);
+void     TimerWheel_arm(TimerWheel *tw, Timer *timer, uint64_t expiration, uint64_t now);
+void     TimerWheel_cancel(TimerWheel *tw, Timer *timer);
+uint64_t TimerWheel_getNextExpiration(const TimerWheel *tw);
+size_t   TimerWheel_expire(TimerWheel *tw, Cpu *cpu, uint64_t now);
+
+#endif
@@ -17,25 +17,85 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 #include "kernel.h"
 
-/** Calibrates the TSC of the current CPU using the ACPI Power Management timer as a reference. */
+/** Returns true if the TSC of the current CPU runs at a constant rate in all ACPI P-, C- and T-states. */
+__attribute__((section(".boot")))
+static bool Tsc_isInvariant() {
+    uint32_t a, b, c, d;
+    Cpu_cpuid(0x80000000, &a, &b, &c, &d);
+    if (a < 0x80000007) return false;
+    Cpu_cpuid(0x80000007, &a, &b, &c, &d);
+    return (d & CpuPowerManagementEdx_invariantTsc) != 0;
+}
+
+/** Initializes the TSC of the current CPU, detecting whether it is invariant. It must be calibrated before use. */
 void __attribute__((section(".boot"))) Tsc_initialize(Tsc *tsc) {
-    unsigned acpiTicks = ACPI_PMTIMER_FREQUENCY / 8;
-    uint64_t initial = Tsc_read();
-    unsigned realAcpiTicks = AcpiPmTimer_busyWait(acpiTicks);
-    uint64_t final = Tsc_read();
-    if (final - initial > UINT32_MAX) {
+    tsc->nsPerTick = 0;
+    tsc->ticksPerNs = 0;
+    tsc->usPerTick = 0;
+    tsc->offset = 0;
+    tsc->invariant = Tsc_isInvariant();
+}
+
+/**
+ * Calibrates the TSC of the current CPU from the specified count of ticks
+ * measured in the specified number of nanoseconds of the reference clock.
+ */
+void __attribute__((section(".boot"))) Tsc_calibrate(Tsc *tsc, uint64_t ticks, uint32_t ns) {
+    if (ticks > UINT32_MAX) {
         panic("TSC way too fast!\n");
     }
-    uint32_t tscDiff = final - initial;
-    Log_printf("TSC calibrated from %d ACPI PM Timer ticks. Diff=%d.\n", realAcpiTicks, tscDiff);
+    uint32_t tscDiff = ticks;
+    Log_printf("TSC calibrated over %d ns. Diff=%d.\n", ns, tscDiff);
     /* Compute the coefficients to convert between TSC ticks and nanoseconds.
      * For the nsPerTick coefficient, a shift of at most 20 allows frequencies as low as 500 KHz.
      * For the ticksPerNs coefficient, a shift of at most 23 allows frequencies as high as 500 GHz.
      */
-    tsc->nsPerTick = div(292935555ULL * realAcpiTicks + tscDiff - 1, tscDiff); // 10^9*2^20/ACPI_PMTIMER_FREQUENCY
-    tsc->usPerTick = div(1199864032ULL * realAcpiTicks + tscDiff - 1, tscDiff); // 10^6*2^32/ACPI_PMTIMER_FREQUENCY
-    tsc->ticksPerNs = div(30027ULL * tscDiff + realAcpiTicks - 1, realAcpiTicks); // 2^23*ACPI_PMTIMER_FREQUENCY/10^9
-    Log_printf("TSC calibration: nsPerTick=0x%08X >> 20, usPerTick=0x%08X >> 32, ticksPerNs=0x%08X >> 23.\n", tsc->nsPerTick, tsc->usPerTick, tsc->ticksPerNs);
+    tsc->nsPerTick = div(((uint64_t) ns << 20) + tscDiff - 1, tscDiff);
+    tsc->usPerTick = div(mul(ns, 4294967) + tscDiff - 1, tscDiff); // 2^32/10^3
+    tsc->ticksPerNs = div(((uint64_t) tscDiff << 23) + ns - 1, ns);
+    Log_printf("TSC calibration: nsPerTick=0x%08X >> 20, usPerTick=0x%08X >> 32, ticksPerNs=0x%08X >> 23, invariant=%d.\n", tsc->nsPerTick, tsc->usPerTick, tsc->ticksPerNs, tsc->invariant);
+}
+
+/** Reuses the calibration of the TSC of another CPU, running at the same rate, for the TSC of the current CPU. */
+void __attribute__((section(".boot"))) Tsc_copyCalibration(Tsc *tsc, const Tsc *other) {
+    tsc->nsPerTick = other->nsPerTick;
+    tsc->ticksPerNs = other->ticksPerNs;
+    tsc->usPerTick = other->usPerTick;
+}
+
+/** Starts a new estimate of the offset between the TSC of the current CPU and the TSC of another CPU. */
+void __attribute__((section(".boot"))) Tsc_initializeSkewEstimate(TscSkewEstimate *e) {
+    e->bestRoundTrip = UINT64_MAX;
+    e->offset = 0;
+}
+
+/**
+ * Refines a skew estimate with a value of the reference TSC, read by another CPU
+ * after the local TSC value before and before the local TSC value after.
+ * Assuming the reference TSC has been read in the middle of the round trip,
+ * the error is at most half the round trip, thus the shortest round trip wins.
+ */
+void __attribute__((section(".boot"))) Tsc_addSkewSample(TscSkewEstimate *e, uint64_t before, uint64_t reference, uint64_t after) {
+    uint64_t roundTrip = after - before;
+    if (roundTrip >= e->bestRoundTrip) return;
+    e->bestRoundTrip = roundTrip;
+    e->offset = reference - (before + (roundTrip >> 1));
+}
+
+/**
+ * Sets the offset of the TSC of the current CPU from the specified skew estimate.
+ * Offsets within the error of the estimate are not distinguishable from zero,
+ * in which case the TSCs are considered synchronized and no compensation is applied.
+ * @return true if the TSC is synchronized with the reference TSC.
+ */
+bool __attribute__((section(".boot"))) Tsc_applySkewEstimate(Tsc *tsc, const TscSkewEstimate *e) {
+    if (e->bestRoundTrip == UINT64_MAX) {
+        tsc->offset = 0;
+        return false;
+    }
+    uint64_t distance = ((int64_t) e->offset < 0) ? -e->offset : e->offset;
+    tsc->offset = (distance <= (e->bestRoundTrip >> 1)) ? 0 : e->offset;
+    return tsc->offset == 0;
 }
 
 /**
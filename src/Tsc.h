@@ -26,6 +26,31 @@ static inline uint64_t Tsc_convertTicksToNanoseconds(const Tsc *tsc, uint32_t ti
     return mul(ticks, tsc->nsPerTick) >> 20;
 }
 
+/** Converts the specified number of nanoseconds to count of ticks of the TSC. */
+static inline uint64_t Tsc_convertNanosecondsToTicks(const Tsc *tsc, uint32_t ns) {
+    return mul(ns, tsc->ticksPerNs) >> 23;
+}
+
+/** Converts the specified full 64-bit count of ticks of the TSC to nanoseconds. */
+static inline uint64_t Tsc_convertLongTicksToNanoseconds(const Tsc *tsc, uint64_t ticks) {
+    return (mul(ticks >> 32, tsc->nsPerTick) << 12) + (mul((uint32_t) ticks, tsc->nsPerTick) >> 20);
+}
+
+/** Returns the current value of the TSC, compensated to match the TSC of the bootstrap processor. */
+static inline uint64_t Tsc_readSynchronized(const Tsc *tsc) {
+    return Tsc_read() + tsc->offset;
+}
+
+/** Returns the current value of the TSC, compensated to match the TSC of the bootstrap processor, converted to nanoseconds. */
+static inline uint64_t Tsc_readNanoseconds(const Tsc *tsc) {
+    return Tsc_convertLongTicksToNanoseconds(tsc, Tsc_readSynchronized(tsc));
+}
+
 __attribute__((section(".boot"))) void Tsc_initialize(Tsc *tsc);
+__attribute__((section(".boot"))) void Tsc_calibrate(Tsc *tsc, uint64_t ticks, uint32_t ns);
+__attribute__((section(".boot"))) void Tsc_copyCalibration(Tsc *tsc, const Tsc *other);
+__attribute__((section(".boot"))) void Tsc_initializeSkewEstimate(TscSkewEstimate *e);
+__attribute__((section(".boot"))) void Tsc_addSkewSample(TscSkewEstimate *e, uint64_t before, uint64_t reference, uint64_t after);
+__attribute__((section(".boot"))) bool Tsc_applySkewEstimate(Tsc *tsc, const TscSkewEstimate *e);
 
 #endif
@@ -53,12 +53,18 @@ __attribute__((noreturn)) void panic(const char *format, ...);
 #define UNLIKELY(x) __builtin_expect((x), 0)
 /** Max number of pages per task for TLB invalidation of individual pages (invlpg) before switching to full TLB invalidation. */
 #define TASK_MAX_TLB_SHOOTDOWN_PAGES 8
+/** The absolute maximum number of CPUs supported. */
+#define MAX_CPU_COUNT 1024
 
 typedef struct Task Task;
 typedef struct Capability Capability;
 typedef struct Thread Thread;
 typedef struct Cpu Cpu;
 typedef struct CpuNode CpuNode;
+typedef struct FrameCache FrameCache;
+typedef struct AddressSpace AddressSpace;
+typedef struct SlabMagazine SlabMagazine;
+typedef struct SlabCpuCache SlabCpuCache;
 typedef struct { uintptr_t v; } CapabilityAddress;
 typedef struct { uintptr_t v; } PhysicalAddress;
 typedef struct { uintptr_t v; } VirtualAddress;
@@ -170,13 +176,28 @@ typedef struct SlabAllocator_FreeItem {
     struct SlabAllocator_FreeItem *next;
 } SlabAllocator_FreeItem;
 
+/** Number of lists of partially used slabs of each slab allocator, by increasing occupancy. */
+#define SLAB_PARTIAL_LIST_COUNT 4
+/** Number of slabs without live items each slab allocator keeps before returning them to physical memory. */
+#define SLAB_MAX_EMPTY_SLABS 1
+/** Granularity of the offset of the first item of each slab, to map items of different slabs to different cache sets. */
+#define SLAB_COLOUR_STEP 64
+
 typedef struct SlabAllocator {
-    SlabAllocator_FreeItem *freeItems;
+    LinkedList_Node partialSlabs[SLAB_PARTIAL_LIST_COUNT]; // slabs with both live and free items, partialSlabs[i] in the i-th quarter of occupancy
+    LinkedList_Node emptySlabs; // slabs without live items, kept to avoid freeing and allocating a frame repeatedly
+    size_t emptySlabCount;
     size_t itemSize;
     size_t itemsPerSlab;
-    uint8_t *brk;
-    uint8_t *limit;
+    uint16_t colour; // offset of the first item in the next new slab
+    uint16_t maxColour; // largest offset leaving room for itemsPerSlab items, a multiple of SLAB_COLOUR_STEP
+    uint8_t  frameType; // FrameType the frame descriptor of each slab is tagged with, along with the task
+    uint8_t  padding[3];
     Task    *task;
+    Spinlock lock; // protects the slab layer and the depot, only used with per-CPU caches
+    SlabMagazine *fullMagazines; // depot of full magazines
+    SlabMagazine *emptyMagazines; // depot of empty magazines
+    SlabCpuCache *cpuCaches; // per-CPU magazines indexed by Cpu.index, NULL for an allocator used by a single CPU at a time
 } SlabAllocator;
 
 
@@ -270,13 +291,16 @@ struct Thread {
     unsigned priority; // Nominal priority level, the higher the level the higher the priority
     PriorityQueue *threadQueue; // The queue this thread is currently in (NULL if delayed or running)
     unsigned timesliceRemaining; // in nanoseconds
-    uint64_t runningTime; // Total CPU time since thread start, in microseconds
+    uint64_t userTime; // CPU time spent in user mode since thread start, in TSC ticks
+    uint64_t kernelTime; // CPU time spent in the kernel on behalf of this thread, in TSC ticks
+    uint32_t runCount; // number of times this thread has been switched to
+    uint32_t migrationCount; // number of times this thread has been switched to on a different CPU than the last one
     bool cpuAffinity;
     bool kernelThread;
     bool kernelRestartNeeded;
     uint8_t *stack; // for kernel-mode threads
     ThreadRegisters *regs; // for user-mode threads points to regsBuf, for kernel-mode threads points to bottom of the stack
-    ThreadRegisters regsBuf; // for user-mode threads and the idle thread of each CPU
+    ThreadRegisters regsBuf; // for user-mode threads
     Endpoint endpoint;
     Channel channel;
     uint8_t padding[12]; // sizeof(Thread) must be a multiple of 16 bytes
@@ -299,7 +323,9 @@ typedef enum KobjType {
     /** Capability refers to a communication Channel. */
     kobjChannel,
     /** Capability refers to a communication Endpoint. */
-    kobjEndpoint
+    kobjEndpoint,
+    /** Capability refers to a Proxy forwarding resolution of another kernel object. */
+    kobjProxy
 } KobjType;
 
 /**
@@ -326,6 +352,86 @@ static inline void *Capability_getObject(const Capability *cap) {
     return (void *) (cap->obj & ~0xF);
 }
 
+/**
+ * Kernel object forwarding resolution of another kernel object, possibly another proxy.
+ * The proxy holds a capability to the forwarded object, linked to the other capabilities
+ * to that object, thus revoking all capabilities to the proxy is deleting that capability.
+ */
+typedef struct Proxy {
+    Capability cap; // capability to the forwarded object, to kobjNone once revoked
+    Task *ownerTask; // the only task allowed to revoke the proxy
+    uintptr_t padding[3];
+} Proxy;
+
+/** Log2 of the number of entries in each leaf page of a CapabilityTable. */
+#define CAPABILITYTABLE_LEAF_SHIFT 7
+#define CAPABILITYTABLE_LEAF_ENTRIES (1 << CAPABILITYTABLE_LEAF_SHIFT)
+/** Log2 of the maximum number of entries of a CapabilityTable, with one directory page of leaf pointers. */
+#define CAPABILITYTABLE_INDEX_BITS 17
+/** Bits of the generation of each entry, so that capability addresses stay positive on 32-bit. */
+#define CAPABILITYTABLE_GENERATION_BITS 10
+
+/** Slot of a CapabilityTable, 32 bytes. */
+typedef struct CapabilityTableEntry {
+    Capability cap; // must be the first member, cap.next links free entries
+    uint32_t generation; // incremented when the entry is freed, to invalidate stale capability addresses
+    uint32_t index;
+    uint32_t padding[2];
+} CapabilityTableEntry;
+
+/**
+ * Dense capability space of a task, a two-level radix table indexed by small integers.
+ * 16 bytes, so that it can be embedded in a Task.
+ */
+typedef struct CapabilityTable {
+    CapabilityTableEntry **leaves; // directory page of leaf pages, NULL if the task uses a sparse capability space
+    CapabilityTableEntry *freeEntries;
+    size_t leafCount;
+    size_t padding;
+} CapabilityTable;
+
+
+/******************************************************************************
+ * Timers
+ ******************************************************************************/
+
+/** Log2 of the resolution of a timer wheel in nanoseconds (about 131 us). */
+#define TIMERWHEEL_RESOLUTION_SHIFT 17
+/** Log2 of the number of slots per level of a timer wheel. */
+#define TIMERWHEEL_SLOT_SHIFT 6
+#define TIMERWHEEL_SLOTS (1 << TIMERWHEEL_SLOT_SHIFT)
+/** Log2 of the granularity ratio between adjacent levels of a timer wheel. */
+#define TIMERWHEEL_LEVEL_SHIFT 3
+#define TIMERWHEEL_LEVELS 6
+/** Value of Timer.slot for timers not armed. */
+#define TIMERWHEEL_NO_SLOT 0xFFFF
+
+typedef struct Timer Timer;
+
+/** Function called on the CPU owning a timer wheel when a timer expires. */
+typedef void (*TimerCallback)(Cpu *cpu, Timer *timer);
+
+/** A one-shot timer, to be embedded in the object to be notified. 24 bytes. */
+struct Timer {
+    LinkedList_Node node; // links the timer in a slot of a TimerWheel
+    uint64_t expiration; // absolute expiration time in nanoseconds
+    TimerCallback callback;
+    uint16_t slot; // index in TimerWheel.slots, or TIMERWHEEL_NO_SLOT if not armed
+    uint16_t padding;
+};
+
+/**
+ * Hashed hierarchical timer wheel, one per CPU (3132 bytes).
+ * Level n has TIMERWHEEL_SLOTS slots each spanning 2^(n*TIMERWHEEL_LEVEL_SHIFT)
+ * units of 2^TIMERWHEEL_RESOLUTION_SHIFT nanoseconds.
+ */
+typedef struct TimerWheel {
+    uint64_t clock; // time of the last expiration processing, in wheel units
+    size_t timerCount;
+    uint64_t occupancy[TIMERWHEEL_LEVELS]; // bit i set if slot i of the level is not empty
+    LinkedList_Node slots[TIMERWHEEL_LEVELS * TIMERWHEEL_SLOTS];
+} TimerWheel;
+
 
 /******************************************************************************
  * CPU
@@ -335,8 +441,16 @@ typedef struct Tsc {
     uint32_t nsPerTick; // <<20 on 32-bit
     uint32_t ticksPerNs; // <<23 on 32-bit
     uint32_t usPerTick; // <<32 on 32-bit
+    uint64_t offset; // added (modulo 2^64) to the local TSC to match the TSC of the bootstrap processor
+    bool     invariant; // runs at a constant rate in all ACPI P-, C- and T-states
 } Tsc;
 
+/** Estimate of the offset between the local TSC and the TSC of another CPU, refined by ping-pong samples. */
+typedef struct TscSkewEstimate {
+    uint64_t bestRoundTrip; // shortest round trip in local TSC ticks, UINT64_MAX if no samples
+    uint64_t offset; // to add (modulo 2^64) to the local TSC, as measured in the shortest round trip
+} TscSkewEstimate;
+
 typedef struct LapicTimer {
     uint64_t currentNanoseconds;
     uint64_t nextExpirationNanoseconds;
@@ -344,9 +458,22 @@ typedef struct LapicTimer {
     uint32_t maxTicks;
     uint32_t nsPerTick; // <<20 on 32-bit
     uint32_t ticksPerNs; // <<23 on 32-bit
+    bool     tscDeadlineMode; // armed by writing absolute TSC values to msrTscDeadline, no calibration needed
 } LapicTimer;
 
+#ifdef PAE
+typedef uint64_t PageTableEntry;
+#else
 typedef uint32_t PageTableEntry;
+#endif
+
+/** Per-CPU slots of kernel virtual memory to temporarily map frames not permanently mapped. 16 bytes. */
+typedef struct TemporaryMappings {
+    PageTableEntry *slots; // page table entries of the slots, in permanently mapped page tables
+    uintptr_t       begin; // virtual address of the first slot
+    size_t          count;
+    size_t          next; // index of the slot to use for the next mapping
+} TemporaryMappings;
 
 typedef struct CpuDescriptor {
     uint32_t word0;
@@ -418,12 +545,19 @@ struct Cpu {
     uint64_t      lastScheduleTime; // used to compute time elapsed by the current thread
     uint64_t      scheduleArrival; // value of CpuNode.scheduleOrder when this CPU was scheduled
     // Cache line boundary
-    LapicTimer    lapicTimer; // 32 bytes
-    Tsc           tsc; // 12 bytes
+    LapicTimer    lapicTimer; // 36 bytes
+    Tsc           tsc; // 24 bytes
     PriorityQueue readyQueue; // per-CPU ready threads, 12 bytes
+    TimerWheel   *timerWheel; // per-CPU timers, allocated in a frame of its own
+    FrameCache   *frameCache; // per-CPU free frames, allocated in a frame of its own
+    TemporaryMappings temporaryMappings; // 16 bytes
+    uint64_t      lastAccountingTime; // TSC value when CPU time was last charged to the current thread
+    AddressSpace *addressSpace; // address space loaded into CR3, left loaded when switching to kernel threads
+    Word          addressSpaceGeneration; // AddressSpace.generation when addressSpace was loaded or last flushed
+    uint32_t      padding2[2];
     CpuDescriptor gdt[gdtEntryCount]; // 56 bytes
     Tss           tss; // 104 bytes
-    Thread        idleThread; // 320 bytes
+    Thread        idleThread; // 336 bytes
     uint8_t       stack[CPU_STACK_SIZE];
     uint8_t       padding1[12];
     AtomicWord    initialized; // true when boot is completed
@@ -446,11 +580,20 @@ typedef struct IsrTableEntry {
     void* param;
 } IsrTableEntry;
 
-typedef struct AddressSpace {
-    PageTableEntry root;
-    size_t tlbShootdownPageCount;
+/** Set of CPUs, as bits indexed by Cpu.index, updated with atomic operations. */
+typedef struct CpuMask {
+    AtomicWord words[MAX_CPU_COUNT / 32];
+} CpuMask;
+
+struct AddressSpace {
+    uintptr_t root; // physical address of the top level page table, as loaded into CR3
+    size_t tlbShootdownPageCount; // pages unmapped or remapped since the last TLB shootdown
     VirtualAddress tlbShootdownPages[TASK_MAX_TLB_SHOOTDOWN_PAGES];
     LinkedList_Node shootdownFrameListHead;
-} AddressSpace;
+    size_t batchDepth; // TLB shootdowns are deferred to AddressSpace_endBatch while not zero
+    CpuMask activeCpus; // CPUs running threads of this task, to be interrupted for TLB shootdowns
+    AtomicWord generation; // incremented on each TLB shootdown, so that CPUs not interrupted flush on return
+    Spinlock lock; // serializes mapping reserved pages on page faults
+};
 
 #endif
@@ -17,6 +17,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 #include "kernel.h"
 
+/** NUMA node of each processor by Local APIC ID, from the ACPI SRAT if any. */
+uint8_t Acpi_lapicNodes[256];
+
 __attribute__((section(".boot")))
 uint16_t Acpi_readPm1Status() {
     uint16_t a = 0;
@@ -99,20 +102,48 @@ static const AcpiRootSystemDescPointer *Acpi_searchRootSystemDescriptorPointer()
 __attribute__((section(".boot")))
 void *Acpi_mapToTemporaryArea(PhysicalAddress address, int tempAreaIndex) {
     VirtualAddress virtualAddress = AddressSpace_getTemporaryMappingArea(tempAreaIndex);
-    ptrdiff_t offset = address.v & 0x3FFFFF;
-    uintptr_t base = address.v & ~0x3FFFFF;
-    int pageNumber = virtualAddress.v >> 22;
-    PageTable *pd = (PageTable *) &Boot_kernelPageDirectory;
+    ptrdiff_t offset = address.v & (LARGE_PAGE_SIZE - 1);
+    uintptr_t base = address.v & ~(LARGE_PAGE_SIZE - 1);
+    PageTableEntry *pde = AddressSpace_getKernelPageDirectoryEntry(virtualAddress);
     PageTableEntry pte = base | ptLargePage | ptPresent;
-    if (pd->entries[pageNumber] != pte) {
-        pd->entries[pageNumber] = pte;
-        pd->entries[pageNumber + 1] = (base + 0x400000) | ptLargePage | ptPresent;
-        AddressSpace_invalidateTlbAddress(virtualAddress);
-        AddressSpace_invalidateTlbAddress(addToVirtualAddress(virtualAddress, 0x400000));
+    if (*pde != pte) {
+        for (size_t i = 0; i < TEMPORARY_MAPPING_AREA_SIZE / LARGE_PAGE_SIZE; i++) {
+            pde[i] = (base + i * LARGE_PAGE_SIZE) | ptLargePage | ptPresent;
+            AddressSpace_invalidateTlbAddress(addToVirtualAddress(virtualAddress, i * LARGE_PAGE_SIZE));
+        }
     }
     return (void *) (virtualAddress.v + offset);
 }
 
+/**
+ * Reads the NUMA node of processors and memory ranges from the SRAT.
+ * Nodes are numbered as proximity domains, those not supported are merged into node 0.
+ */
+__attribute__((section(".boot")))
+static void Acpi_parseSrat(const AcpiSrat *srat) {
+    const uint8_t *end = (const uint8_t *) srat + srat->header.length;
+    for (const uint8_t *p = srat->entries; p + 2 <= end && p[1] >= 2 && p + p[1] <= end; p += p[1]) {
+        if (p[0] == acpiSratProcessorAffinity && p[1] >= sizeof(AcpiSratProcessorAffinity)) {
+            const AcpiSratProcessorAffinity *pa = (const AcpiSratProcessorAffinity *) p;
+            if ((pa->flags & 1) == 0) continue;
+            uint32_t domain = pa->proximityDomainLow | pa->proximityDomainHigh[0] << 8
+                    | pa->proximityDomainHigh[1] << 16 | (uint32_t) pa->proximityDomainHigh[2] << 24;
+            Acpi_lapicNodes[pa->apicId] = (domain < PHYSICALMEMORY_MAX_NODES) ? domain : 0;
+            Log_printf("    Processor with LAPIC ID 0x%02X in proximity domain %u.\n", pa->apicId, domain);
+        } else if (p[0] == acpiSratMemoryAffinity && p[1] >= sizeof(AcpiSratMemoryAffinity)) {
+            const AcpiSratMemoryAffinity *ma = (const AcpiSratMemoryAffinity *) p;
+            if ((ma->flags & 1) == 0) continue;
+            uint64_t beginFrame = (ma->baseAddress + PAGE_SIZE - 1) >> PAGE_SHIFT;
+            uint64_t endFrame = (ma->baseAddress + ma->rangeLength) >> PAGE_SHIFT;
+            if (endFrame > MAX_FRAME_NUMBER.v) endFrame = MAX_FRAME_NUMBER.v;
+            Log_printf("    Memory at 0x%08X%08X, %u MiB, in proximity domain %u.\n", (uint32_t) (ma->baseAddress >> 32),
+                    (uint32_t) ma->baseAddress, (uint32_t) (ma->rangeLength >> 20), ma->proximityDomain);
+            if (beginFrame < endFrame)
+                PhysicalMemory_addNodeRange(frameNumber(beginFrame), frameNumber(endFrame), ma->proximityDomain);
+        }
+    }
+}
+
 __attribute__((section(".boot")))
 void Acpi_doFindConfig(PhysicalAddress rsdtPhysicalAddress, void *(*mapToTemporaryArea)(PhysicalAddress address, int tempAreaIndex)) {
     const AcpiRootSystemDescTable *rsdt = mapToTemporaryArea(rsdtPhysicalAddress, 0);
@@ -132,6 +163,13 @@ void Acpi_doFindConfig(PhysicalAddress rsdtPhysicalAddress, void *(*mapToTempora
                     &Acpi_hpet, Acpi_hpet.eventTimerBlockId,
                     (uint32_t) (Acpi_hpet.baseAddress.address >> 32), (uint32_t) Acpi_hpet.baseAddress.address,
                     Acpi_hpet.hpetNumber, Acpi_hpet.minimumClockTick, Acpi_hpet.pageProtection);
+        } else if (header->signature == ACPI_SRAT_SIGNATURE) {
+            Acpi_parseSrat((const AcpiSrat *) header);
+        } else if (header->signature == ACPI_SLIT_SIGNATURE) {
+            const AcpiSlit *slit = (const AcpiSlit *) header;
+            Log_printf("    %u localities.\n", (uint32_t) slit->localityCount);
+            if (slit->localityCount <= 0xFF && sizeof(AcpiSlit) + slit->localityCount * slit->localityCount <= slit->header.length)
+                PhysicalMemory_initializeNodeOrder(slit->entries, slit->localityCount);
         }
     }
     if (Acpi_fadt.header.signature != ACPI_FADT_SIGNATURE)
@@ -41,9 +41,59 @@ typedef struct AcpiRootSystemDescTable {
     uint32_t entries[]; // physical address of table entries, count derived from header.length
 } __attribute__((packed)) AcpiRootSystemDescTable;
 
+/** ACPI System Resource Affinity Table, assigning processors and memory to NUMA proximity domains. */
+typedef struct AcpiSrat {
+    AcpiDescriptionHeader header; // signature='SRAT'
+    uint32_t reserved1;
+    uint64_t reserved2;
+    uint8_t entries[]; // static resource allocation structures, up to header.length
+} __attribute__((packed)) AcpiSrat;
+
+/** Types of the static resource allocation structures of the SRAT. */
+typedef enum AcpiSratEntryType {
+    acpiSratProcessorAffinity = 0,
+    acpiSratMemoryAffinity = 1
+} AcpiSratEntryType;
+
+/** SRAT structure assigning a processor, by Local APIC ID, to a proximity domain. */
+typedef struct AcpiSratProcessorAffinity {
+    uint8_t type; // acpiSratProcessorAffinity
+    uint8_t length; // 16
+    uint8_t proximityDomainLow; // bits 7..0 of the proximity domain
+    uint8_t apicId;
+    uint32_t flags; // bit 0 set if enabled
+    uint8_t localSapicEid;
+    uint8_t proximityDomainHigh[3]; // bits 31..8 of the proximity domain
+    uint32_t clockDomain;
+} __attribute__((packed)) AcpiSratProcessorAffinity;
+
+/** SRAT structure assigning a range of physical memory to a proximity domain. */
+typedef struct AcpiSratMemoryAffinity {
+    uint8_t type; // acpiSratMemoryAffinity
+    uint8_t length; // 40
+    uint32_t proximityDomain;
+    uint16_t reserved1;
+    uint64_t baseAddress;
+    uint64_t rangeLength;
+    uint32_t reserved2;
+    uint32_t flags; // bit 0 set if enabled
+    uint64_t reserved3;
+} __attribute__((packed)) AcpiSratMemoryAffinity;
+
+/** ACPI System Locality Information Table, with the relative distance between proximity domains. */
+typedef struct AcpiSlit {
+    AcpiDescriptionHeader header; // signature='SLIT'
+    uint64_t localityCount;
+    uint8_t entries[]; // localityCount * localityCount distances, 10 for the same domain
+} __attribute__((packed)) AcpiSlit;
+
 #define ACPI_RSDT_SIGNATURE 0x54445352
 #define ACPI_FADT_SIGNATURE 0x50434146 // yes, this is actually FACP
 #define ACPI_HPET_SIGNATURE 0x54455048
+#define ACPI_SRAT_SIGNATURE 0x54415253
+#define ACPI_SLIT_SIGNATURE 0x54494C53
+
+extern uint8_t Acpi_lapicNodes[256];
 
 const AcpiRootSystemDescPointer *Acpi_doSearchRootSystemDescriptorPointer(PhysicalAddress begin, PhysicalAddress end);
 void *Acpi_mapToTemporaryArea(PhysicalAddress address, int tempAreaIndex);
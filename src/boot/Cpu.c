@@ -45,13 +45,19 @@ static void Cpu_setupGlobalDescriptorTable(Cpu *cpu) {
     SegmentDescriptor_set(&cpu->gdt[kernelGS >> 3], (uint32_t) cpu, sizeof(Cpu) - 1, 0x409200); // byte granular, 32-bit, 32-bit, writable
 }
 
+/**
+ * Sets up the idle thread of the specified CPU to start at Cpu_idleThreadFunction
+ * on the specified stack of PAGE_SIZE bytes, like any other kernel-mode thread.
+ */
 __attribute__((section(".boot")))
-static void Cpu_setupIdleThread(Cpu *cpu) {
+static void Cpu_setupIdleThread(Cpu *cpu, uint8_t *stack) {
     cpu->idleThread.threadFunction = Cpu_idleThreadFunction;
     cpu->idleThread.cpu = cpu;
     cpu->idleThread.priority = THREAD_IDLE_PRIORITY;
     cpu->idleThread.queueNode.key = THREAD_IDLE_PRIORITY;
-    cpu->idleThread.regs = &cpu->idleThread.regsBuf;
+    cpu->idleThread.stack = stack;
+    cpu->idleThread.regs = (ThreadRegisters *) (stack + PAGE_SIZE) - 1; // after iret, esp points to regs->esp
+    memzero(cpu->idleThread.regs, sizeof(ThreadRegisters));
     cpu->idleThread.kernelThread = true;
     cpu->idleThread.regs->gs = kernelGS;
     cpu->idleThread.regs->eip = (uint32_t) cpu->idleThread.threadFunction;
@@ -61,7 +67,7 @@ static void Cpu_setupIdleThread(Cpu *cpu) {
 }
 
 __attribute__((section(".boot")))
-static void Cpu_initialize(Cpu *cpu, size_t index, size_t lapicId) {
+static void Cpu_initialize(Cpu *cpu, size_t index, size_t lapicId, uint8_t *idleThreadStack) {
     memzero(cpu, sizeof(Cpu));
     cpu->index = index;
     cpu->lapicId = lapicId;
@@ -69,7 +75,7 @@ static void Cpu_initialize(Cpu *cpu, size_t index, size_t lapicId) {
     cpu->cpuNode = &CpuNode_theInstance;
     cpu->active = true;
     Cpu_setupGlobalDescriptorTable(cpu);
-    Cpu_setupIdleThread(cpu);
+    Cpu_setupIdleThread(cpu, idleThreadStack);
     cpu->currentThread = &cpu->idleThread;
     cpu->nextThread = cpu->currentThread;
     cpu->tss.ss0 = flatKernelDS;
@@ -85,7 +91,24 @@ typedef struct DescriptorTableLocation {
     uint32_t base;
 } DescriptorTableLocation;
 
-/** Loads the GDT (from the specified CPU structure), IDT, TSS and sysenter registers for the current processor. */
+#ifdef PAE
+/** Enables the no-execute page protection on the current processor, if supported. */
+__attribute__((section(".boot")))
+static void Cpu_enableNoExecute() {
+    uint32_t a, b, c, d;
+    Cpu_cpuid(0x80000000, &a, &b, &c, &d);
+    if (a < 0x80000001) return;
+    Cpu_cpuid(0x80000001, &a, &b, &c, &d);
+    if ((d & (1 << 20)) == 0) return;
+    Cpu_writeMsr(CPU_MSR_EFER, Cpu_readMsr(CPU_MSR_EFER) | CPU_EFER_NXE);
+    AddressSpace_noExecute = ptNoExecute;
+}
+#endif
+
+/**
+ * Loads the GDT (from the specified CPU structure), IDT, TSS and sysenter registers for the current processor.
+ * With PAE, also enables the no-execute page protection.
+ */
 __attribute__((section(".boot")))
 void Cpu_loadCpuTables(Cpu *cpu) {
     DescriptorTableLocation gdtLocation = { .limit = gdtEntryCount * 8 - 1, .base = (uint32_t) cpu->gdt };
@@ -109,6 +132,9 @@ void Cpu_loadCpuTables(Cpu *cpu) {
     Cpu_writeMsr(msrSysenterEip, (uintptr_t) &Cpu_sysenter);
     Cpu_writeMsr(msrSysenterEsp, (uintptr_t) &cpu->tss.esp0);
     Cpu_writeGs(kernelGS);
+#ifdef PAE
+    Cpu_enableNoExecute();
+#endif
     uint32_t a, b, c, d;
     Cpu_cpuid(1, &a, &b, &c, &d);
     Video_printf("Cpu %d features: eax=0x%08X, ebx=0x%08X, ecx=0x%08X, edx=0x%08X.\n", cpu->lapicId, a, b, c, d);
@@ -116,16 +142,43 @@ void Cpu_loadCpuTables(Cpu *cpu) {
 
 __attribute__((section(".boot")))
 static void Cpu_mapLocalApic(const MpConfigHeader *mpConfigHeader) {
-    PageTable *pd = (PageTable *) &Boot_kernelPageDirectory;
+    VirtualAddress lapicVirtualAddress = makeVirtualAddress(CPU_LAPIC_VIRTUAL_ADDRESS);
     FrameNumber ptFrameNumber = PhysicalMemory_allocate(NULL, permamapMemoryRegion);
     if (ptFrameNumber.v == 0)
         panic("Unable to allocate memory to map the Local APIC.");
     PageTable *pt = frame2virt(ptFrameNumber);
-    pd->entries[CPU_LAPIC_VIRTUAL_ADDRESS >> 22] = (ptFrameNumber.v << PAGE_SHIFT) | ptPresent | ptWriteable;
-    pt->entries[(CPU_LAPIC_VIRTUAL_ADDRESS >> 12) & 0x3FF] =
+    *AddressSpace_getKernelPageDirectoryEntry(lapicVirtualAddress) = AddressSpace_makeEntry(ptFrameNumber, ptPresent | ptWriteable);
+    pt->entries[AddressSpace_getPageTableIndex(lapicVirtualAddress)] =
             ((mpConfigHeader != NULL) ? mpConfigHeader->lapicPhysicalAddress : CPU_LAPIC_DEFAULT_PHYSICAL_ADDRESS.v) | ptPresent | ptWriteable | ptGlobal | ptCacheDisable;
 }
 
+/**
+ * Allocates the page tables mapping the per-CPU temporary mapping slots
+ * and splits the slots evenly among all CPUs.
+ */
+__attribute__((section(".boot")))
+static void Cpu_initializeTemporaryMappings() {
+    const size_t pageTableCount = TEMPORARY_MAPPING_SLOTS_SIZE >> LARGE_PAGE_SHIFT;
+    FrameNumber ptFrameNumber = PhysicalMemory_allocateContiguous(NULL, permamapMemoryRegion, pageTableCount, 1);
+    if (ptFrameNumber.v == 0)
+        panic("Unable to allocate memory for temporary mappings.");
+    PageTableEntry *slots = frame2virt(ptFrameNumber);
+    memzero(slots, pageTableCount * PAGE_SIZE);
+    for (size_t i = 0; i < pageTableCount; i++) {
+        VirtualAddress va = makeVirtualAddress(TEMPORARY_MAPPING_SLOTS_BEGIN + i * LARGE_PAGE_SIZE);
+        *AddressSpace_getKernelPageDirectoryEntry(va) = AddressSpace_makeEntry(addToFrameNumber(ptFrameNumber, i), ptPresent | ptWriteable);
+    }
+    size_t slotsPerCpu = (TEMPORARY_MAPPING_SLOTS_SIZE >> PAGE_SHIFT) / Cpu_cpuCount;
+    for (size_t i = 0; i < Cpu_cpuCount; i++) {
+        Cpu_cpus[i]->temporaryMappings = (TemporaryMappings) {
+            .slots = slots + i * slotsPerCpu,
+            .begin = TEMPORARY_MAPPING_SLOTS_BEGIN + i * slotsPerCpu * PAGE_SIZE,
+            .count = slotsPerCpu,
+            .next = 0
+        };
+    }
+}
+
 typedef struct CpuInitializationClosure {
     int currentLapicId;
     Cpu *bootCpu;
@@ -140,7 +193,21 @@ static void Cpu_allocateAndInitialize(void *closure, int lapicId) {
         panic("Unable to allocate memory for CPU %d. Aborting.\n", Cpu_cpuCount);
     Cpu_cpus[Cpu_cpuCount] = frame2virt(frameNumber);
     Cpu *cpu = Cpu_cpus[Cpu_cpuCount];
-    Cpu_initialize(cpu, Cpu_cpuCount, lapicId); // TODO: cp->lapicVersion?
+    frameNumber = PhysicalMemory_allocate(NULL, permamapMemoryRegion);
+    if (frameNumber.v == 0)
+        panic("Unable to allocate the idle thread stack for CPU %d. Aborting.\n", Cpu_cpuCount);
+    Cpu_initialize(cpu, Cpu_cpuCount, lapicId, frame2virt(frameNumber)); // TODO: cp->lapicVersion?
+    frameNumber = PhysicalMemory_allocate(NULL, permamapMemoryRegion);
+    if (frameNumber.v == 0)
+        panic("Unable to allocate the timer wheel for CPU %d. Aborting.\n", Cpu_cpuCount);
+    cpu->timerWheel = frame2virt(frameNumber);
+    TimerWheel_initialize(cpu->timerWheel, 0);
+    frameNumber = PhysicalMemory_allocate(NULL, permamapMemoryRegion);
+    if (frameNumber.v == 0)
+        panic("Unable to allocate the frame cache for CPU %d. Aborting.\n", Cpu_cpuCount);
+    cpu->frameCache = frame2virt(frameNumber);
+    FrameCache_initialize(cpu->frameCache);
+    cpu->frameCache->node = Acpi_lapicNodes[lapicId & 0xFF];
     if (cpuInitializationClosure->currentLapicId == lapicId)
         cpuInitializationClosure->bootCpu = cpu;
     Cpu_cpuCount++;
@@ -164,6 +231,7 @@ Cpu *Cpu_initializeCpuStructs(const MpConfigHeader *mpConfigHeader) {
         Cpu_allocateAndInitialize(&closure, closure.currentLapicId);
     if (closure.bootCpu == NULL)
         panic("Unable to identify the boot CPU. Aborting\n");
+    Cpu_initializeTemporaryMappings();
     Video_printf("Found %u enabled CPUs.\n", Cpu_cpuCount);
     CpuNode_theInstance.cpus = Cpu_cpus;
     CpuNode_theInstance.cpuCount = Cpu_cpuCount;
@@ -186,6 +254,219 @@ void Cpu_setupInterruptDescriptorTable() {
                        (uintptr_t) &Cpu_spuriousInterruptHandler, access);
 }
 
+/**
+ * Runs in a tight loop until at least the specified number of nanoseconds have elapsed,
+ * using the HPET as a reference clock if available, otherwise the ACPI PM Timer.
+ * @return The number of nanoseconds actually passed according to the reference clock.
+ */
+__attribute__((section(".boot")))
+uint32_t Cpu_busyWaitNanoseconds(uint32_t ns) {
+    if (Hpet_theInstance.available)
+        return Hpet_convertTicksToNanoseconds(Hpet_busyWait(Hpet_convertNanosecondsToTicks(ns)));
+    unsigned acpiTicks = mul(ns, 3843512) >> 30; // 2^30*ACPI_PMTIMER_FREQUENCY/10^9
+    return mul(AcpiPmTimer_busyWait(acpiTicks), 292935555) >> 20; // 10^9*2^20/ACPI_PMTIMER_FREQUENCY
+}
+
+/**
+ * Busy waits for a time long enough to calibrate other clocks against the reference clock.
+ * The window is shorter with the HPET, thanks to its higher resolution and memory mapped access.
+ * @return The number of nanoseconds actually passed according to the reference clock.
+ */
+__attribute__((section(".boot")))
+uint32_t Cpu_busyWaitCalibrationWindow() {
+    return Cpu_busyWaitNanoseconds(Hpet_theInstance.available ? CPU_HPET_CALIBRATION_NANOSECONDS : CPU_PMTIMER_CALIBRATION_NANOSECONDS);
+}
+
+/** Window of the reference clock shared by application processors calibrating their timers at the same time. */
+typedef struct CpuCalibrationWindow {
+    AtomicWord generation; // odd while the window is open
+    AtomicWord waitingCpus; // number of CPUs waiting for the next window
+    uint32_t nanoseconds; // length of the last closed window according to the reference clock
+} CpuCalibrationWindow;
+
+static CpuCalibrationWindow Cpu_calibrationWindow;
+/** The CPU whose timers have been calibrated first, used as a reference by other CPUs. */
+static const Cpu *Cpu_referenceCpu;
+
+/** Counts of TSC and LAPIC Timer ticks elapsed in a calibration window. */
+typedef struct CpuTimerMeasurement {
+    uint64_t tscBegin;
+    uint64_t tscEnd;
+    uint32_t lapicTimerDiff;
+    uint32_t nanoseconds;
+} CpuTimerMeasurement;
+
+__attribute__((section(".boot")))
+static void Cpu_beginTimerMeasurement(Cpu *cpu, CpuTimerMeasurement *m) {
+    if (!cpu->lapicTimer.tscDeadlineMode)
+        LapicTimer_startCalibration();
+    m->tscBegin = Tsc_read();
+}
+
+__attribute__((section(".boot")))
+static void Cpu_endTimerMeasurement(Cpu *cpu, CpuTimerMeasurement *m, uint32_t ns) {
+    m->tscEnd = Tsc_read();
+    m->lapicTimerDiff = cpu->lapicTimer.tscDeadlineMode ? 0 : LapicTimer_stopCalibration();
+    m->nanoseconds = ns;
+}
+
+/**
+ * Measures the timers of the current CPU during the next window opened by
+ * the bootstrap processor with Cpu_serveCalibrationWindow, so that all
+ * application processors calibrate concurrently against the same busy wait
+ * on the reference clock.
+ */
+__attribute__((section(".boot")))
+static void Cpu_measureTimersInSharedWindow(Cpu *cpu, CpuTimerMeasurement *m) {
+    CpuCalibrationWindow *w = &Cpu_calibrationWindow;
+    AtomicWord_increment(&w->waitingCpus);
+    while (true) {
+        Word g;
+        while (((g = AtomicWord_get(&w->generation)) & 1) != 0) Cpu_relax();
+        while (AtomicWord_get(&w->generation) == g) Cpu_relax();
+        Cpu_beginTimerMeasurement(cpu, m);
+        if (AtomicWord_get(&w->generation) != g + 1) continue; // missed the opening
+        while (AtomicWord_get(&w->generation) == g + 1) Cpu_relax();
+        Cpu_endTimerMeasurement(cpu, m, w->nanoseconds);
+        if (AtomicWord_get(&w->generation) == g + 2) break; // otherwise missed the closing
+    }
+    AtomicWord_decrement(&w->waitingCpus);
+}
+
+/**
+ * Opens and closes a calibration window on the reference clock if any
+ * application processor is waiting for one.
+ * Called by the bootstrap processor while waiting for other CPUs to boot.
+ */
+__attribute__((section(".boot")))
+void Cpu_serveCalibrationWindow() {
+    CpuCalibrationWindow *w = &Cpu_calibrationWindow;
+    if (AtomicWord_get(&w->waitingCpus) == 0) return;
+    AtomicWord_increment(&w->generation);
+    w->nanoseconds = Cpu_busyWaitCalibrationWindow();
+    AtomicWord_increment(&w->generation);
+}
+
+/**
+ * Checks the specified count of ticks measured in the specified number of nanoseconds
+ * against a ticksPerNs coefficient (<<23) within a tolerance of 1/2^CPU_CALIBRATION_TOLERANCE_SHIFT.
+ */
+__attribute__((section(".boot")))
+bool Cpu_matchesCalibration(uint64_t ticks, uint32_t ns, uint32_t ticksPerNs) {
+    uint64_t expected = mul(ns, ticksPerNs) >> 23;
+    uint64_t error = (ticks > expected) ? ticks - expected : expected - ticks;
+    return error <= (expected >> CPU_CALIBRATION_TOLERANCE_SHIFT);
+}
+
+/**
+ * Reuses the calibration of the reference CPU for the timers of the current CPU,
+ * if both have an invariant TSC and the same LAPIC Timer mode, and a short
+ * measurement confirms that both the TSC and the LAPIC bus clock run at the same rate.
+ * @return true if the calibration has been reused.
+ */
+__attribute__((section(".boot")))
+static bool Cpu_reuseTimerCalibration(Cpu *cpu, const Cpu *reference) {
+    if (!cpu->tsc.invariant || !reference->tsc.invariant) return false;
+    if (cpu->lapicTimer.tscDeadlineMode != reference->lapicTimer.tscDeadlineMode) return false;
+    CpuTimerMeasurement m;
+    Cpu_beginTimerMeasurement(cpu, &m);
+    uint32_t ns = Cpu_busyWaitNanoseconds(CPU_CROSSCHECK_NANOSECONDS);
+    Cpu_endTimerMeasurement(cpu, &m, ns);
+    if (!Cpu_matchesCalibration(m.tscEnd - m.tscBegin, ns, reference->tsc.ticksPerNs)) return false;
+    if (!cpu->lapicTimer.tscDeadlineMode && !Cpu_matchesCalibration(m.lapicTimerDiff, ns, reference->lapicTimer.ticksPerNs)) return false;
+    Tsc_copyCalibration(&cpu->tsc, &reference->tsc);
+    if (!cpu->lapicTimer.tscDeadlineMode)
+        LapicTimer_copyCalibration(&cpu->lapicTimer, &reference->lapicTimer);
+    Log_printf("CPU #%d reuses the timer calibration of CPU #%d.\n", cpu->index, reference->index);
+    return true;
+}
+
+/**
+ * Initializes and calibrates the TSC and the LAPIC Timer of the current CPU.
+ * The first CPU calling this, that is the bootstrap processor, measures both
+ * timers in a single busy wait on the reference clock, and becomes the reference
+ * for other CPUs. Other CPUs reuse its calibration after a short cross-check if
+ * possible, otherwise they measure their timers in a shared calibration window.
+ */
+__attribute__((section(".boot")))
+void Cpu_calibrateTimers(Cpu *cpu) {
+    Tsc_initialize(&cpu->tsc);
+    LapicTimer_initialize(&cpu->lapicTimer);
+    const Cpu *reference = Cpu_referenceCpu;
+    CpuTimerMeasurement m;
+    if (reference == NULL) {
+        Cpu_beginTimerMeasurement(cpu, &m);
+        uint32_t ns = Cpu_busyWaitCalibrationWindow();
+        Cpu_endTimerMeasurement(cpu, &m, ns);
+    } else if (Cpu_reuseTimerCalibration(cpu, reference)) {
+        return;
+    } else {
+        Cpu_measureTimersInSharedWindow(cpu, &m);
+    }
+    Tsc_calibrate(&cpu->tsc, m.tscEnd - m.tscBegin, m.nanoseconds);
+    if (!cpu->lapicTimer.tscDeadlineMode)
+        LapicTimer_calibrate(&cpu->lapicTimer, m.lapicTimerDiff, m.nanoseconds);
+    if (reference == NULL)
+        Cpu_referenceCpu = cpu;
+}
+
+/** Cache line bouncing between the bootstrap processor and one application processor to measure TSC skew. */
+typedef struct CpuTscSyncLine {
+    AtomicWord sequence; // odd while the application processor waits for a timestamp
+    uint64_t referenceTsc; // TSC of the bootstrap processor, written before making the sequence even
+} __attribute__((aligned(64))) CpuTscSyncLine;
+
+static CpuTscSyncLine Cpu_tscSyncLine;
+/** Index plus one of the application processor measuring its TSC skew, or zero if none. */
+static AtomicWord Cpu_tscSyncOwner;
+
+/**
+ * Measures the skew between the TSC of the current CPU, that is an application
+ * processor, and the TSC of the bootstrap processor, by ping-ponging timestamps
+ * served by Cpu_serveTscSynchronization, and stores the offset to compensate it.
+ * Must be called after the TSC has been initialized by Cpu_calibrateTimers.
+ */
+__attribute__((section(".boot")))
+void Cpu_synchronizeTsc(Cpu *cpu) {
+    while (!AtomicWord_compareAndSet(&Cpu_tscSyncOwner, 0, cpu->index + 1)) Cpu_relax();
+    CpuTscSyncLine *line = &Cpu_tscSyncLine;
+    TscSkewEstimate e;
+    Tsc_initializeSkewEstimate(&e);
+    for (size_t i = 0; i < CPU_TSC_SYNC_ROUNDS; i++) {
+        uint64_t before = Tsc_read();
+        AtomicWord_increment(&line->sequence);
+        while ((AtomicWord_get(&line->sequence) & 1) != 0) Cpu_relax();
+        uint64_t after = Tsc_read();
+        Tsc_addSkewSample(&e, before, line->referenceTsc, after);
+    }
+    bool synchronized = Tsc_applySkewEstimate(&cpu->tsc, &e);
+    Log_printf("CPU #%d TSC %s the bootstrap processor (round trip %d ticks, offset 0x%016llX).\n",
+            cpu->index, synchronized ? "synchronized with" : "compensated to match",
+            (int) e.bestRoundTrip, cpu->tsc.offset);
+    AtomicWord_set(&Cpu_tscSyncOwner, 0);
+}
+
+/**
+ * Replies with timestamps to the application processor measuring its TSC skew, if any,
+ * and makes the TSC unusable in user mode if the result is not a synchronized invariant TSC.
+ * Called by the bootstrap processor while waiting for other CPUs to boot.
+ */
+__attribute__((section(".boot")))
+void Cpu_serveTscSynchronization() {
+    Word owner = AtomicWord_get(&Cpu_tscSyncOwner);
+    if (owner == 0) return;
+    CpuTscSyncLine *line = &Cpu_tscSyncLine;
+    for (size_t i = 0; i < CPU_TSC_SYNC_ROUNDS; i++) {
+        while ((AtomicWord_get(&line->sequence) & 1) == 0) Cpu_relax();
+        line->referenceTsc = Tsc_read();
+        AtomicWord_increment(&line->sequence);
+    }
+    while (AtomicWord_get(&Cpu_tscSyncOwner) == owner) Cpu_relax();
+    const Cpu *cpu = Cpu_cpus[owner - 1];
+    if (!cpu->tsc.invariant || cpu->tsc.offset != 0)
+        Clock_reportUnsynchronizedTsc();
+}
+
 __attribute__((section(".boot")))
 void Cpu_startOtherCpus() {
     // Relocate the real-mode startup code for application processors
@@ -199,12 +480,12 @@ void Cpu_startOtherCpus() {
     Cpu_writeLocalApic(lapicInterruptCommandLow, 0xC4500); // INIT assert, level triggered, to all excluding self
     Log_printf("Sending INIT De-assert IPI.\n");
     Cpu_writeLocalApic(lapicInterruptCommandLow, 0xCC500); // INIT de-assert, level triggered, to all including self
-    AcpiPmTimer_busyWait(ACPI_PMTIMER_FREQUENCY * 10E-3); // 10ms
+    Cpu_busyWaitNanoseconds(10000000); // 10ms
     Log_printf("Broadcasting the first SIPI.\n");
     Cpu_writeLocalApic(lapicInterruptCommandLow, 0xC4604); // SIPI to all excluding self, start from physical address 0x04000
-    AcpiPmTimer_busyWait(ACPI_PMTIMER_FREQUENCY * 200E-6); // 200us
+    Cpu_busyWaitNanoseconds(200000); // 200us
     Log_printf("Broadcasting the second SIPI.\n");
     Cpu_writeLocalApic(lapicInterruptCommandLow, 0xC4604); // SIPI to all excluding self, start from physical address 0x04000
-    AcpiPmTimer_busyWait(ACPI_PMTIMER_FREQUENCY * 200E-6); // 200us
+    Cpu_busyWaitNanoseconds(200000); // 200us
     Log_printf("Multiprocessor initialization by BSP completed.\n");
 }
@@ -21,9 +21,27 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "Types.h"
 #include "boot/MultiProcessorSpecification.h"
 
+/** Length of the TSC and LAPIC Timer calibration window when using the HPET as a reference. */
+#define CPU_HPET_CALIBRATION_NANOSECONDS 10000000 // 10 ms
+/** Length of the TSC and LAPIC Timer calibration window when using the ACPI PM Timer as a reference. */
+#define CPU_PMTIMER_CALIBRATION_NANOSECONDS 125000000 // 125 ms
+/** Length of the measurement to check that a CPU can reuse the timer calibration of another CPU. */
+#define CPU_CROSSCHECK_NANOSECONDS 1000000 // 1 ms
+/** Timer frequencies differing by less than 1/2^CPU_CALIBRATION_TOLERANCE_SHIFT are considered the same. */
+#define CPU_CALIBRATION_TOLERANCE_SHIFT 7
+/** Number of timestamps exchanged with the bootstrap processor to measure the TSC skew of an application processor. */
+#define CPU_TSC_SYNC_ROUNDS 64
+
 void Cpu_loadCpuTables(Cpu *cpu);
 void Cpu_setupInterruptDescriptorTable();
 Cpu *Cpu_initializeCpuStructs(const MpConfigHeader *mpConfigHeader);
 void Cpu_startOtherCpus();
+uint32_t Cpu_busyWaitNanoseconds(uint32_t ns);
+uint32_t Cpu_busyWaitCalibrationWindow();
+bool Cpu_matchesCalibration(uint64_t ticks, uint32_t ns, uint32_t ticksPerNs);
+void Cpu_serveCalibrationWindow();
+void Cpu_calibrateTimers(Cpu *cpu);
+void Cpu_synchronizeTsc(Cpu *cpu);
+void Cpu_serveTscSynchronization();
 
 #endif
@@ -0,0 +1,74 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "kernel.h"
+
+/**
+ * Maps the HPET registers to HPET_VIRTUAL_ADDRESS, sharing the page table
+ * of the Local APIC if already present.
+ * @return false if memory for the page table could not be allocated.
+ */
+__attribute__((section(".boot")))
+static bool Hpet_map(PhysicalAddress base) {
+    VirtualAddress hpetVirtualAddress = makeVirtualAddress(HPET_VIRTUAL_ADDRESS);
+    PageTableEntry *pde = AddressSpace_getKernelPageDirectoryEntry(hpetVirtualAddress);
+    if ((*pde & ptPresent) == 0) {
+        FrameNumber ptFrameNumber = PhysicalMemory_allocate(NULL, permamapMemoryRegion);
+        if (ptFrameNumber.v == 0) return false;
+        memzero(frame2virt(ptFrameNumber), PAGE_SIZE);
+        *pde = AddressSpace_makeEntry(ptFrameNumber, ptPresent | ptWriteable);
+    }
+    PageTable *pt = frame2virt(AddressSpace_getEntryFrameNumber(*pde));
+    pt->entries[AddressSpace_getPageTableIndex(hpetVirtualAddress)] = base.v | ptPresent | ptWriteable | ptGlobal | ptCacheDisable;
+    return true;
+}
+
+/**
+ * Initializes the HPET described by the ACPI HPET table, if any,
+ * mapping its registers and starting its main counter.
+ * Called on the bootstrap processor during early kernel initialization.
+ */
+__attribute__((section(".boot")))
+void Hpet_initialize() {
+    Hpet *hpet = &Hpet_theInstance;
+    memzero(hpet, sizeof(Hpet));
+    if (Acpi_hpet.header.signature != ACPI_HPET_SIGNATURE) {
+        Log_printf("No HPET found, falling back to the ACPI PM Timer.\n");
+        return;
+    }
+    uint64_t address = Acpi_hpet.baseAddress.address;
+    if (Acpi_hpet.baseAddress.addressSpaceId != 0 || address == 0 || address > UINT32_MAX || (address & (PAGE_SIZE - 1)) != 0) {
+        Log_printf("Unsupported HPET base address 0x%08X%08X, ignoring the HPET.\n", (uint32_t) (address >> 32), (uint32_t) address);
+        return;
+    }
+    if (!Hpet_map(physicalAddress(address))) {
+        Log_printf("Unable to allocate memory to map the HPET, ignoring it.\n");
+        return;
+    }
+    uint32_t period = Hpet_readRegister(hpetPeriod);
+    if (period == 0 || period > HPET_MAX_PERIOD_FEMTOSECONDS) {
+        Log_printf("Invalid HPET period %d fs, ignoring the HPET.\n", period);
+        return;
+    }
+    hpet->periodFemtoseconds = period;
+    hpet->nsPerTick = div(((uint64_t) period << 20) + 500000, 1000000);
+    hpet->counter64Bit = (Hpet_readRegister(hpetCapabilities) & hpetCapabilities64Bit) != 0;
+    Hpet_writeRegister(hpetConfiguration, Hpet_readRegister(hpetConfiguration) | hpetConfigurationEnable);
+    hpet->available = true;
+    Log_printf("HPET at 0x%08X: period=%d fs, nsPerTick=0x%08X >> 20, %d-bit counter.\n",
+            (uint32_t) address, period, hpet->nsPerTick, hpet->counter64Bit ? 64 : 32);
+}
@@ -18,31 +18,97 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "kernel.h"
 
 /**
- * Calibrates the Local APIC Timer of the current CPU using the ACPI Power Management timer as a reference.
- * A divider of 16 is used for the LAPIC Timer.
+ * Sets up the Local APIC Timer of the current CPU in TSC-deadline mode, if supported.
+ * The timer is then armed with absolute TSC values, thus no calibration is needed.
+ * @return true if TSC-deadline mode has been enabled.
+ */
+__attribute__((section(".boot")))
+static bool LapicTimer_initializeTscDeadlineMode(LapicTimer *lt) {
+    uint32_t a, b, c, d;
+    Cpu_cpuid(1, &a, &b, &c, &d);
+    if ((c & CpuFeature1Ecx_tscDeadline) == 0) return false;
+    Cpu_writeLocalApic(lapicTimerLvt, 0x40000 | lapicTimerVector); // TSC-deadline, not masked, vector lapicTimerVector
+    readWriteBarrier(); // the LVT write must be ordered before any write to msrTscDeadline
+    lt->tscDeadlineMode = true;
+    Log_printf("LAPIC Timer in TSC-deadline mode, calibration skipped.\n");
+    return true;
+}
+
+/**
+ * Initializes the Local APIC Timer of the current CPU, using TSC-deadline mode
+ * if available. Otherwise the LAPIC Timer must be calibrated before use,
+ * either by LapicTimer_calibrate or LapicTimer_copyCalibration.
  */
 __attribute__((section(".boot")))
 void LapicTimer_initialize(LapicTimer *lt) {
-    Cpu_writeLocalApic(lapicTimerLvt, lapicTimerVector); // one-shot, not masked, vector lapicTimerVector
+    lt->nsPerTick = 0;
+    lt->ticksPerNs = 0;
+    lt->maxTicks = 0;
+    lt->currentNanoseconds = 0;
+    lt->nextExpirationNanoseconds = LAPICTIMER_DISARMED;
+    lt->lastInitialCount = 0;
+    lt->tscDeadlineMode = false;
+    LapicTimer_initializeTscDeadlineMode(lt);
+}
+
+/**
+ * Starts counting down the Local APIC Timer of the current CPU from its maximum
+ * count, with a divider of 16, to measure its frequency.
+ */
+__attribute__((section(".boot")))
+void LapicTimer_startCalibration() {
+    Cpu_writeLocalApic(lapicTimerLvt, 0x10000); // one-shot, masked, vector 0, no interrupt when done
     Cpu_writeLocalApic(lapicTimerDivider, 0x03); // divide by 16
-    unsigned acpiTicks = ACPI_PMTIMER_FREQUENCY / 8;
     Cpu_writeLocalApic(lapicTimerInitialCount, 0xFFFFFFFF); // start the LAPIC Timer with max count
-    unsigned realAcpiTicks = AcpiPmTimer_busyWait(acpiTicks);
-    Cpu_writeLocalApic(lapicTimerLvt, 0x10000); // one-shot, masked, vector 0, to stop the counting
-    uint32_t lapicTimerDiff = 0xFFFFFFFF - Cpu_readLocalApic(lapicTimerCurrentCount);
-    Log_printf("LAPIC Timer calibrated from %d ACPI PM Timer ticks. Diff=%d.\n", realAcpiTicks, lapicTimerDiff);
-    /* Compute the coefficients to convert between LAPIC timer ticks and nanoseconds.
-     * For the nsPerTick coefficient, a shift of at most 20 allows frequencies as low as 500 KHz.
-     * For the ticksPerNs coefficient, a shift of at most 23 allows frequencies as high as 500 GHz.
-     */
-    lt->nsPerTick = div(292935555ULL * realAcpiTicks + lapicTimerDiff - 1, lapicTimerDiff); // 10^9*2^20/3579545
-    lt->ticksPerNs = div(30027ULL * lapicTimerDiff + realAcpiTicks - 1, realAcpiTicks); // 2^23*3579545/10^9
+}
+
+/**
+ * Stops the Local APIC Timer of the current CPU started by LapicTimer_startCalibration.
+ * @return The number of LAPIC Timer ticks elapsed since the start.
+ */
+__attribute__((section(".boot")))
+uint32_t LapicTimer_stopCalibration() {
+    uint32_t diff = 0xFFFFFFFF - Cpu_readLocalApic(lapicTimerCurrentCount);
+    Cpu_writeLocalApic(lapicTimerInitialCount, 0); // stop the counting
+    return diff;
+}
+
+/** Arms the calibrated Local APIC Timer of the current CPU in one-shot mode. */
+__attribute__((section(".boot")))
+static void LapicTimer_enable(LapicTimer *lt) {
+    lt->maxTicks = LapicTimer_convertNanosecondsToTicks(lt, LAPICTIMER_MAX_NANOSECONDS);
     Log_printf("LAPIC Timer calibration: nsPerTick=0x%08X >> 20, ticksPerNs=0x%08X >> 23.\n", lt->nsPerTick, lt->ticksPerNs);
-    lt->maxTicks = LapicTimer_convertNanosecondsToTicks(lt, 4000000000U);
-    lt->currentNanoseconds = 0;
-    lt->nextExpirationNanoseconds = 0;
-    lt->lastInitialCount = 0;
     Cpu_writeLocalApic(lapicTimerLvt, lapicTimerVector); // one-shot, not masked, vector lapicTimerVector
     Cpu_writeLocalApic(lapicTimerDivider, 0x03); // divide by 16
     Cpu_writeLocalApic(lapicTimerInitialCount, 0);
 }
+
+/**
+ * Calibrates the Local APIC Timer of the current CPU from the specified
+ * count of ticks measured in the specified number of nanoseconds of the
+ * reference clock, then arms it.
+ */
+__attribute__((section(".boot")))
+void LapicTimer_calibrate(LapicTimer *lt, uint32_t lapicTimerDiff, uint32_t ns) {
+    assert(!lt->tscDeadlineMode);
+    Log_printf("LAPIC Timer calibrated over %d ns. Diff=%d.\n", ns, lapicTimerDiff);
+    /* Compute the coefficients to convert between LAPIC timer ticks and nanoseconds.
+     * For the nsPerTick coefficient, a shift of at most 20 allows frequencies as low as 500 KHz.
+     * For the ticksPerNs coefficient, a shift of at most 23 allows frequencies as high as 500 GHz.
+     */
+    lt->nsPerTick = div(((uint64_t) ns << 20) + lapicTimerDiff - 1, lapicTimerDiff);
+    lt->ticksPerNs = div(((uint64_t) lapicTimerDiff << 23) + ns - 1, ns);
+    LapicTimer_enable(lt);
+}
+
+/**
+ * Reuses the calibration of the Local APIC Timer of another CPU, driven by the
+ * same bus clock, for the Local APIC Timer of the current CPU, then arms it.
+ */
+__attribute__((section(".boot")))
+void LapicTimer_copyCalibration(LapicTimer *lt, const LapicTimer *other) {
+    assert(!lt->tscDeadlineMode);
+    lt->nsPerTick = other->nsPerTick;
+    lt->ticksPerNs = other->ticksPerNs;
+    LapicTimer_enable(lt);
+}
@@ -21,5 +21,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "Types.h"
 
 void LapicTimer_initialize(LapicTimer *lt);
+void LapicTimer_startCalibration();
+uint32_t LapicTimer_stopCalibration();
+void LapicTimer_calibrate(LapicTimer *lt, uint32_t lapicTimerDiff, uint32_t ns);
+void LapicTimer_copyCalibration(LapicTimer *lt, const LapicTimer *other);
 
 #endif
@@ -24,38 +24,71 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 __attribute__((section(".boot")))
 void PhysicalMemoryRegion_initialize(PhysicalMemoryRegion *pmr, FrameNumber begin, FrameNumber end) {
     assert(begin.v <= end.v);
-    LinkedList_initialize(&pmr->freeListHead);
+    for (size_t i = 0; i < PHYSICALMEMORY_FREE_LIST_COUNT; i++)
+        LinkedList_initialize(&pmr->freeLists[i]);
+    pmr->nonEmptyFreeLists = 0;
     pmr->begin = begin;
     pmr->end = end;
     pmr->freeFrameCount = 0;
 }
 
+/**
+ * Frees the specified range of frames as a single free block, merged with the free blocks
+ * it overlaps or is adjacent to. Only the boundary tags are written, thus the time taken
+ * depends on the number of free blocks, rather than on the number of frames.
+ */
 __attribute__((section(".boot")))
 void PhysicalMemoryRegion_add(PhysicalMemoryRegion *pmr, FrameNumber begin, FrameNumber end) {
     assert(begin.v < end.v);
-    size_t count = end.v - begin.v;
-    for (size_t i = 0; i < count; i++) {
-        Frame *frame = getFrame(addToFrameNumber(begin, i));
-        if (Frame_getTask(frame) != &PhysicalMemory_freeFramesDummyOwner) {
-            frame->virtualAddress = makeVirtualAddress(0);
-            Frame_setTaskAndType(frame, &PhysicalMemory_freeFramesDummyOwner, FrameType_unmapped);
-            LinkedList_insertAfter(&frame->node, &pmr->freeListHead);
-            pmr->freeFrameCount++;
+    uintptr_t b = begin.v;
+    uintptr_t e = end.v;
+    for (size_t i = 0; i < PHYSICALMEMORY_FREE_LIST_COUNT; i++) {
+        LinkedList_Node *node = pmr->freeLists[i].next;
+        while (node != &pmr->freeLists[i]) {
+            LinkedList_Node *next = node->next;
+            Frame *first = Frame_fromNode(node);
+            uintptr_t blockBegin = getFrameNumber(first).v;
+            uintptr_t blockEnd = blockBegin + Frame_getFreeBlockLength(first);
+            if (blockBegin <= e && b <= blockEnd) {
+                PhysicalMemoryRegion_removeFreeBlock(pmr, first);
+                pmr->freeFrameCount -= blockEnd - blockBegin;
+                if (blockBegin < b) b = blockBegin;
+                if (blockEnd > e) e = blockEnd;
+            }
+            node = next;
         }
     }
+    PhysicalMemoryRegion_insertFreeBlock(pmr, getFrame(frameNumber(b)), e - b);
+    pmr->freeFrameCount += e - b;
 }
 
+/** Marks the free frames of the specified range as allocated, splitting the free blocks overlapping it. */
 __attribute__((section(".boot")))
 void PhysicalMemoryRegion_remove(PhysicalMemoryRegion *pmr, FrameNumber begin, FrameNumber end) {
     assert(begin.v < end.v);
-    size_t count = end.v - begin.v;
-    for (size_t i = 0; i < count; i++) {
-        Frame *frame = getFrame(addToFrameNumber(begin, i));
-        if (Frame_getTask(frame) == &PhysicalMemory_freeFramesDummyOwner) {
-            frame->virtualAddress = makeVirtualAddress(0);
-            Frame_setTaskAndType(frame, NULL, FrameType_unmapped);
-            LinkedList_remove(&frame->node);
-            pmr->freeFrameCount--;
+    for (size_t i = 0; i < PHYSICALMEMORY_FREE_LIST_COUNT; i++) {
+        LinkedList_Node *node = pmr->freeLists[i].next;
+        while (node != &pmr->freeLists[i]) {
+            LinkedList_Node *next = node->next;
+            Frame *first = Frame_fromNode(node);
+            uintptr_t blockBegin = getFrameNumber(first).v;
+            uintptr_t blockEnd = blockBegin + Frame_getFreeBlockLength(first);
+            if (blockBegin < end.v && begin.v < blockEnd) {
+                uintptr_t b = (begin.v > blockBegin) ? begin.v : blockBegin;
+                uintptr_t e = (end.v < blockEnd) ? end.v : blockEnd;
+                PhysicalMemoryRegion_removeFreeBlock(pmr, first);
+                for (uintptr_t f = b; f < e; f++) {
+                    Frame *frame = getFrame(frameNumber(f));
+                    frame->virtualAddress = makeVirtualAddress(0);
+                    Frame_setTaskAndType(frame, NULL, FrameType_unmapped);
+                }
+                pmr->freeFrameCount -= e - b;
+                if (b > blockBegin)
+                    PhysicalMemoryRegion_insertFreeBlock(pmr, first, b - blockBegin);
+                if (e < blockEnd)
+                    PhysicalMemoryRegion_insertFreeBlock(pmr, getFrame(frameNumber(e)), blockEnd - e);
+            }
+            node = next;
         }
     }
 }
@@ -65,36 +98,128 @@ void PhysicalMemoryRegion_remove(PhysicalMemoryRegion *pmr, FrameNumber begin, F
  * PhysicalMemory
  ******************************************************************************/
 
+/** Initializes the regions of all possible NUMA nodes, with the whole memory assigned to node 0 until told otherwise. */
 __attribute__((section(".boot")))
 void PhysicalMemory_initializeRegions() {
-    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[isadmaMemoryRegion], frameNumber(0), ISADMA_MEMORY_REGION_FRAME_END);
-    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[permamapMemoryRegion], ISADMA_MEMORY_REGION_FRAME_END, PERMAMAP_MEMORY_REGION_FRAME_END);
-    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[otherMemoryRegion], PERMAMAP_MEMORY_REGION_FRAME_END, frameNumber(UINT32_MAX));
+    Spinlock_init(&PhysicalMemory_lock);
+    for (size_t node = 0; node < PHYSICALMEMORY_MAX_NODES; node++) {
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, isadmaMemoryRegion), frameNumber(0), ISADMA_MEMORY_REGION_FRAME_END);
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, permamapMemoryRegion), ISADMA_MEMORY_REGION_FRAME_END, PERMAMAP_MEMORY_REGION_FRAME_END);
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, otherMemoryRegion), PERMAMAP_MEMORY_REGION_FRAME_END, OTHER_MEMORY_REGION_FRAME_END);
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, highMemoryRegion), OTHER_MEMORY_REGION_FRAME_END, frameNumber(UINT32_MAX));
+    }
+    PhysicalMemory_nodeCount = 1;
+    PhysicalMemory_nodeRangeCount = 0;
+    PhysicalMemory_initializeNodeOrder(NULL, 0);
+}
+
+/**
+ * Assigns the frames [begin, end) to the specified NUMA node, from an ACPI SRAT memory affinity structure.
+ * Must be called before any memory is added. Ranges of nodes not supported or exceeding
+ * the capacity of the range table are left to node 0.
+ */
+__attribute__((section(".boot")))
+void PhysicalMemory_addNodeRange(FrameNumber begin, FrameNumber end, size_t node) {
+    if (node == 0 || begin.v >= end.v) return;
+    if (node >= PHYSICALMEMORY_MAX_NODES || PhysicalMemory_nodeRangeCount == PHYSICALMEMORY_MAX_NODE_RANGES) {
+        Log_printf("Memory [%p, %p) of NUMA node %u assigned to node 0.\n", frame2phys(begin).v, frame2phys(end).v, node);
+        return;
+    }
+    PhysicalMemory_nodeRanges[PhysicalMemory_nodeRangeCount++] = (PhysicalMemoryNodeRange) { begin, end, node };
+    if (node >= PhysicalMemory_nodeCount) PhysicalMemory_nodeCount = node + 1;
+}
+
+/**
+ * Sorts the NUMA nodes by increasing distance from each node, for allocations to fall back to
+ * the nearest nodes. Distances are those of an ACPI SLIT for localityCount nodes, any other
+ * node is considered unreachable. Without a SLIT (localityCount 0), other nodes have the same
+ * distance and are sorted by number.
+ */
+__attribute__((section(".boot")))
+void PhysicalMemory_initializeNodeOrder(const uint8_t *distances, size_t localityCount) {
+    for (size_t node = 0; node < PHYSICALMEMORY_MAX_NODES; node++) {
+        uint8_t *order = PhysicalMemory_nodeOrder[node];
+        uint8_t distance[PHYSICALMEMORY_MAX_NODES];
+        for (size_t i = 0; i < PHYSICALMEMORY_MAX_NODES; i++) {
+            if (i == node) distance[i] = 0;
+            else if (localityCount == 0) distance[i] = 20;
+            else if (node < localityCount && i < localityCount) distance[i] = distances[node * localityCount + i];
+            else distance[i] = 0xFF;
+        }
+        for (size_t i = 0; i < PHYSICALMEMORY_MAX_NODES; i++) {
+            size_t j = i;
+            for ( ; j > 0 && distance[order[j - 1]] > distance[i]; j--)
+                order[j] = order[j - 1];
+            order[j] = i;
+        }
+    }
 }
 
+/**
+ * Sets the location of the frame descriptor table, with all frames marked as allocated to no task.
+ * Frames are then freed by PhysicalMemory_add, writing only the descriptors acting as boundary tags.
+ */
 __attribute__((section(".boot")))
 void PhysicalMemory_setFrameDescriptors(void *addr) {
     PhysicalMemory_frameDescriptors = addr;
     FrameNumber end = virt2frame((void *) ((uintptr_t) addr + PhysicalMemory_totalMemoryFrames * sizeof(Frame)));
     if (end.v >= PERMAMAP_MEMORY_REGION_FRAME_END.v || end.v >= PhysicalMemory_totalMemoryFrames)
         panic("Unable to store the frame descriptor table. Aborting.\n");
+    memzero(addr, PhysicalMemory_totalMemoryFrames * sizeof(Frame));
     Log_printf("Frame descriptor table at %p (%u bytes) for %u frames of memory.\n",
                addr, PhysicalMemory_totalMemoryFrames * sizeof(Frame), PhysicalMemory_totalMemoryFrames);
 }
 
+/** Returns the first frame after the specified one where the NUMA node may change. */
 __attribute__((section(".boot")))
-void PhysicalMemory_add(PhysicalAddress begin, PhysicalAddress end) {
-    FrameNumber beginFrame = floorToFrame(begin);
-    FrameNumber endFrame = ceilToFrame(end);
+static FrameNumber PhysicalMemory_findNodeBoundary(FrameNumber fn) {
+    uintptr_t boundary = UINT32_MAX;
+    for (size_t i = 0; i < PhysicalMemory_nodeRangeCount; i++) {
+        const PhysicalMemoryNodeRange *range = &PhysicalMemory_nodeRanges[i];
+        if (range->begin.v > fn.v && range->begin.v < boundary) boundary = range->begin.v;
+        if (range->end.v > fn.v && range->end.v < boundary) boundary = range->end.v;
+    }
+    return frameNumber(boundary);
+}
+
+/**
+ * Frees the frames [beginFrame, endFrame) of a region type to the regions of the nodes they belong to.
+ * Where the memory of a node follows that of another node, the first frame is kept allocated
+ * as a guard, so that free blocks of different nodes are never adjacent, thus never coalesced.
+ */
+__attribute__((section(".boot")))
+static void PhysicalMemory_addFramesToNodes(PhysicalMemoryRegionType type, FrameNumber beginFrame, FrameNumber endFrame) {
+    FrameNumber b = beginFrame;
+    while (b.v < endFrame.v) {
+        FrameNumber e = PhysicalMemory_findNodeBoundary(b);
+        if (e.v > endFrame.v) e = endFrame;
+        size_t node = PhysicalMemory_findNode(b);
+        FrameNumber first = b;
+        if (b.v > PhysicalMemory_regions[type].begin.v && PhysicalMemory_findNode(addToFrameNumber(b, -1)) != node)
+            first = addToFrameNumber(b, 1);
+        if (first.v < e.v)
+            PhysicalMemoryRegion_add(PhysicalMemory_getRegion(node, type), first, e);
+        b = e;
+    }
+}
+
+/** Frees the frames [beginFrame, endFrame), splitting them among the regions they belong to. */
+__attribute__((section(".boot")))
+void PhysicalMemory_addFrames(FrameNumber beginFrame, FrameNumber endFrame) {
     for (int i = 0; i < physicalMemoryRegionCount; i++) {
         FrameNumber b = (beginFrame.v >= PhysicalMemory_regions[i].begin.v) ? beginFrame : PhysicalMemory_regions[i].begin;
         FrameNumber e = (endFrame.v   <= PhysicalMemory_regions[i].end.v)   ? endFrame   : PhysicalMemory_regions[i].end;
         if (b.v < e.v)
-            PhysicalMemoryRegion_add(&PhysicalMemory_regions[i], b, e);
-        if (e.v == end.v) break;
+            PhysicalMemory_addFramesToNodes(i, b, e);
+        if (e.v == endFrame.v) break;
     }
 }
 
+__attribute__((section(".boot")))
+void PhysicalMemory_add(PhysicalAddress begin, PhysicalAddress end) {
+    PhysicalMemory_addFrames(floorToFrame(begin), ceilToFrame(end));
+}
+
 __attribute__((section(".boot")))
 void PhysicalMemory_remove(PhysicalAddress begin, PhysicalAddress end) {
     FrameNumber beginFrame = floorToFrame(begin);
@@ -103,7 +228,8 @@ void PhysicalMemory_remove(PhysicalAddress begin, PhysicalAddress end) {
         FrameNumber b = (beginFrame.v >= PhysicalMemory_regions[i].begin.v) ? beginFrame : PhysicalMemory_regions[i].begin;
         FrameNumber e = (endFrame.v   <= PhysicalMemory_regions[i].end.v)   ? endFrame   : PhysicalMemory_regions[i].end;
         if (b.v < e.v)
-            PhysicalMemoryRegion_remove(&PhysicalMemory_regions[i], b, e);
+            for (size_t node = 0; node < PhysicalMemory_nodeCount; node++)
+                PhysicalMemoryRegion_remove(PhysicalMemory_getRegion(node, i), b, e);
         if (e.v == end.v) break;
     }
 }
@@ -138,30 +264,32 @@ PhysicalAddress PhysicalMemory_findMultibootModulesEnd(const MultibootMbi *mbi)
 }
 
 __attribute__((section(".boot")))
-static void PhysicalMemory_findPhysicalAddressUpperBound_callback(void *closure, uint64_t begin, uint64_t length, int type) {
+static void PhysicalMemory_findFrameNumberUpperBound_callback(void *closure, uint64_t begin, uint64_t length, int type) {
     if (type != 1) return;
-    uint64_t *physicalAddressUpperBound = (uint64_t *) closure;
-    uint64_t end = begin + length;
-    if (end > *physicalAddressUpperBound) *physicalAddressUpperBound = end;
+    uint64_t *frameNumberUpperBound = (uint64_t *) closure;
+    uint64_t end = (begin + length) >> PAGE_SHIFT;
+    if (end > *frameNumberUpperBound) *frameNumberUpperBound = end;
 }
 
+/** Returns the frame number past the end of installed memory, limited to MAX_FRAME_NUMBER. */
 __attribute__((section(".boot")))
-PhysicalAddress PhysicalMemory_findPhysicalAddressUpperBound(const MultibootMbi *mbi) {
-    uint64_t physicalAddressUpperBound = 0;
-    MultibootMbi_scanMemoryMap(mbi, &physicalAddressUpperBound, PhysicalMemory_findPhysicalAddressUpperBound_callback);
-    if (physicalAddressUpperBound > MAX_PHYSICAL_ADDRESS)
-        physicalAddressUpperBound = MAX_PHYSICAL_ADDRESS;
-    if (physicalAddressUpperBound == 0)
+FrameNumber PhysicalMemory_findFrameNumberUpperBound(const MultibootMbi *mbi) {
+    uint64_t frameNumberUpperBound = 0;
+    MultibootMbi_scanMemoryMap(mbi, &frameNumberUpperBound, PhysicalMemory_findFrameNumberUpperBound_callback);
+    if (frameNumberUpperBound > MAX_FRAME_NUMBER.v)
+        frameNumberUpperBound = MAX_FRAME_NUMBER.v;
+    if (frameNumberUpperBound == 0)
         panic("Memory information not available.\nSystem halted.\n");
-    return physicalAddress(physicalAddressUpperBound);
+    return frameNumber(frameNumberUpperBound);
 }
 
 __attribute__((section(".boot")))
 static void PhysicalMemory_addFreeMemoryBlocks_callback(void *closure, uint64_t begin, uint64_t length, int type) {
-    if (type != 1 || begin >= MAX_PHYSICAL_ADDRESS) return;
-    uint64_t end = begin + length;
-    if (end > MAX_PHYSICAL_ADDRESS) end = MAX_PHYSICAL_ADDRESS;
-    PhysicalMemory_add(physicalAddress(begin), physicalAddress(end));
+    uint64_t beginFrame = begin >> PAGE_SHIFT;
+    if (type != 1 || beginFrame >= MAX_FRAME_NUMBER.v) return;
+    uint64_t endFrame = (begin + length + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    if (endFrame > MAX_FRAME_NUMBER.v) endFrame = MAX_FRAME_NUMBER.v;
+    PhysicalMemory_addFrames(frameNumber(beginFrame), frameNumber(endFrame));
 }
 
 __attribute__((section(".boot")))
@@ -187,9 +315,15 @@ void PhysicalMemory_initializeFromMultibootV1(const MultibootMbi *mbi, PhysicalA
     PhysicalAddress kernelEnd = PhysicalMemory_findKernelEnd(mbi, imageBegin, imageEnd);
     PhysicalAddress multibootModulesEnd = PhysicalMemory_findMultibootModulesEnd(mbi);
     PhysicalAddress firstFreeAddress = multibootModulesEnd.v > kernelEnd.v ? multibootModulesEnd : kernelEnd;
-    PhysicalAddress physicalAddressUpperBound = PhysicalMemory_findPhysicalAddressUpperBound(mbi);
+    FrameNumber frameNumberUpperBound = PhysicalMemory_findFrameNumberUpperBound(mbi);
 
-    PhysicalMemory_totalMemoryFrames = physicalAddressUpperBound.v >> PAGE_SHIFT;
+    PhysicalMemory_totalMemoryFrames = frameNumberUpperBound.v;
+    // Clamp regions to installed memory, so that boundary tags of neighbor blocks are always within the frame descriptor table
+    for (size_t i = 0; i < PhysicalMemory_nodeCount * physicalMemoryRegionCount; i++) {
+        PhysicalMemoryRegion *region = &PhysicalMemory_regions[i];
+        if (region->end.v > PhysicalMemory_totalMemoryFrames)
+            region->end = frameNumber(region->begin.v > PhysicalMemory_totalMemoryFrames ? region->begin.v : PhysicalMemory_totalMemoryFrames);
+    }
     PhysicalMemory_setFrameDescriptors(frame2virt(ceilToFrame(firstFreeAddress)));
     PhysicalMemory_addFreeMemoryBlocks(mbi);
     PhysicalMemory_markInitialMemoryAsAllocated(mbi, imageBegin, kernelEnd);
@@ -25,12 +25,15 @@ void PhysicalMemoryRegion_initialize(PhysicalMemoryRegion *pmr, FrameNumber begi
 void PhysicalMemoryRegion_add(PhysicalMemoryRegion *pmr, FrameNumber begin, FrameNumber end);
 void PhysicalMemoryRegion_remove(PhysicalMemoryRegion *pmr, FrameNumber begin, FrameNumber end);
 
+void PhysicalMemory_addNodeRange(FrameNumber begin, FrameNumber end, size_t node);
+void PhysicalMemory_initializeNodeOrder(const uint8_t *distances, size_t localityCount);
+void PhysicalMemory_addFrames(FrameNumber beginFrame, FrameNumber endFrame);
 void PhysicalMemory_add(PhysicalAddress begin, PhysicalAddress end);
 void PhysicalMemory_remove(PhysicalAddress begin, PhysicalAddress end);
 void PhysicalMemory_initializeRegions();
 PhysicalAddress PhysicalMemory_findKernelEnd(const MultibootMbi *mbi, PhysicalAddress imageBegin, PhysicalAddress imageEnd);
 PhysicalAddress PhysicalMemory_findMultibootModulesEnd(const MultibootMbi *mbi);
-PhysicalAddress PhysicalMemory_findPhysicalAddressUpperBound(const MultibootMbi *mbi);
+FrameNumber PhysicalMemory_findFrameNumberUpperBound(const MultibootMbi *mbi);
 void PhysicalMemory_addFreeMemoryBlocks(const MultibootMbi *mbi);
 void PhysicalMemory_markInitialMemoryAsAllocated(const MultibootMbi *mbi, PhysicalAddress imageBegin, PhysicalAddress kernelEnd);
 void PhysicalMemory_initializeFromMultibootV1(const MultibootMbi *mbi, PhysicalAddress imageBegin, PhysicalAddress imageEnd);
@@ -28,6 +28,8 @@ static void waitForAllCpus(Cpu* cpu){
     Video_printf("Now waiting for other CPUs to boot...\n");
     AtomicWord_set(&cpu->initialized, 1);
     while (true) {
+        Cpu_serveCalibrationWindow();
+        Cpu_serveTscSynchronization();
         bool allInitialized = true;
         for (size_t i = 0; i < Cpu_cpuCount; i++) {
             Cpu *c = Cpu_cpus[i];
@@ -45,7 +47,7 @@ static void waitForAllCpus(Cpu* cpu){
 __attribute((section(".boot")))
 static void testMultibootModulesCallback(void *closure, size_t index, PhysicalAddress begin, PhysicalAddress end, PhysicalAddress name) {
     Log_printf("Testing multiboot module %d at [%p-%p), string=%p \"%s\".\n", index, begin.v, end.v, name.v, phys2virt(name));
-    Task *task = Task_create(NULL, NULL);
+    Task *task = Task_create(NULL, NULL, false); // sparse capabilities resolve faster, see TaskBenchmark
     Video_printf("Task at %p\n", task);
     Video_printf("Task address space root at %p.\n", task->addressSpace.root);
     AddressSpace_activate(&task->addressSpace);
@@ -71,19 +73,33 @@ ThreadRegisters *Boot_bspEntry() {
     Cpu *currentCpu = Cpu_getCurrent();
     Log_printf("Welcome from CPU %d.\n", currentCpu->index);
     Cpu_loadCpuTables(currentCpu);
+    PhysicalMemory_frameCachesEnabled = true; // now running on a per-CPU stack
     AcpiPmTimer_initialize();
     Cpu_setupInterruptDescriptorTable();
     Log_printf("Enabling LAPIC on bootstrap processor (CPU #%d, LAPIC ID 0x%02X, Cpu struct at %p).\n", currentCpu->index, currentCpu->lapicId, currentCpu);
     Cpu_writeLocalApic(lapicSpuriousInterrupt, 0x1FF); // LAPIC enabled, Focus Check disabled, spurious vector 0xFF
+    Cpu_calibrateTimers(currentCpu); // before starting other CPUs, so that they can reuse the calibration
+    Clock_initialize(&currentCpu->tsc);
     Cpu_startOtherCpus();
     Pic8259_initialize(0x50, 0x70);
-    SlabAllocator_initialize(&taskAllocator, sizeof(Task), NULL);
-    SlabAllocator_initialize(&threadAllocator, sizeof(Thread), NULL);
-    SlabAllocator_initialize(&channelAllocator, sizeof(Channel), NULL);
-    LapicTimer_initialize(&currentCpu->lapicTimer);
-    Tsc_initialize(&currentCpu->tsc);
+    SlabAllocator_initialize(&taskAllocator, sizeof(Task), NULL, FrameType_unmapped);
+    SlabAllocator_initialize(&threadAllocator, sizeof(Thread), NULL, FrameType_unmapped);
+    SlabAllocator_initialize(&channelAllocator, sizeof(Channel), NULL, FrameType_unmapped);
+    SlabAllocator_initialize(&proxyAllocator, sizeof(Proxy), NULL, FrameType_unmapped);
+    SlabAllocator_initialize(&magazineAllocator, sizeof(SlabMagazine), NULL, FrameType_unmapped);
+    KernelMemory_initialize();
+    if (SlabAllocator_enableCpuCaches(&taskAllocator, Cpu_cpuCount) < 0
+            || SlabAllocator_enableCpuCaches(&threadAllocator, Cpu_cpuCount) < 0
+            || SlabAllocator_enableCpuCaches(&channelAllocator, Cpu_cpuCount) < 0
+            || SlabAllocator_enableCpuCaches(&proxyAllocator, Cpu_cpuCount) < 0)
+        panic("Unable to allocate per-CPU slab caches. Aborting.\n");
+    for (size_t i = 0; i < KERNELMEMORY_SIZE_CLASS_COUNT; i++)
+        if (SlabAllocator_enableCpuCaches(&KernelMemory_allocators[i], Cpu_cpuCount) < 0)
+            panic("Unable to allocate per-CPU slab caches. Aborting.\n");
+    TimerWheel_initialize(currentCpu->timerWheel, Cpu_readNanoseconds(currentCpu));
     waitForAllCpus(currentCpu);
     testMultibootModules();
+    currentCpu->lastAccountingTime = currentCpu->lastScheduleTime = Tsc_read();
     Cpu_schedule(currentCpu);
     return currentCpu->currentThread->regs;
 }
@@ -102,9 +118,11 @@ ThreadRegisters *Boot_apEntry() {
     Cpu_loadCpuTables(currentCpu);
     Log_printf("Enabling LAPIC on CPU #%d (LAPIC ID 0x%02X, Cpu struct at %p).\n", currentCpu->index, currentCpu->lapicId, currentCpu);
     Cpu_writeLocalApic(lapicSpuriousInterrupt, 0x1FF); // LAPIC enabled, Focus Check disabled, spurious vector 0xFF
-    LapicTimer_initialize(&currentCpu->lapicTimer);
-    Tsc_initialize(&currentCpu->tsc);
+    Cpu_calibrateTimers(currentCpu);
+    Cpu_synchronizeTsc(currentCpu);
+    TimerWheel_initialize(currentCpu->timerWheel, Cpu_readNanoseconds(currentCpu));
     AtomicWord_set(&currentCpu->initialized, 1);
+    currentCpu->lastAccountingTime = currentCpu->lastScheduleTime = Tsc_read();
     Cpu_schedule(currentCpu);
     return currentCpu->currentThread->regs;
 }
@@ -136,12 +154,13 @@ Cpu *Boot_entry() {
     Log_printf("sizeof(Endpoint)=%d\n", sizeof(Endpoint));
     Log_printf("sizeof(Frame)=%d\n", sizeof(Frame));
     PhysicalMemory_initializeRegions();
+    Acpi_findConfig(); // before adding memory, to know its NUMA nodes
     PhysicalMemory_initializeFromMultibootV1(
             mbi,
             physicalAddress((uintptr_t) &Boot_imageBeginPhysicalAddress),
             physicalAddress((uintptr_t) &Boot_imageEndPhysicalAddress));
-    Acpi_findConfig();
     const MpConfigHeader *mpConfigHeader = MultiProcessorSpecification_searchFindMpConfig();
     Cpu *bootCpu = Cpu_initializeCpuStructs(mpConfigHeader);
+    Hpet_initialize();
     return bootCpu;
 }
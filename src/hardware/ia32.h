@@ -55,6 +55,16 @@ static inline void Cpu_writeLocalApic(size_t offset, uint32_t value) {
     *(volatile uint32_t *) (CPU_LAPIC_VIRTUAL_ADDRESS + offset) = value;
 }
 
+/** Reads the specified 32-bit HPET register. */
+static inline uint32_t Hpet_readRegister(size_t offset) {
+    return *(volatile uint32_t *) (HPET_VIRTUAL_ADDRESS + offset);
+}
+
+/** Writes to the specified 32-bit HPET register. */
+static inline void Hpet_writeRegister(size_t offset, uint32_t value) {
+    *(volatile uint32_t *) (HPET_VIRTUAL_ADDRESS + offset) = value;
+}
+
 /** Reads the specified Model Specific Register of the current CPU. */
 static inline uint64_t Cpu_readMsr(uint32_t msr) {
     uint32_t a, d;
@@ -131,6 +141,26 @@ static inline void AddressSpace_activate(AddressSpace *as) {
     asm volatile("mov %0, %%cr3" : : "r" (as->root) : "memory");
 }
 
+/**
+ * Fills memory with zeros using non-temporal stores, that bypass the caches
+ * so that zeroing does not evict useful data.
+ * @param begin Address of the memory to clear, aligned to 16 bytes.
+ * @param size Number of bytes to clear, a multiple of 16.
+ */
+static inline void Cpu_zeroNonTemporal(void *begin, size_t size) {
+    uint8_t *end = (uint8_t *) begin + size;
+    asm volatile(
+    "1:  movnti %1, (%0)\n"
+    "    movnti %1, 4(%0)\n"
+    "    movnti %1, 8(%0)\n"
+    "    movnti %1, 12(%0)\n"
+    "    add $16, %0\n"
+    "    cmp %2, %0\n"
+    "    jb 1b\n"
+    "    sfence\n"
+    : "+r" (begin) : "r" (0), "r" (end) : "memory");
+}
+
 /** Invalidates all non-global TLB entries. */
 static inline void AddressSpace_invalidateTlb() {
     asm volatile(
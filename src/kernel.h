@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "hardware.h"
 #include "boot/Acpi.h"
 #include "boot/Cpu.h"
+#include "boot/Hpet.h"
 #include "boot/LapicTimer.h"
 #include "boot/MultiProcessorSpecification.h"
 #include "boot/Multiboot.h"
@@ -29,18 +30,24 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "boot/PhysicalMemory.h"
 #include "Acpi.h"
 #include "AddressSpace.h"
+#include "CapabilityTable.h"
+#include "Clock.h"
 #include "Cpu.h"
 #include "CpuNode.h"
 #include "ElfLoader.h"
 #include "Formatter.h"
+#include "Hpet.h"
+#include "KernelMemory.h"
 #include "LapicTimer.h"
 #include "PhysicalMemory.h"
 #include "Pic8259.h"
 #include "PriorityQueue.h"
 #include "SlabAllocator.h"
 #include "Spinlock.h"
+#include "Syscall.h"
 #include "Task.h"
 #include "Thread.h"
+#include "TimerWheel.h"
 #include "Tsc.h"
 
 #endif
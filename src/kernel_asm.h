@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define WORD_SIZE 32    
 
 #define CPU_LAPIC_VIRTUAL_ADDRESS 0xFEE00000
+#define HPET_VIRTUAL_ADDRESS 0xFED00000
 
 // These constants represents the enum Selector for use in assembly
 #define CPU_FLAT_KERNEL_DS (2 << 3)
@@ -36,14 +37,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define CPU_KERNELENTRYCOUNT_OFFSET 12
 #define CPU_THISCPU_OFFSET 16
 #define CPU_CURRENTTHREAD_OFFSET 24
-#define CPU_STACK_OFFSET 600
+#define CPU_STACK_OFFSET 680
 #define CPU_STRUCT_LOG_SIZE 12
 #define CPU_STRUCT_SIZE (1 << CPU_STRUCT_LOG_SIZE)
 #define CPU_TOP_OF_STACK (CPU_STRUCT_SIZE - 16) // do not touch page boundary so that masking to get the current Cpu structure always works
 #define CPU_STACK_SIZE (CPU_TOP_OF_STACK - CPU_STACK_OFFSET)
 #define THREAD_CPU_OFFSET 0
-#define THREAD_REGS_OFFSET 76
-#define THREAD_REGSBUF_OFFSET 80
+#define THREAD_REGS_OFFSET 92
+#define THREAD_REGSBUF_OFFSET 96
 #define THREADREGISTERS_ES_OFFSET (3 * 4)
 #define THREADREGISTERS_EDI_OFFSET (5 * 4)
 #define THREADREGISTERS_VECTOR_OFFSET (12 * 4)
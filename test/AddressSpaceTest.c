@@ -26,6 +26,7 @@ static void initializePhysicalMemory(uint8_t *fakePhysicalMemory, Frame *frames,
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], baseFrame, addToFrameNumber(baseFrame, frameCount));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], addToFrameNumber(baseFrame, frameCount), addToFrameNumber(baseFrame, frameCount));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], addToFrameNumber(baseFrame, frameCount), addToFrameNumber(baseFrame, frameCount));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], addToFrameNumber(baseFrame, frameCount), addToFrameNumber(baseFrame, frameCount));
     PhysicalMemory_frameDescriptors = frames;
     PhysicalMemory_firstFrame = baseFrame;
     PhysicalMemory_add(base, addToPhysicalAddress(base, frameCount * PAGE_SIZE));
@@ -175,7 +176,7 @@ static void AddressSpaceTest_mapOverAlreadyMapped() {
     ASSERT(frame2virt(newFrameNumber) == &fakePhysicalMemory[(totalMemoryFrames - 3) * PAGE_SIZE]);
     ASSERT(mapResult == 0);
     ASSERT(task.addressSpace.root == virt2phys(pageDirectory).v);
-    ASSERT(task.addressSpace.tlbShootdownPageCount == 1);
+    ASSERT(task.addressSpace.tlbShootdownPageCount == 0);
     ASSERT(task.addressSpace.shootdownFrameListHead.next == &frames[totalMemoryFrames - 2].node);
     ASSERT(frames[totalMemoryFrames - 2].node.next == &task.addressSpace.shootdownFrameListHead);
     ASSERT(theFakeHardware.tlbInvalidationCount == 0);
@@ -191,6 +192,392 @@ static void AddressSpaceTest_mapOverAlreadyMapped() {
                 : 0));
 }
 
+static void AddressSpaceTest_mapRange() {
+    const size_t totalMemoryFrames = 3;
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[totalMemoryFrames * PAGE_SIZE];
+    Frame frames[totalMemoryFrames];
+    initializePhysicalMemory(fakePhysicalMemory, frames, totalMemoryFrames);
+    theFakeHardware = (FakeHardware) { .lastTlbInvalidationAddress = makeVirtualAddress(0), .tlbInvalidationCount = 0 };
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        Boot_kernelPageDirectory.entries[i] = i;
+    Task task;
+    AddressSpace_initialize(&task);
+    const FrameNumber firstFrameNumber = frameNumber(0x1234);
+
+    int mapResult = AddressSpace_mapRange(&task, makeVirtualAddress((3 << 22) | (1022 << 12)), firstFrameNumber, 4, ptWriteable);
+
+    const PageTable *pageDirectory = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 1) * PAGE_SIZE];
+    const PageTable *pageTable3 = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 2) * PAGE_SIZE];
+    const PageTable *pageTable4 = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 3) * PAGE_SIZE];
+    ASSERT(mapResult == 0);
+    ASSERT(task.addressSpace.batchDepth == 0);
+    ASSERT(task.addressSpace.tlbShootdownPageCount == 0);
+    ASSERT(theFakeHardware.lastTlbInvalidationAddress.v == 0);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        ASSERT(pageDirectory->entries[i] == (
+                i == 3 ? (virt2phys(pageTable3).v | ptPresent | ptWriteable | ptUser)
+                : i == 4 ? (virt2phys(pageTable4).v | ptPresent | ptWriteable | ptUser)
+                : i < 768 ? 0
+                : i));
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++) {
+        ASSERT(pageTable3->entries[i] == (
+                i >= 1022 ? ((firstFrameNumber.v + i - 1022) * PAGE_SIZE | ptPresent | ptWriteable | ptUser)
+                : 0));
+        ASSERT(pageTable4->entries[i] == (
+                i < 2 ? ((firstFrameNumber.v + i + 2) * PAGE_SIZE | ptPresent | ptWriteable | ptUser)
+                : 0));
+    }
+}
+
+static void AddressSpaceTest_mapRangeInvalid() {
+    Task task;
+
+    int mapResult = AddressSpace_mapRange(&task, makeVirtualAddress(HIGH_HALF_BEGIN - PAGE_SIZE), frameNumber(0x1234), 2, ptWriteable);
+
+    ASSERT(mapResult == -EINVAL);
+}
+
+static void AddressSpaceTest_unmapRange() {
+    const size_t totalMemoryFrames = 7;
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[totalMemoryFrames * PAGE_SIZE];
+    Frame frames[totalMemoryFrames];
+    initializePhysicalMemory(fakePhysicalMemory, frames, totalMemoryFrames);
+    theFakeHardware = (FakeHardware) { .lastTlbInvalidationAddress = makeVirtualAddress(0), .tlbInvalidationCount = 0 };
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        Boot_kernelPageDirectory.entries[i] = i;
+    Task task;
+    AddressSpace_initialize(&task);
+    int mapResult = AddressSpace_mapRangeFromNewFrames(&task, makeVirtualAddress((3 << 22) | (1022 << 12)), 4, permamapMemoryRegion);
+    const VirtualAddress lastUnmapped = makeVirtualAddress((4 << 22) | (1 << 12));
+
+    AddressSpace_unmapRange(&task, makeVirtualAddress((3 << 22) | (1023 << 12)), 3, 0);
+
+    const PageTable *pageTable3 = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 2) * PAGE_SIZE];
+    const PageTable *pageTable4 = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 5) * PAGE_SIZE];
+    size_t shootdownFrameCount = 0;
+    for (LinkedList_Node *n = task.addressSpace.shootdownFrameListHead.next; n != &task.addressSpace.shootdownFrameListHead; n = n->next)
+        shootdownFrameCount++;
+    ASSERT(mapResult == 0);
+    ASSERT(task.addressSpace.batchDepth == 0);
+    ASSERT(task.addressSpace.tlbShootdownPageCount == 0);
+    ASSERT(shootdownFrameCount == 3);
+    ASSERT(theFakeHardware.lastTlbInvalidationAddress.v == lastUnmapped.v);
+    ASSERT(theFakeHardware.tlbInvalidationCount == 0);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++) {
+        ASSERT(pageTable3->entries[i] == (
+                i == 1022 ? (frame2phys(addToFrameNumber(virt2frame(fakePhysicalMemory), totalMemoryFrames - 3)).v | ptPresent | ptWriteable | ptUser)
+                : 0));
+        ASSERT(pageTable4->entries[i] == 0);
+    }
+}
+
+static void AddressSpaceTest_reserveRangeAndPageFault() {
+    const size_t totalMemoryFrames = 3;
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[totalMemoryFrames * PAGE_SIZE];
+    Frame frames[totalMemoryFrames];
+    initializePhysicalMemory(fakePhysicalMemory, frames, totalMemoryFrames);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        Boot_kernelPageDirectory.entries[i] = i;
+    for (size_t i = 0; i < PAGE_SIZE; i++)
+        fakePhysicalMemory[i] = 0xAA;
+    Task task;
+    AddressSpace_initialize(&task);
+    const VirtualAddress faultingAddress = makeVirtualAddress((3 << 22) | (1023 << 12) | 0x123);
+
+    int reserveResult = AddressSpace_reserveRange(&task, makeVirtualAddress((3 << 22) | (1022 << 12)), 2);
+    int faultResult = AddressSpace_handlePageFault(&task, faultingAddress, pfWrite | pfUser);
+
+    const PageTable *pageTable = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 2) * PAGE_SIZE];
+    ASSERT(reserveResult == 0);
+    ASSERT(faultResult == 0);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        ASSERT(pageTable->entries[i] == (
+                i == 1022 ? ptDemandZero
+                : i == 1023 ? (virt2phys(fakePhysicalMemory).v | ptPresent | ptWriteable | ptUser)
+                : 0));
+    for (size_t i = 0; i < PAGE_SIZE; i++)
+        ASSERT(fakePhysicalMemory[i] == 0);
+    ASSERT(AddressSpace_handlePageFault(&task, faultingAddress, pfUser) == 0);
+    ASSERT(AddressSpace_handlePageFault(&task, faultingAddress, pfProtectionViolation | pfWrite | pfUser) == -EFAULT);
+    ASSERT(AddressSpace_handlePageFault(&task, makeVirtualAddress((3 << 22) | (1021 << 12)), pfUser) == -EFAULT);
+    ASSERT(AddressSpace_handlePageFault(&task, makeVirtualAddress(HIGH_HALF_BEGIN), 0) == -EFAULT);
+    ASSERT(AddressSpace_handlePageFault(&task, makeVirtualAddress((3 << 22) | (1022 << 12)), pfUser) == -ENOMEM);
+    ASSERT(pageTable->entries[1022] == ptDemandZero);
+}
+
+static void AddressSpaceTest_checkUserRangeMapsReservedPages() {
+    const size_t totalMemoryFrames = 3;
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[totalMemoryFrames * PAGE_SIZE];
+    Frame frames[totalMemoryFrames];
+    initializePhysicalMemory(fakePhysicalMemory, frames, totalMemoryFrames);
+    Task task;
+    AddressSpace_initialize(&task);
+    AddressSpace_reserveRange(&task, makeVirtualAddress(0x400000), 1);
+
+    int result = AddressSpace_checkUserRange(&task, makeVirtualAddress(0x400FF0), 16, true);
+
+    const PageTable *pageTable = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 2) * PAGE_SIZE];
+    ASSERT(result == 0);
+    ASSERT(pageTable->entries[0] == (virt2phys(fakePhysicalMemory).v | ptPresent | ptWriteable | ptUser));
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress(0x400FF0), 17, true) == -EFAULT);
+}
+
+static void AddressSpaceTest_mapReadOnly() {
+    const size_t totalMemoryFrames = 3;
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[totalMemoryFrames * PAGE_SIZE];
+    Frame frames[totalMemoryFrames];
+    initializePhysicalMemory(fakePhysicalMemory, frames, totalMemoryFrames);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        Boot_kernelPageDirectory.entries[i] = i;
+    Task task;
+    AddressSpace_initialize(&task);
+    FrameNumber frameNumber = PhysicalMemory_allocate(NULL, permamapMemoryRegion);
+
+    int mapResult = AddressSpace_mapReadOnly(&task, makeVirtualAddress(CLOCKPAGE_ADDRESS), frameNumber);
+
+    const PageTable *pageDirectory = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 1) * PAGE_SIZE];
+    const PageTable *pageTable = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 3) * PAGE_SIZE];
+    ASSERT(mapResult == 0);
+    ASSERT(pageDirectory->entries[CLOCKPAGE_ADDRESS >> 22] == (virt2phys(pageTable).v | ptPresent | ptWriteable | ptUser));
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        ASSERT(pageTable->entries[i] == (
+                i == 1023 ? (frameNumber.v * PAGE_SIZE | ptPresent | ptUser)
+                : 0));
+}
+
+static void AddressSpaceTest_checkUserRange() {
+    const size_t totalMemoryFrames = 4;
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[totalMemoryFrames * PAGE_SIZE];
+    Frame frames[totalMemoryFrames];
+    initializePhysicalMemory(fakePhysicalMemory, frames, totalMemoryFrames);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        Boot_kernelPageDirectory.entries[i] = i;
+    Task task;
+    AddressSpace_initialize(&task);
+    FrameNumber frameNumber = PhysicalMemory_allocate(&task, permamapMemoryRegion);
+    AddressSpace_map(&task, makeVirtualAddress((3 << 22) | (7 << 12)), frameNumber);
+    AddressSpace_map(&task, makeVirtualAddress((3 << 22) | (8 << 12)), frameNumber);
+    AddressSpace_mapReadOnly(&task, makeVirtualAddress((3 << 22) | (9 << 12)), frameNumber);
+
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress((3 << 22) | (7 << 12) | 0xFF0), 0x20, true) == 0);
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress((3 << 22) | (8 << 12) | 0xFF0), 0x20, false) == 0);
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress((3 << 22) | (8 << 12) | 0xFF0), 0x20, true) == -EFAULT);
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress((3 << 22) | (9 << 12) | 0xFF0), 0x20, false) == -EFAULT);
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress((4 << 22) | (7 << 12)), 4, false) == -EFAULT);
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress(HIGH_HALF_BEGIN - 4), 8, false) == -EFAULT);
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress(0xFFFFFFF0), 0x20, false) == -EFAULT);
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress(0), 0, true) == 0);
+}
+
+static void AddressSpaceTest_mapLarge() {
+    const size_t totalMemoryFrames = 3;
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[totalMemoryFrames * PAGE_SIZE];
+    Frame frames[totalMemoryFrames];
+    initializePhysicalMemory(fakePhysicalMemory, frames, totalMemoryFrames);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        Boot_kernelPageDirectory.entries[i] = i;
+    Task task;
+    AddressSpace_initialize(&task);
+    FrameNumber frameNumber = PhysicalMemory_allocate(&task, permamapMemoryRegion);
+    AddressSpace_map(&task, makeVirtualAddress(4 << 22), frameNumber);
+    const FrameNumber firstFrameNumber = { 5 * LARGE_PAGE_FRAMES };
+
+    int mapResult = AddressSpace_mapLarge(&task, makeVirtualAddress(3 << 22), firstFrameNumber);
+
+    const PageTable *pageDirectory = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 1) * PAGE_SIZE];
+    const PageTable *pageTable = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 3) * PAGE_SIZE];
+    ASSERT(mapResult == 0);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        ASSERT(pageDirectory->entries[i] == (
+                i == 3 ? (5 * LARGE_PAGE_SIZE | ptLargePage | ptPresent | ptWriteable | ptUser)
+                : i == 4 ? (virt2phys(pageTable).v | ptPresent | ptWriteable | ptUser)
+                : i < 768 ? 0
+                : i));
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress((3 << 22) | (7 << 12)), 2 * PAGE_SIZE, true) == 0);
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress((4 << 22) - 0x10), 0x20, true) == 0);
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress((4 << 22) - 0x10), PAGE_SIZE + 0x20, true) == -EFAULT);
+    ASSERT(AddressSpace_checkUserRange(&task, makeVirtualAddress((3 << 22) - 0x10), 0x20, false) == -EFAULT);
+    ASSERT(AddressSpace_map(&task, makeVirtualAddress((3 << 22) | (7 << 12)), frameNumber) == -EEXIST);
+}
+
+static void AddressSpaceTest_mapLargeInvalid() {
+    const size_t totalMemoryFrames = 3;
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[totalMemoryFrames * PAGE_SIZE];
+    Frame frames[totalMemoryFrames];
+    initializePhysicalMemory(fakePhysicalMemory, frames, totalMemoryFrames);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        Boot_kernelPageDirectory.entries[i] = i;
+    Task task;
+    AddressSpace_initialize(&task);
+    FrameNumber frameNumber = PhysicalMemory_allocate(&task, permamapMemoryRegion);
+    AddressSpace_map(&task, makeVirtualAddress((4 << 22) | (7 << 12)), frameNumber);
+    const FrameNumber alignedFrameNumber = { 5 * LARGE_PAGE_FRAMES };
+    const FrameNumber misalignedFrameNumber = { 5 * LARGE_PAGE_FRAMES + 1 };
+
+    ASSERT(AddressSpace_mapLarge(&task, makeVirtualAddress((3 << 22) | (1 << 12)), alignedFrameNumber) == -EINVAL);
+    ASSERT(AddressSpace_mapLarge(&task, makeVirtualAddress(3 << 22), misalignedFrameNumber) == -EINVAL);
+    ASSERT(AddressSpace_mapLarge(&task, makeVirtualAddress(HIGH_HALF_BEGIN), alignedFrameNumber) == -EINVAL);
+    ASSERT(AddressSpace_mapLarge(&task, makeVirtualAddress(4 << 22), alignedFrameNumber) == -EEXIST);
+    const PageTable *pageDirectory = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 1) * PAGE_SIZE];
+    ASSERT(pageDirectory->entries[3] == 0);
+    ASSERT((pageDirectory->entries[4] & ptLargePage) == 0);
+}
+
+static void AddressSpaceTest_mapLargeFromNewFramesOutOfMemory() {
+    const size_t totalMemoryFrames = 3;
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[totalMemoryFrames * PAGE_SIZE];
+    Frame frames[totalMemoryFrames];
+    initializePhysicalMemory(fakePhysicalMemory, frames, totalMemoryFrames);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        Boot_kernelPageDirectory.entries[i] = i;
+    Task task;
+    AddressSpace_initialize(&task);
+
+    int mapResult = AddressSpace_mapLargeFromNewFrames(&task, makeVirtualAddress(3 << 22), otherMemoryRegion);
+
+    const PageTable *pageDirectory = (const PageTable *) &fakePhysicalMemory[(totalMemoryFrames - 1) * PAGE_SIZE];
+    ASSERT(mapResult == -ENOMEM);
+    ASSERT(PhysicalMemory_regions[0].freeFrameCount == totalMemoryFrames - 1);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(PageTableEntry); i++)
+        ASSERT(pageDirectory->entries[i] == (i < 768 ? 0 : i));
+}
+
+static void AddressSpaceTest_mapTemporary() {
+    static Cpu cpu;
+    memzero(&cpu, sizeof(Cpu));
+    PageTableEntry slots[2] = { 0, 0 };
+    cpu.temporaryMappings = (TemporaryMappings) { .slots = slots, .begin = TEMPORARY_MAPPING_SLOTS_BEGIN, .count = 2, .next = 0 };
+    FrameNumber savedPermamapEnd = PhysicalMemory_regions[permamapMemoryRegion].end;
+    PhysicalMemory_regions[permamapMemoryRegion].end = frameNumber(0x100);
+    theFakeHardware = (FakeHardware) { .tlbInvalidationCount = 0 };
+
+    void *permamapped = AddressSpace_mapTemporary(&cpu, frameNumber(0xFF));
+    void *first = AddressSpace_mapTemporary(&cpu, frameNumber(0x200));
+    void *firstAgain = AddressSpace_mapTemporary(&cpu, frameNumber(0x200));
+    void *second = AddressSpace_mapTemporary(&cpu, frameNumber(0x300));
+    ASSERT(theFakeHardware.tlbInvalidationCount == 0);
+    ASSERT(slots[1] == (0x300000 | ptPresent | ptWriteable));
+    void *wrapped = AddressSpace_mapTemporary(&cpu, frameNumber(0x400));
+
+    PhysicalMemory_regions[permamapMemoryRegion].end = savedPermamapEnd;
+    ASSERT(permamapped == frame2virt(frameNumber(0xFF)));
+    ASSERT(first == (void *) TEMPORARY_MAPPING_SLOTS_BEGIN);
+    ASSERT(firstAgain == first);
+    ASSERT(second == (void *) (TEMPORARY_MAPPING_SLOTS_BEGIN + PAGE_SIZE));
+    ASSERT(wrapped == first);
+    ASSERT(slots[0] == (0x400000 | ptPresent | ptWriteable));
+    ASSERT(slots[1] == 0);
+    ASSERT(cpu.temporaryMappings.next == 1);
+    ASSERT(theFakeHardware.tlbInvalidationCount == 1);
+}
+
+static void AddressSpaceTest_batchDefersTlbShootdown() {
+    const size_t totalMemoryFrames = 5;
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[totalMemoryFrames * PAGE_SIZE];
+    Frame frames[totalMemoryFrames];
+    initializePhysicalMemory(fakePhysicalMemory, frames, totalMemoryFrames);
+    theFakeHardware = (FakeHardware) { .lastTlbInvalidationAddress = makeVirtualAddress(0), .tlbInvalidationCount = 0 };
+    Task task;
+    AddressSpace_initialize(&task);
+    FrameNumber first = PhysicalMemory_allocate(&task, permamapMemoryRegion);
+    FrameNumber second = PhysicalMemory_allocate(&task, permamapMemoryRegion);
+    const VirtualAddress a = makeVirtualAddress((3 << 22) | (7 << 12));
+    const VirtualAddress b = makeVirtualAddress((3 << 22) | (8 << 12));
+    AddressSpace_map(&task, a, first);
+    AddressSpace_map(&task, b, second);
+
+    AddressSpace_beginBatch(&task);
+    AddressSpace_beginBatch(&task);
+    AddressSpace_map(&task, a, second);
+    AddressSpace_unmap(&task, b, 0);
+    AddressSpace_endBatch(&task);
+    ASSERT(task.addressSpace.tlbShootdownPageCount == 2);
+    ASSERT(theFakeHardware.lastTlbInvalidationAddress.v == 0);
+    AddressSpace_endBatch(&task);
+
+    ASSERT(task.addressSpace.batchDepth == 0);
+    ASSERT(task.addressSpace.tlbShootdownPageCount == 0);
+    ASSERT(theFakeHardware.lastTlbInvalidationAddress.v == b.v);
+    ASSERT(theFakeHardware.tlbInvalidationCount == 0);
+}
+
+/** CPUs other than the current one, simulated to handle TLB shootdown IPIs while the current one spins. */
+static Cpu *remoteCpus[2];
+static size_t remoteCpuCount;
+
+static void handleTlbShootdownOnRemoteCpus() {
+    for (size_t i = 0; i < remoteCpuCount; i++) AddressSpace_handleTlbShootdownIpi(remoteCpus[i]);
+}
+
+/** Remaps a page of a task active on the current CPU and the specified number of other CPUs. */
+static void remapWithActiveCpus(Task *task, Cpu *cpus, size_t otherCpuCount) {
+    static __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[4 * PAGE_SIZE];
+    static Frame frames[4];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 4);
+    AddressSpace_initialize(task);
+    FrameNumber first = PhysicalMemory_allocate(task, permamapMemoryRegion);
+    FrameNumber second = PhysicalMemory_allocate(task, permamapMemoryRegion);
+    const VirtualAddress virtualAddress = makeVirtualAddress((3 << 22) | (7 << 12));
+    AddressSpace_map(task, virtualAddress, first);
+    Cpu_cpuCount = otherCpuCount + 1;
+    remoteCpuCount = otherCpuCount;
+    for (size_t i = 0; i <= otherCpuCount; i++) {
+        memzero(&cpus[i], sizeof(Cpu));
+        cpus[i].index = i;
+        cpus[i].lapicId = 0x10 + i;
+        Cpu_cpus[i] = &cpus[i];
+        if (i > 0) remoteCpus[i - 1] = &cpus[i];
+        CpuMask_set(&task->addressSpace.activeCpus, i);
+    }
+    theFakeHardware = (FakeHardware) { .currentCpu = &cpus[0], .relaxCallback = handleTlbShootdownOnRemoteCpus };
+
+    AddressSpace_map(task, virtualAddress, second);
+
+    theFakeHardware.relaxCallback = NULL;
+    Cpu_cpuCount = 0;
+}
+
+static void AddressSpaceTest_tlbShootdownToSingleCpu() {
+    static Cpu cpus[2];
+    Task task;
+
+    remapWithActiveCpus(&task, cpus, 1);
+
+    ASSERT(theFakeHardware.ipiCount == 1);
+    ASSERT(theFakeHardware.lapicInterruptCommandHigh == 0x11 << 24);
+    ASSERT(theFakeHardware.lapicInterruptCommandLow == (0x4000 | tlbShootdownIpiVector));
+    ASSERT(task.addressSpace.tlbShootdownPageCount == 0);
+    ASSERT(AtomicWord_get(&task.addressSpace.generation) == 1);
+    ASSERT(!CpuMask_testAndClear(&task.addressSpace.activeCpus, 2));
+    ASSERT(CpuMask_testAndClear(&task.addressSpace.activeCpus, 1));
+}
+
+static void AddressSpaceTest_tlbShootdownToManyCpus() {
+    static Cpu cpus[3];
+    Task task;
+
+    remapWithActiveCpus(&task, cpus, 2);
+
+    ASSERT(theFakeHardware.ipiCount == 2);
+    ASSERT(theFakeHardware.lapicInterruptCommandHigh == 0x12 << 24);
+    ASSERT(theFakeHardware.lapicInterruptCommandLow == (0x4000 | tlbShootdownIpiVector));
+    ASSERT(task.addressSpace.tlbShootdownPageCount == 0);
+}
+
+static void AddressSpaceTest_tlbShootdownIpiNotTargeted() {
+    static Cpu cpus[3];
+    Task task;
+    remapWithActiveCpus(&task, cpus, 1);
+    cpus[2].index = 2;
+    theFakeHardware = (FakeHardware) { .lastTlbInvalidationAddress = makeVirtualAddress(0), .tlbInvalidationCount = 0 };
+
+    AddressSpace_handleTlbShootdownIpi(&cpus[1]);
+    AddressSpace_handleTlbShootdownIpi(&cpus[2]);
+
+    ASSERT(theFakeHardware.lastTlbInvalidationAddress.v == 0);
+    ASSERT(theFakeHardware.tlbInvalidationCount == 0);
+}
+
 void AddressSpaceTest_run() {
     RUN_TEST(AddressSpaceTest_initialize);
     RUN_TEST(AddressSpaceTest_initializeOutOfMemory);
@@ -198,4 +585,19 @@ void AddressSpaceTest_run() {
     RUN_TEST(AddressSpaceTest_mapMultiple);
     RUN_TEST(AddressSpaceTest_mapOutOfMemory);
     RUN_TEST(AddressSpaceTest_mapOverAlreadyMapped);
+    RUN_TEST(AddressSpaceTest_mapRange);
+    RUN_TEST(AddressSpaceTest_mapRangeInvalid);
+    RUN_TEST(AddressSpaceTest_unmapRange);
+    RUN_TEST(AddressSpaceTest_reserveRangeAndPageFault);
+    RUN_TEST(AddressSpaceTest_checkUserRangeMapsReservedPages);
+    RUN_TEST(AddressSpaceTest_mapReadOnly);
+    RUN_TEST(AddressSpaceTest_checkUserRange);
+    RUN_TEST(AddressSpaceTest_mapLarge);
+    RUN_TEST(AddressSpaceTest_mapLargeInvalid);
+    RUN_TEST(AddressSpaceTest_mapLargeFromNewFramesOutOfMemory);
+    RUN_TEST(AddressSpaceTest_mapTemporary);
+    RUN_TEST(AddressSpaceTest_batchDefersTlbShootdown);
+    RUN_TEST(AddressSpaceTest_tlbShootdownToSingleCpu);
+    RUN_TEST(AddressSpaceTest_tlbShootdownToManyCpus);
+    RUN_TEST(AddressSpaceTest_tlbShootdownIpiNotTargeted);
 }
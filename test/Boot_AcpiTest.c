@@ -139,6 +139,59 @@ static void Boot_AcpiTest_doFindConfig() {
     ASSERT(memcmp(&Acpi_hpet, &expectedHpet, sizeof(AcpiHpet)) == 0);
 }
 
+static void Boot_AcpiTest_doFindConfig_numa() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[PAGE_SIZE];
+    memzero(fakePhysicalMemory, PAGE_SIZE);
+    memzero(&Acpi_fadt, sizeof(Acpi_fadt));
+    memzero(Acpi_lapicNodes, sizeof(Acpi_lapicNodes));
+    AcpiRootSystemDescTable *rsdt = (AcpiRootSystemDescTable *) fakePhysicalMemory;
+    rsdt->header.signature = ACPI_RSDT_SIGNATURE;
+    rsdt->header.length = sizeof(AcpiDescriptionHeader) + 3 * sizeof(uint32_t);
+    rsdt->entries[0] = (uint32_t) &fakePhysicalMemory[512];
+    rsdt->entries[1] = (uint32_t) &fakePhysicalMemory[1024];
+    rsdt->entries[2] = (uint32_t) &fakePhysicalMemory[2048];
+    *(AcpiFadt *) &fakePhysicalMemory[512] = (AcpiFadt) { .header.signature = ACPI_FADT_SIGNATURE };
+    AcpiSrat *srat = (AcpiSrat *) &fakePhysicalMemory[1024];
+    AcpiSratProcessorAffinity *processors = (AcpiSratProcessorAffinity *) (srat + 1);
+    AcpiSratMemoryAffinity *memory = (AcpiSratMemoryAffinity *) (processors + 2);
+    srat->header = (AcpiDescriptionHeader) { .signature = ACPI_SRAT_SIGNATURE, .length = (uint8_t *) (memory + 4) - (uint8_t *) srat };
+    processors[0] = (AcpiSratProcessorAffinity) { .type = acpiSratProcessorAffinity, .length = 16, .apicId = 0, .flags = 1 };
+    processors[1] = (AcpiSratProcessorAffinity) { .type = acpiSratProcessorAffinity, .length = 16, .proximityDomainLow = 2, .apicId = 4, .flags = 1 };
+    memory[0] = (AcpiSratMemoryAffinity) { .type = acpiSratMemoryAffinity, .length = 40, .proximityDomain = 0, .baseAddress = 0, .rangeLength = 0x40000000, .flags = 1 };
+    memory[1] = (AcpiSratMemoryAffinity) { .type = acpiSratMemoryAffinity, .length = 40, .proximityDomain = 2, .baseAddress = 0x40000000, .rangeLength = 0x40000000, .flags = 1 };
+    memory[2] = (AcpiSratMemoryAffinity) { .type = acpiSratMemoryAffinity, .length = 40, .proximityDomain = 1, .baseAddress = 0x80000000, .rangeLength = 0x40000000, .flags = 0 };
+    memory[3] = (AcpiSratMemoryAffinity) { .type = acpiSratMemoryAffinity, .length = 40, .proximityDomain = 1, .baseAddress = 0xC0000000, .rangeLength = 0x20000000, .flags = 1 };
+    AcpiSlit *slit = (AcpiSlit *) &fakePhysicalMemory[2048];
+    *slit = (AcpiSlit) { .header = { .signature = ACPI_SLIT_SIGNATURE, .length = sizeof(AcpiSlit) + 9 }, .localityCount = 3 };
+    const uint8_t distances[9] = { 10, 30, 20,  30, 10, 20,  20, 20, 10 };
+    for (size_t i = 0; i < sizeof(distances); ++i) {
+        slit->entries[i] = distances[i];
+    }
+    PhysicalMemory_nodeCount = 1;
+    PhysicalMemory_nodeRangeCount = 0;
+
+    Acpi_doFindConfig(physicalAddress((uintptr_t) fakePhysicalMemory), fakeMapToTemporaryArea);
+
+    size_t nodeCount = PhysicalMemory_nodeCount;
+    size_t nodeRangeCount = PhysicalMemory_nodeRangeCount;
+    PhysicalMemory_nodeCount = 1;
+    PhysicalMemory_nodeRangeCount = 0;
+    ASSERT(nodeCount == 3);
+    ASSERT(nodeRangeCount == 2);
+    ASSERT(PhysicalMemory_nodeRanges[0].begin.v == 0x40000 && PhysicalMemory_nodeRanges[0].end.v == 0x80000);
+    ASSERT(PhysicalMemory_nodeRanges[0].node == 2);
+    ASSERT(PhysicalMemory_nodeRanges[1].begin.v == 0xC0000 && PhysicalMemory_nodeRanges[1].end.v == 0xE0000);
+    ASSERT(PhysicalMemory_nodeRanges[1].node == 1);
+    ASSERT(Acpi_lapicNodes[0] == 0);
+    ASSERT(Acpi_lapicNodes[4] == 2);
+    const uint8_t expectedNodeOrder[PHYSICALMEMORY_MAX_NODES][PHYSICALMEMORY_MAX_NODES] = {
+        { 0, 2, 1, 3 }, { 1, 2, 0, 3 }, { 2, 0, 1, 3 }, { 3, 0, 1, 2 }
+    };
+    ASSERT(memcmp(PhysicalMemory_nodeOrder, expectedNodeOrder, sizeof(expectedNodeOrder)) == 0);
+    memzero(Acpi_lapicNodes, sizeof(Acpi_lapicNodes));
+    PhysicalMemory_initializeNodeOrder(NULL, 0);
+}
+
 void Boot_AcpiTest_run() {
     RUN_TEST(Boot_AcpiTest_doSearchRootSystemDescriptorPointer_present);
     RUN_TEST(Boot_AcpiTest_doSearchRootSystemDescriptorPointer_wrongChecksum);
@@ -146,4 +199,5 @@ void Boot_AcpiTest_run() {
     RUN_TEST(Boot_AcpiTest_mapToTemporaryArea_firstMap);
     RUN_TEST(Boot_AcpiTest_mapToTemporaryArea_alreadyMapped);
     RUN_TEST(Boot_AcpiTest_doFindConfig);
+    RUN_TEST(Boot_AcpiTest_doFindConfig_numa);
 }
@@ -26,11 +26,30 @@ static void initializePhysicalMemory(uint8_t *fakePhysicalMemory, Frame *frames,
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], baseFrame, addToFrameNumber(baseFrame, frameCount));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], addToFrameNumber(baseFrame, frameCount), addToFrameNumber(baseFrame, frameCount));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], addToFrameNumber(baseFrame, frameCount), addToFrameNumber(baseFrame, frameCount));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], addToFrameNumber(baseFrame, frameCount), addToFrameNumber(baseFrame, frameCount));
     PhysicalMemory_frameDescriptors = frames;
     PhysicalMemory_firstFrame = baseFrame;
     PhysicalMemory_add(base, addToPhysicalAddress(base, frameCount * PAGE_SIZE));
 }
 
+#define TEMPORARY_MAPPING_PAGE_TABLE_COUNT (TEMPORARY_MAPPING_SLOTS_SIZE >> LARGE_PAGE_SHIFT)
+
+static void assertTemporaryMappingsProperlyInitialized(PageTable *pageTables, Cpu **cpus, size_t cpuCount) {
+    const size_t slotsPerCpu = (TEMPORARY_MAPPING_SLOTS_SIZE >> PAGE_SHIFT) / cpuCount;
+    for (size_t i = 0; i < TEMPORARY_MAPPING_PAGE_TABLE_COUNT; i++) {
+        PageTableEntry pde = *AddressSpace_getKernelPageDirectoryEntry(makeVirtualAddress(TEMPORARY_MAPPING_SLOTS_BEGIN + i * LARGE_PAGE_SIZE));
+        ASSERT(pde == (virt2phys(&pageTables[i]).v | ptPresent | ptWriteable));
+        for (size_t j = 0; j < PAGE_TABLE_LENGTH; j++)
+            ASSERT(pageTables[i].entries[j] == 0);
+    }
+    for (size_t i = 0; i < cpuCount; i++) {
+        ASSERT(cpus[i]->temporaryMappings.slots == pageTables[0].entries + i * slotsPerCpu);
+        ASSERT(cpus[i]->temporaryMappings.begin == TEMPORARY_MAPPING_SLOTS_BEGIN + i * slotsPerCpu * PAGE_SIZE);
+        ASSERT(cpus[i]->temporaryMappings.count == slotsPerCpu);
+        ASSERT(cpus[i]->temporaryMappings.next == 0);
+    }
+}
+
 static void assertCpuProperlyInitialized(Cpu *cpu, int index, int lapicId) {
     ThreadRegisters expectedIdleThreadRegisters = {
         .gs = kernelGS,
@@ -46,16 +65,25 @@ static void assertCpuProperlyInitialized(Cpu *cpu, int index, int lapicId) {
     ASSERT(cpu->currentThread == &cpu->idleThread);
     ASSERT(cpu->nextThread == &cpu->idleThread);
     ASSERT(cpu->tss.ss0 == flatKernelDS);
-    ASSERT(cpu->tss.esp0 == (uint32_t) &cpu->idleThread.regsBuf + offsetof(ThreadRegisters, edi));
+    ASSERT(cpu->tss.esp0 == (uint32_t) cpu->idleThread.regs + offsetof(ThreadRegisters, edi));
+    ASSERT(cpu->idleThread.regs == (ThreadRegisters *) (cpu->idleThread.stack + PAGE_SIZE) - 1);
     ASSERT(cpu->idleThread.cpu == cpu);
     ASSERT(cpu->kernelEntryCount == 1);
+    ASSERT(TimerWheel_isEmpty(cpu->timerWheel));
     ASSERT(memcmp(cpu->idleThread.regs, &expectedIdleThreadRegisters, sizeof(ThreadRegisters)) == 0);
 }
 
 static void Boot_CpuTest_initializeCpuStructs_multiProcessor() {
-    const size_t totalMemoryFrames = 3;
+    const size_t totalMemoryFrames = 9 + TEMPORARY_MAPPING_PAGE_TABLE_COUNT;
     struct {
+        PageTable temporaryMappingPageTables[TEMPORARY_MAPPING_PAGE_TABLE_COUNT];
+        uint8_t frameCache1[PAGE_SIZE];
+        uint8_t timerWheel1[PAGE_SIZE];
+        uint8_t idleThreadStack1[PAGE_SIZE];
         Cpu cpu1;
+        uint8_t frameCache0[PAGE_SIZE];
+        uint8_t timerWheel0[PAGE_SIZE];
+        uint8_t idleThreadStack0[PAGE_SIZE];
         Cpu cpu0;
         PageTable lapicPageTable;
     } __attribute__ ((aligned(PAGE_SIZE))) fakePhysicalMemory;
@@ -80,11 +108,22 @@ static void Boot_CpuTest_initializeCpuStructs_multiProcessor() {
     ASSERT(bootCpu == &fakePhysicalMemory.cpu1);
     assertCpuProperlyInitialized(&fakePhysicalMemory.cpu0, 0, 0x00);
     assertCpuProperlyInitialized(&fakePhysicalMemory.cpu1, 1, 0x02);
+    ASSERT(fakePhysicalMemory.cpu0.timerWheel == (TimerWheel *) fakePhysicalMemory.timerWheel0);
+    ASSERT(fakePhysicalMemory.cpu1.timerWheel == (TimerWheel *) fakePhysicalMemory.timerWheel1);
+    ASSERT(fakePhysicalMemory.cpu0.idleThread.stack == fakePhysicalMemory.idleThreadStack0);
+    ASSERT(fakePhysicalMemory.cpu1.idleThread.stack == fakePhysicalMemory.idleThreadStack1);
+    ASSERT(fakePhysicalMemory.cpu0.frameCache == (FrameCache *) fakePhysicalMemory.frameCache0);
+    ASSERT(fakePhysicalMemory.cpu1.frameCache == (FrameCache *) fakePhysicalMemory.frameCache1);
+    assertTemporaryMappingsProperlyInitialized(fakePhysicalMemory.temporaryMappingPageTables, (Cpu *[]) { &fakePhysicalMemory.cpu0, &fakePhysicalMemory.cpu1 }, 2);
 }
 
 static void Boot_CpuTest_initializeCpuStructs_noMultiProcessorSpecification() {
-    const size_t totalMemoryFrames = 2;
+    const size_t totalMemoryFrames = 5 + TEMPORARY_MAPPING_PAGE_TABLE_COUNT;
     struct {
+        PageTable temporaryMappingPageTables[TEMPORARY_MAPPING_PAGE_TABLE_COUNT];
+        uint8_t frameCache0[PAGE_SIZE];
+        uint8_t timerWheel0[PAGE_SIZE];
+        uint8_t idleThreadStack0[PAGE_SIZE];
         Cpu cpu0;
         PageTable lapicPageTable;
     } __attribute__ ((aligned(PAGE_SIZE))) fakePhysicalMemory;
@@ -98,9 +137,48 @@ static void Boot_CpuTest_initializeCpuStructs_noMultiProcessorSpecification() {
     ASSERT(fakePhysicalMemory.lapicPageTable.entries[(CPU_LAPIC_VIRTUAL_ADDRESS >> 12) & 0x3FF] == (CPU_LAPIC_DEFAULT_PHYSICAL_ADDRESS.v  | ptPresent | ptWriteable | ptGlobal | ptCacheDisable));
     ASSERT(bootCpu == &fakePhysicalMemory.cpu0);
     assertCpuProperlyInitialized(&fakePhysicalMemory.cpu0, 0, 0x00);
+    ASSERT(fakePhysicalMemory.cpu0.timerWheel == (TimerWheel *) fakePhysicalMemory.timerWheel0);
+    ASSERT(fakePhysicalMemory.cpu0.idleThread.stack == fakePhysicalMemory.idleThreadStack0);
+    ASSERT(fakePhysicalMemory.cpu0.frameCache == (FrameCache *) fakePhysicalMemory.frameCache0);
+    assertTemporaryMappingsProperlyInitialized(fakePhysicalMemory.temporaryMappingPageTables, (Cpu *[]) { &fakePhysicalMemory.cpu0 }, 1);
+}
+
+static void Boot_CpuTest_calibrateTimers_bootstrapProcessorWithHpet() {
+    static Cpu cpu;
+    memzero(&cpu, sizeof(Cpu));
+    Hpet_theInstance = (Hpet) { .available = true, .counter64Bit = true, .periodFemtoseconds = 10000000, .nsPerTick = 10 << 20 };
+    theFakeHardware = (FakeHardware) {
+        .hpetMainCounterIncrement = 1,
+        .tscIncrement = 10000000, // 1 GHz over 10 ms, as the TSC is read only at the beginning and at the end
+        .lapicTimerCurrentCount = 0xFFFFFFFF - 62500 // 6.25 MHz over 10 ms
+    };
+
+    Cpu_calibrateTimers(&cpu);
+
+    ASSERT(cpu.tsc.nsPerTick == 1 << 20);
+    ASSERT(cpu.tsc.ticksPerNs == 1 << 23);
+    ASSERT(cpu.lapicTimer.tscDeadlineMode == false);
+    ASSERT(cpu.lapicTimer.nsPerTick == 160 << 20);
+    ASSERT(cpu.lapicTimer.ticksPerNs == 52429);
+    ASSERT(cpu.lapicTimer.nextExpirationNanoseconds == LAPICTIMER_DISARMED);
+    ASSERT(theFakeHardware.lapicTimerLvt == lapicTimerVector);
+    ASSERT(theFakeHardware.lapicTimerDivider == 0x03);
+    ASSERT(theFakeHardware.lapicTimerInitialCount == 0);
+    memzero(&Hpet_theInstance, sizeof(Hpet));
+}
+
+static void Boot_CpuTest_matchesCalibration() {
+    const uint32_t oneGigahertz = 1 << 23;
+    ASSERT(Cpu_matchesCalibration(1000000, 1000000, oneGigahertz));
+    ASSERT(Cpu_matchesCalibration(1007000, 1000000, oneGigahertz));
+    ASSERT(Cpu_matchesCalibration(993000, 1000000, oneGigahertz));
+    ASSERT(!Cpu_matchesCalibration(1010000, 1000000, oneGigahertz));
+    ASSERT(!Cpu_matchesCalibration(990000, 1000000, oneGigahertz));
 }
 
 void Boot_CpuTest_run() {
     RUN_TEST(Boot_CpuTest_initializeCpuStructs_multiProcessor);
     RUN_TEST(Boot_CpuTest_initializeCpuStructs_noMultiProcessorSpecification);
+    RUN_TEST(Boot_CpuTest_calibrateTimers_bootstrapProcessorWithHpet);
+    RUN_TEST(Boot_CpuTest_matchesCalibration);
 }
@@ -0,0 +1,105 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "test.h"
+#include "kernel.h"
+#include "hardware/hardware.h"
+
+static const AcpiHpet fakeAcpiHpet = {
+    .header.signature = ACPI_HPET_SIGNATURE,
+    .baseAddress = { .addressSpaceId = 0, .address = 0xFED00000 }
+};
+
+static void Boot_HpetTest_initialize_sharingLapicPageTable() {
+    static PageTable pageTable __attribute__ ((aligned(PAGE_SIZE)));
+    memzero(&pageTable, sizeof(PageTable));
+    memzero(&Boot_kernelPageDirectory, sizeof(PageTable));
+    Boot_kernelPageDirectory.entries[HPET_VIRTUAL_ADDRESS >> 22] = virt2phys(&pageTable).v | ptPresent | ptWriteable;
+    Acpi_hpet = fakeAcpiHpet;
+    theFakeHardware = (FakeHardware) { .hpetCapabilities = 0x8086A701, .hpetPeriod = 69841279 };
+
+    Hpet_initialize();
+
+    ASSERT(Hpet_theInstance.available == true);
+    ASSERT(Hpet_theInstance.counter64Bit == true);
+    ASSERT(Hpet_theInstance.periodFemtoseconds == 69841279);
+    ASSERT(Hpet_theInstance.nsPerTick == 73233889);
+    ASSERT(theFakeHardware.hpetConfiguration == hpetConfigurationEnable);
+    ASSERT(pageTable.entries[(HPET_VIRTUAL_ADDRESS >> 12) & 0x3FF] == (0xFED00000 | ptPresent | ptWriteable | ptGlobal | ptCacheDisable));
+    ASSERT(Hpet_isMonotonicClock());
+    memzero(&Hpet_theInstance, sizeof(Hpet));
+}
+
+static void Boot_HpetTest_initialize_32BitCounter() {
+    static PageTable pageTable __attribute__ ((aligned(PAGE_SIZE)));
+    memzero(&pageTable, sizeof(PageTable));
+    memzero(&Boot_kernelPageDirectory, sizeof(PageTable));
+    Boot_kernelPageDirectory.entries[HPET_VIRTUAL_ADDRESS >> 22] = virt2phys(&pageTable).v | ptPresent | ptWriteable;
+    Acpi_hpet = fakeAcpiHpet;
+    theFakeHardware = (FakeHardware) { .hpetCapabilities = 0x80868501, .hpetPeriod = 100000000 };
+
+    Hpet_initialize();
+
+    ASSERT(Hpet_theInstance.available == true);
+    ASSERT(Hpet_theInstance.counter64Bit == false);
+    ASSERT(Hpet_theInstance.nsPerTick == 100 << 20);
+    ASSERT(!Hpet_isMonotonicClock());
+    memzero(&Hpet_theInstance, sizeof(Hpet));
+}
+
+static void Boot_HpetTest_initialize_missing() {
+    memzero(&Boot_kernelPageDirectory, sizeof(PageTable));
+    memzero(&Acpi_hpet, sizeof(AcpiHpet));
+    memzero(&theFakeHardware, sizeof(FakeHardware));
+
+    Hpet_initialize();
+
+    ASSERT(Hpet_theInstance.available == false);
+    ASSERT(Boot_kernelPageDirectory.entries[HPET_VIRTUAL_ADDRESS >> 22] == 0);
+}
+
+static void Boot_HpetTest_initialize_unalignedBaseAddress() {
+    memzero(&Boot_kernelPageDirectory, sizeof(PageTable));
+    Acpi_hpet = fakeAcpiHpet;
+    Acpi_hpet.baseAddress.address = 0xFED00400;
+    theFakeHardware = (FakeHardware) { .hpetCapabilities = 0x8086A701, .hpetPeriod = 69841279 };
+
+    Hpet_initialize();
+
+    ASSERT(Hpet_theInstance.available == false);
+    ASSERT(Boot_kernelPageDirectory.entries[HPET_VIRTUAL_ADDRESS >> 22] == 0);
+    ASSERT(theFakeHardware.hpetConfiguration == 0);
+}
+
+static void Boot_HpetTest_readNanoseconds() {
+    Hpet_theInstance = (Hpet) { .available = true, .counter64Bit = true, .periodFemtoseconds = 69841279, .nsPerTick = 73233889 };
+    theFakeHardware = (FakeHardware) { .hpetMainCounter = (5ULL << 32) + 1000 };
+
+    uint64_t ns = Hpet_readNanoseconds();
+
+    ASSERT(ns == 1499830116561ULL);
+    ASSERT(Hpet_convertNanosecondsToTicks(10000000) == 143182);
+    memzero(&Hpet_theInstance, sizeof(Hpet));
+}
+
+void Boot_HpetTest_run() {
+    RUN_TEST(Boot_HpetTest_initialize_sharingLapicPageTable);
+    RUN_TEST(Boot_HpetTest_initialize_32BitCounter);
+    RUN_TEST(Boot_HpetTest_initialize_missing);
+    RUN_TEST(Boot_HpetTest_initialize_unalignedBaseAddress);
+    RUN_TEST(Boot_HpetTest_readNanoseconds);
+}
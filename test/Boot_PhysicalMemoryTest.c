@@ -18,6 +18,43 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "test.h"
 #include "kernel.h"
 
+/** Returns true if frames [begin, end) form a free block linked in the appropriate free list of the region. */
+static bool isFreeBlock(const PhysicalMemoryRegion *region, Frame *frames, size_t begin, size_t end) {
+    size_t length = end - begin;
+    if (Frame_getFreeBlockLength(&frames[begin]) != length || Frame_getFreeBlockLength(&frames[end - 1]) != length) return false;
+    if (!Frame_isFree(&frames[begin]) || !Frame_isFree(&frames[end - 1])) return false;
+    const LinkedList_Node *head = &region->freeLists[31 - __builtin_clz(length)];
+    for (const LinkedList_Node *n = head->next; n != head; n = n->next)
+        if (n == &frames[begin].node) return true;
+    return false;
+}
+
+/** Returns true if the specified frame belongs to a free block of any region. */
+static bool isInFreeBlock(size_t frame) {
+    for (size_t r = 0; r < physicalMemoryRegionCount; r++) {
+        for (size_t i = 0; i < PHYSICALMEMORY_FREE_LIST_COUNT; i++) {
+            const LinkedList_Node *head = &PhysicalMemory_regions[r].freeLists[i];
+            for (LinkedList_Node *n = head->next; n != head; n = n->next) {
+                size_t blockBegin = getFrameNumber(Frame_fromNode(n)).v;
+                if (frame >= blockBegin && frame < blockBegin + Frame_getFreeBlockLength(Frame_fromNode(n))) return true;
+            }
+        }
+    }
+    return false;
+}
+
+/** Returns the number of free blocks in all free lists of the region, or -1 if the free list bitmap is inconsistent. */
+static size_t countFreeBlocks(const PhysicalMemoryRegion *region) {
+    size_t count = 0;
+    for (size_t i = 0; i < PHYSICALMEMORY_FREE_LIST_COUNT; i++) {
+        const LinkedList_Node *head = &region->freeLists[i];
+        if ((head->next != head) != ((region->nonEmptyFreeLists & (1u << i)) != 0)) return (size_t) -1;
+        for (const LinkedList_Node *n = head->next; n != head; n = n->next)
+            count++;
+    }
+    return count;
+}
+
 /******************************************************************************
  * PhysicalMemoryRegion
  ******************************************************************************/
@@ -25,8 +62,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 static void Boot_PhysicalMemoryRegionTest_initialize() {
     PhysicalMemoryRegion region;
     PhysicalMemoryRegion_initialize(&region, frameNumber(1000), frameNumber(2000));
-    ASSERT(region.freeListHead.next == &region.freeListHead);
-    ASSERT(region.freeListHead.prev == &region.freeListHead);
+    for (size_t i = 0; i < PHYSICALMEMORY_FREE_LIST_COUNT; i++) {
+        ASSERT(region.freeLists[i].next == &region.freeLists[i]);
+        ASSERT(region.freeLists[i].prev == &region.freeLists[i]);
+    }
+    ASSERT(region.nonEmptyFreeLists == 0);
     ASSERT(region.begin.v == 1000);
     ASSERT(region.end.v == 2000);
     ASSERT(region.freeFrameCount == 0);
@@ -42,9 +82,39 @@ static void Boot_PhysicalMemoryRegionTest_add() {
     PhysicalMemoryRegion_add(&region, frameNumber(20), frameNumber(22));
     
     ASSERT(region.freeFrameCount == 2);
-    ASSERT(region.freeListHead.next == &frames[21].node);
-    ASSERT(frames[21].node.next == &frames[20].node);
-    ASSERT(frames[20].node.next == &region.freeListHead);
+    ASSERT(countFreeBlocks(&region) == 1);
+    ASSERT(isFreeBlock(&region, frames, 20, 22));
+}
+
+static void Boot_PhysicalMemoryRegionTest_addAdjacent() {
+    PhysicalMemoryRegion region;
+    PhysicalMemoryRegion_initialize(&region, frameNumber(10), frameNumber(30));
+    Frame frames[30];
+    memzero(frames, sizeof(frames));
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemoryRegion_add(&region, frameNumber(20), frameNumber(22));
+    PhysicalMemoryRegion_add(&region, frameNumber(25), frameNumber(27));
+
+    PhysicalMemoryRegion_add(&region, frameNumber(21), frameNumber(26));
+
+    ASSERT(region.freeFrameCount == 7);
+    ASSERT(countFreeBlocks(&region) == 1);
+    ASSERT(isFreeBlock(&region, frames, 20, 27));
+}
+
+static void Boot_PhysicalMemoryRegionTest_addWritesOnlyBoundaryTags() {
+    PhysicalMemoryRegion region;
+    PhysicalMemoryRegion_initialize(&region, frameNumber(10), frameNumber(30));
+    Frame frames[30];
+    memzero(frames, sizeof(frames));
+    PhysicalMemory_frameDescriptors = frames;
+
+    PhysicalMemoryRegion_add(&region, frameNumber(20), frameNumber(25));
+
+    ASSERT(region.freeFrameCount == 5);
+    ASSERT(isFreeBlock(&region, frames, 20, 25));
+    for (size_t i = 21; i < 24; i++)
+        ASSERT(frames[i].taskAndType == 0 && frames[i].virtualAddress.v == 0);
 }
 
 static void Boot_PhysicalMemoryRegionTest_remove() {
@@ -58,8 +128,11 @@ static void Boot_PhysicalMemoryRegionTest_remove() {
     PhysicalMemoryRegion_remove(&region, frameNumber(27), frameNumber(29));
     
     ASSERT(region.freeFrameCount == 8);
-    ASSERT(region.freeListHead.next == &frames[29].node);
-    ASSERT(frames[29].node.next == &frames[26].node);
+    ASSERT(countFreeBlocks(&region) == 2);
+    ASSERT(isFreeBlock(&region, frames, 20, 27));
+    ASSERT(isFreeBlock(&region, frames, 29, 30));
+    ASSERT(Frame_getTask(&frames[27]) == NULL);
+    ASSERT(Frame_getTask(&frames[28]) == NULL);
 }
 
 
@@ -73,21 +146,22 @@ static void Boot_PhysicalMemoryTest_add() {
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(10));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(15), frameNumber(20));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(30));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(30), frameNumber(30));
     PhysicalMemory_frameDescriptors = frames;
     
     PhysicalMemory_add(physicalAddress(0), physicalAddress(30 * PAGE_SIZE));
     
     ASSERT(PhysicalMemory_regions[0].freeFrameCount == 10);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.next == &frames[9].node);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.prev == &frames[0].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[0]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[0], frames, 0, 10));
 
     ASSERT(PhysicalMemory_regions[1].freeFrameCount == 5);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.next == &frames[19].node);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.prev == &frames[15].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[1]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[1], frames, 15, 20));
 
     ASSERT(PhysicalMemory_regions[2].freeFrameCount == 10);
-    ASSERT(PhysicalMemory_regions[2].freeListHead.next == &frames[29].node);
-    ASSERT(PhysicalMemory_regions[2].freeListHead.prev == &frames[20].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[2]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[2], frames, 20, 30));
 }
 
 static void Boot_PhysicalMemoryTest_addUnaligned() {
@@ -96,21 +170,59 @@ static void Boot_PhysicalMemoryTest_addUnaligned() {
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(10));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(15), frameNumber(20));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(30));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(30), frameNumber(30));
     PhysicalMemory_frameDescriptors = frames;
     
     PhysicalMemory_add(physicalAddress(16), physicalAddress(29 * PAGE_SIZE + 16));
     
     ASSERT(PhysicalMemory_regions[0].freeFrameCount == 10);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.next == &frames[9].node);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.prev == &frames[0].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[0]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[0], frames, 0, 10));
 
     ASSERT(PhysicalMemory_regions[1].freeFrameCount == 5);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.next == &frames[19].node);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.prev == &frames[15].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[1]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[1], frames, 15, 20));
 
     ASSERT(PhysicalMemory_regions[2].freeFrameCount == 10);
-    ASSERT(PhysicalMemory_regions[2].freeListHead.next == &frames[29].node);
-    ASSERT(PhysicalMemory_regions[2].freeListHead.prev == &frames[20].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[2]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[2], frames, 20, 30));
+}
+
+static void Boot_PhysicalMemoryTest_addToNodes() {
+    Frame frames[30];
+    memzero(frames, sizeof(frames));
+    for (size_t node = 0; node < 2; ++node) {
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, 0), frameNumber(0),  frameNumber(10));
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, 1), frameNumber(10), frameNumber(20));
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, 2), frameNumber(20), frameNumber(30));
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, 3), frameNumber(30), frameNumber(30));
+    }
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_nodeCount = 1;
+    PhysicalMemory_nodeRangeCount = 0;
+    PhysicalMemory_addNodeRange(frameNumber(15), frameNumber(25), 1);
+
+    PhysicalMemory_add(physicalAddress(0), physicalAddress(30 * PAGE_SIZE));
+
+    size_t nodeCount = PhysicalMemory_nodeCount;
+    PhysicalMemory_nodeCount = 1;
+    PhysicalMemory_nodeRangeCount = 0;
+    ASSERT(nodeCount == 2);
+    ASSERT(PhysicalMemory_getRegion(0, 0)->freeFrameCount == 10);
+    ASSERT(isFreeBlock(PhysicalMemory_getRegion(0, 0), frames, 0, 10));
+    ASSERT(PhysicalMemory_getRegion(1, 0)->freeFrameCount == 0);
+
+    // the first frame of node 1 is withheld so that it cannot coalesce with node 0
+    ASSERT(PhysicalMemory_getRegion(0, 1)->freeFrameCount == 5);
+    ASSERT(isFreeBlock(PhysicalMemory_getRegion(0, 1), frames, 10, 15));
+    ASSERT(PhysicalMemory_getRegion(1, 1)->freeFrameCount == 4);
+    ASSERT(isFreeBlock(PhysicalMemory_getRegion(1, 1), frames, 16, 20));
+
+    // a node beginning at the region boundary loses no frame, the node following it does
+    ASSERT(PhysicalMemory_getRegion(1, 2)->freeFrameCount == 5);
+    ASSERT(isFreeBlock(PhysicalMemory_getRegion(1, 2), frames, 20, 25));
+    ASSERT(PhysicalMemory_getRegion(0, 2)->freeFrameCount == 4);
+    ASSERT(isFreeBlock(PhysicalMemory_getRegion(0, 2), frames, 26, 30));
 }
 
 static void Boot_PhysicalMemoryTest_remove() {
@@ -119,18 +231,19 @@ static void Boot_PhysicalMemoryTest_remove() {
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(10));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(15), frameNumber(20));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(30));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(30), frameNumber(30));
     PhysicalMemory_frameDescriptors = frames;
     PhysicalMemory_add(physicalAddress(0), physicalAddress(30 * PAGE_SIZE));
     
     PhysicalMemory_remove(physicalAddress(9 * PAGE_SIZE), physicalAddress(16 * PAGE_SIZE));
     
     ASSERT(PhysicalMemory_regions[0].freeFrameCount == 9);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.next == &frames[8].node);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.prev == &frames[0].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[0]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[0], frames, 0, 9));
 
     ASSERT(PhysicalMemory_regions[1].freeFrameCount == 4);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.next == &frames[19].node);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.prev == &frames[16].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[1]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[1], frames, 16, 20));
 }
 
 static void Boot_PhysicalMemoryTest_removeUnaligned() {
@@ -139,18 +252,19 @@ static void Boot_PhysicalMemoryTest_removeUnaligned() {
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(10));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(15), frameNumber(20));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(30));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(30), frameNumber(30));
     PhysicalMemory_frameDescriptors = frames;
     PhysicalMemory_add(physicalAddress(0), physicalAddress(30 * PAGE_SIZE));
     
     PhysicalMemory_remove(physicalAddress(9 * PAGE_SIZE + 16), physicalAddress(15 * PAGE_SIZE + 16));
     
     ASSERT(PhysicalMemory_regions[0].freeFrameCount == 9);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.next == &frames[8].node);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.prev == &frames[0].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[0]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[0], frames, 0, 9));
 
     ASSERT(PhysicalMemory_regions[1].freeFrameCount == 4);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.next == &frames[19].node);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.prev == &frames[16].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[1]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[1], frames, 16, 20));
 }
 
 static void Boot_PhysicalMemoryTest_initializeFromMultibootV1() {
@@ -159,6 +273,7 @@ static void Boot_PhysicalMemoryTest_initializeFromMultibootV1() {
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(7));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(10), frameNumber(20));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(30));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(30), frameNumber(30));
     MultibootMemoryMap memoryMaps[3] = {
         (MultibootMemoryMap) { .size = 20, .base_addr_low =  0 * PAGE_SIZE, .length_low =  7 * PAGE_SIZE, .type = 1 },
         (MultibootMemoryMap) { .size = 20, .base_addr_low =  7 * PAGE_SIZE, .length_low =  3 * PAGE_SIZE, .type = 3 },
@@ -183,8 +298,8 @@ static void Boot_PhysicalMemoryTest_initializeFromMultibootV1() {
 
     PhysicalAddress kernelEnd = PhysicalMemory_findKernelEnd(&mbi, physicalAddress(11 * PAGE_SIZE), physicalAddress(12 * PAGE_SIZE));
     PhysicalAddress multibootModulesEnd = PhysicalMemory_findMultibootModulesEnd(&mbi);
-    PhysicalAddress physicalAddressUpperBound = PhysicalMemory_findPhysicalAddressUpperBound(&mbi);
-    PhysicalMemory_totalMemoryFrames = physicalAddressUpperBound.v >> PAGE_SHIFT;
+    FrameNumber frameNumberUpperBound = PhysicalMemory_findFrameNumberUpperBound(&mbi);
+    PhysicalMemory_totalMemoryFrames = frameNumberUpperBound.v;
     PhysicalMemory_frameDescriptors = frames;
     PhysicalMemory_addFreeMemoryBlocks(&mbi);
     PhysicalMemory_markInitialMemoryAsAllocated(&mbi, physicalAddress(11 * PAGE_SIZE), kernelEnd);
@@ -196,18 +311,23 @@ static void Boot_PhysicalMemoryTest_initializeFromMultibootV1() {
     };
     ASSERT(kernelEnd.v == 13 * PAGE_SIZE);
     ASSERT(multibootModulesEnd.v == 16 * PAGE_SIZE);
-    ASSERT(physicalAddressUpperBound.v == 28 * PAGE_SIZE);
-    for (size_t i = 0; i < 30; i++)
-        ASSERT((!availableFrames[i] && Frame_getTask(&frames[i]) == NULL) || (availableFrames[i] && Frame_getTask(&frames[i]) != NULL));
+    ASSERT(frameNumberUpperBound.v == 28);
+    for (size_t i = 0; i < 30; i++) {
+        ASSERT(isInFreeBlock(i) == availableFrames[i]);
+        if (!availableFrames[i]) ASSERT(!Frame_isFree(&frames[i]));
+    }
 }
 
 
 void Boot_PhysicalMemoryTest_run() {
     RUN_TEST(Boot_PhysicalMemoryRegionTest_initialize);
     RUN_TEST(Boot_PhysicalMemoryRegionTest_add);
+    RUN_TEST(Boot_PhysicalMemoryRegionTest_addAdjacent);
+    RUN_TEST(Boot_PhysicalMemoryRegionTest_addWritesOnlyBoundaryTags);
     RUN_TEST(Boot_PhysicalMemoryRegionTest_remove);
     RUN_TEST(Boot_PhysicalMemoryTest_add);
     RUN_TEST(Boot_PhysicalMemoryTest_addUnaligned);
+    RUN_TEST(Boot_PhysicalMemoryTest_addToNodes);
     RUN_TEST(Boot_PhysicalMemoryTest_remove);
     RUN_TEST(Boot_PhysicalMemoryTest_removeUnaligned);
     RUN_TEST(Boot_PhysicalMemoryTest_initializeFromMultibootV1);
@@ -0,0 +1,147 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "test.h"
+#include "kernel.h"
+
+static void initializePhysicalMemory(uint8_t *fakePhysicalMemory, Frame *frames, size_t frameCount) {
+    memzero(frames, frameCount * sizeof(Frame));
+    PhysicalAddress base = virt2phys(fakePhysicalMemory);
+    FrameNumber baseFrame = floorToFrame(base);
+    FrameNumber endFrame = addToFrameNumber(baseFrame, frameCount);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], baseFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], endFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], endFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], endFrame, endFrame);
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_firstFrame = baseFrame;
+    PhysicalMemory_totalMemoryFrames = endFrame.v;
+    PhysicalMemory_add(base, addToPhysicalAddress(base, frameCount * PAGE_SIZE));
+}
+
+static void CapabilityTableTest_allocate() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[2];
+    Task task;
+    CapabilityTable ct;
+    initializePhysicalMemory(fakePhysicalMemory, frames, 2);
+    ASSERT(CapabilityTable_initialize(&ct, &task) == 0);
+
+    Capability *first = CapabilityTable_allocate(&ct, &task);
+    Capability *second = CapabilityTable_allocate(&ct, &task);
+
+    ASSERT(first != NULL);
+    ASSERT(second != NULL);
+    ASSERT(ct.leafCount == 1);
+    ASSERT(CapabilityTable_getAddress(first) == 1 << 4);
+    ASSERT(CapabilityTable_getAddress(second) == 2 << 4);
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(CapabilityTable_getAddress(first))) == first);
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(CapabilityTable_getAddress(second))) == second);
+}
+
+static void CapabilityTableTest_lookupOutOfRange() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[2];
+    Task task;
+    CapabilityTable ct;
+    initializePhysicalMemory(fakePhysicalMemory, frames, 2);
+    ASSERT(CapabilityTable_initialize(&ct, &task) == 0);
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(1 << 4)) == NULL);
+    CapabilityTable_allocate(&ct, &task);
+
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(0)) == NULL);
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(CAPABILITYTABLE_LEAF_ENTRIES << 4)) == NULL);
+    Capability *neverAllocated = CapabilityTable_lookup(&ct, makeCapabilityAddress((CAPABILITYTABLE_LEAF_ENTRIES - 1) << 4));
+    ASSERT(neverAllocated != NULL);
+    ASSERT(Capability_getObjectType(neverAllocated) == kobjNone);
+}
+
+static void CapabilityTableTest_lookupOutOfRangeGeneration() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[2];
+    Task task;
+    CapabilityTable ct;
+    initializePhysicalMemory(fakePhysicalMemory, frames, 2);
+    ASSERT(CapabilityTable_initialize(&ct, &task) == 0);
+    Capability *cap = CapabilityTable_allocate(&ct, &task);
+    const uintptr_t outOfRangeGeneration = 1u << (CAPABILITYTABLE_GENERATION_BITS + CAPABILITYTABLE_INDEX_BITS + 4);
+
+    ASSERT(outOfRangeGeneration == 0x80000000);
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(outOfRangeGeneration)) == NULL); // aliasing the reserved entry 0
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(outOfRangeGeneration | CapabilityTable_getAddress(cap))) == NULL);
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(CapabilityTable_getAddress(cap))) == cap);
+}
+
+static void CapabilityTableTest_lookupStaleAddress() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[2];
+    Task task;
+    CapabilityTable ct;
+    initializePhysicalMemory(fakePhysicalMemory, frames, 2);
+    ASSERT(CapabilityTable_initialize(&ct, &task) == 0);
+    Capability *cap = CapabilityTable_allocate(&ct, &task);
+    cap->obj = (uintptr_t) &task | kobjTask;
+    uintptr_t staleAddress = CapabilityTable_getAddress(cap);
+
+    CapabilityTable_deallocate(&ct, cap);
+    Capability *reused = CapabilityTable_allocate(&ct, &task);
+    uintptr_t address = CapabilityTable_getAddress(reused);
+
+    ASSERT(reused == cap);
+    ASSERT(address != staleAddress);
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(staleAddress)) == NULL);
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(address)) == reused);
+}
+
+static void CapabilityTableTest_grow() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[3 * PAGE_SIZE];
+    Frame frames[3];
+    Task task;
+    CapabilityTable ct;
+    initializePhysicalMemory(fakePhysicalMemory, frames, 3);
+    ASSERT(CapabilityTable_initialize(&ct, &task) == 0);
+    for (size_t i = 1; i < CAPABILITYTABLE_LEAF_ENTRIES; i++) ASSERT(CapabilityTable_allocate(&ct, &task) != NULL);
+    ASSERT(ct.leafCount == 1);
+
+    Capability *cap = CapabilityTable_allocate(&ct, &task);
+
+    ASSERT(cap != NULL);
+    ASSERT(ct.leafCount == 2);
+    ASSERT(CapabilityTable_getAddress(cap) == CAPABILITYTABLE_LEAF_ENTRIES << 4);
+    ASSERT(CapabilityTable_lookup(&ct, makeCapabilityAddress(CAPABILITYTABLE_LEAF_ENTRIES << 4)) == cap);
+}
+
+static void CapabilityTableTest_outOfMemory() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[PAGE_SIZE];
+    Frame frames[1];
+    Task task;
+    CapabilityTable ct;
+    initializePhysicalMemory(fakePhysicalMemory, frames, 1);
+    ASSERT(CapabilityTable_initialize(&ct, &task) == 0);
+
+    ASSERT(CapabilityTable_allocate(&ct, &task) == NULL);
+    ASSERT(CapabilityTable_initialize(&ct, &task) == -ENOMEM);
+}
+
+void CapabilityTableTest_run() {
+    RUN_TEST(CapabilityTableTest_allocate);
+    RUN_TEST(CapabilityTableTest_lookupOutOfRange);
+    RUN_TEST(CapabilityTableTest_lookupOutOfRangeGeneration);
+    RUN_TEST(CapabilityTableTest_lookupStaleAddress);
+    RUN_TEST(CapabilityTableTest_grow);
+    RUN_TEST(CapabilityTableTest_outOfMemory);
+}
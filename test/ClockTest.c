@@ -0,0 +1,82 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "test.h"
+#include "kernel.h"
+
+static void ClockTest_publish() {
+    static ClockPage page;
+    memzero(&page, sizeof(ClockPage));
+    Clock_page = &page;
+    const Tsc tsc = { .nsPerTick = 1 << 19, .invariant = true };
+
+    Clock_publish(&tsc, 1000, 500);
+
+    ASSERT(page.sequence == 2);
+    ASSERT(page.nsPerTick == 1 << 19);
+    ASSERT(page.tscBase == 1000);
+    ASSERT(page.nsBase == 500);
+    ASSERT(page.tscUsable != 0);
+    Clock_page = NULL;
+}
+
+static void ClockTest_publish_nonInvariantTsc() {
+    static ClockPage page;
+    memzero(&page, sizeof(ClockPage));
+    page.sequence = 42;
+    Clock_page = &page;
+    const Tsc tsc = { .nsPerTick = 1 << 20, .invariant = false };
+
+    Clock_publish(&tsc, 0, 0);
+
+    ASSERT(page.sequence == 44);
+    ASSERT(page.tscUsable == 0);
+    Clock_page = NULL;
+}
+
+static void ClockTest_reportUnsynchronizedTsc() {
+    static ClockPage page;
+    memzero(&page, sizeof(ClockPage));
+    Clock_page = &page;
+    const Tsc tsc = { .nsPerTick = 1 << 20, .invariant = true };
+    Clock_publish(&tsc, 0, 0);
+
+    Clock_reportUnsynchronizedTsc();
+    ASSERT(page.sequence == 4);
+    ASSERT(page.tscUsable == 0);
+    Clock_publish(&tsc, 0, 0);
+    ASSERT(page.tscUsable == 0);
+
+    Clock_tscUnsynchronized = false;
+    Clock_page = NULL;
+}
+
+static void ClockTest_mapPage_notInitialized() {
+    Task task;
+    Clock_pageFrameNumber = frameNumber(0);
+
+    int result = Clock_mapPage(&task);
+
+    ASSERT(result == 0);
+}
+
+void ClockTest_run() {
+    RUN_TEST(ClockTest_publish);
+    RUN_TEST(ClockTest_publish_nonInvariantTsc);
+    RUN_TEST(ClockTest_reportUnsynchronizedTsc);
+    RUN_TEST(ClockTest_mapPage_notInitialized);
+}
@@ -63,6 +63,52 @@ static void CpuTest_switchToThread_invariants() {
     ASSERT(cpu.tss.esp0 == (uint32_t) newThread.regs + offsetof(ThreadRegisters, ss) + sizeof(uint32_t));
 }
 
+static void CpuTest_switchToThread_accounting() {
+    Task unimportantTask;
+    Thread currentThread;
+    initThread(&currentThread, threadStateReady, 100, &unimportantTask);
+    currentThread.kernelTime = 100;
+    Thread newThread;
+    initThread(&newThread, threadStateReady, 42, &unimportantTask);
+    newThread.runCount = 7;
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &currentThread);
+    newThread.cpu = &cpu;
+    cpu.lastAccountingTime = 1000;
+    theFakeHardware = (FakeHardware) { .tscRegister = 5000 };
+
+    Cpu_switchToThread(&cpu, &newThread);
+
+    ASSERT(currentThread.kernelTime == 4100);
+    ASSERT(currentThread.userTime == 0);
+    ASSERT(cpu.lastAccountingTime == 5000);
+    ASSERT(newThread.runCount == 8);
+    ASSERT(newThread.migrationCount == 0);
+}
+
+static void CpuTest_switchToThread_migration() {
+    Task unimportantTask;
+    Thread currentThread;
+    initThread(&currentThread, threadStateReady, 100, &unimportantTask);
+    Thread newThread;
+    initThread(&newThread, threadStateReady, 42, &unimportantTask);
+    Thread neverRunThread;
+    initThread(&neverRunThread, threadStateReady, 42, &unimportantTask);
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &currentThread);
+    Cpu otherCpu;
+    initCpu(&otherCpu, true, 3, &newThread);
+    newThread.cpu = &otherCpu;
+
+    Cpu_switchToThread(&cpu, &newThread);
+    Cpu_switchToThread(&cpu, &neverRunThread);
+
+    ASSERT(newThread.runCount == 1);
+    ASSERT(newThread.migrationCount == 1);
+    ASSERT(neverRunThread.runCount == 1);
+    ASSERT(neverRunThread.migrationCount == 0);
+}
+
 static void CpuTest_switchToThread_sameAddressSpace() {
     Task dummyTaskToCheckAddressSpaceDidNotChange;
     Task currentTask;
@@ -95,6 +141,70 @@ static void CpuTest_switchToThread_differentAddressSpace() {
     ASSERT(theFakeHardware.currentAddressSpace == &newTask.addressSpace);
 }
 
+static void CpuTest_switchToThread_updatesActiveCpus() {
+    Task currentTask;
+    memzero(&currentTask.addressSpace.activeCpus, sizeof(CpuMask));
+    Thread currentThread;
+    initThread(&currentThread, threadStateReady, 100, &currentTask);
+    Task newTask;
+    memzero(&newTask.addressSpace.activeCpus, sizeof(CpuMask));
+    Thread newThread;
+    initThread(&newThread, threadStateReady, 42, &newTask);
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &currentThread);
+    cpu.index = 37;
+    CpuMask_set(&currentTask.addressSpace.activeCpus, 37);
+    theFakeHardware = (FakeHardware) { .currentAddressSpace = &currentTask.addressSpace };
+
+    Cpu_switchToThread(&cpu, &newThread);
+
+    ASSERT(!CpuMask_testAndClear(&currentTask.addressSpace.activeCpus, 37));
+    ASSERT(AtomicWord_get(&newTask.addressSpace.activeCpus.words[1]) == 1 << 5);
+}
+
+static void CpuTest_switchToThread_reusesLoadedAddressSpace() {
+    Task dummyTaskToCheckAddressSpaceDidNotChange;
+    Thread kernelThread;
+    initThread(&kernelThread, threadStateReady, 100, NULL);
+    kernelThread.kernelThread = true;
+    Task newTask;
+    memzero(&newTask.addressSpace.activeCpus, sizeof(CpuMask));
+    AtomicWord_set(&newTask.addressSpace.generation, 5);
+    Thread newThread;
+    initThread(&newThread, threadStateReady, 42, &newTask);
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &kernelThread);
+    cpu.addressSpace = &newTask.addressSpace;
+    cpu.addressSpaceGeneration = 5;
+    theFakeHardware = (FakeHardware) { .currentAddressSpace = &dummyTaskToCheckAddressSpaceDidNotChange.addressSpace };
+
+    Cpu_switchToThread(&cpu, &newThread);
+
+    ASSERT(theFakeHardware.currentAddressSpace == &dummyTaskToCheckAddressSpaceDidNotChange.addressSpace);
+}
+
+static void CpuTest_switchToThread_reloadsAddressSpaceAfterShootdown() {
+    Thread kernelThread;
+    initThread(&kernelThread, threadStateReady, 100, NULL);
+    kernelThread.kernelThread = true;
+    Task newTask;
+    memzero(&newTask.addressSpace.activeCpus, sizeof(CpuMask));
+    AtomicWord_set(&newTask.addressSpace.generation, 6);
+    Thread newThread;
+    initThread(&newThread, threadStateReady, 42, &newTask);
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &kernelThread);
+    cpu.addressSpace = &newTask.addressSpace;
+    cpu.addressSpaceGeneration = 5;
+    theFakeHardware = (FakeHardware) { .currentAddressSpace = NULL };
+
+    Cpu_switchToThread(&cpu, &newThread);
+
+    ASSERT(theFakeHardware.currentAddressSpace == &newTask.addressSpace);
+    ASSERT(cpu.addressSpace == &newTask.addressSpace);
+    ASSERT(cpu.addressSpaceGeneration == 6);
+}
+
 static void CpuTest_switchToThread_userToUser() {
     Task unimportantTask;
     Thread currentThread;
@@ -477,6 +587,31 @@ static void CpuTest_accountTimesliceAndCheckExpiration_runningForLongTime() {
     ASSERT(currentThread.timesliceRemaining == Cpu_timesliceLengths[20]);
 }
 
+static void CpuTest_accountThreadTime_userAndKernel() {
+    Task unimportantTask;
+    Thread currentThread;
+    initThread(&currentThread, threadStateRunning, 42, &unimportantTask);
+    currentThread.runCount = 3;
+    currentThread.migrationCount = 2;
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &currentThread);
+    cpu.tsc = (Tsc) { .nsPerTick = 3 << 19 };
+    cpu.lastAccountingTime = 1000;
+    theFakeHardware = (FakeHardware) { .tscRegister = 0x100000000ULL + 1000, .tscIncrement = 2000 };
+
+    Cpu_accountThreadTime(&cpu, true); // longer than UINT32_MAX ticks, must not be clamped
+    Cpu_accountThreadTime(&cpu, false);
+    ThreadStatistics statistics;
+    Thread_getStatistics(&currentThread, &cpu.tsc, &statistics);
+
+    ASSERT(currentThread.userTime == 0x100000000ULL);
+    ASSERT(currentThread.kernelTime == 2000);
+    ASSERT(statistics.userNanoseconds == 0x180000000ULL);
+    ASSERT(statistics.kernelNanoseconds == 3000);
+    ASSERT(statistics.runCount == 3);
+    ASSERT(statistics.migrationCount == 2);
+}
+
 static void CpuTest_setTimesliceTimer_idle() {
     Cpu cpu;
     initCpu(&cpu, true, 3, &cpu.idleThread);
@@ -535,10 +670,169 @@ static void CpuTest_setTimesliceTimer_samePriorityReeadyThread() {
     ASSERT(theFakeHardware.lapicTimerInitialCount == 4000000);
 }
 
+static void CpuTest_setTimesliceTimer_tscDeadlineMode() {
+    Task unimportantTask;
+    Thread currentThread;
+    initThread(&currentThread, threadStateRunning, 42, &unimportantTask);
+    currentThread.timesliceRemaining = 4000000;
+    Thread readyThread;
+    initThread(&readyThread, threadStateReady, 42, &unimportantTask);
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &currentThread);
+    CpuNode node;
+    Cpu *cpus[] = { &cpu };
+    initCpuNode(&node, cpus, 1, 3);
+    PriorityQueue_insert(&node.readyQueue, &readyThread.queueNode);
+    cpu.lapicTimer = (LapicTimer) { .tscDeadlineMode = true };
+    cpu.tsc = (Tsc) { .nsPerTick = 1 << 19, .ticksPerNs = 2 << 23 };
+    const uint32_t unchangingValue = 1234;
+    theFakeHardware = (FakeHardware) { .lapicTimerInitialCount = unchangingValue, .tscRegister = 1000 };
+    
+    Cpu_setTimesliceTimer(&cpu);
+    
+    ASSERT(cpu.timesliceTimerEnabled == true);
+    ASSERT(theFakeHardware.msrTscDeadline == 1000 + 8000000 + 1);
+    ASSERT(theFakeHardware.lapicTimerInitialCount == unchangingValue);
+    ASSERT(cpu.lapicTimer.nextExpirationNanoseconds == 500 + 4000000);
+}
+
+static void CpuTest_setTimesliceTimer_timerExpiringBeforeTimeslice() {
+    Task unimportantTask;
+    Thread currentThread;
+    initThread(&currentThread, threadStateRunning, 42, &unimportantTask);
+    currentThread.timesliceRemaining = 4000000;
+    Thread readyThread;
+    initThread(&readyThread, threadStateReady, 42, &unimportantTask);
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &currentThread);
+    CpuNode node;
+    Cpu *cpus[] = { &cpu };
+    initCpuNode(&node, cpus, 1, 3);
+    PriorityQueue_insert(&node.readyQueue, &readyThread.queueNode);
+    cpu.lapicTimer = (LapicTimer) { .ticksPerNs = 1 << 23 };
+    static TimerWheel timerWheel;
+    TimerWheel_initialize(&timerWheel, 0);
+    cpu.timerWheel = &timerWheel;
+    Timer timer;
+    Timer_initialize(&timer, NULL);
+    TimerWheel_arm(&timerWheel, &timer, 8 << TIMERWHEEL_RESOLUTION_SHIFT, 0);
+    theFakeHardware = (FakeHardware) { .lapicTimerInitialCount = 0 };
+    
+    Cpu_setTimesliceTimer(&cpu);
+    
+    ASSERT(cpu.timesliceTimerEnabled == true);
+    ASSERT(theFakeHardware.lapicTimerInitialCount == 8 << TIMERWHEEL_RESOLUTION_SHIFT);
+    ASSERT(cpu.lapicTimer.nextExpirationNanoseconds == 8 << TIMERWHEEL_RESOLUTION_SHIFT);
+}
+
+static void CpuTest_setTimesliceTimer_idleWithTimer() {
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &cpu.idleThread);
+    CpuNode node;
+    Cpu *cpus[] = { &cpu };
+    initCpuNode(&node, cpus, 1, 3);
+    cpu.lapicTimer = (LapicTimer) { .ticksPerNs = 1 << 23 };
+    cpu.tsc = (Tsc) { .nsPerTick = 1 << 20 };
+    static TimerWheel timerWheel;
+    TimerWheel_initialize(&timerWheel, 0);
+    cpu.timerWheel = &timerWheel;
+    Timer timer;
+    Timer_initialize(&timer, NULL);
+    TimerWheel_arm(&timerWheel, &timer, 50 << TIMERWHEEL_RESOLUTION_SHIFT, 0);
+    theFakeHardware = (FakeHardware) { .tscRegister = 10 << TIMERWHEEL_RESOLUTION_SHIFT };
+    
+    Cpu_setTimesliceTimer(&cpu);
+    
+    ASSERT(cpu.timesliceTimerEnabled == false);
+    ASSERT(theFakeHardware.lapicTimerInitialCount == 40 << TIMERWHEEL_RESOLUTION_SHIFT);
+}
+
+static void CpuTest_armTimer_earlierThanLapicTimer() {
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &cpu.idleThread);
+    cpu.lapicTimer = (LapicTimer) { .ticksPerNs = 1 << 23, .nextExpirationNanoseconds = LAPICTIMER_DISARMED };
+    cpu.tsc = (Tsc) { .nsPerTick = 1 << 20 };
+    static TimerWheel timerWheel;
+    TimerWheel_initialize(&timerWheel, 0);
+    cpu.timerWheel = &timerWheel;
+    Timer timer;
+    Timer_initialize(&timer, NULL);
+    theFakeHardware = (FakeHardware) { .tscRegister = 0 };
+    
+    Cpu_armTimer(&cpu, &timer, 2 << TIMERWHEEL_RESOLUTION_SHIFT);
+    
+    ASSERT(Timer_isArmed(&timer));
+    ASSERT(theFakeHardware.lapicTimerInitialCount == 2 << TIMERWHEEL_RESOLUTION_SHIFT);
+    ASSERT(cpu.lapicTimer.nextExpirationNanoseconds == 2 << TIMERWHEEL_RESOLUTION_SHIFT);
+}
+
+static void CpuTest_armTimer_laterThanLapicTimer() {
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &cpu.idleThread);
+    cpu.lapicTimer = (LapicTimer) { .ticksPerNs = 1 << 23, .nextExpirationNanoseconds = 1 << TIMERWHEEL_RESOLUTION_SHIFT };
+    cpu.tsc = (Tsc) { .nsPerTick = 1 << 20 };
+    static TimerWheel timerWheel;
+    TimerWheel_initialize(&timerWheel, 0);
+    cpu.timerWheel = &timerWheel;
+    Timer timer;
+    Timer_initialize(&timer, NULL);
+    const uint32_t unchangingValue = 1234;
+    theFakeHardware = (FakeHardware) { .lapicTimerInitialCount = unchangingValue };
+    
+    Cpu_armTimer(&cpu, &timer, 2 << TIMERWHEEL_RESOLUTION_SHIFT);
+    
+    ASSERT(Timer_isArmed(&timer));
+    ASSERT(theFakeHardware.lapicTimerInitialCount == unchangingValue);
+}
+
+static void CpuTest_readNanoseconds_invariantTsc() {
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &cpu.idleThread);
+    cpu.tsc = (Tsc) { .nsPerTick = 1 << 19, .invariant = true };
+    Hpet_theInstance = (Hpet) { .available = true, .counter64Bit = true, .nsPerTick = 1 << 20 };
+    theFakeHardware = (FakeHardware) { .tscRegister = 1000, .hpetMainCounter = 3000 };
+
+    uint64_t ns = Cpu_readNanoseconds(&cpu);
+
+    ASSERT(ns == 500);
+    memzero(&Hpet_theInstance, sizeof(Hpet));
+}
+
+static void CpuTest_readNanoseconds_hpetFallback() {
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &cpu.idleThread);
+    cpu.tsc = (Tsc) { .nsPerTick = 1 << 19, .invariant = false };
+    Hpet_theInstance = (Hpet) { .available = true, .counter64Bit = true, .nsPerTick = 1 << 20 };
+    theFakeHardware = (FakeHardware) { .tscRegister = 1000, .hpetMainCounter = 3000 };
+
+    uint64_t ns = Cpu_readNanoseconds(&cpu);
+
+    ASSERT(ns == 3000);
+    memzero(&Hpet_theInstance, sizeof(Hpet));
+}
+
+static void CpuTest_readNanoseconds_noMonotonicHpet() {
+    Cpu cpu;
+    initCpu(&cpu, true, 3, &cpu.idleThread);
+    cpu.tsc = (Tsc) { .nsPerTick = 1 << 19, .invariant = false };
+    Hpet_theInstance = (Hpet) { .available = true, .counter64Bit = false, .nsPerTick = 1 << 20 };
+    theFakeHardware = (FakeHardware) { .tscRegister = 1000, .hpetMainCounter = 3000 };
+
+    uint64_t ns = Cpu_readNanoseconds(&cpu);
+
+    ASSERT(ns == 500);
+    memzero(&Hpet_theInstance, sizeof(Hpet));
+}
+
 void CpuTest_run() {
     RUN_TEST(CpuTest_switchToThread_invariants);
+    RUN_TEST(CpuTest_switchToThread_accounting);
+    RUN_TEST(CpuTest_switchToThread_migration);
     RUN_TEST(CpuTest_switchToThread_sameAddressSpace);
     RUN_TEST(CpuTest_switchToThread_differentAddressSpace);
+    RUN_TEST(CpuTest_switchToThread_updatesActiveCpus);
+    RUN_TEST(CpuTest_switchToThread_reusesLoadedAddressSpace);
+    RUN_TEST(CpuTest_switchToThread_reloadsAddressSpaceAfterShootdown);
     RUN_TEST(CpuTest_switchToThread_userToUser);
     RUN_TEST(CpuTest_switchToThread_userToKernel);
     RUN_TEST(CpuTest_switchToThread_kernelToUser);
@@ -559,7 +853,16 @@ void CpuTest_run() {
     RUN_TEST(CpuTest_accountTimesliceAndCheckExpiration_notExpired);
     RUN_TEST(CpuTest_accountTimesliceAndCheckExpiration_expired);
     RUN_TEST(CpuTest_accountTimesliceAndCheckExpiration_runningForLongTime);
+    RUN_TEST(CpuTest_accountThreadTime_userAndKernel);
     RUN_TEST(CpuTest_setTimesliceTimer_idle);
     RUN_TEST(CpuTest_setTimesliceTimer_lowerPriorityReeadyThread);
     RUN_TEST(CpuTest_setTimesliceTimer_samePriorityReeadyThread);
+    RUN_TEST(CpuTest_setTimesliceTimer_tscDeadlineMode);
+    RUN_TEST(CpuTest_setTimesliceTimer_timerExpiringBeforeTimeslice);
+    RUN_TEST(CpuTest_setTimesliceTimer_idleWithTimer);
+    RUN_TEST(CpuTest_armTimer_earlierThanLapicTimer);
+    RUN_TEST(CpuTest_armTimer_laterThanLapicTimer);
+    RUN_TEST(CpuTest_readNanoseconds_invariantTsc);
+    RUN_TEST(CpuTest_readNanoseconds_hpetFallback);
+    RUN_TEST(CpuTest_readNanoseconds_noMonotonicHpet);
 }
@@ -0,0 +1,134 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "test.h"
+#include "kernel.h"
+
+static void initializePhysicalMemory(uint8_t *fakePhysicalMemory, Frame *frames, size_t frameCount) {
+    memzero(frames, frameCount * sizeof(Frame));
+    PhysicalAddress base = virt2phys(fakePhysicalMemory);
+    FrameNumber baseFrame = floorToFrame(base);
+    FrameNumber endFrame = addToFrameNumber(baseFrame, frameCount);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], baseFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], endFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], endFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], endFrame, endFrame);
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_firstFrame = baseFrame;
+    PhysicalMemory_add(base, addToPhysicalAddress(base, frameCount * PAGE_SIZE));
+    KernelMemory_initialize();
+}
+
+static void KernelMemoryTest_allocateSmall() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[4 * PAGE_SIZE];
+    Frame frames[4];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 4);
+    Task task = { .kernelMemoryQuota = (size_t) -1 };
+
+    uint8_t *p = KernelMemory_allocate(&task, 100);
+    uint8_t *q = KernelMemory_allocate(&task, 128);
+
+    ASSERT(p != NULL && q != NULL);
+    ASSERT(((uintptr_t) p & 0xF) == 0);
+    ASSERT(q - p == 128); // same slab, as both are in the 128 bytes size class
+    ASSERT(task.kernelMemoryUsage == 256);
+    ASSERT(PhysicalMemory_regions[0].freeFrameCount == 3);
+}
+
+static void KernelMemoryTest_allocateSizeClasses() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[8 * PAGE_SIZE];
+    Frame frames[8];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 8);
+    Task task = { .kernelMemoryQuota = (size_t) -1 };
+    const size_t sizes[] = { 1, 16, 17, 2047, 2048 };
+    const size_t expectedUsages[] = { 16, 32, 64, 2112, 4160 };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        KernelMemory_allocate(&task, sizes[i]);
+        ASSERT(task.kernelMemoryUsage == expectedUsages[i]);
+    }
+}
+
+static void KernelMemoryTest_allocateLarge() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[4 * PAGE_SIZE];
+    Frame frames[4];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 4);
+    Task task = { .kernelMemoryQuota = (size_t) -1 };
+
+    uint8_t *p = KernelMemory_allocate(&task, PAGE_SIZE + 1);
+
+    ASSERT(p != NULL);
+    ASSERT(((uintptr_t) p & (PAGE_SIZE - 1)) == 0);
+    ASSERT(task.kernelMemoryUsage == 2 * PAGE_SIZE);
+    ASSERT(PhysicalMemory_regions[0].freeFrameCount == 2);
+
+    KernelMemory_deallocate(&task, p, PAGE_SIZE + 1);
+
+    ASSERT(task.kernelMemoryUsage == 0);
+    ASSERT(PhysicalMemory_regions[0].freeFrameCount == 4);
+}
+
+static void KernelMemoryTest_deallocate() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[4 * PAGE_SIZE];
+    Frame frames[4];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 4);
+    Task task = { .kernelMemoryQuota = (size_t) -1 };
+    void *p = KernelMemory_allocate(&task, 40);
+
+    KernelMemory_deallocate(&task, p, 40);
+
+    ASSERT(task.kernelMemoryUsage == 0);
+    ASSERT(KernelMemory_allocate(NULL, 48) == p);
+    ASSERT(task.kernelMemoryUsage == 0);
+}
+
+static void KernelMemoryTest_allocateBeyondQuota() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[4 * PAGE_SIZE];
+    Frame frames[4];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 4);
+    Task task = { .kernelMemoryQuota = 100 };
+    void *p = KernelMemory_allocate(&task, 64);
+
+    void *q = KernelMemory_allocate(&task, 48);
+
+    ASSERT(p != NULL);
+    ASSERT(q == NULL);
+    ASSERT(task.kernelMemoryUsage == 64);
+    ASSERT(KernelMemory_allocate(&task, 32) != NULL);
+    ASSERT(task.kernelMemoryUsage == 96);
+}
+
+static void KernelMemoryTest_allocateOutOfMemory() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[PAGE_SIZE];
+    Frame frames[1];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 1);
+    Task task = { .kernelMemoryQuota = (size_t) -1 };
+
+    void *p = KernelMemory_allocate(&task, 2 * PAGE_SIZE);
+
+    ASSERT(p == NULL);
+    ASSERT(task.kernelMemoryUsage == 0);
+}
+
+void KernelMemoryTest_run() {
+    RUN_TEST(KernelMemoryTest_allocateSmall);
+    RUN_TEST(KernelMemoryTest_allocateSizeClasses);
+    RUN_TEST(KernelMemoryTest_allocateLarge);
+    RUN_TEST(KernelMemoryTest_deallocate);
+    RUN_TEST(KernelMemoryTest_allocateBeyondQuota);
+    RUN_TEST(KernelMemoryTest_allocateOutOfMemory);
+}
@@ -0,0 +1,133 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "benchmark.h"
+#include "kernel.h"
+
+/*
+ * The host benchmark runs on a single thread, thus CPUs are simulated by
+ * switching the fake current CPU after each burst of operations, so that
+ * the frame caches of all CPUs and the shared regions interleave as they
+ * would on a real multiprocessor, but without actual lock contention.
+ */
+
+#define FRAME_COUNT 65536
+#define MAX_CPUS 8
+#define ROUNDS 4096
+#define MAX_BURST 48 // allocations a simulated CPU performs before yielding to the next one
+
+static Frame frames[FRAME_COUNT];
+static Cpu cpus[MAX_CPUS];
+static FrameCache frameCaches[MAX_CPUS];
+static FrameNumber allocated[MAX_CPUS][MAX_BURST];
+static Task task;
+
+static void initialize(size_t cpuCount, bool frameCachesEnabled) {
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_firstFrame = frameNumber(0);
+    memzero(frames, sizeof(frames)); // all frames allocated to no task
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[isadmaMemoryRegion], frameNumber(0), frameNumber(1));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[permamapMemoryRegion], frameNumber(1), frameNumber(FRAME_COUNT / 2));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[otherMemoryRegion], frameNumber(FRAME_COUNT / 2), frameNumber(FRAME_COUNT));
+    Spinlock_init(&PhysicalMemory_lock);
+    PhysicalMemory_deallocateContiguous(frameNumber(1), FRAME_COUNT / 2 - 1);
+    PhysicalMemory_deallocateContiguous(frameNumber(FRAME_COUNT / 2), FRAME_COUNT / 2);
+    for (size_t i = 0; i < cpuCount; i++) {
+        cpus[i].index = i;
+        cpus[i].frameCache = &frameCaches[i];
+        FrameCache_initialize(&frameCaches[i]);
+    }
+    PhysicalMemory_frameCachesEnabled = frameCachesEnabled;
+}
+
+/** Returns a pseudo-random burst length in [1, MAX_BURST], using a linear congruential generator. */
+static size_t nextBurst(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return 1 + (*seed >> 16) % MAX_BURST;
+}
+
+/** Each CPU allocates a burst of frames and frees them before the next CPU runs. */
+static void allocateAndFreeLocally(const char *operation, size_t cpuCount, bool frameCachesEnabled) {
+    initialize(cpuCount, frameCachesEnabled);
+    uint32_t seed = 12345;
+    size_t allocationCount = 0;
+
+    uint64_t begin = Benchmark_readTsc();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        for (size_t c = 0; c < cpuCount; c++) {
+            theFakeHardware.currentCpu = &cpus[c];
+            size_t burst = nextBurst(&seed);
+            for (size_t i = 0; i < burst; i++)
+                allocated[c][i] = PhysicalMemory_allocate(&task, otherMemoryRegion);
+            for (size_t i = 0; i < burst; i++)
+                PhysicalMemory_deallocate(allocated[c][i]);
+            allocationCount += burst;
+        }
+    }
+    uint64_t end = Benchmark_readTsc();
+
+    PhysicalMemory_frameCachesEnabled = false;
+    BENCHMARK_REPORT(operation, end - begin, allocationCount);
+}
+
+/** Each CPU frees the frames allocated by the previous CPU, moving frames between frame caches through the regions. */
+static void allocateAndFreeRemotely(const char *operation, size_t cpuCount, bool frameCachesEnabled) {
+    initialize(cpuCount, frameCachesEnabled);
+    uint32_t seed = 12345;
+    size_t allocationCount = 0;
+    size_t bursts[MAX_CPUS] = { 0 };
+
+    uint64_t begin = Benchmark_readTsc();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        for (size_t c = 0; c < cpuCount; c++) {
+            theFakeHardware.currentCpu = &cpus[c];
+            size_t previous = (c + cpuCount - 1) % cpuCount;
+            for (size_t i = 0; i < bursts[previous]; i++)
+                PhysicalMemory_deallocate(allocated[previous][i]);
+            bursts[previous] = 0;
+            size_t burst = nextBurst(&seed);
+            for (size_t i = 0; i < burst; i++)
+                allocated[c][i] = PhysicalMemory_allocate(&task, otherMemoryRegion);
+            bursts[c] = burst;
+            allocationCount += burst;
+        }
+    }
+    uint64_t end = Benchmark_readTsc();
+
+    PhysicalMemory_frameCachesEnabled = false;
+    BENCHMARK_REPORT(operation, end - begin, allocationCount);
+}
+
+static void PhysicalMemoryBenchmark_allocateAndFreeLocally() {
+    allocateAndFreeLocally("global lock, 1 CPU", 1, false);
+    allocateAndFreeLocally("global lock, 8 CPUs", 8, false);
+    allocateAndFreeLocally("frame caches, 1 CPU", 1, true);
+    allocateAndFreeLocally("frame caches, 2 CPUs", 2, true);
+    allocateAndFreeLocally("frame caches, 4 CPUs", 4, true);
+    allocateAndFreeLocally("frame caches, 8 CPUs", 8, true);
+}
+
+static void PhysicalMemoryBenchmark_allocateAndFreeRemotely() {
+    allocateAndFreeRemotely("global lock, 8 CPUs", 8, false);
+    allocateAndFreeRemotely("frame caches, 2 CPUs", 2, true);
+    allocateAndFreeRemotely("frame caches, 8 CPUs", 8, true);
+}
+
+void PhysicalMemoryBenchmark_run() {
+    RUN_BENCHMARK(PhysicalMemoryBenchmark_allocateAndFreeLocally);
+    RUN_BENCHMARK(PhysicalMemoryBenchmark_allocateAndFreeRemotely);
+}
@@ -18,6 +18,29 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "test.h"
 #include "kernel.h"
 
+/** Returns true if frames [begin, end) form a free block linked in the appropriate free list of the region. */
+static bool isFreeBlock(const PhysicalMemoryRegion *region, Frame *frames, size_t begin, size_t end) {
+    size_t length = end - begin;
+    if (Frame_getFreeBlockLength(&frames[begin]) != length || Frame_getFreeBlockLength(&frames[end - 1]) != length) return false;
+    if (!Frame_isFree(&frames[begin]) || !Frame_isFree(&frames[end - 1])) return false;
+    const LinkedList_Node *head = &region->freeLists[31 - __builtin_clz(length)];
+    for (const LinkedList_Node *n = head->next; n != head; n = n->next)
+        if (n == &frames[begin].node) return true;
+    return false;
+}
+
+/** Returns the number of free blocks in all free lists of the region, or -1 if the free list bitmap is inconsistent. */
+static size_t countFreeBlocks(const PhysicalMemoryRegion *region) {
+    size_t count = 0;
+    for (size_t i = 0; i < PHYSICALMEMORY_FREE_LIST_COUNT; i++) {
+        const LinkedList_Node *head = &region->freeLists[i];
+        if ((head->next != head) != ((region->nonEmptyFreeLists & (1u << i)) != 0)) return (size_t) -1;
+        for (const LinkedList_Node *n = head->next; n != head; n = n->next)
+            count++;
+    }
+    return count;
+}
+
 /******************************************************************************
  * PhysicalMemoryRegion
  ******************************************************************************/
@@ -35,8 +58,9 @@ static void PhysicalMemoryRegionTest_allocate() {
     
     ASSERT(frameNumber.v == 21);
     ASSERT(region.freeFrameCount == 1);
-    ASSERT(region.freeListHead.next == &frames[20].node);
-    ASSERT(frames[20].node.next == &region.freeListHead);
+    ASSERT(countFreeBlocks(&region) == 1);
+    ASSERT(isFreeBlock(&region, frames, 20, 21));
+    ASSERT(Frame_getTask(&frames[21]) == &task);
 }
 
 static void PhysicalMemoryRegionTest_allocateOutOfMemory() {
@@ -54,7 +78,8 @@ static void PhysicalMemoryRegionTest_allocateOutOfMemory() {
     
     ASSERT(frameNumber.v == 0);
     ASSERT(region.freeFrameCount == 0);
-    ASSERT(region.freeListHead.next == &region.freeListHead);
+    ASSERT(countFreeBlocks(&region) == 0);
+    ASSERT(region.nonEmptyFreeLists == 0);
 }
 
 static void PhysicalMemoryRegionTest_deallocate() {
@@ -72,8 +97,82 @@ static void PhysicalMemoryRegionTest_deallocate() {
     
     ASSERT(frameNumber.v == 21);
     ASSERT(region.freeFrameCount == 1);
-    ASSERT(region.freeListHead.next == &frames[21].node);
-    ASSERT(frames[21].node.next == &region.freeListHead);
+    ASSERT(countFreeBlocks(&region) == 1);
+    ASSERT(isFreeBlock(&region, frames, 21, 22));
+}
+
+static void PhysicalMemoryRegionTest_allocateContiguousAligned() {
+    PhysicalMemoryRegion region;
+    PhysicalMemoryRegion_initialize(&region, frameNumber(10), frameNumber(30));
+    Frame frames[30];
+    memzero(frames, sizeof(frames));
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemoryRegion_add(&region, frameNumber(10), frameNumber(30));
+    Task task;
+
+    FrameNumber frameNumber = PhysicalMemoryRegion_allocateContiguous(&region, &task, 4, 8);
+
+    ASSERT(frameNumber.v == 24);
+    ASSERT(region.freeFrameCount == 16);
+    ASSERT(countFreeBlocks(&region) == 2);
+    ASSERT(isFreeBlock(&region, frames, 10, 24));
+    ASSERT(isFreeBlock(&region, frames, 28, 30));
+    for (size_t i = 24; i < 28; i++)
+        ASSERT(!Frame_isFree(&frames[i]));
+}
+
+static void PhysicalMemoryRegionTest_allocateContiguousFromSmallerSizeClass() {
+    PhysicalMemoryRegion region;
+    PhysicalMemoryRegion_initialize(&region, frameNumber(10), frameNumber(30));
+    Frame frames[30];
+    memzero(frames, sizeof(frames));
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemoryRegion_add(&region, frameNumber(10), frameNumber(12));
+    PhysicalMemoryRegion_add(&region, frameNumber(20), frameNumber(23));
+    Task task;
+
+    FrameNumber frameNumber = PhysicalMemoryRegion_allocateContiguous(&region, &task, 3, 1);
+
+    ASSERT(frameNumber.v == 20);
+    ASSERT(region.freeFrameCount == 2);
+    ASSERT(countFreeBlocks(&region) == 1);
+    ASSERT(isFreeBlock(&region, frames, 10, 12));
+}
+
+static void PhysicalMemoryRegionTest_allocateContiguousFragmented() {
+    PhysicalMemoryRegion region;
+    PhysicalMemoryRegion_initialize(&region, frameNumber(10), frameNumber(30));
+    Frame frames[30];
+    memzero(frames, sizeof(frames));
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemoryRegion_add(&region, frameNumber(10), frameNumber(12));
+    PhysicalMemoryRegion_add(&region, frameNumber(20), frameNumber(22));
+    Task task;
+
+    FrameNumber frameNumber = PhysicalMemoryRegion_allocateContiguous(&region, &task, 3, 1);
+
+    ASSERT(frameNumber.v == 0);
+    ASSERT(region.freeFrameCount == 4);
+    ASSERT(countFreeBlocks(&region) == 2);
+    ASSERT(isFreeBlock(&region, frames, 10, 12));
+    ASSERT(isFreeBlock(&region, frames, 20, 22));
+}
+
+static void PhysicalMemoryRegionTest_deallocateContiguousCoalescing() {
+    PhysicalMemoryRegion region;
+    PhysicalMemoryRegion_initialize(&region, frameNumber(10), frameNumber(30));
+    Frame frames[30];
+    memzero(frames, sizeof(frames));
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemoryRegion_add(&region, frameNumber(10), frameNumber(30));
+    Task task;
+    FrameNumber frameNumber = PhysicalMemoryRegion_allocateContiguous(&region, &task, 4, 8);
+
+    PhysicalMemoryRegion_deallocateContiguous(&region, frameNumber, 4);
+
+    ASSERT(region.freeFrameCount == 20);
+    ASSERT(countFreeBlocks(&region) == 1);
+    ASSERT(isFreeBlock(&region, frames, 10, 30));
 }
 
 
@@ -87,6 +186,7 @@ static void PhysicalMemoryTest_allocate() {
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(10));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(15), frameNumber(20));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(30));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(30), frameNumber(30));
     PhysicalMemory_frameDescriptors = frames;
     PhysicalMemory_add(physicalAddress(0), physicalAddress(30 * PAGE_SIZE));
     Task task;
@@ -96,16 +196,16 @@ static void PhysicalMemoryTest_allocate() {
     ASSERT(frameNumber.v == 19);
     
     ASSERT(PhysicalMemory_regions[0].freeFrameCount == 10);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.next == &frames[9].node);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.prev == &frames[0].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[0]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[0], frames, 0, 10));
 
     ASSERT(PhysicalMemory_regions[1].freeFrameCount == 4);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.next == &frames[18].node);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.prev == &frames[15].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[1]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[1], frames, 15, 19));
 
     ASSERT(PhysicalMemory_regions[2].freeFrameCount == 10);
-    ASSERT(PhysicalMemory_regions[2].freeListHead.next == &frames[29].node);
-    ASSERT(PhysicalMemory_regions[2].freeListHead.prev == &frames[20].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[2]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[2], frames, 20, 30));
 }
 
 static void PhysicalMemoryTest_allocatePreferredRegionExhausted() {
@@ -114,6 +214,7 @@ static void PhysicalMemoryTest_allocatePreferredRegionExhausted() {
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(10));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(15), frameNumber(20));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(30));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(30), frameNumber(30));
     PhysicalMemory_frameDescriptors = frames;
     PhysicalMemory_add(physicalAddress(0), physicalAddress(30 * PAGE_SIZE));
     Task task;
@@ -125,16 +226,15 @@ static void PhysicalMemoryTest_allocatePreferredRegionExhausted() {
     ASSERT(frameNumber.v == 9);
     
     ASSERT(PhysicalMemory_regions[0].freeFrameCount == 9);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.next == &frames[8].node);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.prev == &frames[0].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[0]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[0], frames, 0, 9));
 
     ASSERT(PhysicalMemory_regions[1].freeFrameCount == 0);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.next == &PhysicalMemory_regions[1].freeListHead);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.prev == &PhysicalMemory_regions[1].freeListHead);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[1]) == 0);
 
     ASSERT(PhysicalMemory_regions[2].freeFrameCount == 10);
-    ASSERT(PhysicalMemory_regions[2].freeListHead.next == &frames[29].node);
-    ASSERT(PhysicalMemory_regions[2].freeListHead.prev == &frames[20].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[2]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[2], frames, 20, 30));
 }
 
 static void PhysicalMemoryTest_allocatePreferredRegionAndLowerRegionsExhausted() {
@@ -143,6 +243,7 @@ static void PhysicalMemoryTest_allocatePreferredRegionAndLowerRegionsExhausted()
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(10));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(15), frameNumber(20));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(30));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(30), frameNumber(30));
     PhysicalMemory_frameDescriptors = frames;
     PhysicalMemory_add(physicalAddress(0), physicalAddress(30 * PAGE_SIZE));
     Task task;
@@ -154,16 +255,14 @@ static void PhysicalMemoryTest_allocatePreferredRegionAndLowerRegionsExhausted()
     ASSERT(frameNumber.v == 0);
     
     ASSERT(PhysicalMemory_regions[0].freeFrameCount == 0);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.next == &PhysicalMemory_regions[0].freeListHead);
-    ASSERT(PhysicalMemory_regions[0].freeListHead.prev == &PhysicalMemory_regions[0].freeListHead);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[0]) == 0);
 
     ASSERT(PhysicalMemory_regions[1].freeFrameCount == 0);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.next == &PhysicalMemory_regions[1].freeListHead);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.prev == &PhysicalMemory_regions[1].freeListHead);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[1]) == 0);
 
     ASSERT(PhysicalMemory_regions[2].freeFrameCount == 10);
-    ASSERT(PhysicalMemory_regions[2].freeListHead.next == &frames[29].node);
-    ASSERT(PhysicalMemory_regions[2].freeListHead.prev == &frames[20].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[2]) == 1);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[2], frames, 20, 30));
 }
 
 static void PhysicalMemoryTest_deallocate() {
@@ -172,6 +271,7 @@ static void PhysicalMemoryTest_deallocate() {
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(10));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(15), frameNumber(20));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(30));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(30), frameNumber(30));
     PhysicalMemory_frameDescriptors = frames;
     PhysicalMemory_add(physicalAddress(0), physicalAddress(30 * PAGE_SIZE));
     Task task;
@@ -183,17 +283,358 @@ static void PhysicalMemoryTest_deallocate() {
     ASSERT(frameNumber.v == 19);
     
     ASSERT(PhysicalMemory_regions[1].freeFrameCount == 4);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.next == &frames[19].node);
-    ASSERT(frames[19].node.next == &frames[17].node);
-    ASSERT(PhysicalMemory_regions[1].freeListHead.prev == &frames[15].node);
+    ASSERT(countFreeBlocks(&PhysicalMemory_regions[1]) == 2);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[1], frames, 15, 18));
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[1], frames, 19, 20));
+}
+
+static void PhysicalMemoryTest_allocateContiguousPreferredRegionExhausted() {
+    Frame frames[30];
+    memzero(frames, sizeof(frames));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(10));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(15), frameNumber(20));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(30));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(30), frameNumber(30));
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_add(physicalAddress(0), physicalAddress(30 * PAGE_SIZE));
+    Task task;
+
+    FrameNumber frameNumber = PhysicalMemory_allocateContiguous(&task, 1, 8, 1);
+
+    ASSERT(frameNumber.v == 2);
+    ASSERT(PhysicalMemory_regions[0].freeFrameCount == 2);
+    ASSERT(PhysicalMemory_regions[1].freeFrameCount == 5);
+    ASSERT(isFreeBlock(&PhysicalMemory_regions[0], frames, 0, 2));
+}
+
+/** Sets up regions [0, 10), [10, 20) and [20, end) of the specified frame descriptors, with all frames free. */
+static void initializeRegions(Frame *frames, size_t end) {
+    memzero(frames, end * sizeof(Frame));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], frameNumber(0),  frameNumber(10));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], frameNumber(10), frameNumber(20));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], frameNumber(20), frameNumber(end));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], frameNumber(end), frameNumber(end));
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_add(physicalAddress(0), physicalAddress(end * PAGE_SIZE));
+}
+
+static void FrameCacheTest_allocateRefills() {
+    Frame frames[100];
+    initializeRegions(frames, 100);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    Task task;
+
+    FrameNumber frameNumber = FrameCache_allocate(&fc, &task, otherMemoryRegion);
+
+    ASSERT(frameNumber.v == 100 - FRAMECACHE_BATCH);
+    ASSERT(!Frame_isFree(&frames[frameNumber.v]));
+    ASSERT(fc.count[otherMemoryRegion] == FRAMECACHE_BATCH - 1);
+    ASSERT(PhysicalMemory_regions[otherMemoryRegion].freeFrameCount == 80 - FRAMECACHE_BATCH);
+    ASSERT(fc.count[permamapMemoryRegion] == 0);
+    ASSERT(PhysicalMemory_regions[permamapMemoryRegion].freeFrameCount == 10);
+}
+
+static void FrameCacheTest_allocateFromCache() {
+    Frame frames[100];
+    initializeRegions(frames, 100);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    Task task;
+    FrameCache_allocate(&fc, &task, otherMemoryRegion);
+
+    FrameNumber frameNumber = FrameCache_allocate(&fc, &task, otherMemoryRegion);
+
+    ASSERT(frameNumber.v == 100 - FRAMECACHE_BATCH + 1);
+    ASSERT(fc.count[otherMemoryRegion] == FRAMECACHE_BATCH - 2);
+    ASSERT(PhysicalMemory_regions[otherMemoryRegion].freeFrameCount == 80 - FRAMECACHE_BATCH);
+}
+
+static void FrameCacheTest_allocatePreferredRegionExhausted() {
+    Frame frames[20];
+    initializeRegions(frames, 20);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    Task task;
+
+    FrameNumber frameNumber = FrameCache_allocate(&fc, &task, otherMemoryRegion);
+
+    ASSERT(frameNumber.v == 10);
+    ASSERT(fc.count[otherMemoryRegion] == 0);
+    ASSERT(fc.count[permamapMemoryRegion] == 9);
+    ASSERT(PhysicalMemory_regions[permamapMemoryRegion].freeFrameCount == 0);
+}
+
+static void FrameCacheTest_allocateAllRegionsExhausted() {
+    Frame frames[20];
+    initializeRegions(frames, 20);
+    PhysicalMemory_remove(physicalAddress(0), physicalAddress(20 * PAGE_SIZE));
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    Task task;
+
+    FrameNumber frameNumber = FrameCache_allocate(&fc, &task, otherMemoryRegion);
+
+    ASSERT(frameNumber.v == 0);
+    for (size_t i = 0; i < physicalMemoryRegionCount; i++)
+        ASSERT(fc.count[i] == 0);
+}
+
+static void FrameCacheTest_deallocate() {
+    Frame frames[100];
+    initializeRegions(frames, 100);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    FrameNumber frameNumber = PhysicalMemoryRegion_allocate(&PhysicalMemory_regions[otherMemoryRegion], NULL);
+
+    FrameCache_deallocate(&fc, frameNumber);
+
+    ASSERT(fc.count[otherMemoryRegion] == 1);
+    ASSERT(fc.frames[otherMemoryRegion][0].v == frameNumber.v);
+    ASSERT(!Frame_isFree(&frames[frameNumber.v]));
+    ASSERT(PhysicalMemory_regions[otherMemoryRegion].freeFrameCount == 79);
+}
+
+static void FrameCacheTest_deallocateDrains() {
+    Frame frames[100];
+    initializeRegions(frames, 100);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    FrameNumber frameNumbers[FRAMECACHE_CAPACITY + 1];
+    for (size_t i = 0; i < FRAMECACHE_CAPACITY + 1; i++)
+        frameNumbers[i] = PhysicalMemoryRegion_allocate(&PhysicalMemory_regions[otherMemoryRegion], NULL);
+    for (size_t i = 0; i < FRAMECACHE_CAPACITY; i++)
+        FrameCache_deallocate(&fc, frameNumbers[i]);
+    ASSERT(fc.count[otherMemoryRegion] == FRAMECACHE_CAPACITY);
+
+    FrameCache_deallocate(&fc, frameNumbers[FRAMECACHE_CAPACITY]);
+
+    ASSERT(fc.count[otherMemoryRegion] == FRAMECACHE_CAPACITY - FRAMECACHE_BATCH + 1);
+    ASSERT(PhysicalMemory_regions[otherMemoryRegion].freeFrameCount == 80 - FRAMECACHE_CAPACITY - 1 + FRAMECACHE_BATCH);
+}
+
+static void PhysicalMemoryTest_allocateThroughFrameCache() {
+    Frame frames[100];
+    initializeRegions(frames, 100);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    Cpu cpu;
+    cpu.frameCache = &fc;
+    theFakeHardware.currentCpu = &cpu;
+    PhysicalMemory_frameCachesEnabled = true;
+    Task task;
+
+    FrameNumber frameNumber = PhysicalMemory_allocate(&task, otherMemoryRegion);
+    size_t countAfterAllocate = fc.count[otherMemoryRegion];
+    PhysicalMemory_deallocate(frameNumber);
+
+    PhysicalMemory_frameCachesEnabled = false;
+    theFakeHardware.currentCpu = NULL;
+    ASSERT(frameNumber.v == 100 - FRAMECACHE_BATCH);
+    ASSERT(countAfterAllocate == FRAMECACHE_BATCH - 1);
+    ASSERT(fc.count[otherMemoryRegion] == FRAMECACHE_BATCH);
+    ASSERT(PhysicalMemory_regions[otherMemoryRegion].freeFrameCount == 80 - FRAMECACHE_BATCH);
+}
+
+/**
+ * Sets up regions [0, 10), [10, 20) and [20, end) for NUMA nodes 0 and 1,
+ * with frames [node1Begin, node1End) belonging to node 1, and all frames free.
+ */
+static void initializeNodeRegions(Frame *frames, size_t end, size_t node1Begin, size_t node1End) {
+    memzero(frames, end * sizeof(Frame));
+    for (size_t node = 0; node < 2; node++) {
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, 0), frameNumber(0),  frameNumber(10));
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, 1), frameNumber(10), frameNumber(20));
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, 2), frameNumber(20), frameNumber(end));
+        PhysicalMemoryRegion_initialize(PhysicalMemory_getRegion(node, 3), frameNumber(end), frameNumber(end));
+    }
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_nodeCount = 1;
+    PhysicalMemory_nodeRangeCount = 0;
+    PhysicalMemory_addNodeRange(frameNumber(node1Begin), frameNumber(node1End), 1);
+    PhysicalMemory_initializeNodeOrder(NULL, 0);
+    PhysicalMemory_add(physicalAddress(0), physicalAddress(end * PAGE_SIZE));
+}
+
+/** Restores the single node configuration expected by the other tests. */
+static void restoreSingleNode() {
+    PhysicalMemory_nodeCount = 1;
+    PhysicalMemory_nodeRangeCount = 0;
+}
+
+static void FrameCacheTest_allocateFromLocalNode() {
+    Frame frames[100];
+    initializeNodeRegions(frames, 100, 60, 100);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    fc.node = 1;
+    Task task;
+
+    FrameNumber frameNumber = FrameCache_allocate(&fc, &task, otherMemoryRegion);
+
+    restoreSingleNode();
+    ASSERT(frameNumber.v == 100 - FRAMECACHE_BATCH);
+    ASSERT(fc.count[otherMemoryRegion] == FRAMECACHE_BATCH - 1);
+    ASSERT(PhysicalMemory_getRegion(1, otherMemoryRegion)->freeFrameCount == 39 - FRAMECACHE_BATCH);
+    ASSERT(PhysicalMemory_getRegion(0, otherMemoryRegion)->freeFrameCount == 40);
+}
+
+static void FrameCacheTest_allocateFromRemoteNodeBeforeLowerRegions() {
+    Frame frames[100];
+    initializeNodeRegions(frames, 100, 10, 20);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    fc.node = 1;
+    Task task;
+
+    FrameNumber frameNumber = FrameCache_allocate(&fc, &task, otherMemoryRegion);
+
+    restoreSingleNode();
+    ASSERT(frameNumber.v >= 20 && frameNumber.v < 100);
+    ASSERT(!Frame_isFree(&frames[frameNumber.v]));
+    ASSERT(fc.count[otherMemoryRegion] == 0);
+    ASSERT(fc.count[permamapMemoryRegion] == 0);
+    ASSERT(PhysicalMemory_getRegion(0, otherMemoryRegion)->freeFrameCount == 79);
+    ASSERT(PhysicalMemory_getRegion(1, permamapMemoryRegion)->freeFrameCount == 10);
+}
+
+static void FrameCacheTest_deallocateRemoteFrame() {
+    Frame frames[100];
+    initializeNodeRegions(frames, 100, 60, 100);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    fc.node = 1;
+    FrameNumber frameNumber = PhysicalMemoryRegion_allocate(PhysicalMemory_getRegion(0, otherMemoryRegion), NULL);
+
+    FrameCache_deallocate(&fc, frameNumber);
+
+    restoreSingleNode();
+    ASSERT(fc.count[otherMemoryRegion] == 0);
+    ASSERT(Frame_isFree(&frames[frameNumber.v]));
+    ASSERT(PhysicalMemory_getRegion(0, otherMemoryRegion)->freeFrameCount == 40);
+}
+
+/** Sets up the permanently mapped region on fake physical memory filled with garbage, with all frames free. */
+static void initializeFakePhysicalMemory(uint8_t *fakePhysicalMemory, Frame *frames, size_t frameCount) {
+    memzero(frames, frameCount * sizeof(Frame));
+    for (size_t i = 0; i < frameCount * PAGE_SIZE; i++)
+        fakePhysicalMemory[i] = 0xAA;
+    FrameNumber baseFrame = floorToFrame(virt2phys(fakePhysicalMemory));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[isadmaMemoryRegion], baseFrame, baseFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[permamapMemoryRegion], baseFrame, addToFrameNumber(baseFrame, frameCount));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[otherMemoryRegion], addToFrameNumber(baseFrame, frameCount), addToFrameNumber(baseFrame, frameCount));
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_firstFrame = baseFrame;
+    PhysicalMemory_add(virt2phys(fakePhysicalMemory), virt2phys(fakePhysicalMemory + frameCount * PAGE_SIZE));
+}
+
+/** Returns true if the specified frame is filled with zeros. */
+static bool isZeroed(FrameNumber frameNumber) {
+    const uint8_t *page = frame2virt(frameNumber);
+    for (size_t i = 0; i < PAGE_SIZE; i++)
+        if (page[i] != 0) return false;
+    return true;
+}
+
+static void FrameCacheTest_fillZeroedPool() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[2];
+    initializeFakePhysicalMemory(fakePhysicalMemory, frames, 2);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+
+    bool morePending = FrameCache_fillZeroedPool(&fc);
+
+    ASSERT(morePending);
+    ASSERT(fc.zeroedCount == 1);
+    ASSERT(!Frame_isFree(getFrame(fc.zeroed[0])));
+    ASSERT(isZeroed(fc.zeroed[0]));
+    PhysicalMemory_firstFrame = frameNumber(0);
+}
+
+static void FrameCacheTest_fillZeroedPoolOutOfMemory() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[2];
+    initializeFakePhysicalMemory(fakePhysicalMemory, frames, 2);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    FrameCache_fillZeroedPool(&fc);
+    FrameCache_fillZeroedPool(&fc);
+
+    bool morePending = FrameCache_fillZeroedPool(&fc);
+
+    ASSERT(!morePending);
+    ASSERT(fc.zeroedCount == 2);
+    ASSERT(isZeroed(fc.zeroed[0]));
+    ASSERT(isZeroed(fc.zeroed[1]));
+    PhysicalMemory_firstFrame = frameNumber(0);
+}
+
+static void PhysicalMemoryTest_allocateZeroedFromPool() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[2];
+    initializeFakePhysicalMemory(fakePhysicalMemory, frames, 2);
+    FrameCache fc;
+    FrameCache_initialize(&fc);
+    FrameCache_fillZeroedPool(&fc);
+    FrameNumber zeroedFrameNumber = fc.zeroed[0];
+    Cpu cpu;
+    cpu.frameCache = &fc;
+    theFakeHardware.currentCpu = &cpu;
+    PhysicalMemory_frameCachesEnabled = true;
+    Task task;
+
+    FrameNumber allocated = PhysicalMemory_allocateZeroed(&task, otherMemoryRegion);
+
+    PhysicalMemory_frameCachesEnabled = false;
+    theFakeHardware.currentCpu = NULL;
+    ASSERT(allocated.v == zeroedFrameNumber.v);
+    ASSERT(fc.zeroedCount == 0);
+    ASSERT(!Frame_isFree(getFrame(allocated)));
+    ASSERT(isZeroed(allocated));
+    PhysicalMemory_firstFrame = frameNumber(0);
+}
+
+static void PhysicalMemoryTest_allocateZeroedOnDemand() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[2];
+    initializeFakePhysicalMemory(fakePhysicalMemory, frames, 2);
+    Task task;
+
+    FrameNumber allocated = PhysicalMemory_allocateZeroed(&task, otherMemoryRegion);
+
+    ASSERT(allocated.v == PhysicalMemory_regions[permamapMemoryRegion].end.v - 1);
+    ASSERT(!Frame_isFree(getFrame(allocated)));
+    ASSERT(isZeroed(allocated));
+    ASSERT(fakePhysicalMemory[0] == 0xAA);
+    PhysicalMemory_firstFrame = frameNumber(0);
 }
 
 void PhysicalMemoryTest_run() {
     RUN_TEST(PhysicalMemoryRegionTest_allocate);
     RUN_TEST(PhysicalMemoryRegionTest_allocateOutOfMemory);
     RUN_TEST(PhysicalMemoryRegionTest_deallocate);
+    RUN_TEST(PhysicalMemoryRegionTest_allocateContiguousAligned);
+    RUN_TEST(PhysicalMemoryRegionTest_allocateContiguousFromSmallerSizeClass);
+    RUN_TEST(PhysicalMemoryRegionTest_allocateContiguousFragmented);
+    RUN_TEST(PhysicalMemoryRegionTest_deallocateContiguousCoalescing);
     RUN_TEST(PhysicalMemoryTest_allocate);
     RUN_TEST(PhysicalMemoryTest_allocatePreferredRegionExhausted);
     RUN_TEST(PhysicalMemoryTest_allocatePreferredRegionAndLowerRegionsExhausted);
     RUN_TEST(PhysicalMemoryTest_deallocate);
+    RUN_TEST(PhysicalMemoryTest_allocateContiguousPreferredRegionExhausted);
+    RUN_TEST(PhysicalMemoryTest_allocateThroughFrameCache);
+    RUN_TEST(FrameCacheTest_allocateRefills);
+    RUN_TEST(FrameCacheTest_allocateFromCache);
+    RUN_TEST(FrameCacheTest_allocatePreferredRegionExhausted);
+    RUN_TEST(FrameCacheTest_allocateAllRegionsExhausted);
+    RUN_TEST(FrameCacheTest_deallocate);
+    RUN_TEST(FrameCacheTest_deallocateDrains);
+    RUN_TEST(FrameCacheTest_allocateFromLocalNode);
+    RUN_TEST(FrameCacheTest_allocateFromRemoteNodeBeforeLowerRegions);
+    RUN_TEST(FrameCacheTest_deallocateRemoteFrame);
+    RUN_TEST(FrameCacheTest_fillZeroedPool);
+    RUN_TEST(FrameCacheTest_fillZeroedPoolOutOfMemory);
+    RUN_TEST(PhysicalMemoryTest_allocateZeroedFromPool);
+    RUN_TEST(PhysicalMemoryTest_allocateZeroedOnDemand);
 }
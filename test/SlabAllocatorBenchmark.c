@@ -0,0 +1,184 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "benchmark.h"
+#include "kernel.h"
+
+/*
+ * Channels are created and destroyed by simulated CPUs, switching the fake
+ * current CPU after each burst as in PhysicalMemoryBenchmark. Without per-CPU
+ * caches every operation takes the lock of the allocator, as it would have to
+ * on a real multiprocessor.
+ */
+
+#define FRAME_COUNT 1024
+#define MAX_CPUS 8
+#define ROUNDS 4096
+#define MAX_BURST 48 // channels a simulated CPU creates before yielding to the next one
+#define THREAD_COUNT 6144
+#define SCAN_COUNT 256
+
+static __attribute__((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[FRAME_COUNT * PAGE_SIZE];
+static Frame frames[FRAME_COUNT];
+static Cpu cpus[MAX_CPUS];
+static Channel *channels[MAX_CPUS][MAX_BURST];
+static Thread *threads[THREAD_COUNT];
+
+static void initialize(size_t cpuCount, bool cpuCachesEnabled) {
+    FrameNumber baseFrame = floorToFrame(virt2phys(fakePhysicalMemory));
+    FrameNumber endFrame = addToFrameNumber(baseFrame, FRAME_COUNT);
+    memzero(frames, sizeof(frames));
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_firstFrame = baseFrame;
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[isadmaMemoryRegion], baseFrame, baseFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[permamapMemoryRegion], baseFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[otherMemoryRegion], endFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[highMemoryRegion], endFrame, endFrame);
+    Spinlock_init(&PhysicalMemory_lock);
+    PhysicalMemory_deallocateContiguous(baseFrame, FRAME_COUNT);
+    SlabAllocator_initialize(&magazineAllocator, sizeof(SlabMagazine), NULL, FrameType_unmapped);
+    SlabAllocator_initialize(&channelAllocator, sizeof(Channel), NULL, FrameType_unmapped);
+    SlabAllocator_initialize(&threadAllocator, sizeof(Thread), NULL, FrameType_unmapped);
+    if (cpuCachesEnabled) SlabAllocator_enableCpuCaches(&channelAllocator, cpuCount);
+    for (size_t i = 0; i < cpuCount; i++)
+        cpus[i].index = i;
+}
+
+/** Returns a pseudo-random burst length in [1, MAX_BURST], using a linear congruential generator. */
+static size_t nextBurst(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return 1 + (*seed >> 16) % MAX_BURST;
+}
+
+static Channel *createChannel(bool cpuCachesEnabled) {
+    if (cpuCachesEnabled) return SlabAllocator_allocate(&channelAllocator);
+    Spinlock_lock(&channelAllocator.lock);
+    Channel *channel = SlabAllocator_allocate(&channelAllocator);
+    Spinlock_unlock(&channelAllocator.lock);
+    return channel;
+}
+
+static void destroyChannel(Channel *channel, bool cpuCachesEnabled) {
+    if (cpuCachesEnabled) {
+        SlabAllocator_deallocate(&channelAllocator, channel);
+        return;
+    }
+    Spinlock_lock(&channelAllocator.lock);
+    SlabAllocator_deallocate(&channelAllocator, channel);
+    Spinlock_unlock(&channelAllocator.lock);
+}
+
+/** Each CPU creates a burst of channels and destroys them before the next CPU runs. */
+static void createAndDestroyLocally(const char *operation, size_t cpuCount, bool cpuCachesEnabled) {
+    initialize(cpuCount, cpuCachesEnabled);
+    uint32_t seed = 12345;
+    size_t channelCount = 0;
+
+    uint64_t begin = Benchmark_readTsc();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        for (size_t c = 0; c < cpuCount; c++) {
+            theFakeHardware.currentCpu = &cpus[c];
+            size_t burst = nextBurst(&seed);
+            for (size_t i = 0; i < burst; i++)
+                channels[c][i] = createChannel(cpuCachesEnabled);
+            for (size_t i = 0; i < burst; i++)
+                destroyChannel(channels[c][i], cpuCachesEnabled);
+            channelCount += burst;
+        }
+    }
+    uint64_t end = Benchmark_readTsc();
+
+    theFakeHardware.currentCpu = NULL;
+    BENCHMARK_REPORT(operation, end - begin, channelCount);
+}
+
+/** Each CPU destroys the channels created by the previous CPU, moving magazines through the depot. */
+static void createAndDestroyRemotely(const char *operation, size_t cpuCount, bool cpuCachesEnabled) {
+    initialize(cpuCount, cpuCachesEnabled);
+    uint32_t seed = 12345;
+    size_t channelCount = 0;
+    size_t bursts[MAX_CPUS] = { 0 };
+
+    uint64_t begin = Benchmark_readTsc();
+    for (size_t r = 0; r < ROUNDS; r++) {
+        for (size_t c = 0; c < cpuCount; c++) {
+            theFakeHardware.currentCpu = &cpus[c];
+            size_t previous = (c + cpuCount - 1) % cpuCount;
+            for (size_t i = 0; i < bursts[previous]; i++)
+                destroyChannel(channels[previous][i], cpuCachesEnabled);
+            bursts[previous] = 0;
+            size_t burst = nextBurst(&seed);
+            for (size_t i = 0; i < burst; i++)
+                channels[c][i] = createChannel(cpuCachesEnabled);
+            bursts[c] = burst;
+            channelCount += burst;
+        }
+    }
+    uint64_t end = Benchmark_readTsc();
+
+    theFakeHardware.currentCpu = NULL;
+    BENCHMARK_REPORT(operation, end - begin, channelCount);
+}
+
+static void SlabAllocatorBenchmark_createAndDestroyLocally() {
+    createAndDestroyLocally("global lock, 1 CPU", 1, false);
+    createAndDestroyLocally("global lock, 8 CPUs", 8, false);
+    createAndDestroyLocally("magazines, 1 CPU", 1, true);
+    createAndDestroyLocally("magazines, 2 CPUs", 2, true);
+    createAndDestroyLocally("magazines, 4 CPUs", 4, true);
+    createAndDestroyLocally("magazines, 8 CPUs", 8, true);
+}
+
+static void SlabAllocatorBenchmark_createAndDestroyRemotely() {
+    createAndDestroyRemotely("global lock, 8 CPUs", 8, false);
+    createAndDestroyRemotely("magazines, 2 CPUs", 2, true);
+    createAndDestroyRemotely("magazines, 8 CPUs", 8, true);
+}
+
+/**
+ * Reads the priority of many threads, as the scheduler would, to show the effect of slab colouring.
+ * Reports TSC ticks per scan of all threads.
+ * Without colouring, the same field of the threads at the same index of each slab maps to the same cache set.
+ */
+static void scanThreads(const char *operation, bool colouringEnabled) {
+    initialize(1, false);
+    if (!colouringEnabled) threadAllocator.maxColour = 0;
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        threads[i] = SlabAllocator_allocate(&threadAllocator);
+        threads[i]->priority = i;
+    }
+    volatile unsigned sum = 0;
+
+    uint64_t begin = Benchmark_readTsc();
+    for (size_t s = 0; s < SCAN_COUNT; s++)
+        for (size_t i = 0; i < THREAD_COUNT; i++)
+            sum += threads[i]->priority;
+    uint64_t end = Benchmark_readTsc();
+
+    BENCHMARK_REPORT(operation, end - begin, SCAN_COUNT);
+}
+
+static void SlabAllocatorBenchmark_scanThreads() {
+    scanThreads("uncoloured slabs", false);
+    scanThreads("coloured slabs", true);
+}
+
+void SlabAllocatorBenchmark_run() {
+    RUN_BENCHMARK(SlabAllocatorBenchmark_createAndDestroyLocally);
+    RUN_BENCHMARK(SlabAllocatorBenchmark_createAndDestroyRemotely);
+    RUN_BENCHMARK(SlabAllocatorBenchmark_scanThreads);
+}
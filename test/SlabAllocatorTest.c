@@ -25,23 +25,43 @@ static void initializePhysicalMemory(uint8_t *fakePhysicalMemory, Frame *frames,
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], baseFrame, addToFrameNumber(baseFrame, frameCount));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], addToFrameNumber(baseFrame, frameCount), addToFrameNumber(baseFrame, frameCount));
     PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], addToFrameNumber(baseFrame, frameCount), addToFrameNumber(baseFrame, frameCount));
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], addToFrameNumber(baseFrame, frameCount), addToFrameNumber(baseFrame, frameCount));
     PhysicalMemory_frameDescriptors = frames;
     PhysicalMemory_firstFrame = baseFrame;
     PhysicalMemory_add(base, addToPhysicalAddress(base, frameCount * PAGE_SIZE));
 }
 
+/** Returns the number of live items of the slab containing the specified item, as tracked by its frame descriptor. */
+static size_t getLiveCount(void *item) {
+    return getFrame(virt2frame(item))->virtualAddress.v & 0xFFFF;
+}
+
+/** Returns true if the slab containing the specified item is linked in the specified list. */
+static bool isInList(void *item, const LinkedList_Node *list) {
+    const LinkedList_Node *node = &getFrame(virt2frame(item))->node;
+    for (const LinkedList_Node *n = list->next; n != list; n = n->next)
+        if (n == node) return true;
+    return false;
+}
+
 static void SlabAllocatorTest_initialize() {
     Task task;
     SlabAllocator allocator;
     const size_t itemSize = 48;
-    SlabAllocator_initialize(&allocator, itemSize, &task);
+    SlabAllocator_initialize(&allocator, itemSize, &task, FrameType_unmapped);
     const size_t expectedItemsPerSlab = PAGE_SIZE / itemSize;
-    ASSERT(allocator.freeItems == NULL);
+    for (size_t i = 0; i < SLAB_PARTIAL_LIST_COUNT; i++)
+        ASSERT(allocator.partialSlabs[i].next == &allocator.partialSlabs[i]);
+    ASSERT(allocator.emptySlabs.next == &allocator.emptySlabs);
+    ASSERT(allocator.emptySlabCount == 0);
     ASSERT(allocator.itemSize == itemSize);
     ASSERT(allocator.itemsPerSlab == expectedItemsPerSlab);
-    ASSERT(allocator.brk == NULL);
-    ASSERT(allocator.limit == NULL);
+    ASSERT(allocator.colour == 0);
+    ASSERT(allocator.maxColour == 0); // 16 bytes left over, less than a colour step
     ASSERT(allocator.task == &task);
+    ASSERT(allocator.fullMagazines == NULL);
+    ASSERT(allocator.emptyMagazines == NULL);
+    ASSERT(allocator.cpuCaches == NULL);
 }
 
 static void SlabAllocatorTest_allocateFirst() {
@@ -51,19 +71,14 @@ static void SlabAllocatorTest_allocateFirst() {
     Task task;
     SlabAllocator allocator;
     const size_t itemSize = 48;
-    SlabAllocator_initialize(&allocator, itemSize, &task);
+    SlabAllocator_initialize(&allocator, itemSize, &task, FrameType_unmapped);
 
     void *item = SlabAllocator_allocate(&allocator);
     
-    const size_t expectedItemsPerSlab = PAGE_SIZE / itemSize;
     ASSERT(Frame_getTask(&frames[0]) == &task);
-    ASSERT(allocator.freeItems == NULL);
-    ASSERT(allocator.itemSize == itemSize);
-    ASSERT(allocator.itemsPerSlab == expectedItemsPerSlab);
-    ASSERT(allocator.brk == &fakePhysicalMemory[itemSize]);
-    ASSERT(allocator.limit == &fakePhysicalMemory[expectedItemsPerSlab * itemSize]);
-    ASSERT(allocator.task == &task);
     ASSERT(item == &fakePhysicalMemory[0]);
+    ASSERT(getLiveCount(item) == 1);
+    ASSERT(isInList(item, &allocator.partialSlabs[0]));
 }
 
 static void SlabAllocatorTest_allocateSecond() {
@@ -73,20 +88,15 @@ static void SlabAllocatorTest_allocateSecond() {
     Task task;
     SlabAllocator allocator;
     const size_t itemSize = 48;
-    SlabAllocator_initialize(&allocator, itemSize, &task);
+    SlabAllocator_initialize(&allocator, itemSize, &task, FrameType_unmapped);
     SlabAllocator_allocate(&allocator);
         
     void *item = SlabAllocator_allocate(&allocator);
     
-    const size_t expectedItemsPerSlab = PAGE_SIZE / itemSize;
     ASSERT(Frame_getTask(&frames[0]) == &task);
-    ASSERT(allocator.freeItems == NULL);
-    ASSERT(allocator.itemSize == itemSize);
-    ASSERT(allocator.itemsPerSlab == expectedItemsPerSlab);
-    ASSERT(allocator.brk == &fakePhysicalMemory[2 * itemSize]);
-    ASSERT(allocator.limit == &fakePhysicalMemory[expectedItemsPerSlab * itemSize]);
-    ASSERT(allocator.task == &task);
     ASSERT(item == &fakePhysicalMemory[48]);
+    ASSERT(getLiveCount(item) == 2);
+    ASSERT(isInList(item, &allocator.partialSlabs[0]));
 }
 
 static void SlabAllocatorTest_allocateBeyondPage() {
@@ -97,21 +107,21 @@ static void SlabAllocatorTest_allocateBeyondPage() {
     SlabAllocator allocator;
     const size_t itemSize = 48;
     const size_t expectedItemsPerSlab = PAGE_SIZE / itemSize;
-    SlabAllocator_initialize(&allocator, itemSize, &task);
-    for (size_t i = 0; i < expectedItemsPerSlab; i++)
+    SlabAllocator_initialize(&allocator, itemSize, &task, FrameType_unmapped);
+    void *firstItem = SlabAllocator_allocate(&allocator);
+    for (size_t i = 1; i < expectedItemsPerSlab; i++)
         SlabAllocator_allocate(&allocator);
         
     void *item = SlabAllocator_allocate(&allocator);
     
     ASSERT(Frame_getTask(&frames[0]) == &task);
     ASSERT(Frame_getTask(&frames[1]) == &task);
-    ASSERT(allocator.freeItems == NULL);
-    ASSERT(allocator.itemSize == itemSize);
-    ASSERT(allocator.itemsPerSlab == expectedItemsPerSlab);
-    ASSERT(allocator.brk == &fakePhysicalMemory[itemSize]);
-    ASSERT(allocator.limit == &fakePhysicalMemory[expectedItemsPerSlab * itemSize]);
-    ASSERT(allocator.task == &task);
+    ASSERT(firstItem == &fakePhysicalMemory[PAGE_SIZE]);
+    ASSERT(getLiveCount(firstItem) == expectedItemsPerSlab);
+    ASSERT(!isInList(firstItem, &allocator.partialSlabs[SLAB_PARTIAL_LIST_COUNT - 1]));
     ASSERT(item == &fakePhysicalMemory[0]);
+    ASSERT(getLiveCount(item) == 1);
+    ASSERT(isInList(item, &allocator.partialSlabs[0]));
 }
 
 static void SlabAllocatorTest_deallocateFirst() {
@@ -121,20 +131,17 @@ static void SlabAllocatorTest_deallocateFirst() {
     Task task;
     SlabAllocator allocator;
     const size_t itemSize = 48;
-    SlabAllocator_initialize(&allocator, itemSize, &task);
+    SlabAllocator_initialize(&allocator, itemSize, &task, FrameType_unmapped);
     void *item = SlabAllocator_allocate(&allocator);
         
     SlabAllocator_deallocate(&allocator, item);
     
-    const size_t expectedItemsPerSlab = PAGE_SIZE / itemSize;
     ASSERT(Frame_getTask(&frames[0]) == &task);
-    ASSERT(allocator.freeItems == (SlabAllocator_FreeItem *) &fakePhysicalMemory[0]);
-    ASSERT(allocator.freeItems->next == NULL);
-    ASSERT(allocator.itemSize == itemSize);
-    ASSERT(allocator.itemsPerSlab == expectedItemsPerSlab);
-    ASSERT(allocator.brk == &fakePhysicalMemory[itemSize]);
-    ASSERT(allocator.limit == &fakePhysicalMemory[expectedItemsPerSlab * itemSize]);
-    ASSERT(allocator.task == &task);
+    ASSERT(getLiveCount(item) == 0);
+    ASSERT(allocator.partialSlabs[0].next == &allocator.partialSlabs[0]);
+    ASSERT(isInList(item, &allocator.emptySlabs));
+    ASSERT(allocator.emptySlabCount == 1);
+    ASSERT(SlabAllocator_allocate(&allocator) == item);
 }
 
 static void SlabAllocatorTest_deallocateSecond() {
@@ -144,23 +151,179 @@ static void SlabAllocatorTest_deallocateSecond() {
     Task task;
     SlabAllocator allocator;
     const size_t itemSize = 48;
-    SlabAllocator_initialize(&allocator, itemSize, &task);
+    SlabAllocator_initialize(&allocator, itemSize, &task, FrameType_unmapped);
     void *firstItem = SlabAllocator_allocate(&allocator);
     void *secondItem = SlabAllocator_allocate(&allocator);
         
     SlabAllocator_deallocate(&allocator, firstItem);
     SlabAllocator_deallocate(&allocator, secondItem);
     
-    const size_t expectedItemsPerSlab = PAGE_SIZE / itemSize;
     ASSERT(Frame_getTask(&frames[0]) == &task);
-    ASSERT(allocator.freeItems == (SlabAllocator_FreeItem *) &fakePhysicalMemory[itemSize]);
-    ASSERT(allocator.freeItems->next == (SlabAllocator_FreeItem *) &fakePhysicalMemory[0]);
-    ASSERT(allocator.freeItems->next->next == NULL);
-    ASSERT(allocator.itemSize == itemSize);
-    ASSERT(allocator.itemsPerSlab == expectedItemsPerSlab);
-    ASSERT(allocator.brk == &fakePhysicalMemory[2 * itemSize]);
-    ASSERT(allocator.limit == &fakePhysicalMemory[expectedItemsPerSlab * itemSize]);
-    ASSERT(allocator.task == &task);
+    ASSERT(getLiveCount(firstItem) == 0);
+    ASSERT(((SlabAllocator_FreeItem *) secondItem)->next == firstItem);
+    ASSERT(SlabAllocator_allocate(&allocator) == secondItem);
+    ASSERT(SlabAllocator_allocate(&allocator) == firstItem);
+}
+
+static void SlabAllocatorTest_deallocateReturnsEmptySlab() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[30];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 2);
+    Task task;
+    SlabAllocator allocator;
+    const size_t itemSize = 48;
+    const size_t itemsPerSlab = PAGE_SIZE / itemSize;
+    SlabAllocator_initialize(&allocator, itemSize, &task, FrameType_unmapped);
+    void *items[PAGE_SIZE / 48 + 1];
+    for (size_t i = 0; i < itemsPerSlab + 1; i++)
+        items[i] = SlabAllocator_allocate(&allocator);
+    ASSERT(PhysicalMemory_regions[0].freeFrameCount == 0);
+
+    for (size_t i = 0; i < itemsPerSlab + 1; i++)
+        SlabAllocator_deallocate(&allocator, items[i]);
+
+    ASSERT(allocator.emptySlabCount == SLAB_MAX_EMPTY_SLABS);
+    ASSERT(isInList(items[0], &allocator.emptySlabs));
+    ASSERT(PhysicalMemory_regions[0].freeFrameCount == 1);
+    ASSERT(Frame_isFree(&frames[0]));
+}
+
+static void SlabAllocatorTest_allocateFromFullestSlab() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[30];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 2);
+    Task task;
+    SlabAllocator allocator;
+    const size_t itemSize = 48;
+    const size_t itemsPerSlab = PAGE_SIZE / itemSize;
+    SlabAllocator_initialize(&allocator, itemSize, &task, FrameType_unmapped);
+    void *items[PAGE_SIZE / 48 + 1];
+    for (size_t i = 0; i < itemsPerSlab + 1; i++)
+        items[i] = SlabAllocator_allocate(&allocator);
+    SlabAllocator_deallocate(&allocator, items[1]);
+    ASSERT(isInList(items[0], &allocator.partialSlabs[SLAB_PARTIAL_LIST_COUNT - 1]));
+    ASSERT(isInList(items[itemsPerSlab], &allocator.partialSlabs[0]));
+
+    void *item = SlabAllocator_allocate(&allocator);
+
+    ASSERT(item == items[1]);
+    ASSERT(getLiveCount(items[0]) == itemsPerSlab);
+    ASSERT(getLiveCount(items[itemsPerSlab]) == 1);
+}
+
+static void SlabAllocatorTest_allocateTagsFrame() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[PAGE_SIZE];
+    Frame frames[1];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 1);
+    Task task;
+    SlabAllocator allocator;
+    SlabAllocator_initialize(&allocator, 16, &task, FrameType_capability);
+
+    SlabAllocator_allocate(&allocator);
+
+    ASSERT(Frame_getTask(&frames[0]) == &task);
+    ASSERT(Frame_getType(&frames[0]) == FrameType_capability);
+    ASSERT(((SlabAllocator_FreeItem *) &fakePhysicalMemory[PAGE_SIZE - 16])->next == NULL);
+}
+
+static void SlabAllocatorTest_deallocateUntagsReturnedSlab() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[2];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 2);
+    Task task;
+    SlabAllocator allocator;
+    SlabAllocator_initialize(&allocator, 2048, &task, FrameType_capability);
+    void *items[3];
+    for (size_t i = 0; i < 3; i++)
+        items[i] = SlabAllocator_allocate(&allocator);
+
+    for (size_t i = 0; i < 3; i++)
+        SlabAllocator_deallocate(&allocator, items[i]);
+
+    ASSERT(Frame_getType(&frames[1]) == FrameType_capability); // kept as empty slab
+    ASSERT(Frame_isFree(&frames[0]));
+    ASSERT(Frame_getType(&frames[0]) == FrameType_unmapped);
+}
+
+static void SlabAllocatorTest_allocateColouredSlabs() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[6 * PAGE_SIZE];
+    Frame frames[30];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 6);
+    Task task;
+    SlabAllocator allocator;
+    const size_t itemSize = 320; // 256 bytes left over, for colours 0, 64, 128, 192 and 256
+    const size_t itemsPerSlab = PAGE_SIZE / itemSize;
+    SlabAllocator_initialize(&allocator, itemSize, &task, FrameType_unmapped);
+    ASSERT(allocator.maxColour == 256);
+    uint8_t *firstItems[6];
+
+    for (size_t i = 0; i < 6; i++) {
+        firstItems[i] = SlabAllocator_allocate(&allocator);
+        for (size_t j = 1; j < itemsPerSlab; j++)
+            SlabAllocator_allocate(&allocator);
+    }
+
+    const size_t expectedColours[6] = { 0, 64, 128, 192, 256, 0 };
+    for (size_t i = 0; i < 6; i++)
+        ASSERT(((uintptr_t) firstItems[i] & (PAGE_SIZE - 1)) == expectedColours[i]);
+}
+
+static void SlabAllocatorTest_deallocateToMagazine() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[4 * PAGE_SIZE];
+    Frame frames[30];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 4);
+    SlabAllocator_initialize(&magazineAllocator, sizeof(SlabMagazine), NULL, FrameType_unmapped);
+    SlabAllocator allocator;
+    SlabAllocator_initialize(&allocator, 48, NULL, FrameType_unmapped);
+    SlabAllocator_enableCpuCaches(&allocator, 2);
+    Cpu cpu = { .index = 1 };
+    theFakeHardware.currentCpu = &cpu;
+    void *item = SlabAllocator_allocate(&allocator);
+
+    SlabAllocator_deallocate(&allocator, item);
+    void *reallocatedItem = SlabAllocator_allocate(&allocator);
+
+    theFakeHardware.currentCpu = NULL;
+    const SlabCpuCache *cc = &allocator.cpuCaches[1];
+    ASSERT(allocator.cpuCaches[0].loaded == NULL);
+    ASSERT(cc->loaded != NULL);
+    ASSERT(cc->loaded->rounds == 0);
+    ASSERT(cc->previous == NULL);
+    ASSERT(reallocatedItem == item);
+    ASSERT(getLiveCount(item) == 1);
+    ASSERT(allocator.fullMagazines == NULL);
+}
+
+static void SlabAllocatorTest_exchangeMagazinesThroughDepot() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[4 * PAGE_SIZE];
+    Frame frames[30];
+    initializePhysicalMemory(fakePhysicalMemory, frames, 4);
+    SlabAllocator_initialize(&magazineAllocator, sizeof(SlabMagazine), NULL, FrameType_unmapped);
+    SlabAllocator allocator;
+    SlabAllocator_initialize(&allocator, 48, NULL, FrameType_unmapped);
+    SlabAllocator_enableCpuCaches(&allocator, 2);
+    Cpu cpus[2] = { { .index = 0 }, { .index = 1 } };
+    void *items[2 * SLAB_MAGAZINE_SIZE + 1];
+    theFakeHardware.currentCpu = &cpus[0];
+    for (size_t i = 0; i < 2 * SLAB_MAGAZINE_SIZE + 1; i++)
+        items[i] = SlabAllocator_allocate(&allocator);
+    for (size_t i = 0; i < 2 * SLAB_MAGAZINE_SIZE + 1; i++)
+        SlabAllocator_deallocate(&allocator, items[i]);
+    const SlabMagazine *fullMagazine = allocator.fullMagazines;
+
+    theFakeHardware.currentCpu = &cpus[1];
+    void *item = SlabAllocator_allocate(&allocator);
+
+    theFakeHardware.currentCpu = NULL;
+    ASSERT(fullMagazine != NULL);
+    ASSERT(fullMagazine->next == NULL);
+    ASSERT(allocator.fullMagazines == NULL);
+    ASSERT(allocator.cpuCaches[0].loaded->rounds == 1);
+    ASSERT(allocator.cpuCaches[0].previous->rounds == SLAB_MAGAZINE_SIZE);
+    ASSERT(allocator.cpuCaches[1].loaded == fullMagazine);
+    ASSERT(allocator.cpuCaches[1].loaded->rounds == SLAB_MAGAZINE_SIZE - 1);
+    ASSERT(item == items[SLAB_MAGAZINE_SIZE - 1]);
+    ASSERT(getLiveCount(item) == 2 * SLAB_MAGAZINE_SIZE + 1);
 }
 
 void SlabAllocatorTest_run() {
@@ -170,4 +333,11 @@ void SlabAllocatorTest_run() {
     RUN_TEST(SlabAllocatorTest_allocateBeyondPage);
     RUN_TEST(SlabAllocatorTest_deallocateFirst);
     RUN_TEST(SlabAllocatorTest_deallocateSecond);
+    RUN_TEST(SlabAllocatorTest_deallocateReturnsEmptySlab);
+    RUN_TEST(SlabAllocatorTest_allocateFromFullestSlab);
+    RUN_TEST(SlabAllocatorTest_allocateColouredSlabs);
+    RUN_TEST(SlabAllocatorTest_allocateTagsFrame);
+    RUN_TEST(SlabAllocatorTest_deallocateUntagsReturnedSlab);
+    RUN_TEST(SlabAllocatorTest_deallocateToMagazine);
+    RUN_TEST(SlabAllocatorTest_exchangeMagazinesThroughDepot);
 }
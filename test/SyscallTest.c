@@ -0,0 +1,158 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "test.h"
+#include "kernel.h"
+
+#define FRAME_COUNT 3
+
+static void initialize(Task *task, uint8_t *fakePhysicalMemory, Frame *frames) {
+    memzero(frames, FRAME_COUNT * sizeof(Frame));
+    PhysicalAddress base = virt2phys(fakePhysicalMemory);
+    FrameNumber baseFrame = floorToFrame(base);
+    FrameNumber endFrame = addToFrameNumber(baseFrame, FRAME_COUNT);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], baseFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], endFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], endFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], endFrame, endFrame);
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_firstFrame = baseFrame;
+    PhysicalMemory_totalMemoryFrames = endFrame.v;
+    PhysicalMemory_add(base, addToPhysicalAddress(base, FRAME_COUNT * PAGE_SIZE));
+    SlabAllocator_initialize(&proxyAllocator, sizeof(Proxy), NULL, FrameType_unmapped);
+    SlabAllocator_initialize(&task->capabilitySpace, sizeof(Capability), task, FrameType_capability);
+    task->capabilityTable.leaves = NULL;
+}
+
+/** Allocates a capability to the specified task, or to the object of cap if not NULL, as if derived from it. */
+static CapabilityAddress allocateCapability(Task *task, Capability *cap) {
+    Capability *c = Task_allocateCapability(task, cap != NULL ? cap->obj : (uintptr_t) task | kobjTask, 0);
+    if (cap != NULL) {
+        c->prev = cap;
+        c->next = cap->next;
+        cap->next->prev = c;
+        cap->next = c;
+    }
+    return makeCapabilityAddress(Task_getCapabilityAddress(task, c));
+}
+
+static void SyscallTest_deleteSharedCapability() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[FRAME_COUNT * PAGE_SIZE];
+    Frame frames[FRAME_COUNT];
+    Task task;
+    initialize(&task, fakePhysicalMemory, frames);
+    CapabilityAddress a = allocateCapability(&task, NULL);
+    Capability *cap = Task_lookupCapability(&task, a);
+    CapabilityAddress b = allocateCapability(&task, cap);
+
+    ASSERT(Syscall_deleteCapability(&task, b) == 0);
+
+    ASSERT(Capability_getObjectType(Task_lookupCapability(&task, b)) == kobjNone);
+    ASSERT(Capability_getObject(cap) == &task);
+    ASSERT(cap->next == cap);
+    ASSERT(cap->prev == cap);
+    ASSERT(Syscall_deleteCapability(&task, b) == -EINVAL);
+    ASSERT(Syscall_deleteCapability(&task, a) == 0);
+    ASSERT(Capability_getObjectType(Task_lookupCapability(&task, a)) == kobjNone);
+}
+
+static void SyscallTest_resolveProxy() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[FRAME_COUNT * PAGE_SIZE];
+    Frame frames[FRAME_COUNT];
+    Task task;
+    initialize(&task, fakePhysicalMemory, frames);
+    CapabilityAddress a = allocateCapability(&task, NULL);
+
+    int proxy = Syscall_createProxy(&task, a);
+    int nestedProxy = Syscall_createProxy(&task, makeCapabilityAddress(proxy));
+
+    ASSERT(proxy > 0);
+    ASSERT(nestedProxy > 0);
+    ASSERT(Capability_getObjectType(Task_lookupCapability(&task, makeCapabilityAddress(proxy))) == kobjProxy);
+    Capability *resolved = Task_resolveCapability(&task, makeCapabilityAddress(nestedProxy));
+    ASSERT(Capability_getObjectType(resolved) == kobjTask);
+    ASSERT(Capability_getObject(resolved) == &task);
+    ASSERT(Task_resolveCapability(&task, a) == Task_lookupCapability(&task, a));
+}
+
+static void SyscallTest_revokeProxy() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[FRAME_COUNT * PAGE_SIZE];
+    Frame frames[FRAME_COUNT];
+    Task task;
+    initialize(&task, fakePhysicalMemory, frames);
+    CapabilityAddress a = allocateCapability(&task, NULL);
+    CapabilityAddress proxy = makeCapabilityAddress(Syscall_createProxy(&task, a));
+    CapabilityAddress nestedProxy = makeCapabilityAddress(Syscall_createProxy(&task, proxy));
+    CapabilityAddress derived = allocateCapability(&task, Task_lookupCapability(&task, proxy));
+
+    ASSERT(Syscall_revokeProxy(&task, proxy) == 0);
+
+    ASSERT(Capability_getObjectType(Task_resolveCapability(&task, proxy)) == kobjNone);
+    ASSERT(Capability_getObjectType(Task_resolveCapability(&task, nestedProxy)) == kobjNone);
+    ASSERT(Capability_getObjectType(Task_resolveCapability(&task, derived)) == kobjNone);
+    Capability *cap = Task_resolveCapability(&task, a);
+    ASSERT(Capability_getObject(cap) == &task);
+    ASSERT(cap->next == cap);
+    ASSERT(Syscall_revokeProxy(&task, a) == -EINVAL);
+}
+
+static void SyscallTest_revokeProxyOfOtherTask() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[FRAME_COUNT * PAGE_SIZE];
+    Frame frames[FRAME_COUNT];
+    Task task;
+    Task otherTask;
+    initialize(&task, fakePhysicalMemory, frames);
+    SlabAllocator_initialize(&otherTask.capabilitySpace, sizeof(Capability), &otherTask, FrameType_capability);
+    otherTask.capabilityTable.leaves = NULL;
+    CapabilityAddress a = allocateCapability(&task, NULL);
+    CapabilityAddress proxy = makeCapabilityAddress(Syscall_createProxy(&task, a));
+    Capability *granted = Task_allocateCapability(&otherTask, Task_lookupCapability(&task, proxy)->obj, 0);
+    CapabilityAddress grantedAddress = makeCapabilityAddress(Task_getCapabilityAddress(&otherTask, granted));
+
+    ASSERT(Syscall_revokeProxy(&otherTask, grantedAddress) == -EPERM);
+    ASSERT(Capability_getObject(Task_resolveCapability(&otherTask, grantedAddress)) == &task);
+    ASSERT(Syscall_revokeProxy(&task, proxy) == 0);
+    ASSERT(Capability_getObjectType(Task_resolveCapability(&otherTask, grantedAddress)) == kobjNone);
+}
+
+static void SyscallTest_deleteLastCapabilityToProxy() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[FRAME_COUNT * PAGE_SIZE];
+    Frame frames[FRAME_COUNT];
+    Task task;
+    initialize(&task, fakePhysicalMemory, frames);
+    CapabilityAddress a = allocateCapability(&task, NULL);
+    CapabilityAddress proxy = makeCapabilityAddress(Syscall_createProxy(&task, a));
+    CapabilityAddress nestedProxy = makeCapabilityAddress(Syscall_createProxy(&task, proxy));
+    Capability *cap = Task_lookupCapability(&task, a);
+    ASSERT(cap->next != cap);
+
+    ASSERT(Syscall_deleteCapability(&task, proxy) == 0);
+    ASSERT(Capability_getObject(Task_resolveCapability(&task, nestedProxy)) == &task);
+    ASSERT(Syscall_deleteCapability(&task, nestedProxy) == 0);
+
+    ASSERT(cap->next == cap);
+    ASSERT(cap->prev == cap);
+    ASSERT(Capability_getObject(cap) == &task);
+}
+
+void SyscallTest_run() {
+    RUN_TEST(SyscallTest_deleteSharedCapability);
+    RUN_TEST(SyscallTest_resolveProxy);
+    RUN_TEST(SyscallTest_revokeProxy);
+    RUN_TEST(SyscallTest_revokeProxyOfOtherTask);
+    RUN_TEST(SyscallTest_deleteLastCapabilityToProxy);
+}
@@ -0,0 +1,81 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "benchmark.h"
+#include "kernel.h"
+
+#define FRAME_COUNT 1024
+#define CAPABILITY_COUNT (64 * 1024)
+#define LOOKUP_COUNT (16 * 1024 * 1024)
+
+static __attribute__((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[FRAME_COUNT * PAGE_SIZE];
+static Frame frames[FRAME_COUNT];
+static CapabilityAddress addresses[CAPABILITY_COUNT];
+static Task task;
+
+static void initialize(bool denseCapabilities) {
+    FrameNumber baseFrame = floorToFrame(virt2phys(fakePhysicalMemory));
+    FrameNumber endFrame = addToFrameNumber(baseFrame, FRAME_COUNT);
+    memzero(frames, sizeof(frames));
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_firstFrame = baseFrame;
+    PhysicalMemory_totalMemoryFrames = endFrame.v;
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[isadmaMemoryRegion], baseFrame, baseFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[permamapMemoryRegion], baseFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[otherMemoryRegion], endFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[highMemoryRegion], endFrame, endFrame);
+    Spinlock_init(&PhysicalMemory_lock);
+    PhysicalMemory_deallocateContiguous(baseFrame, FRAME_COUNT);
+    SlabAllocator_initialize(&task.capabilitySpace, sizeof(Capability), &task, FrameType_capability);
+    task.capabilityTable.leaves = NULL;
+    if (denseCapabilities) CapabilityTable_initialize(&task.capabilityTable, &task);
+    for (size_t i = 0; i < CAPABILITY_COUNT; i++) {
+        Capability *cap = denseCapabilities
+                ? CapabilityTable_allocate(&task.capabilityTable, &task)
+                : SlabAllocator_allocate(&task.capabilitySpace);
+        cap->obj = (uintptr_t) &task | kobjTask;
+        addresses[i] = makeCapabilityAddress(Task_getCapabilityAddress(&task, cap));
+    }
+}
+
+/** Resolves capability addresses in pseudo-random order, as system calls would, using a linear congruential generator. */
+static void lookupCapability(const char *operation, bool denseCapabilities) {
+    initialize(denseCapabilities);
+    uint32_t seed = 12345;
+    size_t found = 0;
+
+    uint64_t begin = Benchmark_readTsc();
+    for (size_t i = 0; i < LOOKUP_COUNT; i++) {
+        seed = seed * 1103515245 + 12345;
+        Capability *cap = Task_lookupCapability(&task, addresses[(seed >> 8) % CAPABILITY_COUNT]);
+        found += cap != NULL && Capability_getObjectType(cap) == kobjTask;
+    }
+    uint64_t end = Benchmark_readTsc();
+
+    assert(found == LOOKUP_COUNT);
+    BENCHMARK_REPORT(operation, end - begin, LOOKUP_COUNT);
+}
+
+/** Compares the resolution cost of a sparse capability space made by a slab allocator and of a dense CapabilityTable. */
+static void TaskBenchmark_lookupCapability() {
+    lookupCapability("sparse lookup", false);
+    lookupCapability("dense lookup", true);
+}
+
+void TaskBenchmark_run() {
+    RUN_BENCHMARK(TaskBenchmark_lookupCapability);
+}
@@ -0,0 +1,126 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "test.h"
+#include "kernel.h"
+
+static void initializeCapabilitySpace(Task *task, uint8_t *fakePhysicalMemory, Frame *frames, size_t frameCount) {
+    memzero(frames, frameCount * sizeof(Frame));
+    PhysicalAddress base = virt2phys(fakePhysicalMemory);
+    FrameNumber baseFrame = floorToFrame(base);
+    FrameNumber endFrame = addToFrameNumber(baseFrame, frameCount);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[0], baseFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[1], endFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[2], endFrame, endFrame);
+    PhysicalMemoryRegion_initialize(&PhysicalMemory_regions[3], endFrame, endFrame);
+    PhysicalMemory_frameDescriptors = frames;
+    PhysicalMemory_firstFrame = baseFrame;
+    PhysicalMemory_totalMemoryFrames = endFrame.v;
+    PhysicalMemory_add(base, addToPhysicalAddress(base, frameCount * PAGE_SIZE));
+    SlabAllocator_initialize(&task->capabilitySpace, sizeof(Capability), task, FrameType_capability);
+    task->capabilityTable.leaves = NULL;
+}
+
+static void TaskTest_lookupCapability() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[PAGE_SIZE];
+    Frame frames[1];
+    Task task;
+    initializeCapabilitySpace(&task, fakePhysicalMemory, frames, 1);
+    Capability *cap = Task_allocateCapability(&task, (uintptr_t) &task | kobjTask, 0);
+
+    Capability *found = Task_lookupCapability(&task, makeCapabilityAddress(Task_getCapabilityAddress(&task, cap)));
+
+    ASSERT(found == cap);
+    ASSERT(Capability_getObjectType(found) == kobjTask);
+    ASSERT(Capability_getObject(found) == &task);
+}
+
+static void TaskTest_lookupCapabilityOfOtherTask() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[PAGE_SIZE];
+    Frame frames[1];
+    Task task;
+    Task otherTask;
+    initializeCapabilitySpace(&task, fakePhysicalMemory, frames, 1);
+    otherTask.capabilityTable.leaves = NULL;
+    Capability *cap = Task_allocateCapability(&task, (uintptr_t) &task | kobjTask, 0);
+
+    Capability *found = Task_lookupCapability(&otherTask, makeCapabilityAddress(Task_getCapabilityAddress(&task, cap)));
+
+    ASSERT(found == NULL);
+}
+
+static void TaskTest_lookupCapabilityOutOfMemory() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[PAGE_SIZE];
+    Frame frames[1];
+    Task task;
+    initializeCapabilitySpace(&task, fakePhysicalMemory, frames, 1);
+    Task_allocateCapability(&task, (uintptr_t) &task | kobjTask, 0);
+    uintptr_t base = virt2phys(fakePhysicalMemory).v;
+
+    ASSERT(Task_lookupCapability(&task, makeCapabilityAddress(base - 16)) == NULL);
+    ASSERT(Task_lookupCapability(&task, makeCapabilityAddress(base + PAGE_SIZE)) == NULL);
+    ASSERT(Task_lookupCapability(&task, makeCapabilityAddress(0)) == NULL);
+}
+
+static void TaskTest_lookupFreeCapability() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[PAGE_SIZE];
+    Frame frames[1];
+    Task task;
+    initializeCapabilitySpace(&task, fakePhysicalMemory, frames, 1);
+    Capability *cap = Task_allocateCapability(&task, (uintptr_t) &task | kobjTask, 0);
+    Task_allocateCapability(&task, (uintptr_t) &task | kobjTask, 0);
+    Task_deallocateCapability(&task, cap);
+
+    Capability *found = Task_lookupCapability(&task, makeCapabilityAddress(Task_getCapabilityAddress(&task, cap)));
+    Capability *neverAllocated = Task_lookupCapability(&task, makeCapabilityAddress(virt2phys(fakePhysicalMemory).v + PAGE_SIZE - 16));
+
+    ASSERT(found == cap);
+    ASSERT(Capability_getObjectType(found) == kobjNone);
+    ASSERT(neverAllocated != NULL);
+    ASSERT(Capability_getObjectType(neverAllocated) == kobjNone);
+}
+
+static void TaskTest_lookupDenseCapability() {
+    __attribute__ ((aligned(PAGE_SIZE))) uint8_t fakePhysicalMemory[2 * PAGE_SIZE];
+    Frame frames[2];
+    Task task;
+    Task otherTask;
+    initializeCapabilitySpace(&task, fakePhysicalMemory, frames, 2);
+    ASSERT(CapabilityTable_initialize(&task.capabilityTable, &task) == 0);
+    otherTask.capabilityTable.leaves = NULL;
+    Capability *cap = Task_allocateCapability(&task, (uintptr_t) &task | kobjTask, 0);
+    uintptr_t address = Task_getCapabilityAddress(&task, cap);
+
+    Capability *found = Task_lookupCapability(&task, makeCapabilityAddress(address));
+    void *object = Capability_getObject(found);
+    Capability *foundInOtherTask = Task_lookupCapability(&otherTask, makeCapabilityAddress(address));
+    Task_deallocateCapability(&task, cap);
+    Capability *stale = Task_lookupCapability(&task, makeCapabilityAddress(address));
+
+    ASSERT(found == cap);
+    ASSERT(object == &task);
+    ASSERT(foundInOtherTask == NULL);
+    ASSERT(stale == NULL);
+}
+
+void TaskTest_run() {
+    RUN_TEST(TaskTest_lookupCapability);
+    RUN_TEST(TaskTest_lookupCapabilityOfOtherTask);
+    RUN_TEST(TaskTest_lookupCapabilityOutOfMemory);
+    RUN_TEST(TaskTest_lookupFreeCapability);
+    RUN_TEST(TaskTest_lookupDenseCapability);
+}
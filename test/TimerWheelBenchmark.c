@@ -0,0 +1,127 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "benchmark.h"
+#include "kernel.h"
+
+#define TIMER_COUNT 65536
+#define MAX_DELAY 10000000000ULL // 10 s
+#define EXPIRE_STEP 1000000 // 1 ms
+
+static TimerWheel timerWheel;
+static Timer timers[TIMER_COUNT];
+static uint64_t expirations[TIMER_COUNT];
+static size_t firedCount;
+
+static void countingCallback(Cpu *cpu, Timer *timer) {
+    firedCount++;
+}
+
+/** Fills the expirations with pseudo-random delays from now, using a linear congruential generator. */
+static void generateExpirations(uint64_t now) {
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < TIMER_COUNT; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint64_t r = ((uint64_t) seed << 16) ^ (seed >> 8);
+        expirations[i] = now + r % MAX_DELAY;
+    }
+}
+
+static void TimerWheelBenchmark_armAndCancel() {
+    TimerWheel_initialize(&timerWheel, 0);
+    generateExpirations(0);
+    for (size_t i = 0; i < TIMER_COUNT; i++)
+        Timer_initialize(&timers[i], countingCallback);
+    
+    uint64_t begin = Benchmark_readTsc();
+    for (size_t i = 0; i < TIMER_COUNT; i++)
+        TimerWheel_arm(&timerWheel, &timers[i], expirations[i], 0);
+    uint64_t armed = Benchmark_readTsc();
+    for (size_t i = 0; i < TIMER_COUNT; i++)
+        TimerWheel_cancel(&timerWheel, &timers[i]);
+    uint64_t canceled = Benchmark_readTsc();
+    
+    BENCHMARK_REPORT("arm", armed - begin, TIMER_COUNT);
+    BENCHMARK_REPORT("cancel", canceled - armed, TIMER_COUNT);
+}
+
+/** Models timeouts that are mostly canceled and rearmed before expiring. */
+static void TimerWheelBenchmark_rearm() {
+    TimerWheel_initialize(&timerWheel, 0);
+    generateExpirations(0);
+    for (size_t i = 0; i < TIMER_COUNT; i++) {
+        Timer_initialize(&timers[i], countingCallback);
+        TimerWheel_arm(&timerWheel, &timers[i], expirations[i], 0);
+    }
+    
+    uint64_t begin = Benchmark_readTsc();
+    for (size_t i = 0; i < TIMER_COUNT; i++)
+        TimerWheel_arm(&timerWheel, &timers[i], expirations[TIMER_COUNT - 1 - i], 0);
+    uint64_t end = Benchmark_readTsc();
+    
+    BENCHMARK_REPORT("rearm", end - begin, TIMER_COUNT);
+}
+
+static void TimerWheelBenchmark_expire() {
+    TimerWheel_initialize(&timerWheel, 0);
+    generateExpirations(0);
+    for (size_t i = 0; i < TIMER_COUNT; i++) {
+        Timer_initialize(&timers[i], countingCallback);
+        TimerWheel_arm(&timerWheel, &timers[i], expirations[i], 0);
+    }
+    firedCount = 0;
+    size_t interruptCount = 0;
+    
+    uint64_t begin = Benchmark_readTsc();
+    while (!TimerWheel_isEmpty(&timerWheel)) {
+        TimerWheel_expire(&timerWheel, NULL, TimerWheel_getNextExpiration(&timerWheel));
+        interruptCount++;
+    }
+    uint64_t end = Benchmark_readTsc();
+    
+    assert(firedCount == TIMER_COUNT);
+    BENCHMARK_REPORT("expire (per timer)", end - begin, firedCount);
+    BENCHMARK_REPORT("expire (per tickless interrupt)", end - begin, interruptCount);
+}
+
+static void TimerWheelBenchmark_expirePeriodically() {
+    TimerWheel_initialize(&timerWheel, 0);
+    generateExpirations(0);
+    for (size_t i = 0; i < TIMER_COUNT; i++) {
+        Timer_initialize(&timers[i], countingCallback);
+        TimerWheel_arm(&timerWheel, &timers[i], expirations[i], 0);
+    }
+    firedCount = 0;
+    size_t tickCount = 0;
+    
+    uint64_t begin = Benchmark_readTsc();
+    for (uint64_t now = 0; !TimerWheel_isEmpty(&timerWheel); now += EXPIRE_STEP) {
+        TimerWheel_expire(&timerWheel, NULL, now);
+        tickCount++;
+    }
+    uint64_t end = Benchmark_readTsc();
+    
+    assert(firedCount == TIMER_COUNT);
+    BENCHMARK_REPORT("expire (per 1 ms tick)", end - begin, tickCount);
+}
+
+void TimerWheelBenchmark_run() {
+    RUN_BENCHMARK(TimerWheelBenchmark_armAndCancel);
+    RUN_BENCHMARK(TimerWheelBenchmark_rearm);
+    RUN_BENCHMARK(TimerWheelBenchmark_expire);
+    RUN_BENCHMARK(TimerWheelBenchmark_expirePeriodically);
+}
@@ -0,0 +1,232 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "test.h"
+#include "kernel.h"
+
+/* One unit of the wheel resolution in nanoseconds. */
+#define UNIT (1ULL << TIMERWHEEL_RESOLUTION_SHIFT)
+
+static size_t firedCount;
+static Timer *lastFiredTimer;
+
+static void countingCallback(Cpu *cpu, Timer *timer) {
+    firedCount++;
+    lastFiredTimer = timer;
+}
+
+static void TimerWheelTest_initialize() {
+    static TimerWheel tw;
+    
+    TimerWheel_initialize(&tw, 1000 * UNIT + 5);
+    
+    ASSERT(tw.clock == 1000);
+    ASSERT(TimerWheel_isEmpty(&tw));
+    ASSERT(TimerWheel_getNextExpiration(&tw) == UINT64_MAX);
+}
+
+static void TimerWheelTest_armNear() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 1000 * UNIT);
+    Timer timer;
+    Timer_initialize(&timer, countingCallback);
+    
+    TimerWheel_arm(&tw, &timer, 1010 * UNIT + 1, 1000 * UNIT);
+    
+    ASSERT(Timer_isArmed(&timer));
+    ASSERT(tw.timerCount == 1);
+    ASSERT(timer.slot == (1011 & (TIMERWHEEL_SLOTS - 1)));
+    ASSERT(TimerWheel_getNextExpiration(&tw) == 1011 * UNIT);
+}
+
+static void TimerWheelTest_armFarRoundsUpToLevelGranularity() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 0);
+    Timer timer;
+    Timer_initialize(&timer, countingCallback);
+    
+    TimerWheel_arm(&tw, &timer, 100 * UNIT, 0);
+    
+    ASSERT(timer.slot == TIMERWHEEL_SLOTS + 13);
+    ASSERT(TimerWheel_getNextExpiration(&tw) == 104 * UNIT);
+}
+
+static void TimerWheelTest_cancel() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 0);
+    Timer timer;
+    Timer_initialize(&timer, countingCallback);
+    TimerWheel_arm(&tw, &timer, 10 * UNIT, 0);
+    
+    TimerWheel_cancel(&tw, &timer);
+    
+    ASSERT(!Timer_isArmed(&timer));
+    ASSERT(TimerWheel_isEmpty(&tw));
+    ASSERT(tw.occupancy[0] == 0);
+    ASSERT(TimerWheel_getNextExpiration(&tw) == UINT64_MAX);
+}
+
+static void TimerWheelTest_cancelKeepsOtherTimersOfSameSlot() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 0);
+    Timer timers[2];
+    Timer_initialize(&timers[0], countingCallback);
+    Timer_initialize(&timers[1], countingCallback);
+    TimerWheel_arm(&tw, &timers[0], 10 * UNIT, 0);
+    TimerWheel_arm(&tw, &timers[1], 10 * UNIT, 0);
+    
+    TimerWheel_cancel(&tw, &timers[0]);
+    
+    ASSERT(tw.timerCount == 1);
+    ASSERT(tw.occupancy[0] == 1ULL << 10);
+    ASSERT(TimerWheel_getNextExpiration(&tw) == 10 * UNIT);
+}
+
+static void TimerWheelTest_rearmMovesTimer() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 0);
+    Timer timer;
+    Timer_initialize(&timer, countingCallback);
+    TimerWheel_arm(&tw, &timer, 10 * UNIT, 0);
+    
+    TimerWheel_arm(&tw, &timer, 20 * UNIT, 0);
+    
+    ASSERT(tw.timerCount == 1);
+    ASSERT(tw.occupancy[0] == 1ULL << 20);
+}
+
+static void TimerWheelTest_expireFiresDueTimersInOneBatch() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 0);
+    Timer timers[4];
+    const uint64_t expirations[4] = { 3 * UNIT, 40 * UNIT, 100 * UNIT, 5000 * UNIT };
+    for (size_t i = 0; i < 4; i++) {
+        Timer_initialize(&timers[i], countingCallback);
+        TimerWheel_arm(&tw, &timers[i], expirations[i], 0);
+    }
+    firedCount = 0;
+    
+    size_t result = TimerWheel_expire(&tw, NULL, 200 * UNIT);
+    
+    ASSERT(result == 3);
+    ASSERT(firedCount == 3);
+    ASSERT(!Timer_isArmed(&timers[0]));
+    ASSERT(!Timer_isArmed(&timers[1]));
+    ASSERT(!Timer_isArmed(&timers[2]));
+    ASSERT(Timer_isArmed(&timers[3]));
+    ASSERT(tw.clock == 200);
+    ASSERT(TimerWheel_getNextExpiration(&tw) >= 5000 * UNIT);
+}
+
+static void TimerWheelTest_expireDoesNotFireEarly() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 0);
+    Timer timer;
+    Timer_initialize(&timer, countingCallback);
+    TimerWheel_arm(&tw, &timer, 100 * UNIT + 1, 0);
+    firedCount = 0;
+    
+    TimerWheel_expire(&tw, NULL, 100 * UNIT);
+    
+    ASSERT(firedCount == 0);
+    ASSERT(Timer_isArmed(&timer));
+}
+
+static void TimerWheelTest_expirePastTimerFiresImmediately() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 50 * UNIT);
+    Timer timer;
+    Timer_initialize(&timer, countingCallback);
+    TimerWheel_arm(&tw, &timer, 10 * UNIT, 50 * UNIT);
+    firedCount = 0;
+    lastFiredTimer = NULL;
+    
+    TimerWheel_expire(&tw, NULL, 50 * UNIT);
+    
+    ASSERT(firedCount == 1);
+    ASSERT(lastFiredTimer == &timer);
+}
+
+static void TimerWheelTest_expireRearmsTimersBeyondHighestLevel() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 0);
+    Timer timer;
+    Timer_initialize(&timer, countingCallback);
+    const uint64_t farAway = 1ULL << 50;
+    TimerWheel_arm(&tw, &timer, farAway, 0);
+    uint64_t firstExpiration = TimerWheel_getNextExpiration(&tw);
+    firedCount = 0;
+    
+    TimerWheel_expire(&tw, NULL, firstExpiration);
+    
+    ASSERT(firstExpiration < farAway);
+    ASSERT(firedCount == 0);
+    ASSERT(Timer_isArmed(&timer));
+    ASSERT(TimerWheel_getNextExpiration(&tw) > firstExpiration);
+}
+
+static void TimerWheelTest_expireAfterLongIdle() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 0);
+    Timer timer;
+    Timer_initialize(&timer, countingCallback);
+    TimerWheel_arm(&tw, &timer, 7 * UNIT, 0);
+    firedCount = 0;
+    
+    TimerWheel_expire(&tw, NULL, 1000000 * UNIT);
+    
+    ASSERT(firedCount == 1);
+    ASSERT(tw.clock == 1000000);
+    ASSERT(TimerWheel_isEmpty(&tw));
+}
+
+static void TimerWheelTest_armAfterLongIdle() {
+    static TimerWheel tw;
+    TimerWheel_initialize(&tw, 0);
+    Timer farTimer;
+    Timer_initialize(&farTimer, countingCallback);
+    TimerWheel_arm(&tw, &farTimer, 1500000 * UNIT, 0);
+    Timer timer;
+    Timer_initialize(&timer, countingCallback);
+    
+    TimerWheel_arm(&tw, &timer, 1000010 * UNIT, 1000000 * UNIT);
+    
+    ASSERT(tw.clock == 1000000);
+    ASSERT(timer.slot == (1000010 & (TIMERWHEEL_SLOTS - 1)));
+    ASSERT(TimerWheel_getNextExpiration(&tw) == 1000010 * UNIT);
+    firedCount = 0;
+    lastFiredTimer = NULL;
+    TimerWheel_expire(&tw, NULL, 1000010 * UNIT);
+    ASSERT(firedCount == 1);
+    ASSERT(lastFiredTimer == &timer);
+    ASSERT(Timer_isArmed(&farTimer));
+}
+
+void TimerWheelTest_run() {
+    RUN_TEST(TimerWheelTest_initialize);
+    RUN_TEST(TimerWheelTest_armNear);
+    RUN_TEST(TimerWheelTest_armFarRoundsUpToLevelGranularity);
+    RUN_TEST(TimerWheelTest_cancel);
+    RUN_TEST(TimerWheelTest_cancelKeepsOtherTimersOfSameSlot);
+    RUN_TEST(TimerWheelTest_rearmMovesTimer);
+    RUN_TEST(TimerWheelTest_expireFiresDueTimersInOneBatch);
+    RUN_TEST(TimerWheelTest_expireDoesNotFireEarly);
+    RUN_TEST(TimerWheelTest_expirePastTimerFiresImmediately);
+    RUN_TEST(TimerWheelTest_expireRearmsTimersBeyondHighestLevel);
+    RUN_TEST(TimerWheelTest_expireAfterLongIdle);
+    RUN_TEST(TimerWheelTest_armAfterLongIdle);
+}
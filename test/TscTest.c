@@ -0,0 +1,90 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "test.h"
+#include "kernel.h"
+
+static void TscTest_addSkewSample_keepsShortestRoundTrip() {
+    TscSkewEstimate e;
+    Tsc_initializeSkewEstimate(&e);
+
+    Tsc_addSkewSample(&e, 1000, 5600, 1200);
+    Tsc_addSkewSample(&e, 2000, 6050, 2100);
+    Tsc_addSkewSample(&e, 3000, 9999, 3500);
+
+    ASSERT(e.bestRoundTrip == 100);
+    ASSERT(e.offset == 4000);
+}
+
+static void TscTest_addSkewSample_referenceBehind() {
+    TscSkewEstimate e;
+    Tsc_initializeSkewEstimate(&e);
+
+    Tsc_addSkewSample(&e, 100000, 40050, 100100);
+
+    ASSERT(e.bestRoundTrip == 100);
+    ASSERT((int64_t) e.offset == -60000);
+}
+
+static void TscTest_applySkewEstimate_synchronized() {
+    TscSkewEstimate e = { .bestRoundTrip = 100, .offset = (uint64_t) -30 };
+    Tsc tsc = { .offset = 12345 };
+
+    bool synchronized = Tsc_applySkewEstimate(&tsc, &e);
+
+    ASSERT(synchronized == true);
+    ASSERT(tsc.offset == 0);
+}
+
+static void TscTest_applySkewEstimate_compensated() {
+    TscSkewEstimate e = { .bestRoundTrip = 100, .offset = (uint64_t) -60000 };
+    Tsc tsc = { .offset = 0 };
+
+    bool synchronized = Tsc_applySkewEstimate(&tsc, &e);
+
+    ASSERT(synchronized == false);
+    ASSERT((int64_t) tsc.offset == -60000);
+}
+
+static void TscTest_applySkewEstimate_noSamples() {
+    TscSkewEstimate e;
+    Tsc_initializeSkewEstimate(&e);
+    Tsc tsc = { .offset = 12345 };
+
+    bool synchronized = Tsc_applySkewEstimate(&tsc, &e);
+
+    ASSERT(synchronized == false);
+    ASSERT(tsc.offset == 0);
+}
+
+static void TscTest_readNanoseconds_withOffset() {
+    Tsc tsc = { .nsPerTick = 1 << 20, .offset = (uint64_t) -400 };
+    theFakeHardware = (FakeHardware) { .tscRegister = 1000 };
+
+    uint64_t ns = Tsc_readNanoseconds(&tsc);
+
+    ASSERT(ns == 600);
+}
+
+void TscTest_run() {
+    RUN_TEST(TscTest_addSkewSample_keepsShortestRoundTrip);
+    RUN_TEST(TscTest_addSkewSample_referenceBehind);
+    RUN_TEST(TscTest_applySkewEstimate_synchronized);
+    RUN_TEST(TscTest_applySkewEstimate_compensated);
+    RUN_TEST(TscTest_applySkewEstimate_noSamples);
+    RUN_TEST(TscTest_readNanoseconds_withOffset);
+}
@@ -0,0 +1,41 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "benchmark.h"
+#include "assert.h"
+
+/*
+ * Host benchmarks of kernel data structures, built with "make benchmark".
+ * Results are in TSC ticks of the host CPU, thus only comparable on the same machine.
+ */
+
+extern void PhysicalMemoryBenchmark_run();
+extern void SlabAllocatorBenchmark_run();
+extern void TaskBenchmark_run();
+extern void TimerWheelBenchmark_run();
+
+int Log_printf(const char *format, ...) { return 0; }
+int Video_printf(const char *format, ...) { return 0; }
+void panic(const char *format, ...) { assert(0); }
+
+int main() {
+    PhysicalMemoryBenchmark_run();
+    SlabAllocatorBenchmark_run();
+    TaskBenchmark_run();
+    TimerWheelBenchmark_run();
+    return 0;
+}
@@ -0,0 +1,39 @@
+/*
+FreeDOS-32 kernel
+Copyright (C) 2008-2020  Salvatore ISAJA
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License version 2
+as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+#include "stdint.h"
+
+/** Reads the actual Time Stamp Counter, as opposed to the fake hardware used by tests. */
+static inline uint64_t Benchmark_readTsc() {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t) high << 32) | low;
+}
+
+#define RUN_BENCHMARK(name) \
+    __builtin_printf("%%BENCHMARK_STARTED%% %s (%s)\n", #name, __FILE__); \
+    name(); \
+    __builtin_printf("%%BENCHMARK_FINISHED%% %s (%s)\n", #name, __FILE__);
+
+#define BENCHMARK_REPORT(operation, tscTicks, operationCount) \
+    __builtin_printf("    %-32s %8u operations, %6u TSC ticks per operation\n", \
+            operation, (unsigned) (operationCount), (unsigned) ((tscTicks) / (operationCount)));
+
+#endif
@@ -48,7 +48,7 @@ void Cpu_writeLocalApic(size_t offset, uint32_t value) {
         case lapicIdRegister: theFakeHardware.lapicIdRegister = value; break;
         case lapicEoi: theFakeHardware.lapicEoi = value; break;
         case lapicSpuriousInterrupt: theFakeHardware.lapicSpuriousInterrupt = value; break;
-        case lapicInterruptCommandLow: theFakeHardware.lapicInterruptCommandLow = value; break;
+        case lapicInterruptCommandLow: theFakeHardware.lapicInterruptCommandLow = value; theFakeHardware.ipiCount++; break;
         case lapicInterruptCommandHigh: theFakeHardware.lapicInterruptCommandHigh = value; break;
         case lapicTimerLvt: theFakeHardware.lapicTimerLvt = value; break;
         case lapicPerformanceCounterLvt: theFakeHardware.lapicPerformanceCounterLvt = value; break;
@@ -61,11 +61,34 @@ void Cpu_writeLocalApic(size_t offset, uint32_t value) {
     }
 }
 
+uint32_t Hpet_readRegister(size_t offset) {
+    switch (offset) {
+        case hpetCapabilities: return theFakeHardware.hpetCapabilities;
+        case hpetPeriod: return theFakeHardware.hpetPeriod;
+        case hpetConfiguration: return theFakeHardware.hpetConfiguration;
+        case hpetMainCounterLow: {
+            uint32_t value = (uint32_t) theFakeHardware.hpetMainCounter;
+            theFakeHardware.hpetMainCounter += theFakeHardware.hpetMainCounterIncrement;
+            return value;
+        }
+        case hpetMainCounterHigh: return (uint32_t) (theFakeHardware.hpetMainCounter >> 32);
+        default: assert(false); return 0xDEADBEEF;
+    }
+}
+
+void Hpet_writeRegister(size_t offset, uint32_t value) {
+    switch (offset) {
+        case hpetConfiguration: theFakeHardware.hpetConfiguration = value; break;
+        default: assert(false);
+    }
+}
+
 uint64_t Cpu_readMsr(uint32_t msr) {
     switch (msr) {
         case msrSysenterCs: return theFakeHardware.msrSysenterCs;
         case msrSysenterEsp: return theFakeHardware.msrSysenterEsp;
         case msrSysenterEip: return theFakeHardware.msrSysenterEip;
+        case msrTscDeadline: return theFakeHardware.msrTscDeadline;
         default: assert(false); return 0xDEADBEEF;
     }
 }
@@ -75,6 +98,7 @@ void Cpu_writeMsr(uint32_t msr, uint64_t value) {
         case msrSysenterCs: theFakeHardware.msrSysenterCs = value; break;
         case msrSysenterEsp: theFakeHardware.msrSysenterEsp = value; break;
         case msrSysenterEip: theFakeHardware.msrSysenterEip = value; break;
+        case msrTscDeadline: theFakeHardware.msrTscDeadline = value; break;
         default: assert(false);
     }
 }
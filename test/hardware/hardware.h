@@ -28,6 +28,7 @@ typedef struct FakeHardware {
     uint32_t lapicSpuriousInterrupt;
     uint32_t lapicInterruptCommandLow;
     uint32_t lapicInterruptCommandHigh;
+    int ipiCount; // writes to lapicInterruptCommandLow
     uint32_t lapicTimerLvt;
     uint32_t lapicPerformanceCounterLvt;
     uint32_t lapicLint0Lvt;
@@ -42,16 +43,26 @@ typedef struct FakeHardware {
     uint32_t gsRegister;
     uint32_t ldtRegister;
     uint64_t tscRegister;
+    uint64_t tscIncrement; // added to tscRegister after each read
     uint64_t msrSysenterCs;
     uint64_t msrSysenterEsp;
     uint64_t msrSysenterEip;
+    uint64_t msrTscDeadline;
+    uint32_t hpetCapabilities;
+    uint32_t hpetPeriod;
+    uint32_t hpetConfiguration;
+    uint64_t hpetMainCounter;
+    uint32_t hpetMainCounterIncrement; // added to hpetMainCounter after each read of its low word
     bool interruptsEnabled;
+    void (*relaxCallback)(); // called by Cpu_relax, to simulate other CPUs while spinning
 } FakeHardware;
 
 extern FakeHardware theFakeHardware;
 
 uint32_t Cpu_readLocalApic(size_t offset);
 void Cpu_writeLocalApic(size_t offset, uint32_t value);
+uint32_t Hpet_readRegister(size_t offset);
+void Hpet_writeRegister(size_t offset, uint32_t value);
 uint64_t Cpu_readMsr(uint32_t msr);
 void Cpu_writeMsr(uint32_t msr, uint64_t value);
 
@@ -61,6 +72,7 @@ static inline void *Cpu_getFaultingAddress() {
 
 static inline void Cpu_relax() {
     asm volatile("pause" : : : "memory");
+    if (theFakeHardware.relaxCallback != NULL) theFakeHardware.relaxCallback();
 }
 
 static inline uint32_t Cpu_readFs() {
@@ -99,6 +111,10 @@ static inline void Cpu_disableInterrupts() {
     theFakeHardware.interruptsEnabled = false;
 }
 
+static inline void Cpu_zeroNonTemporal(void *begin, size_t size) {
+    memzero(begin, size);
+}
+
 static inline void AddressSpace_activate(AddressSpace *as) {
     theFakeHardware.currentAddressSpace = as;
 }
@@ -112,7 +128,9 @@ static inline void AddressSpace_invalidateTlbAddress(VirtualAddress a) {
 }
 
 static inline uint64_t Tsc_read() {
-    return theFakeHardware.tscRegister;
+    uint64_t value = theFakeHardware.tscRegister;
+    theFakeHardware.tscRegister += theFakeHardware.tscIncrement;
+    return value;
 }
 
 static inline void Cpu_cpuid(uint32_t level, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
@@ -29,10 +29,18 @@ extern void Boot_PhysicalMemoryTest_run();
 extern void PhysicalMemoryTest_run();
 extern void Boot_MultibootTest_run();
 extern void SlabAllocatorTest_run();
+extern void KernelMemoryTest_run();
 extern void AddressSpaceTest_run();
+extern void ClockTest_run();
 extern void Boot_AcpiTest_run();
 extern void Boot_MultiProcessorSpecificationTest_run();
 extern void Boot_CpuTest_run();
+extern void Boot_HpetTest_run();
+extern void CapabilityTableTest_run();
+extern void SyscallTest_run();
+extern void TaskTest_run();
+extern void TimerWheelTest_run();
+extern void TscTest_run();
 
 int Log_printf(const char *format, ...) { return 0; }
 int Video_printf(const char *format, ...) { return 0; }
@@ -48,9 +56,17 @@ int main() {
     RUN_SUITE(PhysicalMemoryTest_run);
     RUN_SUITE(Boot_MultibootTest_run);
     RUN_SUITE(SlabAllocatorTest_run);
+    RUN_SUITE(KernelMemoryTest_run);
     RUN_SUITE(AddressSpaceTest_run);
+    RUN_SUITE(ClockTest_run);
     RUN_SUITE(Boot_AcpiTest_run);
     RUN_SUITE(Boot_MultiProcessorSpecificationTest_run);
     RUN_SUITE(Boot_CpuTest_run);
+    RUN_SUITE(Boot_HpetTest_run);
+    RUN_SUITE(CapabilityTableTest_run);
+    RUN_SUITE(SyscallTest_run);
+    RUN_SUITE(TaskTest_run);
+    RUN_SUITE(TimerWheelTest_run);
+    RUN_SUITE(TscTest_run);
     return exitCode;
 }